@@ -0,0 +1,294 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* libopenarc includes */
+#include "arc-internal.h"
+#include "arc-types.h"
+#include "arc-arena.h"
+
+/* macros */
+#define	ARC_ARENA_ALIGN		16
+#define	ARC_ARENA_ROUND(x)	(((x) + ARC_ARENA_ALIGN - 1) & \
+				 ~((size_t) ARC_ARENA_ALIGN - 1))
+#define	ARC_ARENA_HDRSIZE	ARC_ARENA_ROUND(sizeof(struct arc_arena_chunk))
+#define	ARC_ARENA_BIG		(ARC_ARENA_CHUNKSIZE / 4)
+
+/*
+**  ARC_ARENA_CHUNK -- one block of arena memory; the data follows the header
+*/
+
+struct arc_arena_chunk
+{
+	size_t			ac_size;
+	size_t			ac_used;
+	struct arc_arena_chunk * ac_next;
+};
+
+/*
+**  ARC_ARENA -- the arena itself
+**
+**  Small requests are carved sequentially out of the chunk at the head of
+**  aa_chunks; when it fills up a new one is pushed in front of it, taken
+**  from aa_spare if possible.  Large requests get a chunk of their own on
+**  aa_big so they don't waste the tail of the current chunk.  Nothing is
+**  released until the arena is reset (when the small chunks move to
+**  aa_spare for reuse) or destroyed.
+*/
+
+struct arc_arena
+{
+	struct arc_arena_chunk * aa_chunks;
+	struct arc_arena_chunk * aa_spare;
+	struct arc_arena_chunk * aa_big;
+};
+
+/*
+**  ARC_ARENA_NEW -- create an arena
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	A new, empty arena, or NULL on failure.
+*/
+
+ARC_ARENA *
+arc_arena_new(void)
+{
+	ARC_ARENA *aa;
+
+	aa = (ARC_ARENA *) malloc(sizeof *aa);
+	if (aa == NULL)
+		return NULL;
+
+	aa->aa_chunks = NULL;
+	aa->aa_spare = NULL;
+	aa->aa_big = NULL;
+
+	return aa;
+}
+
+/*
+**  ARC_ARENA_ALLOC -- allocate memory from an arena
+**
+**  Parameters:
+**  	aa -- arena
+**  	len -- bytes wanted
+**
+**  Return value:
+**  	Pointer to "len" bytes of uninitialized memory, suitably aligned for
+**  	any type, or NULL on failure.
+*/
+
+void *
+arc_arena_alloc(ARC_ARENA *aa, size_t len)
+{
+	u_char *p;
+	struct arc_arena_chunk *ac;
+
+	assert(aa != NULL);
+
+	if (len > (size_t) -1 - ARC_ARENA_HDRSIZE - ARC_ARENA_ALIGN)
+		return NULL;
+
+	len = ARC_ARENA_ROUND(MAX(len, 1));
+
+	if (len > ARC_ARENA_BIG)
+	{
+		ac = (struct arc_arena_chunk *) malloc(ARC_ARENA_HDRSIZE + len);
+		if (ac == NULL)
+			return NULL;
+
+		ac->ac_size = len;
+		ac->ac_used = len;
+		ac->ac_next = aa->aa_big;
+		aa->aa_big = ac;
+
+		return (u_char *) ac + ARC_ARENA_HDRSIZE;
+	}
+
+	ac = aa->aa_chunks;
+	if (ac == NULL || ac->ac_size - ac->ac_used < len)
+	{
+		if (aa->aa_spare != NULL)
+		{
+			ac = aa->aa_spare;
+			aa->aa_spare = ac->ac_next;
+		}
+		else
+		{
+			ac = (struct arc_arena_chunk *) malloc(ARC_ARENA_HDRSIZE +
+			                                       ARC_ARENA_CHUNKSIZE);
+			if (ac == NULL)
+				return NULL;
+
+			ac->ac_size = ARC_ARENA_CHUNKSIZE;
+		}
+
+		ac->ac_used = 0;
+		ac->ac_next = aa->aa_chunks;
+		aa->aa_chunks = ac;
+	}
+
+	p = (u_char *) ac + ARC_ARENA_HDRSIZE + ac->ac_used;
+	ac->ac_used += len;
+
+	return p;
+}
+
+/*
+**  ARC_ARENA_RESET -- release everything allocated from an arena, but keep
+**                     its memory for reuse
+**
+**  Parameters:
+**  	aa -- arena
+**
+**  Return value:
+**  	None.
+*/
+
+void
+arc_arena_reset(ARC_ARENA *aa)
+{
+	struct arc_arena_chunk *ac;
+	struct arc_arena_chunk *next;
+
+	assert(aa != NULL);
+
+	for (ac = aa->aa_chunks; ac != NULL; ac = next)
+	{
+		next = ac->ac_next;
+		ac->ac_next = aa->aa_spare;
+		aa->aa_spare = ac;
+	}
+	aa->aa_chunks = NULL;
+
+	for (ac = aa->aa_big; ac != NULL; ac = next)
+	{
+		next = ac->ac_next;
+		free(ac);
+	}
+	aa->aa_big = NULL;
+}
+
+/*
+**  ARC_ARENA_FREE -- destroy an arena and everything allocated from it
+**
+**  Parameters:
+**  	aa -- arena
+**
+**  Return value:
+**  	None.
+*/
+
+void
+arc_arena_free(ARC_ARENA *aa)
+{
+	struct arc_arena_chunk *ac;
+	struct arc_arena_chunk *next;
+
+	if (aa == NULL)
+		return;
+
+	arc_arena_reset(aa);
+
+	for (ac = aa->aa_spare; ac != NULL; ac = next)
+	{
+		next = ac->ac_next;
+		free(ac);
+	}
+
+	free(aa);
+}
+
+/*
+**  ARC_MALLOC -- allocate memory for use by a message
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	len -- bytes wanted
+**
+**  Return value:
+**  	Pointer to the memory, or NULL on failure.
+**
+**  Notes:
+**  	If the message has an arena, the memory comes from it and lives
+**  	until arc_free() or arc_message_reset(); otherwise this is just
+**  	malloc().
+*/
+
+void *
+arc_malloc(ARC_MESSAGE *msg, size_t len)
+{
+	assert(msg != NULL);
+
+	if (msg->arc_arena != NULL)
+		return arc_arena_alloc(msg->arc_arena, len);
+	else
+		return malloc(len);
+}
+
+/*
+**  ARC_MFREE -- release memory obtained from arc_malloc()
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	ptr -- memory to release (may be NULL)
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Arena memory is released all at once by arc_free() or
+**  	arc_message_reset(), so this does nothing for a message with
+**  	an arena.
+*/
+
+void
+arc_mfree(ARC_MESSAGE *msg, void *ptr)
+{
+	assert(msg != NULL);
+
+	if (ptr != NULL && msg->arc_arena == NULL)
+		free(ptr);
+}
+
+/*
+**  ARC_MSTRNDUP -- arc_strndup() using a message's allocator
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	src -- source string
+**  	len -- bytes to copy
+**
+**  Return value:
+**  	Pointer to the copy, which is released with arc_mfree().
+*/
+
+u_char *
+arc_mstrndup(ARC_MESSAGE *msg, u_char *src, size_t len)
+{
+	u_char *ret;
+
+	assert(msg != NULL);
+	assert(src != NULL);
+
+	ret = arc_malloc(msg, len + 1);
+	if (ret != NULL)
+	{
+		memset(ret, '\0', len + 1);
+		memcpy(ret, src, len);
+	}
+
+	return ret;
+}
@@ -0,0 +1,34 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#ifndef _ARC_ARENA_H_
+#define _ARC_ARENA_H_
+
+/* system includes */
+#include <sys/types.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+/* defaults */
+#define	ARC_ARENA_CHUNKSIZE	16384	/* bytes per arena chunk */
+
+/*
+**  ARC_ARENA -- per-message bump allocator
+*/
+
+struct arc_arena;
+typedef struct arc_arena ARC_ARENA;
+
+/* prototypes */
+extern ARC_ARENA *arc_arena_new __P((void));
+extern void *arc_arena_alloc __P((ARC_ARENA *, size_t));
+extern void arc_arena_free __P((ARC_ARENA *));
+extern void arc_arena_reset __P((ARC_ARENA *));
+
+extern void *arc_malloc __P((ARC_MESSAGE *, size_t));
+extern void arc_mfree __P((ARC_MESSAGE *, void *));
+extern u_char *arc_mstrndup __P((ARC_MESSAGE *, u_char *, size_t));
+
+#endif /* ! _ARC_ARENA_H_ */
@@ -0,0 +1,977 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* OpenSSL includes */
+#include <openssl/opensslv.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+/* libopenarc includes */
+#include "arc-internal.h"
+#include "arc-cache.h"
+
+/* macros */
+#define	ARC_KEYCACHE_BUCKETS	1021
+#define	ARC_SNAP_MAGIC		"ARCKEYS\001"	/* snapshot file magic */
+#define	ARC_SNAP_ORDER		0x01020304	/* byte order check */
+#define	ARC_SNAP_ALIGN(x)	(((x) + 7) & ~((size_t) 7))
+
+/*
+**  ARC_KEYCACHE_ENTRY -- one cached key record (or negative result)
+*/
+
+struct arc_keycache_entry
+{
+	ARC_STAT		ke_status;
+	u_int			ke_hash;
+	time_t			ke_expire;
+	size_t			ke_txtlen;
+	char *			ke_name;
+	u_char *		ke_txt;
+	EVP_PKEY *		ke_pkey;
+	struct arc_keycache_entry * ke_next;
+	struct arc_keycache_entry * ke_lruprev;
+	struct arc_keycache_entry * ke_lrunext;
+};
+
+/*
+**  ARC_SNAPHDR -- key cache snapshot file header
+**
+**  The file is a header followed by "sh_count" records, least recently
+**  used first, each an arc_snaprec followed by the NUL-terminated name
+**  and (for positive entries) TXT record, padded to eight bytes.  It is
+**  written in host byte order; a snapshot is only meant to survive a
+**  restart on the same machine.
+*/
+
+struct arc_snaphdr
+{
+	char			sh_magic[8];
+	uint32_t		sh_order;
+	uint32_t		sh_count;
+	int64_t			sh_saved;
+};
+
+struct arc_snaprec
+{
+	int64_t			sr_expire;
+	int32_t			sr_status;
+	uint32_t		sr_namelen;
+	uint32_t		sr_txtlen;
+	uint32_t		sr_pad;
+};
+
+/*
+**  ARC_KEYCACHE -- the cache itself
+*/
+
+struct arc_keycache
+{
+	u_int			kc_maxentries;
+	u_int			kc_entries;
+	uint64_t		kc_hits;
+	uint64_t		kc_misses;
+	pthread_mutex_t		kc_lock;
+	struct arc_keycache_entry * kc_lruhead;
+	struct arc_keycache_entry * kc_lrutail;
+	struct arc_keycache_entry * kc_buckets[ARC_KEYCACHE_BUCKETS];
+};
+
+/*
+**  ARC_KEYCACHE_HASH -- hash a key name, case-insensitively
+**
+**  Parameters:
+**  	name -- name to hash
+**
+**  Return value:
+**  	Hash of "name".
+*/
+
+static u_int
+arc_keycache_hash(const char *name)
+{
+	u_int h = 5381;
+	const u_char *p;
+
+	for (p = (const u_char *) name; *p != '\0'; p++)
+		h = ((h << 5) + h) + tolower(*p);
+
+	return h;
+}
+
+/*
+**  ARC_KEYCACHE_UNLINK -- remove an entry from both the bucket chain and
+**                         the LRU list, and destroy it
+**
+**  Parameters:
+**  	kc -- cache handle
+**  	ke -- entry to remove
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Caller must hold kc->kc_lock.
+*/
+
+static void
+arc_keycache_unlink(ARC_KEYCACHE *kc, struct arc_keycache_entry *ke)
+{
+	struct arc_keycache_entry **pp;
+
+	pp = &kc->kc_buckets[ke->ke_hash % ARC_KEYCACHE_BUCKETS];
+	while (*pp != NULL && *pp != ke)
+		pp = &(*pp)->ke_next;
+	if (*pp == ke)
+		*pp = ke->ke_next;
+
+	if (ke->ke_lruprev != NULL)
+		ke->ke_lruprev->ke_lrunext = ke->ke_lrunext;
+	else
+		kc->kc_lruhead = ke->ke_lrunext;
+	if (ke->ke_lrunext != NULL)
+		ke->ke_lrunext->ke_lruprev = ke->ke_lruprev;
+	else
+		kc->kc_lrutail = ke->ke_lruprev;
+
+	kc->kc_entries--;
+
+	free(ke->ke_name);
+	if (ke->ke_txt != NULL)
+		free(ke->ke_txt);
+	if (ke->ke_pkey != NULL)
+		EVP_PKEY_free(ke->ke_pkey);
+	free(ke);
+}
+
+/*
+**  ARC_KEYCACHE_TRIM -- evict least recently used entries until the cache
+**                       is within "max" entries
+**
+**  Parameters:
+**  	kc -- cache handle
+**  	max -- target entry count
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Caller must hold kc->kc_lock.
+*/
+
+static void
+arc_keycache_trim(ARC_KEYCACHE *kc, u_int max)
+{
+	while (kc->kc_entries > max && kc->kc_lrutail != NULL)
+		arc_keycache_unlink(kc, kc->kc_lrutail);
+}
+
+/*
+**  ARC_KEYCACHE_FIND -- locate an entry
+**
+**  Parameters:
+**  	kc -- cache handle
+**  	name -- key name
+**  	hash -- hash of "name"
+**
+**  Return value:
+**  	Pointer to the entry, or NULL if not present.
+**
+**  Notes:
+**  	Caller must hold kc->kc_lock.
+*/
+
+static struct arc_keycache_entry *
+arc_keycache_find(ARC_KEYCACHE *kc, const char *name, u_int hash)
+{
+	struct arc_keycache_entry *ke;
+
+	for (ke = kc->kc_buckets[hash % ARC_KEYCACHE_BUCKETS];
+	     ke != NULL;
+	     ke = ke->ke_next)
+	{
+		if (ke->ke_hash == hash && strcasecmp(ke->ke_name, name) == 0)
+			return ke;
+	}
+
+	return NULL;
+}
+
+/*
+**  ARC_KEYCACHE_NEW -- create a key cache
+**
+**  Parameters:
+**  	maxentries -- maximum number of records to hold (0 == disabled)
+**
+**  Return value:
+**  	A new cache handle, or NULL on failure.
+*/
+
+ARC_KEYCACHE *
+arc_keycache_new(u_int maxentries)
+{
+	ARC_KEYCACHE *kc;
+
+	kc = (ARC_KEYCACHE *) malloc(sizeof *kc);
+	if (kc == NULL)
+		return NULL;
+
+	memset(kc, '\0', sizeof *kc);
+
+	if (pthread_mutex_init(&kc->kc_lock, NULL) != 0)
+	{
+		free(kc);
+		return NULL;
+	}
+
+	kc->kc_maxentries = maxentries;
+
+	return kc;
+}
+
+/*
+**  ARC_KEYCACHE_FREE -- destroy a key cache
+**
+**  Parameters:
+**  	kc -- cache handle
+**
+**  Return value:
+**  	None.
+*/
+
+void
+arc_keycache_free(ARC_KEYCACHE *kc)
+{
+	if (kc == NULL)
+		return;
+
+	arc_keycache_trim(kc, 0);
+
+	(void) pthread_mutex_destroy(&kc->kc_lock);
+
+	free(kc);
+}
+
+/*
+**  ARC_KEYCACHE_SETSIZE -- change the maximum size of a key cache
+**
+**  Parameters:
+**  	kc -- cache handle
+**  	maxentries -- new maximum (0 == disabled; flushes the cache)
+**
+**  Return value:
+**  	None.
+*/
+
+void
+arc_keycache_setsize(ARC_KEYCACHE *kc, u_int maxentries)
+{
+	assert(kc != NULL);
+
+	pthread_mutex_lock(&kc->kc_lock);
+	kc->kc_maxentries = maxentries;
+	arc_keycache_trim(kc, maxentries);
+	pthread_mutex_unlock(&kc->kc_lock);
+}
+
+/*
+**  ARC_KEYCACHE_STATS -- retrieve key cache statistics
+**
+**  Parameters:
+**  	kc -- cache handle
+**  	hits -- lookups satisfied from the cache (returned; may be NULL)
+**  	misses -- lookups not satisfied from the cache (returned; may be NULL)
+**  	entries -- records currently cached (returned; may be NULL)
+**
+**  Return value:
+**  	None.
+*/
+
+void
+arc_keycache_stats(ARC_KEYCACHE *kc, uint64_t *hits, uint64_t *misses,
+                   u_int *entries)
+{
+	assert(kc != NULL);
+
+	pthread_mutex_lock(&kc->kc_lock);
+	if (hits != NULL)
+		*hits = kc->kc_hits;
+	if (misses != NULL)
+		*misses = kc->kc_misses;
+	if (entries != NULL)
+		*entries = kc->kc_entries;
+	pthread_mutex_unlock(&kc->kc_lock);
+}
+
+/*
+**  ARC_KEYCACHE_GET -- look up a key record in the cache
+**
+**  Parameters:
+**  	kc -- cache handle
+**  	name -- key name (selector._domainkey.domain)
+**  	buf -- buffer to receive the TXT record
+**  	buflen -- bytes available at "buf"
+**  	status -- cached status (returned)
+**
+**  Return value:
+**  	TRUE iff a live entry was found.  In that case "status" is
+**  	ARC_STAT_OK and "buf" contains the record, or "status" is the
+**  	cached failure (e.g. ARC_STAT_NOKEY) and "buf" is untouched.
+*/
+
+_Bool
+arc_keycache_get(ARC_KEYCACHE *kc, const char *name, u_char *buf,
+                 size_t buflen, ARC_STAT *status)
+{
+	u_int hash;
+	time_t now;
+	struct arc_keycache_entry *ke;
+
+	assert(kc != NULL);
+	assert(name != NULL);
+	assert(buf != NULL);
+	assert(status != NULL);
+
+	hash = arc_keycache_hash(name);
+	(void) time(&now);
+
+	pthread_mutex_lock(&kc->kc_lock);
+
+	if (kc->kc_maxentries == 0)
+	{
+		pthread_mutex_unlock(&kc->kc_lock);
+		return FALSE;
+	}
+
+	ke = arc_keycache_find(kc, name, hash);
+	if (ke != NULL && ke->ke_expire <= now)
+	{
+		arc_keycache_unlink(kc, ke);
+		ke = NULL;
+	}
+
+	if (ke == NULL)
+	{
+		kc->kc_misses++;
+		pthread_mutex_unlock(&kc->kc_lock);
+		return FALSE;
+	}
+
+	kc->kc_hits++;
+
+	/* move to the front of the LRU list */
+	if (ke->ke_lruprev != NULL)
+	{
+		ke->ke_lruprev->ke_lrunext = ke->ke_lrunext;
+		if (ke->ke_lrunext != NULL)
+			ke->ke_lrunext->ke_lruprev = ke->ke_lruprev;
+		else
+			kc->kc_lrutail = ke->ke_lruprev;
+
+		ke->ke_lruprev = NULL;
+		ke->ke_lrunext = kc->kc_lruhead;
+		kc->kc_lruhead->ke_lruprev = ke;
+		kc->kc_lruhead = ke;
+	}
+
+	*status = ke->ke_status;
+	if (ke->ke_status == ARC_STAT_OK)
+	{
+		memset(buf, '\0', buflen);
+		memcpy(buf, ke->ke_txt, MIN(ke->ke_txtlen, buflen - 1));
+	}
+
+	pthread_mutex_unlock(&kc->kc_lock);
+
+	return TRUE;
+}
+
+/*
+**  ARC_KEYCACHE_PUT -- add or replace a key record in the cache
+**
+**  Parameters:
+**  	kc -- cache handle
+**  	name -- key name (selector._domainkey.domain)
+**  	status -- ARC_STAT_OK for a record, or a failure to cache negatively
+**  	txt -- TXT record (ignored unless status is ARC_STAT_OK)
+**  	ttl -- lifetime in seconds; 0 means "don't cache"
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Failure to allocate memory simply means the record isn't cached.
+*/
+
+void
+arc_keycache_put(ARC_KEYCACHE *kc, const char *name, ARC_STAT status,
+                 u_char *txt, u_int ttl)
+{
+	u_int hash;
+	time_t now;
+	struct arc_keycache_entry *ke;
+	struct arc_keycache_entry *old;
+
+	assert(kc != NULL);
+	assert(name != NULL);
+	assert(status != ARC_STAT_OK || txt != NULL);
+
+	if (ttl == 0)
+		return;
+	if (ttl > ARC_KEYCACHE_MAXTTL)
+		ttl = ARC_KEYCACHE_MAXTTL;
+
+	ke = (struct arc_keycache_entry *) malloc(sizeof *ke);
+	if (ke == NULL)
+		return;
+	memset(ke, '\0', sizeof *ke);
+
+	ke->ke_name = strdup(name);
+	if (ke->ke_name == NULL)
+	{
+		free(ke);
+		return;
+	}
+
+	if (status == ARC_STAT_OK)
+	{
+		ke->ke_txtlen = strlen((char *) txt);
+		ke->ke_txt = (u_char *) strdup((char *) txt);
+		if (ke->ke_txt == NULL)
+		{
+			free(ke->ke_name);
+			free(ke);
+			return;
+		}
+	}
+
+	hash = arc_keycache_hash(name);
+	(void) time(&now);
+
+	ke->ke_status = status;
+	ke->ke_hash = hash;
+	ke->ke_expire = now + ttl;
+
+	pthread_mutex_lock(&kc->kc_lock);
+
+	if (kc->kc_maxentries == 0)
+	{
+		pthread_mutex_unlock(&kc->kc_lock);
+		free(ke->ke_name);
+		if (ke->ke_txt != NULL)
+			free(ke->ke_txt);
+		free(ke);
+		return;
+	}
+
+	/* replace any existing record */
+	old = arc_keycache_find(kc, name, hash);
+	if (old != NULL)
+		arc_keycache_unlink(kc, old);
+
+	/* make room */
+	arc_keycache_trim(kc, kc->kc_maxentries - 1);
+
+	ke->ke_next = kc->kc_buckets[hash % ARC_KEYCACHE_BUCKETS];
+	kc->kc_buckets[hash % ARC_KEYCACHE_BUCKETS] = ke;
+
+	ke->ke_lrunext = kc->kc_lruhead;
+	if (kc->kc_lruhead != NULL)
+		kc->kc_lruhead->ke_lruprev = ke;
+	kc->kc_lruhead = ke;
+	if (kc->kc_lrutail == NULL)
+		kc->kc_lrutail = ke;
+
+	kc->kc_entries++;
+
+	pthread_mutex_unlock(&kc->kc_lock);
+}
+
+/*
+**  ARC_KEYCACHE_PEEK -- see whether a live record is cached
+**
+**  Parameters:
+**  	kc -- cache handle
+**  	name -- key name (selector._domainkey.domain)
+**
+**  Return value:
+**  	TRUE iff an unexpired record (positive or negative) is present.
+**
+**  Notes:
+**  	Unlike arc_keycache_get(), this doesn't update the LRU list or
+**  	the hit/miss counters.
+*/
+
+_Bool
+arc_keycache_peek(ARC_KEYCACHE *kc, const char *name)
+{
+	_Bool ret = FALSE;
+	u_int hash;
+	time_t now;
+	struct arc_keycache_entry *ke;
+
+	assert(kc != NULL);
+	assert(name != NULL);
+
+	hash = arc_keycache_hash(name);
+	(void) time(&now);
+
+	pthread_mutex_lock(&kc->kc_lock);
+
+	ke = arc_keycache_find(kc, name, hash);
+	if (ke != NULL && ke->ke_expire > now)
+		ret = TRUE;
+
+	pthread_mutex_unlock(&kc->kc_lock);
+
+	return ret;
+}
+
+/*
+**  ARC_KEYCACHE_GETPKEY -- retrieve the decoded public key attached to
+**                          a cached record
+**
+**  Parameters:
+**  	kc -- cache handle
+**  	name -- key name (selector._domainkey.domain)
+**
+**  Return value:
+**  	The key, with a reference taken on behalf of the caller (who must
+**  	release it with EVP_PKEY_free()), or NULL if there is no live
+**  	record or no key has been attached to it yet.
+*/
+
+EVP_PKEY *
+arc_keycache_getpkey(ARC_KEYCACHE *kc, const char *name)
+{
+	u_int hash;
+	time_t now;
+	EVP_PKEY *pkey = NULL;
+	struct arc_keycache_entry *ke;
+
+	assert(kc != NULL);
+	assert(name != NULL);
+
+	hash = arc_keycache_hash(name);
+	(void) time(&now);
+
+	pthread_mutex_lock(&kc->kc_lock);
+
+	ke = arc_keycache_find(kc, name, hash);
+	if (ke != NULL && ke->ke_expire > now && ke->ke_pkey != NULL)
+	{
+		pkey = ke->ke_pkey;
+		EVP_PKEY_up_ref(pkey);
+	}
+
+	pthread_mutex_unlock(&kc->kc_lock);
+
+	return pkey;
+}
+
+/*
+**  ARC_KEYCACHE_SETPKEY -- attach a decoded public key to a cached record
+**
+**  Parameters:
+**  	kc -- cache handle
+**  	name -- key name (selector._domainkey.domain)
+**  	pkey -- decoded key
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	The cache takes its own reference to "pkey"; the caller's reference
+**  	is unaffected.  Nothing happens if the record isn't cached (any
+**  	more) or already has a key attached.
+*/
+
+void
+arc_keycache_setpkey(ARC_KEYCACHE *kc, const char *name, EVP_PKEY *pkey)
+{
+	u_int hash;
+	struct arc_keycache_entry *ke;
+
+	assert(kc != NULL);
+	assert(name != NULL);
+	assert(pkey != NULL);
+
+	hash = arc_keycache_hash(name);
+
+	pthread_mutex_lock(&kc->kc_lock);
+
+	ke = arc_keycache_find(kc, name, hash);
+	if (ke != NULL && ke->ke_status == ARC_STAT_OK && ke->ke_pkey == NULL)
+	{
+		EVP_PKEY_up_ref(pkey);
+		ke->ke_pkey = pkey;
+	}
+
+	pthread_mutex_unlock(&kc->kc_lock);
+}
+
+/*
+**  ARC_KEYCACHE_SAVE -- write a snapshot of the live cache entries
+**
+**  Parameters:
+**  	kc -- cache handle
+**  	path -- file to write
+**
+**  Return value:
+**  	ARC_STAT_OK on success, or ARC_STAT_NORESOURCE with errno set if
+**  	the snapshot couldn't be written.
+**
+**  Notes:
+**  	The records are copied out under the cache lock and written to a
+**  	temporary file beside "path", which is then renamed over it, so
+**  	readers never see a partial snapshot.  Decoded keys aren't saved;
+**  	they're rebuilt from the TXT records on first use.
+*/
+
+ARC_STAT
+arc_keycache_save(ARC_KEYCACHE *kc, const char *path)
+{
+	int fd;
+	int saveerrno;
+	size_t len;
+	size_t off;
+	size_t plen;
+	ssize_t wlen;
+	time_t now;
+	u_char *buf;
+	char *tmppath;
+	struct arc_keycache_entry *ke;
+	struct arc_snaphdr sh;
+	struct arc_snaprec sr;
+
+	assert(kc != NULL);
+	assert(path != NULL);
+
+	(void) time(&now);
+
+	memset(&sh, '\0', sizeof sh);
+	memcpy(sh.sh_magic, ARC_SNAP_MAGIC, sizeof sh.sh_magic);
+	sh.sh_order = ARC_SNAP_ORDER;
+	sh.sh_saved = (int64_t) now;
+
+	pthread_mutex_lock(&kc->kc_lock);
+
+	len = sizeof sh;
+	for (ke = kc->kc_lrutail; ke != NULL; ke = ke->ke_lruprev)
+	{
+		if (ke->ke_expire <= now)
+			continue;
+
+		len += sizeof sr + ARC_SNAP_ALIGN(strlen(ke->ke_name) + 1);
+		if (ke->ke_status == ARC_STAT_OK)
+			len += ARC_SNAP_ALIGN(ke->ke_txtlen + 1);
+	}
+
+	buf = (u_char *) malloc(len);
+	if (buf == NULL)
+	{
+		pthread_mutex_unlock(&kc->kc_lock);
+		return ARC_STAT_NORESOURCE;
+	}
+
+	memset(buf, '\0', len);
+
+	off = sizeof sh;
+	for (ke = kc->kc_lrutail; ke != NULL; ke = ke->ke_lruprev)
+	{
+		if (ke->ke_expire <= now)
+			continue;
+
+		memset(&sr, '\0', sizeof sr);
+		sr.sr_expire = (int64_t) ke->ke_expire;
+		sr.sr_status = ke->ke_status;
+		sr.sr_namelen = strlen(ke->ke_name);
+		if (ke->ke_status == ARC_STAT_OK)
+			sr.sr_txtlen = ke->ke_txtlen;
+
+		memcpy(buf + off, &sr, sizeof sr);
+		off += sizeof sr;
+		memcpy(buf + off, ke->ke_name, sr.sr_namelen);
+		off += ARC_SNAP_ALIGN(sr.sr_namelen + 1);
+		if (ke->ke_status == ARC_STAT_OK)
+		{
+			memcpy(buf + off, ke->ke_txt, sr.sr_txtlen);
+			off += ARC_SNAP_ALIGN(sr.sr_txtlen + 1);
+		}
+
+		sh.sh_count++;
+	}
+
+	pthread_mutex_unlock(&kc->kc_lock);
+
+	assert(off == len);
+	memcpy(buf, &sh, sizeof sh);
+
+	plen = strlen(path) + 8;
+	tmppath = (char *) malloc(plen);
+	if (tmppath == NULL)
+	{
+		free(buf);
+		return ARC_STAT_NORESOURCE;
+	}
+	snprintf(tmppath, plen, "%s.XXXXXX", path);
+
+	fd = mkstemp(tmppath);
+	if (fd < 0)
+	{
+		saveerrno = errno;
+		free(tmppath);
+		free(buf);
+		errno = saveerrno;
+		return ARC_STAT_NORESOURCE;
+	}
+
+	for (off = 0; off < len; off += wlen)
+	{
+		wlen = write(fd, buf + off, len - off);
+		if (wlen < 0 && errno == EINTR)
+		{
+			wlen = 0;
+		}
+		else if (wlen <= 0)
+		{
+			if (wlen == 0)
+				errno = EIO;
+			break;
+		}
+	}
+
+	saveerrno = errno;
+	free(buf);
+
+	if (off < len || close(fd) != 0 || rename(tmppath, path) != 0)
+	{
+		if (off < len)
+			(void) close(fd);
+		else
+			saveerrno = errno;
+		(void) unlink(tmppath);
+		free(tmppath);
+		errno = saveerrno;
+		return ARC_STAT_NORESOURCE;
+	}
+
+	free(tmppath);
+
+	return ARC_STAT_OK;
+}
+
+/*
+**  ARC_KEYCACHE_LOAD -- add the unexpired entries of a snapshot to a cache
+**
+**  Parameters:
+**  	kc -- cache handle
+**  	path -- file to read
+**  	nloaded -- number of entries restored (returned; may be NULL)
+**
+**  Return value:
+**  	ARC_STAT_OK on success, ARC_STAT_NORESOURCE with errno set if the
+**  	file couldn't be read, or ARC_STAT_SYNTAX if it isn't a snapshot
+**  	written by this host.
+**
+**  Notes:
+**  	Each entry keeps the expiry it had when saved, so only what's
+**  	left of its TTL is honoured.  Entries already in the cache are
+**  	replaced.  A truncated or damaged file restores the entries
+**  	before the damage and reports ARC_STAT_SYNTAX.
+*/
+
+ARC_STAT
+arc_keycache_load(ARC_KEYCACHE *kc, const char *path, u_int *nloaded)
+{
+	int fd;
+	int saveerrno;
+	u_int n;
+	u_int count = 0;
+	size_t off;
+	size_t len;
+	size_t need;
+	time_t now;
+	ARC_STAT status = ARC_STAT_OK;
+	u_char *map;
+	u_char *name;
+	u_char *txt;
+	struct stat st;
+	struct arc_snaphdr sh;
+	struct arc_snaprec sr;
+
+	assert(kc != NULL);
+	assert(path != NULL);
+
+	if (nloaded != NULL)
+		*nloaded = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return ARC_STAT_NORESOURCE;
+
+	if (fstat(fd, &st) != 0)
+	{
+		saveerrno = errno;
+		(void) close(fd);
+		errno = saveerrno;
+		return ARC_STAT_NORESOURCE;
+	}
+
+	len = (size_t) st.st_size;
+	if (len < sizeof sh)
+	{
+		(void) close(fd);
+		return ARC_STAT_SYNTAX;
+	}
+
+	map = (u_char *) mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	saveerrno = errno;
+	(void) close(fd);
+	if (map == (u_char *) MAP_FAILED)
+	{
+		errno = saveerrno;
+		return ARC_STAT_NORESOURCE;
+	}
+
+	memcpy(&sh, map, sizeof sh);
+	if (memcmp(sh.sh_magic, ARC_SNAP_MAGIC, sizeof sh.sh_magic) != 0 ||
+	    sh.sh_order != ARC_SNAP_ORDER)
+	{
+		(void) munmap(map, len);
+		return ARC_STAT_SYNTAX;
+	}
+
+	(void) time(&now);
+
+	off = sizeof sh;
+	for (n = 0; n < sh.sh_count; n++)
+	{
+		if (len - off < sizeof sr)
+		{
+			status = ARC_STAT_SYNTAX;
+			break;
+		}
+
+		memcpy(&sr, map + off, sizeof sr);
+		off += sizeof sr;
+
+		/* only records and missing keys are ever cached */
+		if (sr.sr_status != ARC_STAT_OK &&
+		    sr.sr_status != ARC_STAT_NOKEY)
+		{
+			status = ARC_STAT_SYNTAX;
+			break;
+		}
+
+		need = ARC_SNAP_ALIGN((size_t) sr.sr_namelen + 1);
+		if (sr.sr_status == ARC_STAT_OK)
+			need += ARC_SNAP_ALIGN((size_t) sr.sr_txtlen + 1);
+		if (sr.sr_namelen == 0 || len - off < need)
+		{
+			status = ARC_STAT_SYNTAX;
+			break;
+		}
+
+		name = map + off;
+		txt = name + ARC_SNAP_ALIGN((size_t) sr.sr_namelen + 1);
+		off += need;
+
+		if (name[sr.sr_namelen] != '\0' ||
+		    strlen((char *) name) != sr.sr_namelen ||
+		    (sr.sr_status == ARC_STAT_OK &&
+		     (txt[sr.sr_txtlen] != '\0' ||
+		      strlen((char *) txt) != sr.sr_txtlen)))
+		{
+			status = ARC_STAT_SYNTAX;
+			break;
+		}
+
+		if (sr.sr_expire <= (int64_t) now)
+			continue;
+
+		arc_keycache_put(kc, (char *) name, sr.sr_status,
+		                 sr.sr_status == ARC_STAT_OK ? txt : NULL,
+		                 (u_int) MIN(sr.sr_expire - (int64_t) now,
+		                             ARC_KEYCACHE_MAXTTL));
+		count++;
+	}
+
+	(void) munmap(map, len);
+
+	if (nloaded != NULL)
+		*nloaded = count;
+
+	return status;
+}
+
+/*
+**  ARC_KEYCACHE_CLONE -- copy the live records of one key cache into another
+**
+**  Parameters:
+**  	dst -- cache to fill
+**  	src -- cache to copy from
+**  	ncopied -- number of records copied (returned; may be NULL)
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Records are copied least recently used first, so "dst" ends up in
+**  	the same order, and keep their expiry time.  Decoded keys are
+**  	shared rather than copied.
+*/
+
+void
+arc_keycache_clone(ARC_KEYCACHE *dst, ARC_KEYCACHE *src, u_int *ncopied)
+{
+	u_int count = 0;
+	time_t now;
+	struct arc_keycache_entry *ke;
+
+	assert(dst != NULL);
+	assert(src != NULL);
+	assert(dst != src);
+
+	(void) time(&now);
+
+	pthread_mutex_lock(&src->kc_lock);
+
+	for (ke = src->kc_lrutail; ke != NULL; ke = ke->ke_lruprev)
+	{
+		if (ke->ke_expire <= now)
+			continue;
+
+		arc_keycache_put(dst, ke->ke_name, ke->ke_status,
+		                 ke->ke_status == ARC_STAT_OK ? ke->ke_txt : NULL,
+		                 (u_int) MIN(ke->ke_expire - now,
+		                             ARC_KEYCACHE_MAXTTL));
+		if (ke->ke_pkey != NULL)
+			arc_keycache_setpkey(dst, ke->ke_name, ke->ke_pkey);
+		count++;
+	}
+
+	pthread_mutex_unlock(&src->kc_lock);
+
+	if (ncopied != NULL)
+		*ncopied = count;
+}
@@ -0,0 +1,52 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#ifndef _ARC_CACHE_H_
+#define _ARC_CACHE_H_
+
+/* system includes */
+#include <sys/types.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#endif /* HAVE_STDBOOL_H */
+
+/* OpenSSL includes */
+#include <openssl/evp.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+/* defaults */
+#define	DEFKEYCACHESIZE		1024	/* default max. cached keys */
+#define	DEFKEYCACHENEGTTL	300	/* default negative cache TTL */
+#define	ARC_KEYCACHE_MAXTTL	86400	/* cap on any cached record */
+
+/*
+**  ARC_KEYCACHE -- public key record cache
+*/
+
+struct arc_keycache;
+typedef struct arc_keycache ARC_KEYCACHE;
+
+/* prototypes */
+extern ARC_KEYCACHE *arc_keycache_new __P((u_int));
+extern void arc_keycache_free __P((ARC_KEYCACHE *));
+extern _Bool arc_keycache_get __P((ARC_KEYCACHE *, const char *,
+                                   u_char *, size_t, ARC_STAT *));
+extern _Bool arc_keycache_peek __P((ARC_KEYCACHE *, const char *));
+extern EVP_PKEY *arc_keycache_getpkey __P((ARC_KEYCACHE *, const char *));
+extern void arc_keycache_put __P((ARC_KEYCACHE *, const char *, ARC_STAT,
+                                  u_char *, u_int));
+extern void arc_keycache_setpkey __P((ARC_KEYCACHE *, const char *,
+                                     EVP_PKEY *));
+extern void arc_keycache_setsize __P((ARC_KEYCACHE *, u_int));
+extern ARC_STAT arc_keycache_save __P((ARC_KEYCACHE *, const char *));
+extern ARC_STAT arc_keycache_load __P((ARC_KEYCACHE *, const char *,
+                                       u_int *));
+extern void arc_keycache_clone __P((ARC_KEYCACHE *, ARC_KEYCACHE *,
+                                    u_int *));
+extern void arc_keycache_stats __P((ARC_KEYCACHE *, uint64_t *, uint64_t *,
+                                    u_int *));
+
+#endif /* ! _ARC_CACHE_H_ */
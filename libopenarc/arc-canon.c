@@ -29,6 +29,8 @@
 #include "arc-internal.h"
 #include "arc-types.h"
 #include "arc-canon.h"
+#include "arc-crypto.h"
+#include "arc-scan.h"
 #include "arc-util.h"
 
 /* libbsd if found */
@@ -81,6 +83,8 @@ arc_canon_free(ARC_MESSAGE *msg, ARC_CANON *canon)
 
 			sha1 = (struct arc_sha1 *) canon->canon_hash;
 
+			arc_mdctx_put(sha1->sha1_ctx);
+
 			if (sha1->sha1_tmpbio != NULL)
 			{
 				BIO_free(sha1->sha1_tmpbio);
@@ -98,6 +102,8 @@ arc_canon_free(ARC_MESSAGE *msg, ARC_CANON *canon)
 
 			sha256 = (struct arc_sha256 *) canon->canon_hash;
 
+			arc_mdctx_put(sha256->sha256_ctx);
+
 			if (sha256->sha256_tmpbio != NULL)
 			{
 				BIO_free(sha256->sha256_tmpbio);
@@ -114,20 +120,20 @@ arc_canon_free(ARC_MESSAGE *msg, ARC_CANON *canon)
 			/* NOTREACHED */
 		}
 
-		free(canon->canon_hash);
+		arc_mfree(msg, canon->canon_hash);
 	}
 
 	if (canon->canon_hashbuf != NULL)
-		free(canon->canon_hashbuf);
+		arc_mfree(msg, canon->canon_hashbuf);
 
 	if (canon->canon_buf != NULL)
 		arc_dstring_free(canon->canon_buf);
 
-	free(canon);
+	arc_mfree(msg, canon);
 }
 
 /*
-**  ARC_CANON_WRITE -- write data to canonicalization stream(s)
+**  ARC_CANON_HASH -- write data to one canonicalization's hash
 **
 **  Parameters:
 **  	canon -- ARC_CANON handle
@@ -139,7 +145,7 @@ arc_canon_free(ARC_MESSAGE *msg, ARC_CANON *canon)
 */
 
 static void
-arc_canon_write(ARC_CANON *canon, u_char *buf, size_t buflen)
+arc_canon_hash(ARC_CANON *canon, u_char *buf, size_t buflen)
 {
 	assert(canon != NULL);
 
@@ -160,7 +166,7 @@ arc_canon_write(ARC_CANON *canon, u_char *buf, size_t buflen)
 		struct arc_sha1 *sha1;
 
 		sha1 = (struct arc_sha1 *) canon->canon_hash;
-		SHA1_Update(&sha1->sha1_ctx, buf, buflen);
+		(void) EVP_DigestUpdate(sha1->sha1_ctx, buf, buflen);
 
 		if (sha1->sha1_tmpbio != NULL)
 			BIO_write(sha1->sha1_tmpbio, buf, buflen);
@@ -174,7 +180,7 @@ arc_canon_write(ARC_CANON *canon, u_char *buf, size_t buflen)
 		struct arc_sha256 *sha256;
 
 		sha256 = (struct arc_sha256 *) canon->canon_hash;
-		SHA256_Update(&sha256->sha256_ctx, buf, buflen);
+		(void) EVP_DigestUpdate(sha256->sha256_ctx, buf, buflen);
 
 		if (sha256->sha256_tmpbio != NULL)
 			BIO_write(sha256->sha256_tmpbio, buf, buflen);
@@ -189,7 +195,7 @@ arc_canon_write(ARC_CANON *canon, u_char *buf, size_t buflen)
 }
 
 /*
-**  ARC_CANON_BUFFER -- buffer for arc_canon_write()
+**  ARC_CANON_WRITE -- write data to canonicalization stream(s)
 **
 **  Parameters:
 **  	canon -- ARC_CANON handle
@@ -198,10 +204,35 @@ arc_canon_write(ARC_CANON *canon, u_char *buf, size_t buflen)
 **
 **  Return value:
 **  	None.
+**
+**  Notes:
+**  	The data also goes to every body canonicalization chained off
+**  	"canon" via canon_nextsink; see arc_canon_init().
 */
 
 static void
-arc_canon_buffer(ARC_CANON *canon, u_char *buf, size_t buflen)
+arc_canon_write(ARC_CANON *canon, u_char *buf, size_t buflen)
+{
+	assert(canon != NULL);
+
+	for (; canon != NULL; canon = canon->canon_nextsink)
+		arc_canon_hash(canon, buf, buflen);
+}
+
+/*
+**  ARC_CANON_COPY -- copy into the buffer for arc_canon_write()
+**
+**  Parameters:
+**  	canon -- ARC_CANON handle
+**  	buf -- buffer containing canonicalized data
+**  	buflen -- number of bytes to consume
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_canon_copy(ARC_CANON *canon, u_char *buf, size_t buflen)
 {
 	assert(canon != NULL);
 
@@ -242,6 +273,198 @@ arc_canon_buffer(ARC_CANON *canon, u_char *buf, size_t buflen)
 	}
 }
 
+/*
+**  ARC_CANON_FLUSHSPAN -- hand a pending span to arc_canon_write()
+**
+**  Parameters:
+**  	canon -- ARC_CANON handle
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Short spans are copied into the hash buffer instead, since one
+**  	hash update per few bytes costs more than the copy.
+*/
+
+static void
+arc_canon_flushspan(ARC_CANON *canon)
+{
+	size_t len;
+	u_char *span;
+
+	assert(canon != NULL);
+
+	if (canon->canon_spanlen == 0)
+		return;
+
+	span = canon->canon_span;
+	len = canon->canon_spanlen;
+	canon->canon_span = NULL;
+	canon->canon_spanlen = 0;
+
+	if (len < ARC_MINSPAN)
+	{
+		arc_canon_copy(canon, span, len);
+	}
+	else
+	{
+		arc_canon_copy(canon, NULL, 0);
+		arc_canon_write(canon, span, len);
+	}
+}
+
+/*
+**  ARC_CANON_BUFFER -- buffer for arc_canon_write()
+**
+**  Parameters:
+**  	canon -- ARC_CANON handle
+**  	buf -- buffer containing canonicalized data
+**  	buflen -- number of bytes to consume
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	The data is copied, so "buf" may be reused as soon as this
+**  	returns.  A NULL "buf" or zero "buflen" flushes everything pending.
+*/
+
+static void
+arc_canon_buffer(ARC_CANON *canon, u_char *buf, size_t buflen)
+{
+	assert(canon != NULL);
+
+	arc_canon_flushspan(canon);
+	arc_canon_copy(canon, buf, buflen);
+}
+
+/*
+**  ARC_CANON_SPAN -- queue canonicalized data without copying it
+**
+**  Parameters:
+**  	canon -- ARC_CANON handle
+**  	buf -- canonicalized data, in the caller's body chunk
+**  	buflen -- number of bytes to consume
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Adjacent spans are merged, so a run of input that canonicalization
+**  	leaves alone reaches the hash in one piece.  "buf" must stay valid
+**  	until the next flush, which arc_canon_bodychunk() does before
+**  	returning.
+*/
+
+static void
+arc_canon_span(ARC_CANON *canon, u_char *buf, size_t buflen)
+{
+	assert(canon != NULL);
+
+	if (buflen == 0)
+		return;
+
+	if (canon->canon_spanlen > 0 &&
+	    canon->canon_span + canon->canon_spanlen == buf)
+	{
+		canon->canon_spanlen += buflen;
+		return;
+	}
+
+	arc_canon_flushspan(canon);
+
+	canon->canon_span = buf;
+	canon->canon_spanlen = buflen;
+}
+
+/*
+**  ARC_CANON_WORDSAVE -- copy the in-chunk part of the current relaxed
+**                        body word into canon_buf
+**
+**  Parameters:
+**  	canon -- ARC_CANON handle
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_canon_wordsave(ARC_CANON *canon)
+{
+	assert(canon != NULL);
+
+	if (canon->canon_wordlen == 0)
+		return;
+
+	arc_dstring_catn(canon->canon_buf, canon->canon_word,
+	                 canon->canon_wordlen);
+	canon->canon_word = NULL;
+	canon->canon_wordlen = 0;
+}
+
+/*
+**  ARC_CANON_WORDADD -- append bytes to the current relaxed body word
+**
+**  Parameters:
+**  	canon -- ARC_CANON handle
+**  	buf -- bytes to add, in the caller's body chunk
+**  	buflen -- number of bytes to add
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	A word is whatever is in canon_buf followed by canon_word; the
+**  	latter is only a reference into the current chunk, and only
+**  	gets copied if the word is interrupted or the chunk ends.
+*/
+
+static void
+arc_canon_wordadd(ARC_CANON *canon, u_char *buf, size_t buflen)
+{
+	assert(canon != NULL);
+
+	if (canon->canon_wordlen > 0 &&
+	    canon->canon_word + canon->canon_wordlen == buf)
+	{
+		canon->canon_wordlen += buflen;
+		return;
+	}
+
+	arc_canon_wordsave(canon);
+
+	canon->canon_word = buf;
+	canon->canon_wordlen = buflen;
+}
+
+/*
+**  ARC_CANON_WORDFLUSH -- write out the current relaxed body word
+**
+**  Parameters:
+**  	canon -- ARC_CANON handle
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_canon_wordflush(ARC_CANON *canon)
+{
+	assert(canon != NULL);
+
+	if (arc_dstring_len(canon->canon_buf) > 0)
+	{
+		arc_canon_buffer(canon, arc_dstring_get(canon->canon_buf),
+		                 arc_dstring_len(canon->canon_buf));
+		arc_dstring_blank(canon->canon_buf);
+	}
+
+	arc_canon_span(canon, canon->canon_word, canon->canon_wordlen);
+	canon->canon_word = NULL;
+	canon->canon_wordlen = 0;
+}
+
 /*
 **  ARC_CANON_HEADER_STRING -- canonicalize a header field
 **
@@ -412,18 +635,32 @@ arc_canon_header_string(struct arc_dstring *dstr, arc_canon_t canon,
 **
 **  Return value:
 **  	A ARC_STAT constant.
+**
+**  Notes:
+**  	The relaxed form of a complete header field is kept on "hdr" the
+**  	first time it is computed, since ARC header fields are fed to
+**  	several canonicalizations.
 */
 
 static ARC_STAT
 arc_canon_header(ARC_MESSAGE *msg, ARC_CANON *canon, struct arc_hdrfield *hdr,
                  _Bool crlf)
 {
+	_Bool cache;
 	ARC_STAT status;
 
 	assert(msg != NULL);
 	assert(canon != NULL);
 	assert(hdr != NULL);
 
+	cache = (crlf && canon->canon_canon == ARC_CANON_RELAXED);
+
+	if (cache && hdr->hdr_canon != NULL)
+	{
+		arc_canon_buffer(canon, hdr->hdr_canon, hdr->hdr_canonlen);
+		return ARC_STAT_OK;
+	}
+
 	if (msg->arc_canonbuf == NULL)
 	{
 		msg->arc_canonbuf = arc_dstring_new(msg, hdr->hdr_textlen, 0);
@@ -443,6 +680,18 @@ arc_canon_header(ARC_MESSAGE *msg, ARC_CANON *canon, struct arc_hdrfield *hdr,
 	if (status != ARC_STAT_OK)
 		return status;
 
+	if (cache)
+	{
+		hdr->hdr_canonlen = arc_dstring_len(msg->arc_canonbuf);
+		hdr->hdr_canon = arc_malloc(msg, hdr->hdr_canonlen);
+		if (hdr->hdr_canon != NULL)
+		{
+			memcpy(hdr->hdr_canon,
+			       arc_dstring_get(msg->arc_canonbuf),
+			       hdr->hdr_canonlen);
+		}
+	}
+
 	arc_canon_buffer(canon, arc_dstring_get(msg->arc_canonbuf),
 	                 arc_dstring_len(msg->arc_canonbuf));
 
@@ -485,6 +734,10 @@ arc_canon_flushblanks(ARC_CANON *canon)
 **
 **  Side effects:
 **  	msg->arc_canonbuf will be initialized and used.
+**
+**  Notes:
+**  	Every body canonicalization sees the same input, so their
+**  	canon_lastchar values agree and any of them can be passed here.
 */
 
 static ARC_STAT
@@ -562,23 +815,59 @@ arc_canon_init(ARC_MESSAGE *msg, _Bool tmp, _Bool keep)
 	int fd;
 	ARC_STAT status;
 	ARC_CANON *cur;
+	ARC_CANON *lead;
 
 	assert(msg != NULL);
 
+	/*
+	**  Body canonicalizations using the same mode produce the same
+	**  stream regardless of hash or length limit, so only the first
+	**  of each mode (the leader) runs the canonicalizer; the others
+	**  are chained to it as extra hash sinks.
+	*/
+
 	for (cur = msg->arc_canonhead; cur != NULL; cur = cur->canon_next)
 	{
-		cur->canon_hashbuf = malloc(ARC_HASHBUFSIZE);
-		if (cur->canon_hashbuf == NULL)
+		if (cur->canon_type != ARC_CANONTYPE_BODY)
+			continue;
+
+		for (lead = msg->arc_canonhead;
+		     lead != cur;
+		     lead = lead->canon_next)
 		{
-			arc_error(msg, "unable to allocate %d byte(s)",
-			          ARC_HASHBUFSIZE);
-			return ARC_STAT_NORESOURCE;
+			if (lead->canon_type == ARC_CANONTYPE_BODY &&
+			    lead->canon_leader == NULL &&
+			    lead->canon_canon == cur->canon_canon)
+				break;
+		}
+
+		if (lead == cur)
+			continue;
+
+		cur->canon_leader = lead;
+		while (lead->canon_nextsink != NULL)
+			lead = lead->canon_nextsink;
+		lead->canon_nextsink = cur;
+	}
+
+	for (cur = msg->arc_canonhead; cur != NULL; cur = cur->canon_next)
+	{
+		if (cur->canon_leader == NULL)
+		{
+			cur->canon_hashbuf = arc_malloc(msg, ARC_HASHBUFSIZE);
+			if (cur->canon_hashbuf == NULL)
+			{
+				arc_error(msg,
+				          "unable to allocate %d byte(s)",
+				          ARC_HASHBUFSIZE);
+				return ARC_STAT_NORESOURCE;
+			}
+			cur->canon_hashbufsize = ARC_HASHBUFSIZE;
+			cur->canon_hashbuflen = 0;
+			cur->canon_buf = arc_dstring_new(msg, BUFRSZ, BUFRSZ);
+			if (cur->canon_buf == NULL)
+				return ARC_STAT_NORESOURCE;
 		}
-		cur->canon_hashbufsize = ARC_HASHBUFSIZE;
-		cur->canon_hashbuflen = 0;
-		cur->canon_buf = arc_dstring_new(msg, BUFRSZ, BUFRSZ);
-		if (cur->canon_buf == NULL)
-			return ARC_STAT_NORESOURCE;
 
 		switch (cur->canon_hashtype)
 		{
@@ -586,7 +875,8 @@ arc_canon_init(ARC_MESSAGE *msg, _Bool tmp, _Bool keep)
 		  {
 			struct arc_sha1 *sha1;
 
-			sha1 = (struct arc_sha1 *) malloc(sizeof(struct arc_sha1));
+			sha1 = (struct arc_sha1 *) arc_malloc(msg,
+			                                      sizeof(struct arc_sha1));
 			if (sha1 == NULL)
 			{
 				arc_error(msg,
@@ -596,14 +886,24 @@ arc_canon_init(ARC_MESSAGE *msg, _Bool tmp, _Bool keep)
 			}
 
 			memset(sha1, '\0', sizeof(struct arc_sha1));
-			SHA1_Init(&sha1->sha1_ctx);
+			sha1->sha1_ctx = arc_mdctx_get();
+			if (sha1->sha1_ctx == NULL ||
+			    EVP_DigestInit_ex(sha1->sha1_ctx, arc_md_sha1(),
+			                      NULL) != 1)
+			{
+				arc_error(msg, "EVP_DigestInit_ex() failed");
+				arc_mdctx_put(sha1->sha1_ctx);
+				arc_mfree(msg, sha1);
+				return ARC_STAT_INTERNAL;
+			}
 
 			if (tmp)
 			{
 				status = arc_tmpfile(msg, &fd, keep);
 				if (status != ARC_STAT_OK)
 				{
-					free(sha1);
+					arc_mdctx_put(sha1->sha1_ctx);
+					arc_mfree(msg, sha1);
 					return status;
 				}
 
@@ -621,7 +921,8 @@ arc_canon_init(ARC_MESSAGE *msg, _Bool tmp, _Bool keep)
 		  {
 			struct arc_sha256 *sha256;
 
-			sha256 = (struct arc_sha256 *) malloc(sizeof(struct arc_sha256));
+			sha256 = (struct arc_sha256 *) arc_malloc(msg,
+			                                          sizeof(struct arc_sha256));
 			if (sha256 == NULL)
 			{
 				arc_error(msg,
@@ -631,14 +932,25 @@ arc_canon_init(ARC_MESSAGE *msg, _Bool tmp, _Bool keep)
 			}
 
 			memset(sha256, '\0', sizeof(struct arc_sha256));
-			SHA256_Init(&sha256->sha256_ctx);
+
+			sha256->sha256_ctx = arc_mdctx_get();
+			if (sha256->sha256_ctx == NULL ||
+			    EVP_DigestInit_ex(sha256->sha256_ctx,
+			                      arc_md_sha256(), NULL) != 1)
+			{
+				arc_error(msg, "EVP_DigestInit_ex() failed");
+				arc_mdctx_put(sha256->sha256_ctx);
+				arc_mfree(msg, sha256);
+				return ARC_STAT_INTERNAL;
+			}
 
 			if (tmp)
 			{
 				status = arc_tmpfile(msg, &fd, keep);
 				if (status != ARC_STAT_OK)
 				{
-					free(sha256);
+					arc_mdctx_put(sha256->sha256_ctx);
+					arc_mfree(msg, sha256);
 					return status;
 				}
 
@@ -730,14 +1042,15 @@ arc_add_canon(ARC_MESSAGE *msg, int type, arc_canon_t canon, int hashtype,
 		assert(hashtype == ARC_HASHTYPE_SHA1);
 	}
 
-	if (type == ARC_CANONTYPE_HEADER)
+	if (type == ARC_CANONTYPE_BODY)
 	{
 		for (cur = msg->arc_canonhead;
 		     cur != NULL;
 		     cur = cur->canon_next)
 		{
-			if (cur->canon_type == ARC_CANONTYPE_HEADER ||
-			    cur->canon_hashtype != hashtype)
+			if (cur->canon_type != ARC_CANONTYPE_BODY ||
+			    cur->canon_hashtype != hashtype ||
+			    cur->canon_canon != canon)
 				continue;
 
 			if (length != cur->canon_length)
@@ -750,7 +1063,7 @@ arc_add_canon(ARC_MESSAGE *msg, int type, arc_canon_t canon, int hashtype,
 		}
 	}
 
-	new = (ARC_CANON *) malloc(sizeof *new);
+	new = (ARC_CANON *) arc_malloc(msg, sizeof *new);
 	if (new == NULL)
 	{
 		arc_error(msg, "unable to allocate %d byte(s)", sizeof *new);
@@ -776,6 +1089,8 @@ arc_add_canon(ARC_MESSAGE *msg, int type, arc_canon_t canon, int hashtype,
 	new->canon_sigheader = sighdr;
 	new->canon_hdrlist = hdrlist;
 	new->canon_buf = NULL;
+	new->canon_leader = NULL;
+	new->canon_nextsink = NULL;
 	new->canon_next = NULL;
 	new->canon_blankline = TRUE;
 	new->canon_blanks = 0;
@@ -783,6 +1098,10 @@ arc_add_canon(ARC_MESSAGE *msg, int type, arc_canon_t canon, int hashtype,
 	new->canon_hashbuflen = 0;
 	new->canon_hashbufsize = 0;
 	new->canon_hashbuf = NULL;
+	new->canon_span = NULL;
+	new->canon_spanlen = 0;
+	new->canon_word = NULL;
+	new->canon_wordlen = 0;
 	new->canon_lastchar = '\0';
 
 	if (msg->arc_canonhead == NULL)
@@ -802,6 +1121,60 @@ arc_add_canon(ARC_MESSAGE *msg, int type, arc_canon_t canon, int hashtype,
 	return ARC_STAT_OK;
 }
 
+/*
+**  ARC_CANON_SELECTRESET -- prepare a message's header fields for selection
+**
+**  Parameters:
+**  	msg -- ARC message context
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Clears every field's ARC_HDR_SIGNED flag and points each name's
+**  	selection cursor at its last instance.
+*/
+
+static void
+arc_canon_selectreset(ARC_MESSAGE *msg)
+{
+	struct arc_hdrfield *hdr;
+
+	for (hdr = msg->arc_hhead; hdr != NULL; hdr = hdr->hdr_next)
+	{
+		hdr->hdr_flags &= ~ARC_HDR_SIGNED;
+		if (hdr->hdr_nsame > 0)
+			hdr->hdr_selnext = hdr->hdr_lastsame;
+	}
+}
+
+/*
+**  ARC_CANON_SELECTNEXT -- take the last unused instance of a name
+**
+**  Parameters:
+**  	first -- first instance of the name, from arc_hdrindex_find()
+**  	         (may be NULL)
+**
+**  Return value:
+**  	The field selected, now marked ARC_HDR_SIGNED, or NULL if the name
+**  	isn't present or all its instances have been taken.
+*/
+
+static struct arc_hdrfield *
+arc_canon_selectnext(struct arc_hdrfield *first)
+{
+	struct arc_hdrfield *hdr;
+
+	if (first == NULL || first->hdr_selnext == NULL)
+		return NULL;
+
+	hdr = first->hdr_selnext;
+	first->hdr_selnext = hdr->hdr_prevsame;
+	hdr->hdr_flags |= ARC_HDR_SIGNED;
+
+	return hdr;
+}
+
 /*
 **  ARC_CANON_SELECTHDRS -- choose headers to be included in canonicalization
 **
@@ -820,25 +1193,21 @@ arc_add_canon(ARC_MESSAGE *msg, int type, arc_canon_t canon, int hashtype,
 **  	which this is done.  "ptrs" is populated by pointers to header fields
 **  	in the order in which they should be fed to canonicalization.
 **
-**  	If any of the returned pointers is NULL, then a header field named by
-**  	"hdrlist" was not found.
+**  	Each name in "hdrlist" takes the last instance of that name not
+**  	already taken (RFC 6376 section 5.4.2); names with no instances
+**  	left are skipped.  Lookups go through the message's header name
+**  	index, so this is linear in the sizes of "hdrlist" and the header.
 */
 
 int
 arc_canon_selecthdrs(ARC_MESSAGE *msg, u_char *hdrlist,
                      struct arc_hdrfield **ptrs, int nptrs)
 {
-	int c;
 	int n;
-	int m;
-	int shcnt;
 	size_t len;
-	char *bar;
-	char *ctx;
-	u_char *colon;
+	u_char *p;
+	u_char *q;
 	struct arc_hdrfield *hdr;
-	struct arc_hdrfield **lhdrs;
-	u_char **hdrs;
 
 	assert(msg != NULL);
 	assert(ptrs != NULL);
@@ -865,111 +1234,91 @@ arc_canon_selecthdrs(ARC_MESSAGE *msg, u_char *hdrlist,
 		return n;
 	}
 
-	if (msg->arc_hdrlist == NULL)
+	arc_canon_selectreset(msg);
+
+	n = 0;
+	for (p = hdrlist; *p != '\0'; p = q)
 	{
-		msg->arc_hdrlist = malloc(ARC_MAXHEADER);
-		if (msg->arc_hdrlist == NULL)
-		{
-			arc_error(msg, "unable to allocate %d bytes(s)",
-			          ARC_MAXHEADER);
-			return -1;
-		}
-	}
+		for (q = p; *q != '\0' && *q != ':'; q++)
+			continue;
 
-	strlcpy((char *) msg->arc_hdrlist, (char *) hdrlist, ARC_MAXHEADER);
+		len = q - p;
+		while (len > 0 && ARC_ISWSP(p[len - 1]))
+			len--;
 
-	/* mark all headers as not used */
-	for (hdr = msg->arc_hhead; hdr != NULL; hdr = hdr->hdr_next)
-		hdr->hdr_flags &= ~ARC_HDR_SIGNED;
+		if (*q == ':')
+			q++;
 
-	n = msg->arc_hdrcnt * sizeof(struct arc_hdrfield *);
-	lhdrs = malloc(n);
-	if (lhdrs == NULL)
-		return -1;
-	memset(lhdrs, '\0', n);
+		if (len == 0)
+			continue;
 
-	shcnt = 1;
-	for (colon = msg->arc_hdrlist; *colon != '\0'; colon++)
-	{
-		if (*colon == ':')
-			shcnt++;
-	}
-	n = sizeof(u_char *) * shcnt;
-	hdrs = malloc(n);
-	if (hdrs == NULL)
-	{
-		free(lhdrs);
-		return -1;
-	}
-	memset(hdrs, '\0', n);
+		hdr = arc_canon_selectnext(arc_hdrindex_find(msg, p, len));
+		if (hdr == NULL)
+			continue;
 
-	n = 0;
+		if (n >= nptrs)
+		{
+			arc_error(msg, "too many headers (max %d)", nptrs);
+			return -1;
+		}
 
-	/* make a split-out copy of hdrlist */
-	for (bar = strtok_r((char *) msg->arc_hdrlist, ":", &ctx);
-	     bar != NULL;
-	     bar = strtok_r(NULL, ":", &ctx))
-	{
-		hdrs[n] = (u_char *) bar;
+		ptrs[n] = hdr;
 		n++;
 	}
 
-	/* for each named header, find the last unused one and use it up */
-	shcnt = 0;
-	for (c = 0; c < n; c++)
-	{
-		lhdrs[shcnt] = NULL;
-
-		len = MIN(ARC_MAXHEADER, strlen((char *) hdrs[c]));
-		while (len > 0 &&
-		       ARC_ISWSP(hdrs[c][len - 1]))
-			len--;
+	return n;
+}
 
-		for (hdr = msg->arc_hhead; hdr != NULL; hdr = hdr->hdr_next)
-		{
-			if (hdr->hdr_flags & ARC_HDR_SIGNED)
-				continue;
+/*
+**  ARC_CANON_SELECTALL -- choose all but the ARC header fields for signing
+**
+**  Parameters:
+**  	msg -- ARC message context in which this is performed
+**  	ptrs -- array of header pointers (modified)
+**  	nptr -- number of pointers available at "ptrs"
+**
+**  Return value:
+**  	Count of headers added to "ptrs", or -1 on error.
+**
+**  Notes:
+**  	Equivalent to arc_canon_selecthdrs() given the names of all non-ARC
+**  	fields in header order, without building and re-parsing that list:
+**  	the n-th field of a name from the top selects the n-th from the
+**  	bottom, matching what a verifier does with the resulting h= tag.
+*/
 
-			if (len == hdr->hdr_namelen &&
-			    strncasecmp((char *) hdr->hdr_text,
-			                (char *) hdrs[c], len) == 0)
-				lhdrs[shcnt] = hdr;
-		}
+static int
+arc_canon_selectall(ARC_MESSAGE *msg, struct arc_hdrfield **ptrs, int nptrs)
+{
+	int n;
+	struct arc_hdrfield *hdr;
+	struct arc_hdrfield *sel;
 
-		if (lhdrs[shcnt] != NULL)
-		{
-			lhdrs[shcnt]->hdr_flags |= ARC_HDR_SIGNED;
-			shcnt++;
-		}
-	}
+	arc_canon_selectreset(msg);
 
-	/* bounds check */
-	if (shcnt > nptrs)
+	n = 0;
+	for (hdr = msg->arc_hhead; hdr != NULL; hdr = hdr->hdr_next)
 	{
-		arc_error(msg, "too many headers (found %d, max %d)", shcnt,
-		          nptrs);
-
-		free(lhdrs);
-		free(hdrs);
+		if (arc_hdr_arctype(hdr) != -1)
+			continue;
 
-		return -1;
-	}
+		sel = arc_canon_selectnext(arc_hdrindex_find(msg,
+		                                             hdr->hdr_text,
+		                                             hdr->hdr_namelen));
+		if (sel == NULL)
+			continue;
 
-	/* copy to the caller's buffers */
-	m = 0;
-	for (c = 0; c < shcnt; c++)
-	{
-		if (lhdrs[c] != NULL)
+		if (n >= nptrs)
 		{
-			ptrs[m] = lhdrs[c];
-			m++;
+			arc_error(msg, "too many headers (max %d)", nptrs);
+			return -1;
 		}
-	}
 
-	free(lhdrs);
-	free(hdrs);
+		ptrs[n] = sel;
+		n++;
+	}
 
-	return m;
+	return n;
 }
 
 /*
@@ -1003,7 +1352,7 @@ arc_canon_strip_b(ARC_MESSAGE *msg, u_char *text)
 	arc_dstring_blank(msg->arc_hdrbuf);
 
 	tmp = tmpbuf;
-	end = tmpbuf + sizeof tmpbuf;
+	end = tmpbuf + sizeof tmpbuf - 1;
 
 	n = 0;
 	in = '\0';
@@ -1073,7 +1422,7 @@ arc_canon_finalize(ARC_CANON *canon)
 		struct arc_sha1 *sha1;
 
 		sha1 = (struct arc_sha1 *) canon->canon_hash;
-		SHA1_Final(sha1->sha1_out, &sha1->sha1_ctx);
+		(void) EVP_DigestFinal_ex(sha1->sha1_ctx, sha1->sha1_out, NULL);
 
 		if (sha1->sha1_tmpbio != NULL)
 			(void) BIO_flush(sha1->sha1_tmpbio);
@@ -1087,7 +1436,8 @@ arc_canon_finalize(ARC_CANON *canon)
 		struct arc_sha256 *sha256;
 
 		sha256 = (struct arc_sha256 *) canon->canon_hash;
-		SHA256_Final(sha256->sha256_out, &sha256->sha256_ctx);
+		(void) EVP_DigestFinal_ex(sha256->sha256_ctx,
+		                          sha256->sha256_out, NULL);
 
 		if (sha256->sha256_tmpbio != NULL)
 			(void) BIO_flush(sha256->sha256_tmpbio);
@@ -1102,6 +1452,41 @@ arc_canon_finalize(ARC_CANON *canon)
 	}
 }
 
+/*
+**  ARC_CANON_CLONE -- start a seal canonicalization from another one's state
+**
+**  Parameters:
+**  	dst -- canonicalization to set up; nothing may have been hashed yet
+**  	src -- canonicalization to copy
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+*/
+
+static ARC_STAT
+arc_canon_clone(ARC_CANON *dst, ARC_CANON *src)
+{
+	struct arc_sha256 *dsha;
+	struct arc_sha256 *ssha;
+
+	assert(dst != NULL);
+	assert(src != NULL);
+	assert(dst->canon_hashtype == ARC_HASHTYPE_SHA256);
+	assert(src->canon_hashtype == ARC_HASHTYPE_SHA256);
+
+	arc_canon_buffer(src, NULL, 0);
+
+	dsha = (struct arc_sha256 *) dst->canon_hash;
+	ssha = (struct arc_sha256 *) src->canon_hash;
+
+	if (EVP_MD_CTX_copy_ex(dsha->sha256_ctx, ssha->sha256_ctx) != 1)
+		return ARC_STAT_INTERNAL;
+
+	dst->canon_wrote = src->canon_wrote;
+
+	return ARC_STAT_OK;
+}
+
 /*
 **  ARC_CANON_RUNHEADERS_SEAL -- run the ARC-specific header fields through
 **                               seal canonicalization(s)
@@ -1112,103 +1497,112 @@ arc_canon_finalize(ARC_CANON *canon)
 **  Return value:
 **  	An ARC_STAT_* constant.
 **
-**  For each ARC set number N, apply it to seal canonicalization handles 0
-**  through N-1.  That way the first one is only set 1, the second one is
-**  sets 1 and 2, etc.  For the final one in each set, strip "b=".  Then
-**  also do one more complete one so that can be used for re-sealing.
+**  The seal for set N covers every field of sets 1 through N-1 and then
+**  set N with "b=" stripped from its ARC-Seal.  The complete sets are
+**  written once, in order, to the re-sealing canonicalization; each
+**  verification canonicalization starts from a copy of that state taken
+**  just ahead of its own ARC-Seal, so a chain costs linear time.  The
+**  re-sealing canonicalization is finalized later by
+**  arc_canon_signature().  Sets arc_eoh() didn't ask to verify have no
+**  verification canonicalization, and an incomplete chain is skipped.
 */
 
 ARC_STAT
 arc_canon_runheaders_seal(ARC_MESSAGE *msg)
 {
 	ARC_STAT status;
-	u_int m;
 	u_int n;
+	ARC_CANON *all;
 	ARC_CANON *cur;
+	struct arc_hdrfield *as;
+	struct arc_hdrfield tmphdr;
 
 	assert(msg != NULL);
 
+	all = msg->arc_sealcanon;
+	assert(all != NULL);
+
+	if (all->canon_done)
+		return ARC_STAT_OK;
+
 	for (n = 0; n < msg->arc_nsets; n++)
 	{
-		cur = msg->arc_sealcanons[n];
+		if (msg->arc_sets[n].arcset_aar == NULL ||
+		    msg->arc_sets[n].arcset_ams == NULL ||
+		    msg->arc_sets[n].arcset_as == NULL)
+			return ARC_STAT_OK;
+	}
 
-		if (cur->canon_done)
-			continue;
+	if (msg->arc_hdrbuf == NULL)
+	{
+		msg->arc_hdrbuf = arc_dstring_new(msg, BUFRSZ, MAXBUFRSZ);
+		if (msg->arc_hdrbuf == NULL)
+			return ARC_STAT_NORESOURCE;
+	}
+
+	for (n = 0; n < msg->arc_nsets; n++)
+	{
+		status = arc_canon_header(msg, all,
+		                          msg->arc_sets[n].arcset_aar, TRUE);
+		if (status != ARC_STAT_OK)
+			return status;
+
+		status = arc_canon_header(msg, all,
+		                          msg->arc_sets[n].arcset_ams, TRUE);
+		if (status != ARC_STAT_OK)
+			return status;
+
+		as = msg->arc_sets[n].arcset_as;
+		cur = msg->arc_sealcanons[n];
 
-		/* build up the canonicalized seals for verification */
-		for (m = 0; m <= n; m++)
+		/* the verification seal for this set */
+		if (cur != NULL && !cur->canon_done)
 		{
-			status = arc_canon_header(msg, cur,
-			                          msg->arc_sets[m].arcset_aar,
-			                          TRUE);
+			status = arc_canon_clone(cur, all);
 			if (status != ARC_STAT_OK)
+			{
+				arc_error(msg, "EVP_MD_CTX_copy_ex() failed");
 				return status;
+			}
 
-			status = arc_canon_header(msg, cur,
-			                          msg->arc_sets[m].arcset_ams,
-			                          TRUE);
+			status = arc_canon_strip_b(msg, as->hdr_text);
 			if (status != ARC_STAT_OK)
 				return status;
 
-			if (m != n)
-			{
-				status = arc_canon_header(msg, cur,
-				                          msg->arc_sets[m].arcset_as,
-				                          TRUE);
-			}
-			else
-			{
-				struct arc_hdrfield tmphdr;
-
-				tmphdr.hdr_text = arc_dstring_get(msg->arc_hdrbuf);
-				tmphdr.hdr_namelen = cur->canon_sigheader->hdr_namelen;
-				tmphdr.hdr_colon = tmphdr.hdr_text + (cur->canon_sigheader->hdr_colon - cur->canon_sigheader->hdr_text);
-				tmphdr.hdr_textlen = arc_dstring_len(msg->arc_hdrbuf);
-				tmphdr.hdr_flags = 0;
-				tmphdr.hdr_next = NULL;
-
-				arc_lowerhdr(tmphdr.hdr_text);
-				/* XXX -- void? */
-				(void) arc_canon_header(msg, cur, &tmphdr,
-				                        FALSE);
-				arc_canon_buffer(cur, NULL, 0);
-			}
-
+			tmphdr.hdr_text = arc_dstring_get(msg->arc_hdrbuf);
+			tmphdr.hdr_namelen = as->hdr_namelen;
+			tmphdr.hdr_colon = tmphdr.hdr_text + (as->hdr_colon - as->hdr_text);
+			tmphdr.hdr_textlen = arc_dstring_len(msg->arc_hdrbuf);
+			tmphdr.hdr_flags = 0;
+			tmphdr.hdr_canon = NULL;
+			tmphdr.hdr_canonlen = 0;
+			tmphdr.hdr_next = NULL;
+
+			arc_lowerhdr(tmphdr.hdr_text);
+			status = arc_canon_header(msg, cur, &tmphdr, FALSE);
 			if (status != ARC_STAT_OK)
 				return status;
-
-			arc_canon_finalize(cur);
-
-			cur->canon_done = TRUE;
+			arc_canon_buffer(cur, NULL, 0);
 		}
 
-		cur = msg->arc_sealcanon;
-
-		if (cur->canon_done)
-			continue;
-
-		/* write all the ARC sets once more for re-sealing */
-		status = arc_canon_header(msg, cur,
-		                          msg->arc_sets[n].arcset_aar,
-		                          TRUE);
+		/* and the complete set for the next one */
+		status = arc_canon_header(msg, all, as, TRUE);
 		if (status != ARC_STAT_OK)
 			return status;
+	}
 
-		status = arc_canon_header(msg, cur,
-		                          msg->arc_sets[n].arcset_ams,
-		                          TRUE);
-		if (status != ARC_STAT_OK)
-			return status;
+	/* finalize the verification seals */
+	for (n = 0; n < msg->arc_nsets; n++)
+	{
+		cur = msg->arc_sealcanons[n];
 
-		status = arc_canon_header(msg, cur,
-		                          msg->arc_sets[n].arcset_as,
-		                          TRUE);
-		if (status != ARC_STAT_OK)
-			return status;
-	}
+		if (cur == NULL || cur->canon_done)
+			continue;
 
-	/* now finalize the main one */
-	arc_canon_finalize(msg->arc_sealcanon);
+		arc_canon_finalize(cur);
+
+		cur->canon_done = TRUE;
+	}
 
 	return ARC_STAT_OK;
 }
@@ -1233,27 +1627,17 @@ ARC_STAT
 arc_canon_runheaders(ARC_MESSAGE *msg)
 {
 	_Bool signing;
-	u_char savechar;
 	int c;
 	int n;
-	int in;
 	int nhdrs = 0;
-	int last = '\0';
 	ARC_STAT status;
-	u_char *tmp;
-	u_char *end;
 	ARC_CANON *cur;
-	u_char *p;
 	struct arc_hdrfield *hdr;
 	struct arc_hdrfield **hdrset;
 	struct arc_hdrfield tmphdr;
-	u_char tmpbuf[BUFRSZ];
 
 	assert(msg != NULL);
 
-	tmp = tmpbuf;
-	end = tmpbuf + sizeof tmpbuf - 1;
-
 	n = msg->arc_hdrcnt * sizeof(struct arc_hdrfield *);
 	hdrset = malloc(n);
 	if (hdrset == NULL)
@@ -1317,51 +1701,16 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
 		}
 		else
 		{
-			ARC_LIB *lib;
-			regex_t *hdrtest;
-
-			lib = msg->arc_library;
-			memset(hdrset, '\0', sizeof *hdrset);
-			nhdrs = 0;
-
-			/* tag all header fields to be signed */
-			for (hdr = msg->arc_hhead;
-			     hdr != NULL;
-			     hdr = hdr->hdr_next)
-			{
-				if (strncasecmp(ARC_AR_HDRNAME,
-				                hdr->hdr_text,
-				                hdr->hdr_namelen) == 0 ||
-				    strncasecmp(ARC_MSGSIG_HDRNAME,
-				                hdr->hdr_text,
-				                hdr->hdr_namelen) == 0 ||
-				    strncasecmp(ARC_SEAL_HDRNAME,
-				                hdr->hdr_text,
-				                hdr->hdr_namelen) == 0)
-					continue;
-
-				tmp = arc_dstring_get(msg->arc_hdrbuf);
-
-				if (tmp[0] != '\0')
-					arc_dstring_cat1(msg->arc_hdrbuf, ':');
-
-				arc_dstring_catn(msg->arc_hdrbuf,
-				                 hdr->hdr_text,
-				                 hdr->hdr_namelen);
-			}
-
 			memset(hdrset, '\0', n);
 
-			/* do header selection */
-			nhdrs = arc_canon_selecthdrs(msg,
-			                             arc_dstring_get(msg->arc_hdrbuf),
-			                             hdrset,
-			                             msg->arc_hdrcnt);
+			/* tag all header fields to be signed */
+			nhdrs = arc_canon_selectall(msg, hdrset,
+			                            msg->arc_hdrcnt);
 
 			if (nhdrs == -1)
 			{
 				arc_error(msg,
-				          "arc_canon_selecthdrs() failed during canonicalization");
+				          "arc_canon_selectall() failed during canonicalization");
 				free(hdrset);
 				return ARC_STAT_INTERNAL;
 			}
@@ -1407,6 +1756,8 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
 		tmphdr.hdr_colon = tmphdr.hdr_text + (cur->canon_sigheader->hdr_colon - cur->canon_sigheader->hdr_text);
 		tmphdr.hdr_textlen = arc_dstring_len(msg->arc_hdrbuf);
 		tmphdr.hdr_flags = 0;
+		tmphdr.hdr_canon = NULL;
+		tmphdr.hdr_canonlen = 0;
 		tmphdr.hdr_next = NULL;
 
 		arc_lowerhdr(tmphdr.hdr_text);
@@ -1477,6 +1828,8 @@ arc_canon_signature(ARC_MESSAGE *msg, struct arc_hdrfield *hdr, _Bool seal)
 		tmphdr.hdr_colon = tmphdr.hdr_text + (hdr->hdr_colon - hdr->hdr_text);
 		tmphdr.hdr_textlen = arc_dstring_len(msg->arc_hdrbuf);
 		tmphdr.hdr_flags = 0;
+		tmphdr.hdr_canon = NULL;
+		tmphdr.hdr_canonlen = 0;
 		tmphdr.hdr_next = NULL;
 		arc_lowerhdr(tmphdr.hdr_text);
 		
@@ -1544,6 +1897,10 @@ arc_canon_minbody(ARC_MESSAGE *msg)
 **
 **  Return value:
 **  	A ARC_STAT_* constant.
+**
+**  Notes:
+**  	The chunk is canonicalized once per mode, by that mode's leader;
+**  	its output is hashed by every canonicalization chained to it.
 */
 
 ARC_STAT
@@ -1553,8 +1910,10 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 	ARC_STAT status;
 	u_int wlen;
 	ARC_CANON *cur;
+	size_t n;
 	size_t plen;
 	u_char *p;
+	u_char *wsp;
 	u_char *wrote;
 	u_char *eob;
 	u_char *start;
@@ -1565,24 +1924,40 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 
 	fixcrlf = (msg->arc_library->arcl_flags & ARC_LIBFLAGS_FIXCRLF);
 
+	start = buf;
+	plen = buflen;
+
+	if (fixcrlf)
+	{
+		for (cur = msg->arc_canonhead;
+		     cur != NULL;
+		     cur = cur->canon_next)
+		{
+			if (!cur->canon_done &&
+			    cur->canon_type == ARC_CANONTYPE_BODY)
+				break;
+		}
+
+		if (cur == NULL)
+			return ARC_STAT_OK;
+
+		status = arc_canon_fixcrlf(msg, cur, buf, buflen);
+		if (status != ARC_STAT_OK)
+			return status;
+
+		start = arc_dstring_get(msg->arc_canonbuf);
+		plen = arc_dstring_len(msg->arc_canonbuf);
+	}
+
 	for (cur = msg->arc_canonhead; cur != NULL; cur = cur->canon_next)
 	{
 		/* skip done hashes and those which are of the wrong type */
 		if (cur->canon_done || cur->canon_type != ARC_CANONTYPE_BODY)
 			continue;
 
-		start = buf;
-		plen = buflen;
-
-		if (fixcrlf)
-		{
-			status = arc_canon_fixcrlf(msg, cur, buf, buflen);
-			if (status != ARC_STAT_OK)
-				return status;
-
-			start = arc_dstring_get(msg->arc_canonbuf);
-			plen = arc_dstring_len(msg->arc_canonbuf);
-		}
+		/* skip those fed by another canonicalization */
+		if (cur->canon_leader != NULL)
+			continue;
 
 		eob = start + plen - 1;
 		wrote = start;
@@ -1610,9 +1985,9 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 						}
 						else
 						{
-							arc_canon_buffer(cur,
-							                 wrote,
-							                 wlen + 1);
+							arc_canon_span(cur,
+							               wrote,
+							               wlen + 1);
 						}
 
 						wrote = p + 1;
@@ -1641,14 +2016,20 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 						}
 					}
 
+					wlen++;
+
 					if (*p != '\r')
 					{
 						if (cur->canon_blanks > 0)
 							arc_canon_flushblanks(cur);
 						cur->canon_blankline = FALSE;
-					}
 
-					wlen++;
+						/* the rest of the run is copied as-is */
+						n = arc_scan(p + 1, eob - p,
+						             '\r', '\n', '\r', '\n');
+						wlen += n;
+						p += n;
+					}
 				}
 
 				cur->canon_lastchar = *p;
@@ -1657,11 +2038,13 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 			if (wlen > 0 && wrote[wlen - 1] == '\r')
 				wlen--;
 
-			arc_canon_buffer(cur, wrote, wlen);
+			arc_canon_span(cur, wrote, wlen);
 
 			break;
 
 		  case ARC_CANON_RELAXED:
+			wsp = NULL;
+
 			for (p = start; p <= eob; p++)
 			{
 				switch (cur->canon_bodystate)
@@ -1669,6 +2052,7 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 				  case 0:
 					if (ARC_ISWSP(*p))
 					{
+						wsp = p;
 						cur->canon_bodystate = 1;
 					}
 					else if (*p == '\r')
@@ -1678,8 +2062,7 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 					else
 					{
 						cur->canon_blankline = FALSE;
-						arc_dstring_cat1(cur->canon_buf,
-						                 *p);
+						arc_canon_wordadd(cur, p, 1);
 						cur->canon_bodystate = 3;
 					}
 					break;
@@ -1696,10 +2079,13 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 					else
 					{
 						arc_canon_flushblanks(cur);
-						arc_canon_buffer(cur, SP, 1);
+						if (wsp != NULL && p - wsp == 1 &&
+						    *wsp == ' ')
+							arc_canon_span(cur, wsp, 1);
+						else
+							arc_canon_buffer(cur, SP, 1);
 						cur->canon_blankline = FALSE;
-						arc_dstring_cat1(cur->canon_buf,
-						                 *p);
+						arc_canon_wordadd(cur, p, 1);
 						cur->canon_bodystate = 3;
 					}
 					break;
@@ -1715,13 +2101,19 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 						else
 						{
 							arc_canon_flushblanks(cur);
-							arc_canon_buffer(cur,
-							                 arc_dstring_get(cur->canon_buf),
-							                 arc_dstring_len(cur->canon_buf));
-							arc_canon_buffer(cur,
-							                 CRLF,
-							                 2);
-							arc_dstring_blank(cur->canon_buf);
+							arc_canon_wordflush(cur);
+							if (*p == '\n' && p > start)
+							{
+								arc_canon_span(cur,
+								               p - 1,
+								               2);
+							}
+							else
+							{
+								arc_canon_buffer(cur,
+								                 CRLF,
+								                 2);
+							}
 
 							if (*p == '\n')
 							{
@@ -1736,12 +2128,14 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 							{
 								if (ARC_ISWSP(*p))
 								{
+									wsp = p;
 									cur->canon_bodystate = 1;
 								}
 								else
 								{
-									arc_dstring_cat1(cur->canon_buf,
-									                 *p);
+									arc_canon_wordadd(cur,
+									                  p,
+									                  1);
 									cur->canon_bodystate = 3;
 								}
 							}
@@ -1750,23 +2144,19 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 					else if (*p == '\r')
 					{
 						cur->canon_blankline = FALSE;
-						arc_dstring_cat1(cur->canon_buf,
-						                 *p);
+						arc_canon_wordadd(cur, p, 1);
 					}
 					else if (ARC_ISWSP(*p))
 					{
 						arc_canon_flushblanks(cur);
-						arc_canon_buffer(cur,
-						                 arc_dstring_get(cur->canon_buf),
-						                 arc_dstring_len(cur->canon_buf));
-						arc_dstring_blank(cur->canon_buf);
+						arc_canon_wordflush(cur);
+						wsp = p;
 						cur->canon_bodystate = 1;
 					}
 					else
 					{
 						cur->canon_blankline = FALSE;
-						arc_dstring_cat1(cur->canon_buf,
-						                 *p);
+						arc_canon_wordadd(cur, p, 1);
 						cur->canon_bodystate = 3;
 					}
 					break;
@@ -1775,10 +2165,8 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 					if (ARC_ISWSP(*p))
 					{
 						arc_canon_flushblanks(cur);
-						arc_canon_buffer(cur,
-						                 arc_dstring_get(cur->canon_buf),
-						                 arc_dstring_len(cur->canon_buf));
-						arc_dstring_blank(cur->canon_buf);
+						arc_canon_wordflush(cur);
+						wsp = p;
 						cur->canon_bodystate = 1;
 					}
 					else if (*p == '\r')
@@ -1787,15 +2175,29 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 					}
 					else
 					{
-						arc_dstring_cat1(cur->canon_buf,
-						                 *p);
+						arc_canon_wordadd(cur, p, 1);
 					}
 					break;
 				}
 
+				/* a word continues up to the next WSP or CR */
+				if (cur->canon_bodystate == 3 && p < eob)
+				{
+					n = arc_scan(p + 1, eob - p,
+					             ' ', '\t', '\r', '\r');
+					if (n > 0)
+					{
+						arc_canon_wordadd(cur, p + 1, n);
+						p += n;
+					}
+				}
+
 				cur->canon_lastchar = *p;
 			}
 
+			/* "buf" belongs to the caller; keep what's still needed */
+			arc_canon_wordsave(cur);
+
 			arc_canon_buffer(cur, NULL, 0);
 
 			break;
@@ -1834,8 +2236,9 @@ arc_canon_closebody(ARC_MESSAGE *msg)
 		if (cur->canon_done || cur->canon_type != ARC_CANONTYPE_BODY)
 			continue;
 
-		/* handle unprocessed content */
-		if (arc_dstring_len(cur->canon_buf) > 0)
+		/* handle unprocessed content; the leader does it for sinks */
+		if (cur->canon_leader == NULL &&
+		    arc_dstring_len(cur->canon_buf) > 0)
 		{
 			if ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_FIXCRLF) != 0)
 			{
@@ -1851,7 +2254,8 @@ arc_canon_closebody(ARC_MESSAGE *msg)
 			}
 		}
 
-		arc_canon_buffer(cur, NULL, 0);
+		if (cur->canon_leader == NULL)
+			arc_canon_buffer(cur, NULL, 0);
 
 		/* finalize */
 		switch (cur->canon_hashtype)
@@ -1861,7 +2265,8 @@ arc_canon_closebody(ARC_MESSAGE *msg)
 			struct arc_sha1 *sha1;
 
 			sha1 = (struct arc_sha1 *) cur->canon_hash;
-			SHA1_Final(sha1->sha1_out, &sha1->sha1_ctx);
+			(void) EVP_DigestFinal_ex(sha1->sha1_ctx,
+			                          sha1->sha1_out, NULL);
 
 			if (sha1->sha1_tmpbio != NULL)
 				(void) BIO_flush(sha1->sha1_tmpbio);
@@ -1875,7 +2280,8 @@ arc_canon_closebody(ARC_MESSAGE *msg)
 			struct arc_sha256 *sha256;
 
 			sha256 = (struct arc_sha256 *) cur->canon_hash;
-			SHA256_Final(sha256->sha256_out, &sha256->sha256_ctx);
+			(void) EVP_DigestFinal_ex(sha256->sha256_ctx,
+			                          sha256->sha256_out, NULL);
 
 			if (sha256->sha256_tmpbio != NULL)
 				(void) BIO_flush(sha256->sha256_tmpbio);
@@ -1976,6 +2382,8 @@ arc_canon_getsealhash(ARC_MESSAGE *msg, int setnum, void **sh, size_t *shlen)
 	assert(setnum <= msg->arc_nsets);
 
 	sdc = msg->arc_sealcanons[setnum - 1];
+	if (sdc == NULL)
+		return ARC_STAT_INVALID;
 
 	status = arc_canon_getfinal(sdc, &sd, &sdlen);
 	if (status != ARC_STAT_OK)
@@ -22,6 +22,7 @@
 #include "arc-types.h"
 
 #define	ARC_HASHBUFSIZE	4096
+#define	ARC_MINSPAN	128
 
 #define	ARC_CANONTYPE_HEADER	0
 #define	ARC_CANONTYPE_BODY	1
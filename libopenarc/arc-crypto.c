@@ -0,0 +1,216 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/types.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+/* OpenSSL includes */
+#include <openssl/opensslv.h>
+#include <openssl/evp.h>
+
+/* libopenarc includes */
+#include "arc-internal.h"
+#include "arc-crypto.h"
+
+/* limits */
+#define	ARC_MDCTX_CACHE		64	/* idle digest contexts per thread */
+
+/*
+**  ARC_MDCTX_CACHE -- one thread's idle digest contexts
+*/
+
+struct arc_mdctx_cache
+{
+	u_int			mc_n;
+	EVP_MD_CTX *		mc_ctx[ARC_MDCTX_CACHE];
+};
+
+/* globals */
+static pthread_once_t arc_crypto_once = PTHREAD_ONCE_INIT;
+static pthread_key_t arc_mdctx_key;
+static _Bool arc_mdctx_keyok = FALSE;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static EVP_MD *arc_sha1 = NULL;
+static EVP_MD *arc_sha256 = NULL;
+#endif /* OPENSSL_VERSION_NUMBER >= 0x30000000L */
+
+/*
+**  ARC_MDCTX_DESTROY -- release a thread's idle digest contexts
+**
+**  Parameters:
+**  	arg -- the thread's struct arc_mdctx_cache
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_mdctx_destroy(void *arg)
+{
+	struct arc_mdctx_cache *cache;
+
+	cache = (struct arc_mdctx_cache *) arg;
+
+	while (cache->mc_n > 0)
+		EVP_MD_CTX_free(cache->mc_ctx[--cache->mc_n]);
+
+	free(cache);
+}
+
+/*
+**  ARC_CRYPTO_SETUP -- one-time setup
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	With OpenSSL 3.0 the digests are fetched once here rather than
+**  	implicitly by every EVP_DigestInit_ex() call.  They are kept for
+**  	the life of the process.
+*/
+
+static void
+arc_crypto_setup(void)
+{
+	arc_mdctx_keyok = (pthread_key_create(&arc_mdctx_key,
+	                                      arc_mdctx_destroy) == 0);
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	arc_sha1 = EVP_MD_fetch(NULL, "SHA1", NULL);
+	arc_sha256 = EVP_MD_fetch(NULL, "SHA256", NULL);
+#endif /* OPENSSL_VERSION_NUMBER >= 0x30000000L */
+}
+
+/*
+**  ARC_MD_SHA1 -- SHA-1 digest method
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	An EVP_MD for SHA-1.
+*/
+
+const EVP_MD *
+arc_md_sha1(void)
+{
+	(void) pthread_once(&arc_crypto_once, arc_crypto_setup);
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	if (arc_sha1 != NULL)
+		return arc_sha1;
+#endif /* OPENSSL_VERSION_NUMBER >= 0x30000000L */
+
+	return EVP_sha1();
+}
+
+/*
+**  ARC_MD_SHA256 -- SHA-256 digest method
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	An EVP_MD for SHA-256.
+*/
+
+const EVP_MD *
+arc_md_sha256(void)
+{
+	(void) pthread_once(&arc_crypto_once, arc_crypto_setup);
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	if (arc_sha256 != NULL)
+		return arc_sha256;
+#endif /* OPENSSL_VERSION_NUMBER >= 0x30000000L */
+
+	return EVP_sha256();
+}
+
+/*
+**  ARC_MDCTX_GET -- get a digest context for this thread
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	An EVP_MD_CTX ready for EVP_DigestInit_ex() or the like, or NULL
+**  	on failure.  Hand it back with arc_mdctx_put().
+*/
+
+EVP_MD_CTX *
+arc_mdctx_get(void)
+{
+	struct arc_mdctx_cache *cache;
+
+	(void) pthread_once(&arc_crypto_once, arc_crypto_setup);
+
+	if (arc_mdctx_keyok)
+	{
+		cache = pthread_getspecific(arc_mdctx_key);
+		if (cache != NULL && cache->mc_n > 0)
+			return cache->mc_ctx[--cache->mc_n];
+	}
+
+	return EVP_MD_CTX_new();
+}
+
+/*
+**  ARC_MDCTX_PUT -- return a digest context for reuse
+**
+**  Parameters:
+**  	ctx -- context from arc_mdctx_get() (may be NULL)
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	The context is reset and kept by the calling thread, which need
+**  	not be the one that got it.  Past ARC_MDCTX_CACHE idle contexts
+**  	it is freed instead.
+*/
+
+void
+arc_mdctx_put(EVP_MD_CTX *ctx)
+{
+	struct arc_mdctx_cache *cache;
+
+	if (ctx == NULL)
+		return;
+
+	(void) EVP_MD_CTX_reset(ctx);
+
+	cache = NULL;
+	if (arc_mdctx_keyok)
+	{
+		cache = pthread_getspecific(arc_mdctx_key);
+		if (cache == NULL)
+		{
+			cache = (struct arc_mdctx_cache *) malloc(sizeof *cache);
+			if (cache != NULL)
+			{
+				cache->mc_n = 0;
+				if (pthread_setspecific(arc_mdctx_key,
+				                        cache) != 0)
+				{
+					free(cache);
+					cache = NULL;
+				}
+			}
+		}
+	}
+
+	if (cache != NULL && cache->mc_n < ARC_MDCTX_CACHE)
+		cache->mc_ctx[cache->mc_n++] = ctx;
+	else
+		EVP_MD_CTX_free(ctx);
+}
@@ -0,0 +1,25 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#ifndef _ARC_CRYPTO_H_
+#define _ARC_CRYPTO_H_
+
+/* system includes */
+#include <sys/types.h>
+
+/* OpenSSL includes */
+#include <openssl/opensslv.h>
+#include <openssl/evp.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+/* prototypes */
+extern const EVP_MD *arc_md_sha1 __P((void));
+extern const EVP_MD *arc_md_sha256 __P((void));
+
+extern EVP_MD_CTX *arc_mdctx_get __P((void));
+extern void arc_mdctx_put __P((EVP_MD_CTX *));
+
+#endif /* ! _ARC_CRYPTO_H_ */
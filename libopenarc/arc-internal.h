@@ -93,6 +93,7 @@ typedef int arc_kvsettype_t;
 
 #define	ARC_KEYTYPE_UNKNOWN	(-1)
 #define	ARC_KEYTYPE_RSA		0
+#define	ARC_KEYTYPE_ED25519	1
 
 /*
 **  ARC_QUERY -- types of queries
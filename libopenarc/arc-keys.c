@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
@@ -52,20 +53,609 @@ extern void arc_error __P((ARC_MESSAGE *, const char *, ...));
 # define T_RRSIG		46
 #endif /* ! T_RRSIG */
 
+/* arc_keyflight states */
+#define	ARC_KF_STARTING		0	/* query being started */
+#define	ARC_KF_PENDING		1	/* query outstanding */
+#define	ARC_KF_COLLECTING	2	/* someone is waiting for the reply */
+#define	ARC_KF_DONE		3	/* result available */
+#define	ARC_KF_ABANDONED	4	/* query could not be started */
+#define	ARC_KF_TIMEOUT		(-1)	/* returned by arc_key_flight_wait() */
+
 /*
-**  ARC_GET_KEY_DNS -- retrieve a key from DNS
+**  struct arc_keyflight -- a key query shared by every message that needs
+**  the same key at the same time
+**
+**  Flights are kept on a list in the ARC_LIB while STARTING, PENDING or
+**  COLLECTING, and are removed from it when they become DONE or ABANDONED
+**  so that later lookups go to the key cache or start a new query.  The
+**  flight itself lives until the last reference is released.  All fields
+**  are protected by arcl_flightlock.
+*/
+
+struct arc_keyflight
+{
+	int			kf_state;
+	int			kf_dnssec;
+	u_int			kf_refcnt;
+	u_int			kf_ttl;
+	ARC_STAT		kf_status;
+	void *			kf_qh;
+	size_t			kf_anslen;
+	u_char *		kf_txt;
+	char *			kf_error;
+	struct arc_keyflight *	kf_next;
+	pthread_cond_t		kf_cond;
+	unsigned char		kf_qname[ARC_MAXHOSTNAMELEN + 1];
+	unsigned char		kf_ansbuf[MAXPACKET];
+};
+
+/* struct arc_keyquery -- a key query started ahead of need */
+struct arc_keyquery
+{
+	struct arc_keyflight *	kq_flight;
+	struct arc_keyquery *	kq_next;
+};
+
+/*
+**  ARC_KEY_DNSINIT -- make sure the resolver has been initialized
+**
+**  Parameters:
+**  	lib -- ARC_LIB handle
+**
+**  Return value:
+**  	TRUE on success, FALSE on failure.
+**
+**  Notes:
+**  	Any nameserver list set with ARC_OPTS_NAMESERVERS is applied to
+**  	the new service handle.
+*/
+
+static _Bool
+arc_key_dnsinit(ARC_LIB *lib)
+{
+	_Bool ret = TRUE;
+
+	pthread_mutex_lock(&lib->arcl_dnslock);
+
+	if (lib->arcl_dns_service == NULL && lib->arcl_dns_init != NULL)
+	{
+		if (lib->arcl_dns_init(&lib->arcl_dns_service) != 0)
+		{
+			lib->arcl_dns_service = NULL;
+			ret = FALSE;
+		}
+		else if (lib->arcl_nslist != NULL &&
+		         lib->arcl_dns_nslist != NULL &&
+		         lib->arcl_dns_nslist(lib->arcl_dns_service,
+		                              (char *) lib->arcl_nslist) != 0)
+		{
+			lib->arcl_dns_close(lib->arcl_dns_service);
+			lib->arcl_dns_service = NULL;
+			ret = FALSE;
+		}
+	}
+
+	pthread_mutex_unlock(&lib->arcl_dnslock);
+
+	return ret;
+}
+
+/*
+**  ARC_KEY_FLIGHT_UNLINK -- remove a flight from the list of live flights
+**
+**  Parameters:
+**  	lib -- ARC_LIB handle
+**  	kf -- flight to remove
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Caller must hold arcl_flightlock.  Does nothing if "kf" isn't on
+**  	the list.
+*/
+
+static void
+arc_key_flight_unlink(ARC_LIB *lib, struct arc_keyflight *kf)
+{
+	struct arc_keyflight **pp;
+
+	for (pp = &lib->arcl_keyflights; *pp != NULL; pp = &(*pp)->kf_next)
+	{
+		if (*pp == kf)
+		{
+			*pp = kf->kf_next;
+			kf->kf_next = NULL;
+			break;
+		}
+	}
+}
+
+/*
+**  ARC_KEY_FLIGHT_JOIN -- find or create the flight for a key name
+**
+**  Parameters:
+**  	lib -- ARC_LIB handle
+**  	qname -- key name (selector._domainkey.domain)
+**  	created -- set to TRUE iff a new flight was created (returned)
+**
+**  Return value:
+**  	The flight, with a reference held for the caller, or NULL if
+**  	memory could not be allocated.
+**
+**  Notes:
+**  	A caller that gets a new flight must start its query with
+**  	arc_key_flight_start(); everybody else waits for it.
+*/
+
+static struct arc_keyflight *
+arc_key_flight_join(ARC_LIB *lib, const u_char *qname, _Bool *created)
+{
+	struct arc_keyflight *kf;
+
+	assert(lib != NULL);
+	assert(qname != NULL);
+	assert(created != NULL);
+
+	*created = FALSE;
+
+	pthread_mutex_lock(&lib->arcl_flightlock);
+
+	for (kf = lib->arcl_keyflights; kf != NULL; kf = kf->kf_next)
+	{
+		if (strcasecmp((char *) kf->kf_qname, (char *) qname) == 0)
+		{
+			kf->kf_refcnt++;
+			pthread_mutex_unlock(&lib->arcl_flightlock);
+			return kf;
+		}
+	}
+
+	kf = (struct arc_keyflight *) malloc(sizeof *kf);
+	if (kf == NULL)
+	{
+		pthread_mutex_unlock(&lib->arcl_flightlock);
+		return NULL;
+	}
+
+	memset(kf, '\0', sizeof *kf);
+
+	if (pthread_cond_init(&kf->kf_cond, NULL) != 0)
+	{
+		pthread_mutex_unlock(&lib->arcl_flightlock);
+		free(kf);
+		return NULL;
+	}
+
+	strlcpy((char *) kf->kf_qname, (char *) qname, sizeof kf->kf_qname);
+	kf->kf_state = ARC_KF_STARTING;
+	kf->kf_refcnt = 1;
+	kf->kf_anslen = sizeof kf->kf_ansbuf;
+
+	kf->kf_next = lib->arcl_keyflights;
+	lib->arcl_keyflights = kf;
+
+	pthread_mutex_unlock(&lib->arcl_flightlock);
+
+	*created = TRUE;
+
+	return kf;
+}
+
+/*
+**  ARC_KEY_FLIGHT_START -- issue the query for a new flight
+**
+**  Parameters:
+**  	lib -- ARC_LIB handle
+**  	kf -- flight, as created by arc_key_flight_join()
+**
+**  Return value:
+**  	TRUE iff the query was started.  On failure the flight is
+**  	abandoned and anyone waiting on it will try again.
+*/
+
+static _Bool
+arc_key_flight_start(ARC_LIB *lib, struct arc_keyflight *kf)
+{
+	int status = -1;
+
+	assert(lib != NULL);
+	assert(kf != NULL);
+	assert(kf->kf_state == ARC_KF_STARTING);
+
+	if (arc_key_dnsinit(lib))
+	{
+		status = lib->arcl_dns_start(lib->arcl_dns_service, T_TXT,
+		                             kf->kf_qname, kf->kf_ansbuf,
+		                             kf->kf_anslen, &kf->kf_qh);
+	}
+
+	pthread_mutex_lock(&lib->arcl_flightlock);
+
+	if (status == 0)
+	{
+		kf->kf_state = ARC_KF_PENDING;
+	}
+	else
+	{
+		kf->kf_qh = NULL;
+		kf->kf_state = ARC_KF_ABANDONED;
+		arc_key_flight_unlink(lib, kf);
+	}
+
+	pthread_cond_broadcast(&kf->kf_cond);
+
+	pthread_mutex_unlock(&lib->arcl_flightlock);
+
+	return (status == 0);
+}
+
+/*
+**  ARC_KEY_FLIGHT_RELEASE -- drop a reference to a flight
+**
+**  Parameters:
+**  	lib -- ARC_LIB handle
+**  	kf -- flight
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	When the last reference goes away the flight is destroyed, and
+**  	a query nobody collected is cancelled.
+*/
+
+static void
+arc_key_flight_release(ARC_LIB *lib, struct arc_keyflight *kf)
+{
+	assert(lib != NULL);
+	assert(kf != NULL);
+
+	pthread_mutex_lock(&lib->arcl_flightlock);
+
+	assert(kf->kf_refcnt > 0);
+
+	if (--kf->kf_refcnt > 0)
+	{
+		pthread_mutex_unlock(&lib->arcl_flightlock);
+		return;
+	}
+
+	arc_key_flight_unlink(lib, kf);
+
+	if (kf->kf_qh != NULL)
+		(void) lib->arcl_dns_cancel(lib->arcl_dns_service, kf->kf_qh);
+
+	pthread_mutex_unlock(&lib->arcl_flightlock);
+
+	(void) pthread_cond_destroy(&kf->kf_cond);
+	if (kf->kf_txt != NULL)
+		free(kf->kf_txt);
+	if (kf->kf_error != NULL)
+		free(kf->kf_error);
+	free(kf);
+}
+
+/*
+**  ARC_KEY_FLIGHT_WAIT -- wait for a flight's result, or for the right to
+**                         collect it
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	kf -- flight
+**  	status -- the flight's result, if it has one (returned)
+**  	buf -- buffer to receive the key record
+**  	buflen -- bytes available at "buf"
+**  	ttl -- TTL of the record (returned; may be NULL)
+**
+**  Return value:
+**  	ARC_KF_COLLECTING -- the caller must now collect the reply and
+**  	                     call arc_key_flight_land()
+**  	ARC_KF_DONE -- "status" (and "buf", on success) has the result
+**  	ARC_KF_ABANDONED -- the query failed to start; try again
+**  	ARC_KF_TIMEOUT -- the message's timeout expired first
+**
+**  Notes:
+**  	Like arc_get_key_dns(), this honours the message timeout and calls
+**  	the DNS callback, if any, every arcl_callback_int seconds.
+*/
+
+static int
+arc_key_flight_wait(ARC_MESSAGE *msg, struct arc_keyflight *kf,
+                    ARC_STAT *status, u_char *buf, size_t buflen, u_int *ttl)
+{
+	int ret;
+	ARC_LIB *lib;
+	struct timeval master;
+	struct timeval next;
+	struct timeval *wt;
+	struct timespec ts;
+
+	assert(msg != NULL);
+	assert(kf != NULL);
+	assert(status != NULL);
+	assert(buf != NULL);
+
+	lib = msg->arc_library;
+
+	(void) gettimeofday(&master, NULL);
+	master.tv_sec += msg->arc_timeout;
+
+	pthread_mutex_lock(&lib->arcl_flightlock);
+
+	for (;;)
+	{
+		if (kf->kf_state == ARC_KF_PENDING)
+		{
+			kf->kf_state = ARC_KF_COLLECTING;
+			ret = ARC_KF_COLLECTING;
+			break;
+		}
+		else if (kf->kf_state == ARC_KF_DONE)
+		{
+			*status = kf->kf_status;
+			if (kf->kf_status == ARC_STAT_OK)
+			{
+				memset(buf, '\0', buflen);
+				strlcpy((char *) buf, (char *) kf->kf_txt, buflen);
+				if (ttl != NULL)
+					*ttl = kf->kf_ttl;
+				msg->arc_dnssec_key = kf->kf_dnssec;
+			}
+			else
+			{
+				arc_error(msg, "%s",
+				          kf->kf_error != NULL ? kf->kf_error
+				                               : "key query failed");
+			}
+
+			ret = ARC_KF_DONE;
+			break;
+		}
+		else if (kf->kf_state == ARC_KF_ABANDONED)
+		{
+			ret = ARC_KF_ABANDONED;
+			break;
+		}
+
+		/* STARTING or COLLECTING; wait for whoever is working on it */
+		wt = NULL;
+		if (msg->arc_timeout != 0)
+			wt = &master;
+		if (lib->arcl_dns_callback != NULL)
+		{
+			(void) gettimeofday(&next, NULL);
+			next.tv_sec += lib->arcl_callback_int;
+
+			if (wt == NULL || next.tv_sec < wt->tv_sec ||
+			    (next.tv_sec == wt->tv_sec &&
+			     next.tv_usec < wt->tv_usec))
+				wt = &next;
+		}
+
+		if (wt == NULL)
+		{
+			(void) pthread_cond_wait(&kf->kf_cond,
+			                         &lib->arcl_flightlock);
+			continue;
+		}
+
+		ts.tv_sec = wt->tv_sec;
+		ts.tv_nsec = wt->tv_usec * 1000;
+
+		if (pthread_cond_timedwait(&kf->kf_cond, &lib->arcl_flightlock,
+		                           &ts) != ETIMEDOUT)
+			continue;
+
+		if (wt == &master)
+		{
+			ret = ARC_KF_TIMEOUT;
+			break;
+		}
+
+		pthread_mutex_unlock(&lib->arcl_flightlock);
+		lib->arcl_dns_callback(msg->arc_user_context);
+		pthread_mutex_lock(&lib->arcl_flightlock);
+	}
+
+	pthread_mutex_unlock(&lib->arcl_flightlock);
+
+	return ret;
+}
+
+/*
+**  ARC_KEY_FLIGHT_LAND -- publish the result of a flight
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle of the collector
+**  	kf -- flight
+**  	status -- result of the query
+**  	txt -- key record (if "status" is ARC_STAT_OK)
+**  	ttl -- TTL of the key record
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	The result is also added to the key cache, so lookups that arrive
+**  	after the flight is gone find it there.
+*/
+
+static void
+arc_key_flight_land(ARC_MESSAGE *msg, struct arc_keyflight *kf,
+                    ARC_STAT status, u_char *txt, u_int ttl)
+{
+	ARC_LIB *lib;
+
+	assert(msg != NULL);
+	assert(kf != NULL);
+
+	lib = msg->arc_library;
+
+	if (status == ARC_STAT_OK)
+	{
+		arc_keycache_put(lib->arcl_keycache, (char *) kf->kf_qname,
+		                 ARC_STAT_OK, txt, ttl);
+	}
+	else if (status == ARC_STAT_NOKEY)
+	{
+		arc_keycache_put(lib->arcl_keycache, (char *) kf->kf_qname,
+		                 ARC_STAT_NOKEY, NULL,
+		                 lib->arcl_keycache_negttl);
+	}
+
+	pthread_mutex_lock(&lib->arcl_flightlock);
+
+	kf->kf_status = status;
+	kf->kf_ttl = ttl;
+	if (status == ARC_STAT_OK)
+	{
+		kf->kf_txt = (u_char *) strdup((char *) txt);
+		if (kf->kf_txt == NULL)
+			kf->kf_status = ARC_STAT_NORESOURCE;
+	}
+	if (kf->kf_status != ARC_STAT_OK && msg->arc_error != NULL)
+		kf->kf_error = strdup((char *) msg->arc_error);
+
+	kf->kf_state = ARC_KF_DONE;
+	arc_key_flight_unlink(lib, kf);
+
+	pthread_cond_broadcast(&kf->kf_cond);
+
+	pthread_mutex_unlock(&lib->arcl_flightlock);
+}
+
+/*
+**  ARC_KEY_PREFETCH -- start a key query whose answer will be needed later
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	selector -- selector
+**  	domain -- domain
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	The reply is collected by arc_get_key_dns().  Failures are silently
+**  	ignored here; arc_get_key_dns() will simply issue the query itself
+**  	and report any error then.  Nothing is done for names already
+**  	queried for this message or present in the key cache, and a query
+**  	another message already has in flight is joined rather than
+**  	repeated.
+*/
+
+void
+arc_key_prefetch(ARC_MESSAGE *msg, u_char *selector, u_char *domain)
+{
+	_Bool created;
+	int n;
+	ARC_LIB *lib;
+	struct arc_keyflight *kf;
+	struct arc_keyquery *kq;
+	unsigned char qname[ARC_MAXHOSTNAMELEN + 1];
+
+	assert(msg != NULL);
+
+	if (msg->arc_query != ARC_QUERY_DNS ||
+	    selector == NULL || domain == NULL)
+		return;
+
+	lib = msg->arc_library;
+
+	n = snprintf((char *) qname, sizeof qname, "%s.%s.%s",
+	             selector, ARC_DNSKEYNAME, domain);
+	if (n < 0 || n >= sizeof qname)
+		return;
+
+	for (kq = msg->arc_keyqueries; kq != NULL; kq = kq->kq_next)
+	{
+		if (kq->kq_flight != NULL &&
+		    strcasecmp((char *) kq->kq_flight->kf_qname,
+		               (char *) qname) == 0)
+			return;
+	}
+
+	if (arc_keycache_peek(lib->arcl_keycache, (char *) qname))
+		return;
+
+	kq = (struct arc_keyquery *) malloc(sizeof *kq);
+	if (kq == NULL)
+		return;
+
+	kf = arc_key_flight_join(lib, qname, &created);
+	if (kf == NULL)
+	{
+		free(kq);
+		return;
+	}
+
+	if (created && !arc_key_flight_start(lib, kf))
+	{
+		arc_key_flight_release(lib, kf);
+		free(kq);
+		return;
+	}
+
+	kq->kq_flight = kf;
+	kq->kq_next = msg->arc_keyqueries;
+	msg->arc_keyqueries = kq;
+}
+
+/*
+**  ARC_KEY_PREFETCH_CLEANUP -- release any prefetched queries
 **
 **  Parameters:
 **  	msg -- ARC_MESSAGE handle
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Queries no other message is sharing are cancelled.
+*/
+
+void
+arc_key_prefetch_cleanup(ARC_MESSAGE *msg)
+{
+	ARC_LIB *lib;
+	struct arc_keyquery *kq;
+	struct arc_keyquery *next;
+
+	assert(msg != NULL);
+
+	lib = msg->arc_library;
+
+	for (kq = msg->arc_keyqueries; kq != NULL; kq = next)
+	{
+		next = kq->kq_next;
+
+		if (kq->kq_flight != NULL)
+			arc_key_flight_release(lib, kq->kq_flight);
+
+		free(kq);
+	}
+
+	msg->arc_keyqueries = NULL;
+}
+
+/*
+**  ARC_KEY_FLIGHT_COLLECT -- wait for and decode the reply to a flight
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	kf -- flight, which the caller is collecting
 **  	buf -- buffer into which to write the result
 **  	buflen -- bytes available at "buf"
+**  	ttl -- TTL of the record found (returned)
 **
 **  Return value:
 **  	A ARC_STAT_* constant.
 */
 
-ARC_STAT
-arc_get_key_dns(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
+static ARC_STAT
+arc_key_flight_collect(ARC_MESSAGE *msg, struct arc_keyflight *kf,
+                       u_char *buf, size_t buflen, u_int *ttl)
 {
 	int status;
 	int qdcount;
@@ -77,54 +667,32 @@ arc_get_key_dns(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 	int rdlength = 0;
 	int type = -1;
 	int class = -1;
+	uint32_t rrttl = 0;
+	uint32_t txtttl = 0;
 	size_t anslen;
 	void *q;
 	ARC_LIB *lib;
 	unsigned char *txtfound = NULL;
+	unsigned char *ansbuf;
 	unsigned char *p;
 	unsigned char *cp;
 	unsigned char *eom;
 	unsigned char *eob;
 	unsigned char qname[ARC_MAXHOSTNAMELEN + 1];
-	unsigned char ansbuf[MAXPACKET];
 	struct timeval timeout;
 	HEADER hdr;
 
 	assert(msg != NULL);
-	assert(msg->arc_selector != NULL);
-	assert(msg->arc_domain != NULL);
+	assert(kf != NULL);
+	assert(kf->kf_state == ARC_KF_COLLECTING);
+	assert(ttl != NULL);
 
 	lib = msg->arc_library;
 
-	n = snprintf((char *) qname, sizeof qname - 1, "%s.%s.%s",
-	             msg->arc_selector, ARC_DNSKEYNAME, msg->arc_domain);
-	if (n == -1 || n > sizeof qname - 1)
-	{
-		arc_error(msg, "key query name too large");
-		return ARC_STAT_NORESOURCE;
-	}
-
-	anslen = sizeof ansbuf;
-
-	timeout.tv_sec = msg->arc_timeout;
-	timeout.tv_usec = 0;
-
-	if (lib->arcl_dns_service == NULL &&
-	    lib->arcl_dns_init != NULL &&
-	    lib->arcl_dns_init(&lib->arcl_dns_service) != 0)
-	{
-		arc_error(msg, "cannot initialize resolver");
-		return ARC_STAT_KEYFAIL;
-	}
-
-	status = lib->arcl_dns_start(lib->arcl_dns_service, T_TXT,
-	                              qname, ansbuf, anslen, &q);
-
-	if (status != 0)
-	{
-		arc_error(msg, "'%s' query failed", qname);
-		return ARC_STAT_KEYFAIL;
-	}
+	q = kf->kf_qh;
+	ansbuf = kf->kf_ansbuf;
+	anslen = kf->kf_anslen;
+	strlcpy((char *) qname, (char *) kf->kf_qname, sizeof qname);
 
 	if (lib->arcl_dns_callback == NULL)
 	{
@@ -178,27 +746,27 @@ arc_get_key_dns(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 		}
 	}
 
-	if (status == ARC_DNS_EXPIRED)
+	(void) lib->arcl_dns_cancel(lib->arcl_dns_service, q);
+	kf->kf_qh = NULL;
+
+	if (status == ARC_DNS_EXPIRED || status == ARC_DNS_NOREPLY)
 	{
-		(void) lib->arcl_dns_cancel(lib->arcl_dns_service, q);
 		arc_error(msg, "'%s' query timed out", qname);
 		return ARC_STAT_KEYFAIL;
 	}
 	else if (status == ARC_DNS_ERROR)
 	{
-		(void) lib->arcl_dns_cancel(lib->arcl_dns_service, q);
 		arc_error(msg, "'%s' query failed", qname);
 		return ARC_STAT_KEYFAIL;
 	}
 
-	(void) lib->arcl_dns_cancel(lib->arcl_dns_service, q);
-
 	msg->arc_dnssec_key = dnssec;
+	kf->kf_dnssec = dnssec;
 
 	/* set up pointers */
 	memcpy(&hdr, ansbuf, sizeof hdr);
-	cp = (u_char *) &ansbuf + HFIXEDSZ;
-	eom = (u_char *) &ansbuf + anslen;
+	cp = ansbuf + HFIXEDSZ;
+	eom = ansbuf + anslen;
 
 	/* skip over the name at the front of the answer */
 	for (qdcount = ntohs((unsigned short) hdr.qdcount);
@@ -206,7 +774,7 @@ arc_get_key_dns(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 	     qdcount--)
 	{
 		/* copy it first */
-		(void) dn_expand((unsigned char *) &ansbuf, eom, cp,
+		(void) dn_expand(ansbuf, eom, cp,
 		                 (char *) qname, sizeof qname);
  
 		if ((n = dn_skipname(cp, eom)) < 0)
@@ -259,7 +827,7 @@ arc_get_key_dns(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 	while (--ancount >= 0 && cp < eom)
 	{
 		/* grab the label, even though we know what we asked... */
-		if ((n = dn_expand((unsigned char *) &ansbuf, eom, cp,
+		if ((n = dn_expand(ansbuf, eom, cp,
 		                   (RES_UNC_T) qname, sizeof qname)) < 0)
 		{
 			arc_error(msg, "'%s' reply corrupt", qname);
@@ -277,8 +845,7 @@ arc_get_key_dns(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 
 		GETSHORT(type, cp);			/* TYPE */
 		GETSHORT(class, cp);			/* CLASS */
-		/* skip the TTL */
-		cp += INT32SZ;				/* TTL */
+		GETLONG(rrttl, cp);			/* TTL */
 		GETSHORT(n, cp);			/* RDLENGTH */
 
 		/* skip CNAME if found; assume it was resolved */
@@ -309,6 +876,7 @@ arc_get_key_dns(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 		/* remember where this one started */
 		txtfound = cp;
 		rdlength = n;
+		txtttl = rrttl;
 
 		/* move forward for now */
 		cp += n;
@@ -351,9 +919,121 @@ arc_get_key_dns(ARC_MESSAGE *msg, u_char *buf, size_t buflen)
 		}
 	}
 
+	*ttl = (u_int) txtttl;
+
 	return ARC_STAT_OK;
 }
 
+/*
+**  ARC_GET_KEY_DNS -- retrieve a key from DNS
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	buf -- buffer into which to write the result
+**  	buflen -- bytes available at "buf"
+**  	ttl -- TTL of the record found (returned; may be NULL)
+**
+**  Return value:
+**  	A ARC_STAT_* constant.
+**
+**  Notes:
+**  	Concurrent lookups of the same name share a single query: the
+**  	first caller (or arc_key_prefetch()) starts it, one caller collects
+**  	the reply, and the rest wait for that result, each subject to its
+**  	own message's timeout.  The result is also added to the key cache.
+*/
+
+ARC_STAT
+arc_get_key_dns(ARC_MESSAGE *msg, u_char *buf, size_t buflen, u_int *ttl)
+{
+	_Bool created;
+	int n;
+	int state;
+	u_int rttl = 0;
+	ARC_STAT status = ARC_STAT_KEYFAIL;
+	ARC_LIB *lib;
+	struct arc_keyflight *kf = NULL;
+	struct arc_keyquery *kq;
+	unsigned char qname[ARC_MAXHOSTNAMELEN + 1];
+
+	assert(msg != NULL);
+	assert(msg->arc_selector != NULL);
+	assert(msg->arc_domain != NULL);
+
+	lib = msg->arc_library;
+
+	n = snprintf((char *) qname, sizeof qname - 1, "%s.%s.%s",
+	             msg->arc_selector, ARC_DNSKEYNAME, msg->arc_domain);
+	if (n == -1 || n > sizeof qname - 1)
+	{
+		arc_error(msg, "key query name too large");
+		return ARC_STAT_NORESOURCE;
+	}
+
+	/* see if arc_eoh() already started this one */
+	for (kq = msg->arc_keyqueries; kq != NULL; kq = kq->kq_next)
+	{
+		if (kq->kq_flight != NULL &&
+		    strcasecmp((char *) kq->kq_flight->kf_qname,
+		               (char *) qname) == 0)
+		{
+			kf = kq->kq_flight;
+			kq->kq_flight = NULL;
+			break;
+		}
+	}
+
+	for (;;)
+	{
+		if (kf == NULL)
+		{
+			kf = arc_key_flight_join(lib, qname, &created);
+			if (kf == NULL)
+			{
+				arc_error(msg, "unable to allocate %d byte(s)",
+				          sizeof *kf);
+				return ARC_STAT_NORESOURCE;
+			}
+
+			if (created && !arc_key_flight_start(lib, kf))
+			{
+				arc_key_flight_release(lib, kf);
+				arc_error(msg, "'%s' query failed", qname);
+				return ARC_STAT_KEYFAIL;
+			}
+		}
+
+		state = arc_key_flight_wait(msg, kf, &status, buf, buflen,
+		                            &rttl);
+		if (state != ARC_KF_ABANDONED)
+			break;
+
+		/* whoever started it failed; try again ourselves */
+		arc_key_flight_release(lib, kf);
+		kf = NULL;
+	}
+
+	if (state == ARC_KF_TIMEOUT)
+	{
+		arc_key_flight_release(lib, kf);
+		arc_error(msg, "'%s' query timed out", qname);
+		return ARC_STAT_KEYFAIL;
+	}
+
+	if (state == ARC_KF_COLLECTING)
+	{
+		status = arc_key_flight_collect(msg, kf, buf, buflen, &rttl);
+		arc_key_flight_land(msg, kf, status, buf, rttl);
+	}
+
+	arc_key_flight_release(lib, kf);
+
+	if (status == ARC_STAT_OK && ttl != NULL)
+		*ttl = rttl;
+
+	return status;
+}
+
 /*
 **  ARC_GET_KEY_FILE -- retrieve a key from a text file (for testing)
 **
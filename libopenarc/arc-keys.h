@@ -12,7 +12,10 @@
 #include "arc.h"
 
 /* prototypes */
-extern ARC_STAT arc_get_key_dns __P((ARC_MESSAGE *, u_char *, size_t));
+extern ARC_STAT arc_get_key_dns __P((ARC_MESSAGE *, u_char *, size_t,
+                                     u_int *));
 extern ARC_STAT arc_get_key_file __P((ARC_MESSAGE *, u_char *, size_t));
+extern void arc_key_prefetch __P((ARC_MESSAGE *, u_char *, u_char *));
+extern void arc_key_prefetch_cleanup __P((ARC_MESSAGE *));
 
 #endif /* ! _ARC_KEYS_H_ */
@@ -0,0 +1,1476 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+/* for Solaris */
+#ifndef _REENTRANT
+# define _REENTRANT
+#endif /* ! REENTRANT */
+
+/* system includes */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <resolv.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+
+/* OpenSSL includes */
+#include <openssl/rand.h>
+
+/* libopenarc includes */
+#include "arc.h"
+#include "arc-internal.h"
+#include "arc-resolv.h"
+
+/* OpenARC includes */
+#include "build-config.h"
+
+/* macros, limits, etc. */
+#ifndef MAXPACKET
+# define MAXPACKET		8192
+#endif /* ! MAXPACKET */
+#ifndef _PATH_RESCONF
+# define _PATH_RESCONF		"/etc/resolv.conf"
+#endif /* ! _PATH_RESCONF */
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL		0
+#endif /* ! MSG_NOSIGNAL */
+
+#define	ARC_RESOLV_BUCKETS	256		/* query table buckets */
+#define	ARC_RESOLV_EDNSSIZE	1232		/* advertised UDP size */
+#define	ARC_RESOLV_QUERYSZ	(PACKETSZ + 2)	/* with TCP length prefix */
+
+/* query states */
+#define	ARC_RQ_UDP		0		/* awaiting UDP reply */
+#define	ARC_RQ_TCPCONNECT	1		/* TCP connect in progress */
+#define	ARC_RQ_TCPWRITE		2		/* TCP query being sent */
+#define	ARC_RQ_TCPREAD		3		/* TCP reply being read */
+#define	ARC_RQ_DONE		4		/* reply available */
+#define	ARC_RQ_EXPIRED		5		/* retries exhausted */
+#define	ARC_RQ_ERROR		6		/* hard error */
+
+/*
+**  Built-in non-blocking resolver
+**
+**  Queries are sent over UDP as soon as they are started.  Each one
+**  has a socket of its own, so like res_nsend() it goes out from a
+**  fresh source port that a forged reply has to guess along with the
+**  ID.  A single thread per service handle waits for replies, matches
+**  them to outstanding queries by socket, ID, source and question,
+**  retransmits to the next nameserver on timeout and falls back to TCP
+**  when a reply is truncated.  Callers block only in
+**  arc_resolv_waitreply(), and only for as long as they ask to.
+*/
+
+struct arc_resolv_query
+{
+	_Bool			rq_edns;
+	int			rq_state;
+	int			rq_error;
+	int			rq_tries;
+	int			rq_sent;
+	int			rq_ns;
+	int			rq_udpfd;
+	int			rq_udpfamily;
+	int			rq_tcpfd;
+	uint16_t		rq_id;
+	size_t			rq_qlen;
+	size_t			rq_qdend;
+	size_t			rq_tcpoff;
+	size_t			rq_tcplen;
+	size_t			rq_buflen;
+	size_t			rq_anslen;
+	struct timeval		rq_deadline;
+	unsigned char *		rq_buf;
+	struct arc_resolv_query * rq_next;
+	unsigned char		rq_lenbuf[2];
+	unsigned char		rq_query[ARC_RESOLV_QUERYSZ];
+};
+
+struct arc_resolv
+{
+	_Bool			rs_running;
+	_Bool			rs_shutdown;
+	int			rs_nscount;
+	int			rs_timeout;
+	int			rs_attempts;
+	int			rs_pipe[2];
+	u_int			rs_pending;
+	u_int			rs_pfdalloc;
+	struct pollfd *		rs_pfds;
+	uint16_t *		rs_pfdids;
+	pthread_t		rs_thread;
+	pthread_mutex_t		rs_lock;
+	pthread_cond_t		rs_cond;
+	socklen_t		rs_nslen[ARC_RESOLV_MAXNS];
+	struct sockaddr_storage	rs_ns[ARC_RESOLV_MAXNS];
+	struct arc_resolv_query * rs_queries[ARC_RESOLV_BUCKETS];
+};
+
+/*
+**  ARC_RESOLV_NONBLOCK -- make a descriptor non-blocking and close-on-exec
+**
+**  Parameters:
+**  	fd -- descriptor
+**
+**  Return value:
+**  	0 on success, -1 on failure.
+*/
+
+static int
+arc_resolv_nonblock(int fd)
+{
+	int flags;
+
+	flags = fcntl(fd, F_GETFL, 0);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+		return -1;
+
+	(void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	return 0;
+}
+
+/*
+**  ARC_RESOLV_WAKE -- wake up the I/O thread
+**
+**  Parameters:
+**  	rs -- service handle
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_resolv_wake(struct arc_resolv *rs)
+{
+	ssize_t wlen;
+	char c = 0;
+
+	wlen = write(rs->rs_pipe[1], &c, 1);
+	(void) wlen;
+}
+
+/*
+**  ARC_RESOLV_TVADD -- set a deadline some seconds from now
+**
+**  Parameters:
+**  	tv -- deadline (updated)
+**  	now -- current time
+**  	secs -- seconds to add
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_resolv_tvadd(struct timeval *tv, struct timeval *now, int secs)
+{
+	tv->tv_sec = now->tv_sec + secs;
+	tv->tv_usec = now->tv_usec;
+}
+
+/*
+**  ARC_RESOLV_ADDNS -- parse and add a nameserver address
+**
+**  Parameters:
+**  	rs -- service handle
+**  	ns -- address, optionally with port ("a.b.c.d:port" or "[v6]:port")
+**
+**  Return value:
+**  	0 on success, -1 on failure.
+*/
+
+static int
+arc_resolv_addns(struct arc_resolv *rs, const char *ns)
+{
+	int status;
+	char *p;
+	char *port = "53";
+	struct addrinfo hints;
+	struct addrinfo *ai;
+	char host[NI_MAXHOST + 1];
+
+	if (rs->rs_nscount >= ARC_RESOLV_MAXNS)
+		return 0;
+
+	if (strlen(ns) >= sizeof host)
+		return -1;
+	strcpy(host, ns);
+
+	if (host[0] == '[')
+	{
+		p = strchr(host, ']');
+		if (p == NULL)
+			return -1;
+		*p = '\0';
+		if (*(p + 1) == ':')
+			port = p + 2;
+		else if (*(p + 1) != '\0')
+			return -1;
+		memmove(host, host + 1, strlen(host + 1) + 1);
+	}
+	else
+	{
+		p = strchr(host, ':');
+		if (p != NULL && strchr(p + 1, ':') == NULL)
+		{
+			*p = '\0';
+			port = p + 1;
+		}
+	}
+
+	memset(&hints, '\0', sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+	status = getaddrinfo(host, port, &hints, &ai);
+	if (status != 0)
+		return -1;
+
+	memcpy(&rs->rs_ns[rs->rs_nscount], ai->ai_addr, ai->ai_addrlen);
+	rs->rs_nslen[rs->rs_nscount] = ai->ai_addrlen;
+	rs->rs_nscount++;
+
+	freeaddrinfo(ai);
+
+	return 0;
+}
+
+/*
+**  ARC_RESOLV_READCONF -- load nameservers and options from resolv.conf
+**
+**  Parameters:
+**  	rs -- service handle
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_resolv_readconf(struct arc_resolv *rs)
+{
+	int n;
+	char *p;
+	char *last;
+	char *word;
+	FILE *f;
+	char buf[BUFSIZ];
+
+	f = fopen(_PATH_RESCONF, "r");
+	if (f != NULL)
+	{
+		while (fgets(buf, sizeof buf, f) != NULL)
+		{
+			word = strtok_r(buf, " \t\r\n", &last);
+			if (word == NULL || word[0] == '#' || word[0] == ';')
+				continue;
+
+			if (strcmp(word, "nameserver") == 0)
+			{
+				p = strtok_r(NULL, " \t\r\n", &last);
+				if (p != NULL)
+					(void) arc_resolv_addns(rs, p);
+			}
+			else if (strcmp(word, "options") == 0)
+			{
+				while ((p = strtok_r(NULL, " \t\r\n",
+				                     &last)) != NULL)
+				{
+					if (strncmp(p, "timeout:", 8) == 0)
+					{
+						n = atoi(p + 8);
+						if (n > 0)
+							rs->rs_timeout = n;
+					}
+					else if (strncmp(p, "attempts:", 9) == 0)
+					{
+						n = atoi(p + 9);
+						if (n > 0)
+							rs->rs_attempts = n;
+					}
+				}
+			}
+		}
+
+		fclose(f);
+	}
+
+	if (rs->rs_nscount == 0)
+		(void) arc_resolv_addns(rs, "127.0.0.1");
+}
+
+/*
+**  ARC_RESOLV_MKQUERY -- construct a query packet
+**
+**  Parameters:
+**  	rq -- query handle; rq_id and rq_edns must be set
+**  	name -- name to query
+**  	type -- RR type
+**
+**  Return value:
+**  	0 on success, -1 if "name" can't be encoded.
+**
+**  Notes:
+**  	The packet is written at rq_query + 2 so the same buffer can be
+**  	sent over TCP with its length prefix.
+*/
+
+static int
+arc_resolv_mkquery(struct arc_resolv_query *rq, const char *name, int type)
+{
+	size_t llen;
+	const char *l;
+	const char *dot;
+	unsigned char *p;
+	unsigned char *start;
+	unsigned char *end;
+
+	start = rq->rq_query + 2;
+	end = rq->rq_query + sizeof rq->rq_query;
+	p = start;
+
+	memset(p, '\0', HFIXEDSZ);
+	p[0] = (rq->rq_id >> 8) & 0xff;
+	p[1] = rq->rq_id & 0xff;
+	p[2] = 0x01;				/* RD */
+	p[5] = 1;				/* QDCOUNT */
+	if (rq->rq_edns)
+		p[11] = 1;			/* ARCOUNT */
+	p += HFIXEDSZ;
+
+	for (l = name; *l != '\0'; l = dot + 1)
+	{
+		dot = strchr(l, '.');
+		llen = (dot == NULL) ? strlen(l) : (size_t) (dot - l);
+
+		if (llen == 0 || llen > 63 || p + llen + 1 >= end)
+			return -1;
+
+		*p++ = (unsigned char) llen;
+		memcpy(p, l, llen);
+		p += llen;
+
+		if (dot == NULL)
+			break;
+	}
+
+	if (p + 1 - (start + HFIXEDSZ) > MAXCDNAME || p + 1 + 4 + 11 > end)
+		return -1;
+
+	*p++ = 0;
+	PUTSHORT(type, p);
+	PUTSHORT(C_IN, p);
+
+	rq->rq_qdend = p - start;
+
+	if (rq->rq_edns)
+	{
+		*p++ = 0;			/* root */
+		PUTSHORT(T_OPT, p);
+		PUTSHORT(ARC_RESOLV_EDNSSIZE, p);
+		PUTLONG(0, p);			/* rcode, version, flags */
+		PUTSHORT(0, p);			/* RDLENGTH */
+	}
+
+	rq->rq_qlen = p - start;
+	rq->rq_query[0] = (rq->rq_qlen >> 8) & 0xff;
+	rq->rq_query[1] = rq->rq_qlen & 0xff;
+
+	return 0;
+}
+
+/*
+**  ARC_RESOLV_FIND -- find an outstanding query by ID
+**
+**  Parameters:
+**  	rs -- service handle
+**  	id -- query ID
+**
+**  Return value:
+**  	The query, or NULL if none is outstanding with that ID.
+*/
+
+static struct arc_resolv_query *
+arc_resolv_find(struct arc_resolv *rs, uint16_t id)
+{
+	struct arc_resolv_query *rq;
+
+	for (rq = rs->rs_queries[id % ARC_RESOLV_BUCKETS];
+	     rq != NULL;
+	     rq = rq->rq_next)
+	{
+		if (rq->rq_id == id)
+			return rq;
+	}
+
+	return NULL;
+}
+
+/*
+**  ARC_RESOLV_FINISH -- mark a query as complete
+**
+**  Parameters:
+**  	rq -- query handle
+**  	state -- final state
+**  	error -- error code to report, if any
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_resolv_finish(struct arc_resolv_query *rq, int state, int error)
+{
+	if (rq->rq_udpfd != -1)
+	{
+		close(rq->rq_udpfd);
+		rq->rq_udpfd = -1;
+	}
+
+	if (rq->rq_tcpfd != -1)
+	{
+		close(rq->rq_tcpfd);
+		rq->rq_tcpfd = -1;
+	}
+
+	rq->rq_state = state;
+	rq->rq_error = error;
+}
+
+/*
+**  ARC_RESOLV_SEND -- (re)transmit a query over UDP
+**
+**  Parameters:
+**  	rs -- service handle
+**  	rq -- query handle
+**  	now -- current time
+**
+**  Return value:
+**  	None.  rq_state is updated if there's nothing left to try.
+**
+**  Notes:
+**  	The query's socket is opened on first use and kept for retries,
+**  	so a late reply to an earlier try can still be taken; it is
+**  	replaced only when the next nameserver is of another family.
+*/
+
+static void
+arc_resolv_send(struct arc_resolv *rs, struct arc_resolv_query *rq,
+                struct timeval *now)
+{
+	int fd;
+	int ns;
+	int family;
+	ssize_t wlen;
+
+	while (rq->rq_tries < rs->rs_nscount * rs->rs_attempts)
+	{
+		ns = rq->rq_tries % rs->rs_nscount;
+		rq->rq_tries++;
+
+		family = rs->rs_ns[ns].ss_family;
+		if (rq->rq_udpfd != -1 && rq->rq_udpfamily != family)
+		{
+			close(rq->rq_udpfd);
+			rq->rq_udpfd = -1;
+		}
+
+		if (rq->rq_udpfd == -1)
+		{
+			fd = socket(family, SOCK_DGRAM, 0);
+			if (fd == -1)
+			{
+				rq->rq_error = errno;
+				continue;
+			}
+
+			if (arc_resolv_nonblock(fd) != 0)
+			{
+				rq->rq_error = errno;
+				close(fd);
+				continue;
+			}
+
+			rq->rq_udpfd = fd;
+			rq->rq_udpfamily = family;
+		}
+
+		wlen = sendto(rq->rq_udpfd, rq->rq_query + 2, rq->rq_qlen, 0,
+		              (struct sockaddr *) &rs->rs_ns[ns],
+		              rs->rs_nslen[ns]);
+		if (wlen != (ssize_t) rq->rq_qlen)
+		{
+			rq->rq_error = errno;
+			continue;
+		}
+
+		rq->rq_ns = ns;
+		rq->rq_sent++;
+		rq->rq_state = ARC_RQ_UDP;
+		arc_resolv_tvadd(&rq->rq_deadline, now, rs->rs_timeout);
+		return;
+	}
+
+	if (rq->rq_sent > 0)
+		arc_resolv_finish(rq, ARC_RQ_EXPIRED, ETIMEDOUT);
+	else
+		arc_resolv_finish(rq, ARC_RQ_ERROR, rq->rq_error);
+}
+
+/*
+**  ARC_RESOLV_TCPSTART -- begin retrying a truncated query over TCP
+**
+**  Parameters:
+**  	rs -- service handle
+**  	rq -- query handle
+**  	now -- current time
+**
+**  Return value:
+**  	None.  rq_state is updated.
+*/
+
+static void
+arc_resolv_tcpstart(struct arc_resolv *rs, struct arc_resolv_query *rq,
+                    struct timeval *now)
+{
+	int fd;
+	struct sockaddr *sa;
+
+	sa = (struct sockaddr *) &rs->rs_ns[rq->rq_ns];
+
+	fd = socket(sa->sa_family, SOCK_STREAM, 0);
+	if (fd == -1)
+	{
+		arc_resolv_finish(rq, ARC_RQ_ERROR, errno);
+		return;
+	}
+
+	if (arc_resolv_nonblock(fd) != 0)
+	{
+		arc_resolv_finish(rq, ARC_RQ_ERROR, errno);
+		close(fd);
+		return;
+	}
+
+	rq->rq_tcpfd = fd;
+	rq->rq_tcpoff = 0;
+	arc_resolv_tvadd(&rq->rq_deadline, now, rs->rs_timeout);
+
+	if (connect(fd, sa, rs->rs_nslen[rq->rq_ns]) == 0)
+		rq->rq_state = ARC_RQ_TCPWRITE;
+	else if (errno == EINPROGRESS)
+		rq->rq_state = ARC_RQ_TCPCONNECT;
+	else
+		arc_resolv_finish(rq, ARC_RQ_ERROR, errno);
+}
+
+/*
+**  ARC_RESOLV_FROMNS -- see whether an address is one of our nameservers
+**
+**  Parameters:
+**  	rs -- service handle
+**  	sa -- address
+**
+**  Return value:
+**  	TRUE iff "sa" matches a configured nameserver address and port.
+*/
+
+static _Bool
+arc_resolv_fromns(struct arc_resolv *rs, struct sockaddr_storage *sa)
+{
+	int c;
+
+	for (c = 0; c < rs->rs_nscount; c++)
+	{
+		if (rs->rs_ns[c].ss_family != sa->ss_family)
+			continue;
+
+		if (sa->ss_family == AF_INET)
+		{
+			struct sockaddr_in *a;
+			struct sockaddr_in *b;
+
+			a = (struct sockaddr_in *) sa;
+			b = (struct sockaddr_in *) &rs->rs_ns[c];
+			if (a->sin_port == b->sin_port &&
+			    a->sin_addr.s_addr == b->sin_addr.s_addr)
+				return TRUE;
+		}
+#ifdef AF_INET6
+		else if (sa->ss_family == AF_INET6)
+		{
+			struct sockaddr_in6 *a;
+			struct sockaddr_in6 *b;
+
+			a = (struct sockaddr_in6 *) sa;
+			b = (struct sockaddr_in6 *) &rs->rs_ns[c];
+			if (a->sin6_port == b->sin6_port &&
+			    memcmp(&a->sin6_addr, &b->sin6_addr,
+			           sizeof a->sin6_addr) == 0)
+				return TRUE;
+		}
+#endif /* AF_INET6 */
+	}
+
+	return FALSE;
+}
+
+/*
+**  ARC_RESOLV_MATCH -- see whether a reply answers a given query
+**
+**  Parameters:
+**  	rq -- query handle
+**  	buf -- reply
+**  	len -- reply length
+**
+**  Return value:
+**  	TRUE iff the reply carries the query's ID and question.
+*/
+
+static _Bool
+arc_resolv_match(struct arc_resolv_query *rq, unsigned char *buf, size_t len)
+{
+	size_t c;
+	unsigned char *q;
+
+	if (len < rq->rq_qdend)
+		return FALSE;
+
+	q = rq->rq_query + 2;
+
+	if (buf[0] != q[0] || buf[1] != q[1] ||	/* ID */
+	    (buf[2] & 0x80) == 0 ||		/* QR */
+	    buf[4] != 0 || buf[5] != 1)		/* QDCOUNT */
+		return FALSE;
+
+	for (c = HFIXEDSZ; c < rq->rq_qdend; c++)
+	{
+		if (tolower(buf[c]) != tolower(q[c]))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+**  ARC_RESOLV_UDPREPLY -- handle a datagram from a nameserver
+**
+**  Parameters:
+**  	rs -- service handle
+**  	rq -- query whose socket it arrived on
+**  	buf -- reply
+**  	len -- reply length
+**  	now -- current time
+**
+**  Return value:
+**  	TRUE iff a query changed state.
+*/
+
+static _Bool
+arc_resolv_udpreply(struct arc_resolv *rs, struct arc_resolv_query *rq,
+                    unsigned char *buf, size_t len, struct timeval *now)
+{
+	int rcode;
+
+	if (len < HFIXEDSZ || rq->rq_state != ARC_RQ_UDP ||
+	    !arc_resolv_match(rq, buf, len))
+		return FALSE;
+
+	rcode = buf[3] & 0x0f;
+
+	/* an old server that doesn't like EDNS; ask again without it */
+	if (rcode == FORMERR && rq->rq_edns)
+	{
+		rq->rq_edns = FALSE;
+		rq->rq_query[2 + 11] = 0;
+		rq->rq_qlen = rq->rq_qdend;
+		rq->rq_query[0] = (rq->rq_qlen >> 8) & 0xff;
+		rq->rq_query[1] = rq->rq_qlen & 0xff;
+		rq->rq_tries--;
+		arc_resolv_send(rs, rq, now);
+		return rq->rq_state != ARC_RQ_UDP;
+	}
+
+	/* this server can't help; try the next one if there is one */
+	if ((rcode == SERVFAIL || rcode == REFUSED) &&
+	    rq->rq_tries < rs->rs_nscount * rs->rs_attempts)
+	{
+		arc_resolv_send(rs, rq, now);
+		return rq->rq_state != ARC_RQ_UDP;
+	}
+
+	/* truncated; retry over TCP */
+	if ((buf[2] & 0x02) != 0)
+	{
+		arc_resolv_tcpstart(rs, rq, now);
+		return rq->rq_state == ARC_RQ_ERROR;
+	}
+
+	rq->rq_anslen = MIN(len, rq->rq_buflen);
+	memcpy(rq->rq_buf, buf, rq->rq_anslen);
+	arc_resolv_finish(rq, ARC_RQ_DONE, 0);
+
+	return TRUE;
+}
+
+/*
+**  ARC_RESOLV_TCPIO -- make progress on a TCP exchange
+**
+**  Parameters:
+**  	rq -- query handle
+**
+**  Return value:
+**  	TRUE iff the query changed to a final state.
+*/
+
+static _Bool
+arc_resolv_tcpio(struct arc_resolv_query *rq)
+{
+	int err;
+	ssize_t n;
+	size_t want;
+	socklen_t errlen;
+
+	if (rq->rq_state == ARC_RQ_TCPCONNECT)
+	{
+		err = 0;
+		errlen = sizeof err;
+		if (getsockopt(rq->rq_tcpfd, SOL_SOCKET, SO_ERROR,
+		               &err, &errlen) != 0)
+			err = errno;
+		if (err != 0)
+		{
+			arc_resolv_finish(rq, ARC_RQ_ERROR, err);
+			return TRUE;
+		}
+
+		rq->rq_state = ARC_RQ_TCPWRITE;
+	}
+
+	if (rq->rq_state == ARC_RQ_TCPWRITE)
+	{
+		n = send(rq->rq_tcpfd, rq->rq_query + rq->rq_tcpoff,
+		         rq->rq_qlen + 2 - rq->rq_tcpoff, MSG_NOSIGNAL);
+		if (n == -1)
+		{
+			if (errno == EAGAIN || errno == EINTR)
+				return FALSE;
+			arc_resolv_finish(rq, ARC_RQ_ERROR, errno);
+			return TRUE;
+		}
+
+		rq->rq_tcpoff += n;
+		if (rq->rq_tcpoff < rq->rq_qlen + 2)
+			return FALSE;
+
+		rq->rq_state = ARC_RQ_TCPREAD;
+		rq->rq_tcpoff = 0;
+		return FALSE;
+	}
+
+	if (rq->rq_state != ARC_RQ_TCPREAD)
+		return FALSE;
+
+	if (rq->rq_tcpoff < 2)
+	{
+		n = recv(rq->rq_tcpfd, rq->rq_lenbuf + rq->rq_tcpoff,
+		         2 - rq->rq_tcpoff, 0);
+	}
+	else
+	{
+		want = MIN(rq->rq_tcplen, rq->rq_buflen) - (rq->rq_tcpoff - 2);
+		n = recv(rq->rq_tcpfd, rq->rq_buf + rq->rq_tcpoff - 2,
+		         want, 0);
+	}
+
+	if (n == -1)
+	{
+		if (errno == EAGAIN || errno == EINTR)
+			return FALSE;
+		arc_resolv_finish(rq, ARC_RQ_ERROR, errno);
+		return TRUE;
+	}
+	else if (n == 0)
+	{
+		arc_resolv_finish(rq, ARC_RQ_ERROR, ECONNRESET);
+		return TRUE;
+	}
+
+	rq->rq_tcpoff += n;
+
+	if (rq->rq_tcpoff == 2)
+	{
+		rq->rq_tcplen = (rq->rq_lenbuf[0] << 8) | rq->rq_lenbuf[1];
+		if (rq->rq_tcplen < HFIXEDSZ)
+		{
+			arc_resolv_finish(rq, ARC_RQ_ERROR, EPROTO);
+			return TRUE;
+		}
+		return FALSE;
+	}
+
+	if (rq->rq_tcpoff - 2 < MIN(rq->rq_tcplen, rq->rq_buflen))
+		return FALSE;
+
+	rq->rq_anslen = rq->rq_tcpoff - 2;
+	if (!arc_resolv_match(rq, rq->rq_buf, rq->rq_anslen))
+		arc_resolv_finish(rq, ARC_RQ_ERROR, EPROTO);
+	else
+		arc_resolv_finish(rq, ARC_RQ_DONE, 0);
+
+	return TRUE;
+}
+
+/*
+**  ARC_RESOLV_LOOP -- I/O thread
+**
+**  Parameters:
+**  	arg -- service handle
+**
+**  Return value:
+**  	Always NULL.
+*/
+
+static void *
+arc_resolv_loop(void *arg)
+{
+	_Bool done;
+	int c;
+	int n;
+	int fd;
+	int ms;
+	u_int nfds;
+	u_int want;
+	ssize_t rlen;
+	long left;
+	struct arc_resolv *rs;
+	struct arc_resolv_query *rq;
+	struct arc_resolv_query *next;
+	struct timeval now;
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	unsigned char buf[MAXPACKET];
+
+	rs = arg;
+
+	pthread_mutex_lock(&rs->rs_lock);
+
+	for (;;)
+	{
+		if (rs->rs_shutdown)
+			break;
+
+		/* make room for every descriptor we might watch */
+		want = rs->rs_pending + 1;
+		if (want > rs->rs_pfdalloc)
+		{
+			struct pollfd *newpfds;
+			uint16_t *newids;
+
+			newpfds = realloc(rs->rs_pfds,
+			                  want * sizeof(struct pollfd));
+			if (newpfds != NULL)
+				rs->rs_pfds = newpfds;
+			newids = realloc(rs->rs_pfdids, want * sizeof(uint16_t));
+			if (newids != NULL)
+				rs->rs_pfdids = newids;
+			if (newpfds != NULL && newids != NULL)
+				rs->rs_pfdalloc = want;
+		}
+
+		nfds = 0;
+		rs->rs_pfds[nfds].fd = rs->rs_pipe[0];
+		rs->rs_pfds[nfds++].events = POLLIN;
+
+		/* work out the poll() timeout, and each query's socket */
+		(void) gettimeofday(&now, NULL);
+		ms = -1;
+		for (c = 0; c < ARC_RESOLV_BUCKETS; c++)
+		{
+			for (rq = rs->rs_queries[c]; rq != NULL; rq = rq->rq_next)
+			{
+				if (rq->rq_state >= ARC_RQ_DONE)
+					continue;
+
+				left = (rq->rq_deadline.tv_sec - now.tv_sec) * 1000 +
+				       (rq->rq_deadline.tv_usec - now.tv_usec) / 1000;
+				if (left < 0)
+					left = 0;
+				if (ms == -1 || left < ms)
+					ms = (int) left;
+
+				if (rq->rq_state == ARC_RQ_UDP)
+					fd = rq->rq_udpfd;
+				else
+					fd = rq->rq_tcpfd;
+
+				if (fd == -1 || nfds >= rs->rs_pfdalloc)
+					continue;
+
+				rs->rs_pfds[nfds].fd = fd;
+				if (rq->rq_state == ARC_RQ_TCPCONNECT ||
+				    rq->rq_state == ARC_RQ_TCPWRITE)
+					rs->rs_pfds[nfds].events = POLLOUT;
+				else
+					rs->rs_pfds[nfds].events = POLLIN;
+				rs->rs_pfdids[nfds] = rq->rq_id;
+				nfds++;
+			}
+		}
+
+		pthread_mutex_unlock(&rs->rs_lock);
+
+		for (c = 0; c < nfds; c++)
+			rs->rs_pfds[c].revents = 0;
+
+		n = poll(rs->rs_pfds, nfds, ms);
+
+		pthread_mutex_lock(&rs->rs_lock);
+
+		if (rs->rs_shutdown)
+			break;
+
+		(void) gettimeofday(&now, NULL);
+		done = FALSE;
+
+		if (n > 0 && (rs->rs_pfds[0].revents & POLLIN) != 0)
+		{
+			while (read(rs->rs_pipe[0], buf, sizeof buf) > 0)
+				continue;
+		}
+
+		/* replies and TCP progress; queries may be gone meanwhile */
+		for (c = 1; n > 0 && c < nfds; c++)
+		{
+			if (rs->rs_pfds[c].revents == 0)
+				continue;
+
+			rq = arc_resolv_find(rs, rs->rs_pfdids[c]);
+			if (rq == NULL)
+				continue;
+
+			fd = rs->rs_pfds[c].fd;
+
+			if (rq->rq_tcpfd == fd)
+			{
+				if (arc_resolv_tcpio(rq))
+					done = TRUE;
+				continue;
+			}
+
+			while (rq->rq_state == ARC_RQ_UDP && rq->rq_udpfd == fd)
+			{
+				fromlen = sizeof from;
+				rlen = recvfrom(fd, buf, sizeof buf, 0,
+				                (struct sockaddr *) &from,
+				                &fromlen);
+				if (rlen < 0)
+					break;
+
+				if (!arc_resolv_fromns(rs, &from))
+					continue;
+
+				if (arc_resolv_udpreply(rs, rq, buf,
+				                        (size_t) rlen, &now))
+					done = TRUE;
+			}
+		}
+
+		/* timeouts */
+		for (c = 0; c < ARC_RESOLV_BUCKETS; c++)
+		{
+			for (rq = rs->rs_queries[c]; rq != NULL; rq = next)
+			{
+				next = rq->rq_next;
+
+				if (rq->rq_state >= ARC_RQ_DONE ||
+				    timercmp(&now, &rq->rq_deadline, <))
+					continue;
+
+				if (rq->rq_state == ARC_RQ_UDP)
+					arc_resolv_send(rs, rq, &now);
+				else
+					arc_resolv_finish(rq, ARC_RQ_EXPIRED,
+					                  ETIMEDOUT);
+
+				if (rq->rq_state >= ARC_RQ_DONE)
+					done = TRUE;
+			}
+		}
+
+		if (done)
+			pthread_cond_broadcast(&rs->rs_cond);
+	}
+
+	pthread_mutex_unlock(&rs->rs_lock);
+
+	return NULL;
+}
+
+/*
+**  ARC_RESOLV_INIT -- initialize the resolver
+**
+**  Parameters:
+**  	srv -- service handle (returned)
+**
+**  Return value
+**  	0 on success, !0 on failure
+*/
+
+int
+arc_resolv_init(void **srv)
+{
+	int status;
+	struct arc_resolv *rs;
+	sigset_t all;
+	sigset_t old;
+
+	assert(srv != NULL);
+
+	rs = (struct arc_resolv *) malloc(sizeof *rs);
+	if (rs == NULL)
+		return -1;
+
+	memset(rs, '\0', sizeof *rs);
+	rs->rs_timeout = ARC_RESOLV_DEFTIMEOUT;
+	rs->rs_attempts = ARC_RESOLV_DEFATTEMPTS;
+	rs->rs_pipe[0] = -1;
+	rs->rs_pipe[1] = -1;
+
+	arc_resolv_readconf(rs);
+
+	rs->rs_pfdalloc = 1;
+	rs->rs_pfds = malloc(rs->rs_pfdalloc * sizeof(struct pollfd));
+	rs->rs_pfdids = malloc(rs->rs_pfdalloc * sizeof(uint16_t));
+	if (rs->rs_pfds == NULL || rs->rs_pfdids == NULL)
+	{
+		arc_resolv_close(rs);
+		return -1;
+	}
+
+	if (pipe(rs->rs_pipe) != 0)
+	{
+		rs->rs_pipe[0] = -1;
+		rs->rs_pipe[1] = -1;
+		arc_resolv_close(rs);
+		return -1;
+	}
+	(void) arc_resolv_nonblock(rs->rs_pipe[0]);
+	(void) arc_resolv_nonblock(rs->rs_pipe[1]);
+
+	pthread_mutex_init(&rs->rs_lock, NULL);
+	pthread_cond_init(&rs->rs_cond, NULL);
+
+	/* the I/O thread should never take the application's signals */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	status = pthread_create(&rs->rs_thread, NULL, arc_resolv_loop, rs);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (status != 0)
+	{
+		pthread_cond_destroy(&rs->rs_cond);
+		pthread_mutex_destroy(&rs->rs_lock);
+		arc_resolv_close(rs);
+		return -1;
+	}
+
+	rs->rs_running = TRUE;
+	*srv = rs;
+
+	return 0;
+}
+
+/*
+**  ARC_RESOLV_CLOSE -- shut down the resolver
+**
+**  Parameters:
+**  	srv -- service handle
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Any queries still outstanding are discarded; no other thread
+**  	may be using the handle at this point.
+*/
+
+void
+arc_resolv_close(void *srv)
+{
+	int c;
+	struct arc_resolv *rs;
+	struct arc_resolv_query *rq;
+	struct arc_resolv_query *next;
+
+	rs = srv;
+	if (rs == NULL)
+		return;
+
+	if (rs->rs_running)
+	{
+		pthread_mutex_lock(&rs->rs_lock);
+		rs->rs_shutdown = TRUE;
+		pthread_mutex_unlock(&rs->rs_lock);
+
+		arc_resolv_wake(rs);
+		pthread_join(rs->rs_thread, NULL);
+
+		pthread_cond_destroy(&rs->rs_cond);
+		pthread_mutex_destroy(&rs->rs_lock);
+	}
+
+	for (c = 0; c < ARC_RESOLV_BUCKETS; c++)
+	{
+		for (rq = rs->rs_queries[c]; rq != NULL; rq = next)
+		{
+			next = rq->rq_next;
+			if (rq->rq_udpfd != -1)
+				close(rq->rq_udpfd);
+			if (rq->rq_tcpfd != -1)
+				close(rq->rq_tcpfd);
+			free(rq);
+		}
+	}
+
+	if (rs->rs_pipe[0] != -1)
+		close(rs->rs_pipe[0]);
+	if (rs->rs_pipe[1] != -1)
+		close(rs->rs_pipe[1]);
+
+	if (rs->rs_pfds != NULL)
+		free(rs->rs_pfds);
+	if (rs->rs_pfdids != NULL)
+		free(rs->rs_pfdids);
+
+	free(rs);
+}
+
+/*
+**  ARC_RESOLV_START -- initiate a DNS query
+**
+**  Parameters:
+**  	srv -- service handle
+**  	type -- RR type to query
+**  	query -- the question to ask
+**  	buf -- where to write the answer
+**  	buflen -- bytes at "buf"
+**  	qh -- query handle, used with arc_resolv_waitreply
+**
+**  Return value:
+**  	An ARC_DNS_* constant.
+**
+**  Notes:
+**  	"buf" must remain valid until the query is passed to
+**  	arc_resolv_cancel().
+*/
+
+int
+arc_resolv_start(void *srv, int type, unsigned char *query,
+                 unsigned char *buf, size_t buflen, void **qh)
+{
+	int tries;
+	uint16_t id;
+	struct arc_resolv *rs;
+	struct arc_resolv_query *rq;
+	struct timeval now;
+
+	assert(srv != NULL);
+	assert(query != NULL);
+	assert(buf != NULL);
+	assert(qh != NULL);
+
+	rs = srv;
+
+	rq = (struct arc_resolv_query *) malloc(sizeof *rq);
+	if (rq == NULL)
+		return ARC_DNS_ERROR;
+
+	memset(rq, '\0', sizeof *rq);
+	rq->rq_edns = TRUE;
+	rq->rq_udpfd = -1;
+	rq->rq_tcpfd = -1;
+	rq->rq_buf = buf;
+	rq->rq_buflen = buflen;
+
+	pthread_mutex_lock(&rs->rs_lock);
+
+	if (rs->rs_nscount == 0)
+	{
+		pthread_mutex_unlock(&rs->rs_lock);
+		free(rq);
+		return ARC_DNS_ERROR;
+	}
+
+	/* pick an unpredictable ID not already in flight */
+	for (tries = 0; tries < 16; tries++)
+	{
+		if (RAND_bytes((unsigned char *) &id, sizeof id) != 1)
+			id = (uint16_t) random();
+		if (arc_resolv_find(rs, id) == NULL)
+			break;
+	}
+
+	if (tries == 16)
+	{
+		pthread_mutex_unlock(&rs->rs_lock);
+		free(rq);
+		return ARC_DNS_ERROR;
+	}
+
+	rq->rq_id = id;
+
+	if (arc_resolv_mkquery(rq, (char *) query, type) != 0)
+	{
+		pthread_mutex_unlock(&rs->rs_lock);
+		free(rq);
+		return ARC_DNS_INVALID;
+	}
+
+	(void) gettimeofday(&now, NULL);
+	arc_resolv_send(rs, rq, &now);
+	if (rq->rq_state == ARC_RQ_ERROR)
+	{
+		pthread_mutex_unlock(&rs->rs_lock);
+		errno = rq->rq_error;
+		free(rq);
+		return ARC_DNS_ERROR;
+	}
+
+	rq->rq_next = rs->rs_queries[id % ARC_RESOLV_BUCKETS];
+	rs->rs_queries[id % ARC_RESOLV_BUCKETS] = rq;
+	rs->rs_pending++;
+
+	pthread_mutex_unlock(&rs->rs_lock);
+
+	/* so the I/O thread picks up the new deadline */
+	arc_resolv_wake(rs);
+
+	*qh = rq;
+
+	return ARC_DNS_SUCCESS;
+}
+
+/*
+**  ARC_RESOLV_CANCEL -- cancel (and release) a query
+**
+**  Parameters:
+**  	srv -- service handle
+**  	qh -- query handle
+**
+**  Return value:
+**  	0 on success, !0 on error
+*/
+
+int
+arc_resolv_cancel(void *srv, void *qh)
+{
+	struct arc_resolv *rs;
+	struct arc_resolv_query *rq;
+	struct arc_resolv_query **prq;
+
+	assert(srv != NULL);
+
+	if (qh == NULL)
+		return 0;
+
+	rs = srv;
+	rq = qh;
+
+	pthread_mutex_lock(&rs->rs_lock);
+
+	for (prq = &rs->rs_queries[rq->rq_id % ARC_RESOLV_BUCKETS];
+	     *prq != NULL;
+	     prq = &(*prq)->rq_next)
+	{
+		if (*prq == rq)
+		{
+			*prq = rq->rq_next;
+			rs->rs_pending--;
+			break;
+		}
+	}
+
+	if (rq->rq_udpfd != -1)
+		close(rq->rq_udpfd);
+	if (rq->rq_tcpfd != -1)
+		close(rq->rq_tcpfd);
+
+	pthread_mutex_unlock(&rs->rs_lock);
+
+	free(rq);
+
+	return 0;
+}
+
+/*
+**  ARC_RESOLV_WAITREPLY -- wait for a reply to a pending query
+**
+**  Parameters:
+**  	srv -- service handle
+**  	qh -- query handle
+**  	to -- timeout (NULL means wait until the query completes)
+**  	bytes -- number of bytes in the reply (returned)
+**  	error -- error code (returned)
+**  	dnssec -- DNSSEC status (returned)
+**
+**  Return value:
+**  	ARC_DNS_SUCCESS -- reply is in the caller's buffer
+**  	ARC_DNS_NOREPLY -- "to" elapsed, query still outstanding
+**  	ARC_DNS_EXPIRED -- all nameservers and retries exhausted
+**  	ARC_DNS_ERROR -- the query failed; see "error"
+*/
+
+int
+arc_resolv_waitreply(void *srv, void *qh, struct timeval *to, size_t *bytes,
+                     int *error, int *dnssec)
+{
+	int ret;
+	struct arc_resolv *rs;
+	struct arc_resolv_query *rq;
+	struct timeval now;
+	struct timespec until;
+
+	assert(srv != NULL);
+	assert(qh != NULL);
+
+	rs = srv;
+	rq = qh;
+
+	if (to != NULL)
+	{
+		(void) gettimeofday(&now, NULL);
+		until.tv_sec = now.tv_sec + to->tv_sec;
+		until.tv_nsec = (now.tv_usec + to->tv_usec) * 1000;
+		if (until.tv_nsec >= 1000000000)
+		{
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock(&rs->rs_lock);
+
+	while (rq->rq_state < ARC_RQ_DONE)
+	{
+		if (to == NULL)
+		{
+			pthread_cond_wait(&rs->rs_cond, &rs->rs_lock);
+		}
+		else if (pthread_cond_timedwait(&rs->rs_cond, &rs->rs_lock,
+		                                &until) == ETIMEDOUT)
+		{
+			break;
+		}
+	}
+
+	switch (rq->rq_state)
+	{
+	  case ARC_RQ_DONE:
+		if (bytes != NULL)
+			*bytes = rq->rq_anslen;
+		if (error != NULL)
+			*error = 0;
+		ret = ARC_DNS_SUCCESS;
+		break;
+
+	  case ARC_RQ_EXPIRED:
+		if (error != NULL)
+			*error = rq->rq_error;
+		ret = ARC_DNS_EXPIRED;
+		break;
+
+	  case ARC_RQ_ERROR:
+		if (error != NULL)
+			*error = rq->rq_error;
+		ret = ARC_DNS_ERROR;
+		break;
+
+	  default:
+		ret = ARC_DNS_NOREPLY;
+		break;
+	}
+
+	pthread_mutex_unlock(&rs->rs_lock);
+
+	if (dnssec != NULL)
+		*dnssec = ARC_DNSSEC_UNKNOWN;
+
+	return ret;
+}
+
+/*
+**  ARC_RESOLV_NSLIST -- set nameserver list
+**
+**  Parameters:
+**  	srv -- service handle
+**  	nslist -- comma-separated nameserver addresses, each optionally
+**  	          with a port ("192.0.2.1:5353", "[2001:db8::1]:5353")
+**
+**  Return value:
+**  	ARC_DNS_SUCCESS -- success
+**  	ARC_DNS_ERROR -- error
+*/
+
+int
+arc_resolv_nslist(void *srv, const char *nslist)
+{
+	int status = ARC_DNS_SUCCESS;
+	char *tmp;
+	char *ns;
+	char *last = NULL;
+	struct arc_resolv *rs;
+	struct arc_resolv new;
+
+	assert(srv != NULL);
+	assert(nslist != NULL);
+
+	rs = srv;
+
+	tmp = strdup(nslist);
+	if (tmp == NULL)
+		return ARC_DNS_ERROR;
+
+	new.rs_nscount = 0;
+
+	for (ns = strtok_r(tmp, ", \t", &last);
+	     ns != NULL;
+	     ns = strtok_r(NULL, ", \t", &last))
+	{
+		if (arc_resolv_addns(&new, ns) != 0)
+		{
+			status = ARC_DNS_ERROR;
+			break;
+		}
+	}
+
+	free(tmp);
+
+	if (status != ARC_DNS_SUCCESS || new.rs_nscount == 0)
+		return ARC_DNS_ERROR;
+
+	pthread_mutex_lock(&rs->rs_lock);
+	memcpy(rs->rs_ns, new.rs_ns, sizeof rs->rs_ns);
+	memcpy(rs->rs_nslen, new.rs_nslen, sizeof rs->rs_nslen);
+	rs->rs_nscount = new.rs_nscount;
+	pthread_mutex_unlock(&rs->rs_lock);
+
+	return ARC_DNS_SUCCESS;
+}
@@ -0,0 +1,30 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#ifndef _ARC_RESOLV_H_
+#define _ARC_RESOLV_H_
+
+/* system includes */
+#include <sys/types.h>
+#include <sys/time.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+/* defaults */
+#define	ARC_RESOLV_MAXNS	8	/* max. nameservers used */
+#define	ARC_RESOLV_DEFTIMEOUT	5	/* default per-try timeout (secs) */
+#define	ARC_RESOLV_DEFATTEMPTS	2	/* default tries per nameserver */
+
+/* prototypes */
+extern int arc_resolv_cancel __P((void *, void *));
+extern void arc_resolv_close __P((void *));
+extern int arc_resolv_init __P((void **));
+extern int arc_resolv_nslist __P((void *, const char *));
+extern int arc_resolv_start __P((void *, int, unsigned char *,
+                                 unsigned char *, size_t, void **));
+extern int arc_resolv_waitreply __P((void *, void *, struct timeval *,
+                                     size_t *, int *, int *));
+
+#endif /* ! _ARC_RESOLV_H_ */
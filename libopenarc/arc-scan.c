@@ -0,0 +1,201 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/types.h>
+#include <assert.h>
+#include <pthread.h>
+#ifdef HAVE_X86_SIMD
+# include <immintrin.h>
+#endif /* HAVE_X86_SIMD */
+
+/* libopenarc includes */
+#include "arc-scan.h"
+
+/* prototypes */
+typedef size_t (*arc_scan_f) __P((const u_char *, size_t, int, int, int, int));
+
+static size_t arc_scan_scalar __P((const u_char *, size_t,
+                                   int, int, int, int));
+
+/* globals */
+static pthread_once_t arc_scan_once = PTHREAD_ONCE_INIT;
+static arc_scan_f arc_scan_impl = arc_scan_scalar;
+
+/*
+**  ARC_SCAN_SCALAR -- portable arc_scan()
+**
+**  Parameters:
+**  	See arc_scan().
+**
+**  Return value:
+**  	See arc_scan().
+*/
+
+static size_t
+arc_scan_scalar(const u_char *buf, size_t len, int c1, int c2, int c3, int c4)
+{
+	size_t c;
+
+	for (c = 0; c < len; c++)
+	{
+		if (buf[c] == c1 || buf[c] == c2 || buf[c] == c3 || buf[c] == c4)
+			break;
+	}
+
+	return c;
+}
+
+#ifdef HAVE_X86_SIMD
+/*
+**  ARC_SCAN_SSE2 -- arc_scan(), sixteen bytes at a time
+**
+**  Parameters:
+**  	See arc_scan().
+**
+**  Return value:
+**  	See arc_scan().
+*/
+
+__attribute__((target("sse2")))
+static size_t
+arc_scan_sse2(const u_char *buf, size_t len, int c1, int c2, int c3, int c4)
+{
+	int mask;
+	size_t c;
+	__m128i d;
+	__m128i m;
+	__m128i v1;
+	__m128i v2;
+	__m128i v3;
+	__m128i v4;
+
+	v1 = _mm_set1_epi8((char) c1);
+	v2 = _mm_set1_epi8((char) c2);
+	v3 = _mm_set1_epi8((char) c3);
+	v4 = _mm_set1_epi8((char) c4);
+
+	for (c = 0; c + 16 <= len; c += 16)
+	{
+		d = _mm_loadu_si128((const __m128i *) (buf + c));
+		m = _mm_or_si128(_mm_cmpeq_epi8(d, v1), _mm_cmpeq_epi8(d, v2));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(d, v3));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(d, v4));
+		mask = _mm_movemask_epi8(m);
+		if (mask != 0)
+			return c + __builtin_ctz(mask);
+	}
+
+	return c + arc_scan_scalar(buf + c, len - c, c1, c2, c3, c4);
+}
+
+/*
+**  ARC_SCAN_AVX2 -- arc_scan(), thirty-two bytes at a time
+**
+**  Parameters:
+**  	See arc_scan().
+**
+**  Return value:
+**  	See arc_scan().
+*/
+
+__attribute__((target("avx2")))
+static size_t
+arc_scan_avx2(const u_char *buf, size_t len, int c1, int c2, int c3, int c4)
+{
+	u_int mask;
+	size_t c;
+	__m256i d;
+	__m256i m;
+	__m256i v1;
+	__m256i v2;
+	__m256i v3;
+	__m256i v4;
+
+	v1 = _mm256_set1_epi8((char) c1);
+	v2 = _mm256_set1_epi8((char) c2);
+	v3 = _mm256_set1_epi8((char) c3);
+	v4 = _mm256_set1_epi8((char) c4);
+
+	for (c = 0; c + 32 <= len; c += 32)
+	{
+		d = _mm256_loadu_si256((const __m256i *) (buf + c));
+		m = _mm256_or_si256(_mm256_cmpeq_epi8(d, v1),
+		                    _mm256_cmpeq_epi8(d, v2));
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(d, v3));
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(d, v4));
+		mask = (u_int) _mm256_movemask_epi8(m);
+		if (mask != 0)
+			return c + __builtin_ctz(mask);
+	}
+
+	return c + arc_scan_sse2(buf + c, len - c, c1, c2, c3, c4);
+}
+#endif /* HAVE_X86_SIMD */
+
+/*
+**  ARC_SCAN_SELECT -- choose the best arc_scan() for this CPU
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_scan_select(void)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		arc_scan_impl = arc_scan_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		arc_scan_impl = arc_scan_sse2;
+#endif /* HAVE_X86_SIMD */
+}
+
+/*
+**  ARC_SCAN_INIT -- one-time setup for arc_scan()
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Safe to call more than once, from any thread.  Until it has been
+**  	called arc_scan() uses the portable implementation.
+*/
+
+void
+arc_scan_init(void)
+{
+	(void) pthread_once(&arc_scan_once, arc_scan_select);
+}
+
+/*
+**  ARC_SCAN -- find the first occurrence of any of four bytes
+**
+**  Parameters:
+**  	buf -- data to scan
+**  	len -- bytes at "buf"
+**  	c1, c2, c3, c4 -- bytes to look for (repeat one to look for fewer)
+**
+**  Return value:
+**  	Offset of the first byte in "buf" matching any of "c1" through "c4",
+**  	or "len" if there is none.
+*/
+
+size_t
+arc_scan(const u_char *buf, size_t len, int c1, int c2, int c3, int c4)
+{
+	assert(buf != NULL || len == 0);
+
+	return arc_scan_impl(buf, len, c1, c2, c3, c4);
+}
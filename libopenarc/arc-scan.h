@@ -0,0 +1,18 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#ifndef _ARC_SCAN_H_
+#define _ARC_SCAN_H_
+
+/* system includes */
+#include <sys/types.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+/* prototypes */
+extern void arc_scan_init __P((void));
+extern size_t arc_scan __P((const u_char *, size_t, int, int, int, int));
+
+#endif /* ! _ARC_SCAN_H_ */
@@ -22,6 +22,9 @@ static struct nametable prv_algorithms[] =	/* signing algorithms */
 {
 	{ "rsa-sha1",	ARC_SIGN_RSASHA1 },
 	{ "rsa-sha256",	ARC_SIGN_RSASHA256 },
+#ifdef HAVE_ED25519
+	{ "ed25519-sha256", ARC_SIGN_ED25519SHA256 },
+#endif /* HAVE_ED25519 */
 	{ NULL,		-1 },
 };
 struct nametable *algorithms = prv_algorithms;
@@ -62,6 +65,9 @@ struct nametable *keyflags = prv_keyflags;
 static struct nametable prv_keytypes[] =	/* key types */
 {
 	{ "rsa",	ARC_KEYTYPE_RSA },
+#ifdef HAVE_ED25519
+	{ "ed25519",	ARC_KEYTYPE_ED25519 },
+#endif /* HAVE_ED25519 */
 	{ NULL,		-1 },
 };
 struct nametable *keytypes = prv_keytypes;
@@ -13,24 +13,29 @@
 # include <stdbool.h>
 #endif /* HAVE_STDBOOL_H */
 #include <regex.h>
+#include <pthread.h>
 
 /* OpenSSL includes */
 #include <openssl/pem.h>
 #include <openssl/rsa.h>
 #include <openssl/bio.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
 #include <openssl/sha.h>
 
 /* libopenarc includes */
 #include "arc.h"
 #include "arc-internal.h"
+#include "arc-arena.h"
+#include "arc-cache.h"
+#include "arc-verify.h"
 
 /* struct arc_sha1 -- stuff needed to do a sha1 hash */
 struct arc_sha1
 {
 	int			sha1_tmpfd;
 	BIO *			sha1_tmpbio;
-	SHA_CTX			sha1_ctx;
+	EVP_MD_CTX *		sha1_ctx;
 	u_char			sha1_out[SHA_DIGEST_LENGTH];
 };
 
@@ -40,7 +45,7 @@ struct arc_sha256
 {
 	int			sha256_tmpfd;
 	BIO *			sha256_tmpbio;
-	SHA256_CTX		sha256_ctx;
+	EVP_MD_CTX *		sha256_ctx;
 	u_char			sha256_out[SHA256_DIGEST_LENGTH];
 };
 #endif /* HAVE_SHA256 */
@@ -75,14 +80,34 @@ struct arc_dstring
 struct arc_hdrfield
 {
 	uint32_t		hdr_flags;
+	u_int			hdr_hash;
+	u_int			hdr_nsame;
 	size_t			hdr_namelen;
 	size_t			hdr_textlen;
 	u_char *		hdr_colon;
 	u_char *		hdr_text;
+	u_char *		hdr_canon;
+	size_t			hdr_canonlen;
 	void *			hdr_data;
 	struct arc_hdrfield *	hdr_next;
+	struct arc_hdrfield *	hdr_nextname;
+	struct arc_hdrfield *	hdr_nextsame;
+	struct arc_hdrfield *	hdr_prevsame;
+	struct arc_hdrfield *	hdr_lastsame;
+	struct arc_hdrfield *	hdr_selnext;
 };
 
+/*
+**  Header fields are also indexed by name: arc_hindex[] buckets chain the
+**  first instance of each distinct name through hdr_nextname, and that
+**  instance keeps the count (hdr_nsame) and last instance (hdr_lastsame)
+**  of its name, whose instances are linked in order by hdr_nextsame and
+**  hdr_prevsame.  During header selection the first instance's
+**  hdr_selnext is the next instance to be taken, working upwards.
+*/
+
+#define	ARC_HDRBUCKETS		64
+
 /* hdr_flags bits */
 #define	ARC_HDR_SIGNED		0x01
 
@@ -131,19 +156,46 @@ struct arc_canon
 	arc_canon_t		canon_canon;
 	u_char *		canon_hashbuf;
 	u_char *		canon_hdrlist;
+	u_char *		canon_span;
+	size_t			canon_spanlen;
+	u_char *		canon_word;
+	size_t			canon_wordlen;
 	void *			canon_hash;
 	struct arc_dstring *	canon_buf;
 	struct arc_hdrfield *	canon_sigheader;
+	struct arc_canon *	canon_leader;
+	struct arc_canon *	canon_nextsink;
 	struct arc_canon *	canon_next;
 };
 
+/* struct arc_keyquery -- a prefetched key query (see arc-keys.c) */
+struct arc_keyquery;
+
+/* struct arc_keyflight -- a key query shared between messages (ditto) */
+struct arc_keyflight;
+
+/* struct arc_signkey -- a parsed private key */
+struct arc_signkey
+{
+	u_int			sk_keytype;
+	size_t			sk_keysize;
+	EVP_PKEY *		sk_pkey;
+};
+
+/* struct arc_hoptiming -- time spent on one ARC set */
+struct arc_hoptiming
+{
+	uint64_t		ht_keyfetch;
+	uint64_t		ht_verify;
+};
+
 /* struct arc_msghandle -- a complete ARC transaction context */
 struct arc_msghandle
 {
 	_Bool			arc_partial;
 	u_char *		arc_key;
 	u_char *		arc_error;
-	u_char *		arc_hdrlist;
+	EVP_PKEY *		arc_pkey;
 	u_char *		arc_domain;
 	u_char *		arc_selector;
 	u_char *		arc_authservid;
@@ -180,16 +232,22 @@ struct arc_msghandle
 	struct arc_canon *	arc_sealcanon;
 	struct arc_canon **	arc_sealcanons;
 	struct arc_canon *	arc_hdrcanon;
+	struct arc_canon *	arc_signhdrcanon;
 	struct arc_canon *	arc_bodycanon;
 	struct arc_canon *	arc_canonhead;
 	struct arc_canon *	arc_canontail;
 	struct arc_hdrfield *	arc_hhead;
 	struct arc_hdrfield *	arc_htail;
+	struct arc_hdrfield *	arc_hindex[ARC_HDRBUCKETS];
 	struct arc_hdrfield *	arc_sealhead;
 	struct arc_hdrfield *	arc_sealtail;
 	struct arc_kvset *	arc_kvsethead;
 	struct arc_kvset *	arc_kvsettail;
 	struct arc_set *	arc_sets;
+	struct arc_hoptiming *	arc_hoptiming;
+	uint64_t		arc_timing[ARC_TIMING_MAX + 1];
+	struct arc_keyquery *	arc_keyqueries;
+	ARC_ARENA *		arc_arena;
 	ARC_LIB *		arc_library;
 	const void *		arc_user_context;
 };
@@ -197,11 +255,22 @@ struct arc_msghandle
 /* struct arc_lib -- a ARC library context */
 struct arc_lib
 {
+	_Bool			arcl_dns_async;
 	_Bool			arcl_dnsinit_done;
 	u_int			arcl_flsize;
+	u_int			arcl_keycachesize;
+	u_int			arcl_keycache_negttl;
+	u_int			arcl_verifythreads;
+	arc_query_t		arcl_querymethod;
 	uint32_t		arcl_flags;
 	time_t			arcl_fixedtime;
 	u_int *			arcl_flist;
+	ARC_KEYCACHE *		arcl_keycache;
+	ARC_VERIFYPOOL *	arcl_verifypool;
+	u_char *		arcl_nslist;
+	pthread_mutex_t		arcl_dnslock;
+	struct arc_keyflight *	arcl_keyflights;
+	pthread_mutex_t		arcl_flightlock;
 	struct arc_dstring *	arcl_sslerrbuf;
 	u_int			arcl_callback_int;
 	void			(*arcl_dns_callback) (const void *context);
@@ -214,6 +283,8 @@ struct arc_lib
 				                   size_t buflen,
 				                   void **qh);
 	int			(*arcl_dns_cancel) (void *srv, void *qh);
+	int			(*arcl_dns_nslist) (void *srv,
+				                    const char *nslist);
 	int			(*arcl_dns_waitreply) (void *srv,
 				                       void *qh,
 				                       struct timeval *to,
@@ -8,6 +8,7 @@
 /* system includes */
 #include <sys/param.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include <arpa/inet.h>
 #include <arpa/nameser.h>
 #include <netinet/in.h>
@@ -21,6 +22,7 @@
 #include <limits.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <stdio.h>
 #include <netdb.h>
 #include <resolv.h>
@@ -29,6 +31,7 @@
 /* libopenarc includes */
 #include "arc-internal.h"
 #include "arc-types.h"
+#include "arc-tables.h"
 #include "arc-util.h"
 
 #if defined(__RES) && (__RES >= 19940415)
@@ -96,7 +99,7 @@ arc_dstring_resize(struct arc_dstring *dstr, int len)
 		}
 	}
 
-	new = malloc(newsz);
+	new = arc_malloc(dstr->ds_msg, newsz);
 	if (new == NULL)
 	{
 		arc_error(dstr->ds_msg, "unable to allocate %d byte(s)",
@@ -105,7 +108,7 @@ arc_dstring_resize(struct arc_dstring *dstr, int len)
 	}
 
 	memcpy(new, dstr->ds_buf, dstr->ds_alloc);
-	free(dstr->ds_buf);
+	arc_mfree(dstr->ds_msg, dstr->ds_buf);
 	dstr->ds_alloc = newsz;
 	dstr->ds_buf = new;
 
@@ -139,7 +142,7 @@ arc_dstring_new(ARC_MESSAGE *msg, int len, int maxlen)
 	if (len < BUFRSZ)
 		len = BUFRSZ;
 
-	new = (struct arc_dstring *) malloc(sizeof *new);
+	new = (struct arc_dstring *) arc_malloc(msg, sizeof *new);
 	if (new == NULL)
 	{
 		arc_error(msg, "unable to allocate %d byte(s)",
@@ -148,12 +151,12 @@ arc_dstring_new(ARC_MESSAGE *msg, int len, int maxlen)
 	}
 
 	new->ds_msg = msg;
-	new->ds_buf = malloc(len);
+	new->ds_buf = arc_malloc(msg, len);
 	if (new->ds_buf == NULL)
 	{
 		arc_error(msg, "unable to allocate %d byte(s)",
 		          sizeof(struct arc_dstring));
-		free(new);
+		arc_mfree(msg, new);
 		return NULL;
 	}
 
@@ -181,8 +184,8 @@ arc_dstring_free(struct arc_dstring *dstr)
 {
 	assert(dstr != NULL);
 
-	free(dstr->ds_buf);
-	free(dstr);
+	arc_mfree(dstr->ds_msg, dstr->ds_buf);
+	arc_mfree(dstr->ds_msg, dstr);
 }
 
 /*
@@ -598,6 +601,171 @@ arc_tmpfile(ARC_MESSAGE *msg, int *fp, _Bool keep)
 	return ARC_STAT_OK;
 }
 
+/*
+**  ARC_CLOCK_USEC -- read the monotonic clock
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	Microseconds since some arbitrary point; only differences are
+**  	meaningful.  Falls back to the time of day where there is no
+**  	monotonic clock.
+*/
+
+uint64_t
+arc_clock_usec(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif /* CLOCK_MONOTONIC */
+	{
+		struct timeval tv;
+
+		(void) gettimeofday(&tv, NULL);
+		return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+	}
+}
+
+/*
+**  ARC_HDRHASH -- hash a header field name, case-insensitively
+**
+**  Parameters:
+**  	name -- name to hash (need not be NUL-terminated)
+**  	len -- bytes of "name" to use
+**
+**  Return value:
+**  	Hash of "name".
+*/
+
+u_int
+arc_hdrhash(const u_char *name, size_t len)
+{
+	u_int h = 5381;
+	const u_char *end;
+
+	for (end = name + len; name < end; name++)
+		h = ((h << 5) + h) + tolower(*name);
+
+	return h;
+}
+
+/*
+**  ARC_HDR_ARCTYPE -- classify a header field as one of the ARC fields
+**
+**  Parameters:
+**  	h -- header field
+**
+**  Return value:
+**  	The ARC_KVSETTYPE_* the field's name denotes, or -1 if it isn't
+**  	an ARC field.
+**
+**  Notes:
+**  	Works on the field as stored, without copying its name out.
+*/
+
+arc_kvsettype_t
+arc_hdr_arctype(struct arc_hdrfield *h)
+{
+	int c;
+	size_t len;
+
+	for (c = 0; archdrnames[c].tbl_name != NULL; c++)
+	{
+		len = strlen(archdrnames[c].tbl_name);
+		if (h->hdr_namelen == len &&
+		    strncasecmp((char *) h->hdr_text,
+		                archdrnames[c].tbl_name, len) == 0)
+			return archdrnames[c].tbl_code;
+	}
+
+	return -1;
+}
+
+/*
+**  ARC_HDRINDEX_FIND -- find the first instance of a header field name
+**
+**  Parameters:
+**  	msg -- message handle
+**  	name -- field name (need not be NUL-terminated)
+**  	len -- bytes of "name" to use
+**
+**  Return value:
+**  	The earliest field with that name, or NULL if there is none.  Later
+**  	ones follow via hdr_nextsame; hdr_nsame gives the count.
+*/
+
+struct arc_hdrfield *
+arc_hdrindex_find(ARC_MESSAGE *msg, const u_char *name, size_t len)
+{
+	u_int hash;
+	struct arc_hdrfield *h;
+
+	assert(msg != NULL);
+	assert(name != NULL);
+
+	hash = arc_hdrhash(name, len);
+
+	for (h = msg->arc_hindex[hash % ARC_HDRBUCKETS];
+	     h != NULL;
+	     h = h->hdr_nextname)
+	{
+		if (h->hdr_hash == hash && h->hdr_namelen == len &&
+		    strncasecmp((char *) h->hdr_text, (char *) name, len) == 0)
+			return h;
+	}
+
+	return NULL;
+}
+
+/*
+**  ARC_HDRINDEX_ADD -- add a header field to the name index
+**
+**  Parameters:
+**  	msg -- message handle
+**  	h -- field just appended to the message's header list
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Fields must be added in header order.
+*/
+
+void
+arc_hdrindex_add(ARC_MESSAGE *msg, struct arc_hdrfield *h)
+{
+	struct arc_hdrfield *first;
+
+	assert(msg != NULL);
+	assert(h != NULL);
+
+	h->hdr_nextname = NULL;
+	h->hdr_nextsame = NULL;
+	h->hdr_prevsame = NULL;
+	h->hdr_lastsame = NULL;
+	h->hdr_nsame = 0;
+
+	first = arc_hdrindex_find(msg, h->hdr_text, h->hdr_namelen);
+	if (first == NULL)
+	{
+		h->hdr_nextname = msg->arc_hindex[h->hdr_hash % ARC_HDRBUCKETS];
+		msg->arc_hindex[h->hdr_hash % ARC_HDRBUCKETS] = h;
+		h->hdr_lastsame = h;
+		h->hdr_nsame = 1;
+	}
+	else
+	{
+		h->hdr_prevsame = first->hdr_lastsame;
+		first->hdr_lastsame->hdr_nextsame = h;
+		first->hdr_lastsame = h;
+		first->hdr_nsame++;
+	}
+}
+
 /*
 **  ARC_MIN_TIMEVAL -- determine the timeout to apply before reaching
 **                     one of two timevals
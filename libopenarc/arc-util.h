@@ -30,6 +30,12 @@ extern size_t arc_dstring_printf __P((struct arc_dstring *dstr, char *fmt,
 
 extern int arc_check_dns_reply __P((unsigned char *ansbuf, size_t anslen,
                                     int xclass, int xtype));
+extern uint64_t arc_clock_usec __P((void));
+extern arc_kvsettype_t arc_hdr_arctype __P((struct arc_hdrfield *));
+extern u_int arc_hdrhash __P((const u_char *, size_t));
+extern void arc_hdrindex_add __P((ARC_MESSAGE *, struct arc_hdrfield *));
+extern struct arc_hdrfield *arc_hdrindex_find __P((ARC_MESSAGE *,
+                                                   const u_char *, size_t));
 extern void arc_collapse __P((u_char *));
 extern void arc_lowerhdr __P((u_char *));
 extern void arc_min_timeval __P((struct timeval *, struct timeval *,
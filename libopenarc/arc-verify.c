@@ -0,0 +1,385 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/types.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+/* OpenSSL includes */
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+
+/* libopenarc includes */
+#include "arc-internal.h"
+#include "arc-crypto.h"
+#include "arc-types.h"
+#include "arc-util.h"
+#include "arc-verify.h"
+
+/*
+**  ARC_VERIFYBATCH -- checks submitted together by one caller
+*/
+
+struct arc_verifybatch
+{
+	u_int			vb_pending;
+};
+
+/*
+**  ARC_VERIFYPOOL -- the pool itself
+*/
+
+struct arc_verifypool
+{
+	_Bool			vp_stop;
+	u_int			vp_nthreads;
+	pthread_t *		vp_threads;
+	pthread_mutex_t		vp_lock;
+	pthread_cond_t		vp_work;
+	pthread_cond_t		vp_done;
+	struct arc_verify *	vp_head;
+	struct arc_verify *	vp_tail;
+};
+
+/*
+**  ARC_VERIFY_CHECK -- check one signature
+**
+**  Parameters:
+**  	av -- check to run
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_verify_check(struct arc_verify *av)
+{
+	EVP_PKEY_CTX *pctx;
+
+	av->av_result = 0;
+
+	if (av->av_md == NULL)
+	{
+#ifdef HAVE_ED25519
+		EVP_MD_CTX *ctx;
+
+		ctx = arc_mdctx_get();
+		if (ctx == NULL)
+			return;
+
+		if (EVP_DigestVerifyInit(ctx, NULL, NULL, NULL,
+		                         av->av_pkey) == 1 &&
+		    EVP_DigestVerify(ctx, av->av_sig, av->av_siglen,
+		                     av->av_hash, av->av_hashlen) == 1)
+			av->av_result = 1;
+
+		arc_mdctx_put(ctx);
+#endif /* HAVE_ED25519 */
+		return;
+	}
+
+	pctx = EVP_PKEY_CTX_new(av->av_pkey, NULL);
+	if (pctx == NULL)
+		return;
+
+	if (EVP_PKEY_verify_init(pctx) == 1 &&
+	    EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PADDING) > 0 &&
+	    EVP_PKEY_CTX_set_signature_md(pctx, av->av_md) > 0 &&
+	    EVP_PKEY_verify(pctx, av->av_sig, av->av_siglen,
+	                    av->av_hash, av->av_hashlen) == 1)
+		av->av_result = 1;
+
+	EVP_PKEY_CTX_free(pctx);
+}
+
+/*
+**  ARC_VERIFY_ONE -- run one signature check
+**
+**  Parameters:
+**  	av -- check to run
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_verify_one(struct arc_verify *av)
+{
+	uint64_t start;
+
+	assert(av != NULL);
+
+	if (!av->av_timed)
+	{
+		arc_verify_check(av);
+		return;
+	}
+
+	start = arc_clock_usec();
+	arc_verify_check(av);
+	av->av_usec = arc_clock_usec() - start;
+}
+
+/*
+**  ARC_VERIFYPOOL_WORKER -- pool thread
+**
+**  Parameters:
+**  	arg -- ARC_VERIFYPOOL handle
+**
+**  Return value:
+**  	Always NULL.
+*/
+
+static void *
+arc_verifypool_worker(void *arg)
+{
+	ARC_VERIFYPOOL *pool;
+	struct arc_verify *av;
+
+	pool = (ARC_VERIFYPOOL *) arg;
+
+	pthread_mutex_lock(&pool->vp_lock);
+
+	for (;;)
+	{
+		while (pool->vp_head == NULL && !pool->vp_stop)
+			pthread_cond_wait(&pool->vp_work, &pool->vp_lock);
+
+		av = pool->vp_head;
+		if (av == NULL)
+			break;
+
+		pool->vp_head = av->av_next;
+		if (pool->vp_head == NULL)
+			pool->vp_tail = NULL;
+
+		pthread_mutex_unlock(&pool->vp_lock);
+
+		arc_verify_one(av);
+
+		pthread_mutex_lock(&pool->vp_lock);
+
+		av->av_batch->vb_pending--;
+		if (av->av_batch->vb_pending == 0)
+			pthread_cond_broadcast(&pool->vp_done);
+	}
+
+	pthread_mutex_unlock(&pool->vp_lock);
+
+	return NULL;
+}
+
+/*
+**  ARC_VERIFYPOOL_FREE -- stop and destroy a verification pool
+**
+**  Parameters:
+**  	pool -- pool to destroy (may be NULL)
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Checks already queued are finished first.
+*/
+
+void
+arc_verifypool_free(ARC_VERIFYPOOL *pool)
+{
+	u_int c;
+
+	if (pool == NULL)
+		return;
+
+	pthread_mutex_lock(&pool->vp_lock);
+	pool->vp_stop = TRUE;
+	pthread_cond_broadcast(&pool->vp_work);
+	pthread_mutex_unlock(&pool->vp_lock);
+
+	for (c = 0; c < pool->vp_nthreads; c++)
+		(void) pthread_join(pool->vp_threads[c], NULL);
+
+	pthread_cond_destroy(&pool->vp_done);
+	pthread_cond_destroy(&pool->vp_work);
+	pthread_mutex_destroy(&pool->vp_lock);
+
+	free(pool->vp_threads);
+	free(pool);
+}
+
+/*
+**  ARC_VERIFYPOOL_NEW -- start a verification pool
+**
+**  Parameters:
+**  	nthreads -- number of threads to start
+**
+**  Return value:
+**  	A new ARC_VERIFYPOOL handle, or NULL on failure.
+*/
+
+ARC_VERIFYPOOL *
+arc_verifypool_new(u_int nthreads)
+{
+	ARC_VERIFYPOOL *pool;
+
+	assert(nthreads > 0);
+
+	pool = (ARC_VERIFYPOOL *) malloc(sizeof *pool);
+	if (pool == NULL)
+		return NULL;
+
+	pool->vp_threads = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+	if (pool->vp_threads == NULL)
+	{
+		free(pool);
+		return NULL;
+	}
+
+	pool->vp_stop = FALSE;
+	pool->vp_nthreads = 0;
+	pool->vp_head = NULL;
+	pool->vp_tail = NULL;
+	pthread_mutex_init(&pool->vp_lock, NULL);
+	pthread_cond_init(&pool->vp_work, NULL);
+	pthread_cond_init(&pool->vp_done, NULL);
+
+	while (pool->vp_nthreads < nthreads)
+	{
+		if (pthread_create(&pool->vp_threads[pool->vp_nthreads], NULL,
+		                   arc_verifypool_worker, pool) != 0)
+		{
+			arc_verifypool_free(pool);
+			return NULL;
+		}
+
+		pool->vp_nthreads++;
+	}
+
+	return pool;
+}
+
+/*
+**  ARC_VERIFY_RUN -- run a set of signature checks
+**
+**  Parameters:
+**  	pool -- ARC_VERIFYPOOL handle (may be NULL)
+**  	av -- checks to run
+**  	n -- number of entries at "av"
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Entries whose av_status is not ARC_STAT_OK could not be prepared;
+**  	they are not run, and like any other check not run are left with
+**  	an av_result of -1.  Without a pool the checks run here, in
+**  	order, stopping at the first one that fails.  With a pool the
+**  	caller runs the first check while the pool runs the others, and
+**  	all of them are done on return.
+*/
+
+void
+arc_verify_run(ARC_VERIFYPOOL *pool, struct arc_verify *av, u_int n)
+{
+	u_int c;
+	u_int first;
+	struct arc_verifybatch batch;
+
+	assert(av != NULL || n == 0);
+
+	for (c = 0; c < n; c++)
+		av[c].av_result = -1;
+
+	if (pool == NULL)
+	{
+		for (c = 0; c < n; c++)
+		{
+			if (av[c].av_status != ARC_STAT_OK)
+				break;
+
+			arc_verify_one(&av[c]);
+			if (av[c].av_result != 1)
+				break;
+		}
+
+		return;
+	}
+
+	for (first = 0; first < n; first++)
+	{
+		if (av[first].av_status == ARC_STAT_OK)
+			break;
+	}
+
+	if (first == n)
+		return;
+
+	batch.vb_pending = 0;
+
+	pthread_mutex_lock(&pool->vp_lock);
+
+	for (c = first + 1; c < n; c++)
+	{
+		if (av[c].av_status != ARC_STAT_OK)
+			continue;
+
+		batch.vb_pending++;
+		av[c].av_batch = &batch;
+		av[c].av_next = NULL;
+
+		if (pool->vp_tail == NULL)
+			pool->vp_head = &av[c];
+		else
+			pool->vp_tail->av_next = &av[c];
+		pool->vp_tail = &av[c];
+	}
+
+	if (batch.vb_pending > 0)
+		pthread_cond_broadcast(&pool->vp_work);
+	pthread_mutex_unlock(&pool->vp_lock);
+
+	arc_verify_one(&av[first]);
+
+	pthread_mutex_lock(&pool->vp_lock);
+	while (batch.vb_pending > 0)
+		pthread_cond_wait(&pool->vp_done, &pool->vp_lock);
+	pthread_mutex_unlock(&pool->vp_lock);
+}
+
+/*
+**  ARC_VERIFY_FREE -- release a set of signature checks
+**
+**  Parameters:
+**  	av -- checks to release (may be NULL)
+**  	n -- number of entries at "av"
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	"av" itself is freed, along with each entry's key and signature.
+**  	Entries never filled in must be zeroed.
+*/
+
+void
+arc_verify_free(struct arc_verify *av, u_int n)
+{
+	u_int c;
+
+	if (av == NULL)
+		return;
+
+	for (c = 0; c < n; c++)
+	{
+		if (av[c].av_pkey != NULL)
+			EVP_PKEY_free(av[c].av_pkey);
+		if (av[c].av_sig != NULL)
+			free(av[c].av_sig);
+	}
+
+	free(av);
+}
@@ -0,0 +1,54 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#ifndef _ARC_VERIFY_H_
+#define _ARC_VERIFY_H_
+
+/* system includes */
+#include <sys/types.h>
+
+/* OpenSSL includes */
+#include <openssl/evp.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+/*
+**  ARC_VERIFY -- one signature check, ready to run
+*/
+
+struct arc_verifybatch;
+
+struct arc_verify
+{
+	_Bool			av_timed;	/* set av_usec? */
+	int			av_result;	/* 1 if good, -1 if not run */
+	int			av_siglen;
+	ARC_STAT		av_status;	/* preparation result */
+	size_t			av_hashlen;
+	uint64_t		av_usec;	/* time taken */
+	void *			av_hash;
+	u_char *		av_sig;
+	const EVP_MD *		av_md;		/* NULL for Ed25519 */
+	EVP_PKEY *		av_pkey;
+	struct arc_verifybatch * av_batch;
+	struct arc_verify *	av_next;
+};
+
+/*
+**  ARC_VERIFYPOOL -- threads that run signature checks
+*/
+
+struct arc_verifypool;
+typedef struct arc_verifypool ARC_VERIFYPOOL;
+
+/* prototypes */
+extern ARC_VERIFYPOOL *arc_verifypool_new __P((u_int));
+extern void arc_verifypool_free __P((ARC_VERIFYPOOL *));
+
+extern void arc_verify_run __P((ARC_VERIFYPOOL *, struct arc_verify *,
+                                u_int));
+extern void arc_verify_free __P((struct arc_verify *, u_int));
+
+#endif /* ! _ARC_VERIFY_H_ */
@@ -45,12 +45,20 @@
 
 /* libopenarc includes */
 #include "arc-internal.h"
+#include "arc-arena.h"
+#include "arc-cache.h"
 #include "arc-canon.h"
+#include "arc-crypto.h"
 #include "arc-dns.h"
 #include "arc-keys.h"
+#ifdef ASYNCDNS
+# include "arc-resolv.h"
+#endif /* ASYNCDNS */
+#include "arc-scan.h"
 #include "arc-tables.h"
 #include "arc-types.h"
 #include "arc-util.h"
+#include "arc-verify.h"
 #include "arc.h"
 #include "base64.h"
 
@@ -676,9 +684,12 @@ arc_getamshdr_d(ARC_MESSAGE *msg, size_t initial, u_char **buf, size_t *buflen,
 
 					len += offset;
 
-					arc_dstring_cat1(msg->arc_hdrbuf,
-					                 *(pv + offset));
-					len++;
+					if (*(pv + offset) != '\0')
+					{
+						arc_dstring_cat1(msg->arc_hdrbuf,
+						                 *(pv + offset));
+						len++;
+					}
 
 					x = pv + offset + 1;
 					y = pv + pvlen;
@@ -759,6 +770,8 @@ arc_init(void)
 	memset(lib, '\0', sizeof *lib);
 	lib->arcl_flags = ARC_LIBFLAGS_DEFAULT;
 
+	arc_scan_init();
+
 #define FEATURE_INDEX(x)	((x) / (8 * sizeof(u_int)))
 #define FEATURE_OFFSET(x)	((x) % (8 * sizeof(u_int)))
 #define FEATURE_ADD(lib,x)	(lib)->arcl_flist[FEATURE_INDEX((x))] |= (1 << FEATURE_OFFSET(x))
@@ -775,16 +788,52 @@ arc_init(void)
 	lib->arcl_dns_callback = NULL;
 	lib->arcl_dns_service = NULL;
 	lib->arcl_dnsinit_done = FALSE;
+#ifdef ASYNCDNS
+	lib->arcl_dns_async = TRUE;
+	lib->arcl_dns_init = arc_resolv_init;
+	lib->arcl_dns_close = arc_resolv_close;
+	lib->arcl_dns_start = arc_resolv_start;
+	lib->arcl_dns_cancel = arc_resolv_cancel;
+	lib->arcl_dns_waitreply = arc_resolv_waitreply;
+	lib->arcl_dns_nslist = arc_resolv_nslist;
+#else /* ASYNCDNS */
+	lib->arcl_dns_async = FALSE;
 	lib->arcl_dns_init = arc_res_init;
 	lib->arcl_dns_close = arc_res_close;
 	lib->arcl_dns_start = arc_res_query;
 	lib->arcl_dns_cancel = arc_res_cancel;
 	lib->arcl_dns_waitreply = arc_res_waitreply;
+	lib->arcl_dns_nslist = NULL;
+#endif /* ASYNCDNS */
+	pthread_mutex_init(&lib->arcl_dnslock, NULL);
+	lib->arcl_keyflights = NULL;
+	pthread_mutex_init(&lib->arcl_flightlock, NULL);
 	strncpy(lib->arcl_tmpdir, DEFTMPDIR, sizeof lib->arcl_tmpdir - 1);
 
+	lib->arcl_keycachesize = DEFKEYCACHESIZE;
+	lib->arcl_keycache_negttl = DEFKEYCACHENEGTTL;
+	lib->arcl_verifythreads = 0;
+	lib->arcl_verifypool = NULL;
+	lib->arcl_querymethod = ARC_QUERY_DEFAULT;
+	lib->arcl_keycache = arc_keycache_new(lib->arcl_keycachesize);
+	if (lib->arcl_keycache == NULL)
+	{
+		pthread_mutex_destroy(&lib->arcl_dnslock);
+		pthread_mutex_destroy(&lib->arcl_flightlock);
+		free(lib->arcl_flist);
+		free(lib);
+		return NULL;
+	}
+
 #ifdef HAVE_SHA256
 	FEATURE_ADD(lib, ARC_FEATURE_SHA256);
 #endif /* HAVE_SHA256 */
+#ifdef ASYNCDNS
+	FEATURE_ADD(lib, ARC_FEATURE_ASYNCDNS);
+#endif /* ASYNCDNS */
+#ifdef HAVE_ED25519
+	FEATURE_ADD(lib, ARC_FEATURE_ED25519);
+#endif /* HAVE_ED25519 */
 
 	return lib;
 }
@@ -802,6 +851,16 @@ arc_init(void)
 void
 arc_close(ARC_LIB *lib)
 {
+	if (lib->arcl_dns_service != NULL && lib->arcl_dns_close != NULL)
+		lib->arcl_dns_close(lib->arcl_dns_service);
+	pthread_mutex_destroy(&lib->arcl_dnslock);
+	pthread_mutex_destroy(&lib->arcl_flightlock);
+	if (lib->arcl_nslist != NULL)
+		free(lib->arcl_nslist);
+
+	arc_keycache_free(lib->arcl_keycache);
+	arc_verifypool_free(lib->arcl_verifypool);
+	free(lib->arcl_flist);
 	free(lib);
 }
 
@@ -824,6 +883,71 @@ arc_geterror(ARC_MESSAGE *msg)
 	return (const char *) msg->arc_error;
 }
 
+/*
+**  ARC_CHAIN_STATUS_STR -- report the chain state of a message
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**
+**  Return value:
+**  	"none", "fail" or "pass" once arc_eom() has run; "none" before.
+*/
+
+const char *
+arc_chain_status_str(ARC_MESSAGE *msg)
+{
+	assert(msg != NULL);
+
+	return arc_code_to_name(chainstatus, msg->arc_cstate);
+}
+
+/*
+**  ARC_GETTIMING -- report time spent in one phase of a message
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	phase -- ARC_TIMING_* constant
+**  	hop -- ARC set instance, or 0 for the whole message
+**  	usec -- microseconds spent (returned)
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+*/
+
+ARC_STAT
+arc_gettiming(ARC_MESSAGE *msg, int phase, u_int hop, uint64_t *usec)
+{
+	struct arc_hoptiming *ht;
+
+	assert(msg != NULL);
+	assert(usec != NULL);
+
+	if (phase < 0 || phase > ARC_TIMING_MAX)
+		return ARC_STAT_INVALID;
+
+	if (hop == 0)
+	{
+		*usec = msg->arc_timing[phase];
+		return ARC_STAT_OK;
+	}
+
+	if (hop > msg->arc_nsets ||
+	    (phase != ARC_TIMING_KEYFETCH && phase != ARC_TIMING_VERIFY))
+		return ARC_STAT_INVALID;
+
+	if (msg->arc_hoptiming == NULL)
+	{
+		*usec = 0;
+		return ARC_STAT_OK;
+	}
+
+	ht = &msg->arc_hoptiming[hop - 1];
+	*usec = (phase == ARC_TIMING_KEYFETCH ? ht->ht_keyfetch
+	                                      : ht->ht_verify);
+
+	return ARC_STAT_OK;
+}
+
 /*
 ** 
 **  ARC_OPTIONS -- get/set library options
@@ -842,6 +966,9 @@ arc_geterror(ARC_MESSAGE *msg)
 ARC_STAT
 arc_options(ARC_LIB *lib, int op, int arg, void *val, size_t valsz)
 {
+	uint64_t hits;
+	uint64_t misses;
+
 	assert(lib != NULL);
 	assert(op == ARC_OP_GETOPT || op == ARC_OP_SETOPT);
 
@@ -879,6 +1006,49 @@ arc_options(ARC_LIB *lib, int op, int arg, void *val, size_t valsz)
 		}
 		return ARC_STAT_OK;
 
+	  case ARC_OPTS_QUERYMETHOD:
+		if (val == NULL)
+			return ARC_STAT_INVALID;
+
+		if (valsz != sizeof lib->arcl_querymethod)
+			return ARC_STAT_INVALID;
+
+		if (op == ARC_OP_GETOPT)
+		{
+			memcpy(val, &lib->arcl_querymethod, valsz);
+		}
+		else
+		{
+			arc_query_t method;
+
+			memcpy(&method, val, valsz);
+			if (method != ARC_QUERY_DNS && method != ARC_QUERY_FILE)
+				return ARC_STAT_INVALID;
+			lib->arcl_querymethod = method;
+		}
+
+		return ARC_STAT_OK;
+
+	  case ARC_OPTS_QUERYINFO:
+		if (op == ARC_OP_GETOPT)
+		{
+			if (val == NULL)
+				return ARC_STAT_INVALID;
+
+			strlcpy((char *) val, (char *) lib->arcl_queryinfo,
+			        valsz);
+		}
+		else if (val == NULL)
+		{
+			lib->arcl_queryinfo[0] = '\0';
+		}
+		else
+		{
+			strlcpy((char *) lib->arcl_queryinfo, (char *) val,
+			        sizeof lib->arcl_queryinfo);
+		}
+		return ARC_STAT_OK;
+
 	  case ARC_OPTS_FIXEDTIME:
 		if (val == NULL)
 			return ARC_STAT_INVALID;
@@ -893,6 +1063,139 @@ arc_options(ARC_LIB *lib, int op, int arg, void *val, size_t valsz)
 
 		return ARC_STAT_OK;
 
+	  case ARC_OPTS_KEYCACHESIZE:
+		if (val == NULL)
+			return ARC_STAT_INVALID;
+
+		if (valsz != sizeof lib->arcl_keycachesize)
+			return ARC_STAT_INVALID;
+
+		if (op == ARC_OP_GETOPT)
+		{
+			memcpy(val, &lib->arcl_keycachesize, valsz);
+		}
+		else
+		{
+			memcpy(&lib->arcl_keycachesize, val, valsz);
+			arc_keycache_setsize(lib->arcl_keycache,
+			                     lib->arcl_keycachesize);
+		}
+
+		return ARC_STAT_OK;
+
+	  case ARC_OPTS_KEYCACHENEGTTL:
+		if (val == NULL)
+			return ARC_STAT_INVALID;
+
+		if (valsz != sizeof lib->arcl_keycache_negttl)
+			return ARC_STAT_INVALID;
+
+		if (op == ARC_OP_GETOPT)
+			memcpy(val, &lib->arcl_keycache_negttl, valsz);
+		else
+			memcpy(&lib->arcl_keycache_negttl, val, valsz);
+
+		return ARC_STAT_OK;
+
+	  case ARC_OPTS_KEYCACHEHITS:
+	  case ARC_OPTS_KEYCACHEMISSES:
+		if (val == NULL || op != ARC_OP_GETOPT)
+			return ARC_STAT_INVALID;
+
+		if (valsz != sizeof(uint64_t))
+			return ARC_STAT_INVALID;
+
+		arc_keycache_stats(lib->arcl_keycache, &hits, &misses, NULL);
+
+		if (arg == ARC_OPTS_KEYCACHEHITS)
+			memcpy(val, &hits, valsz);
+		else
+			memcpy(val, &misses, valsz);
+
+		return ARC_STAT_OK;
+
+	  case ARC_OPTS_VERIFYTHREADS:
+	  {
+		ARC_VERIFYPOOL *pool = NULL;
+
+		if (val == NULL)
+			return ARC_STAT_INVALID;
+
+		if (valsz != sizeof lib->arcl_verifythreads)
+			return ARC_STAT_INVALID;
+
+		if (op == ARC_OP_GETOPT)
+		{
+			memcpy(val, &lib->arcl_verifythreads, valsz);
+			return ARC_STAT_OK;
+		}
+
+		memcpy(&lib->arcl_verifythreads, val, valsz);
+
+		if (lib->arcl_verifythreads > 0)
+		{
+			pool = arc_verifypool_new(lib->arcl_verifythreads);
+			if (pool == NULL)
+			{
+				lib->arcl_verifythreads = 0;
+				return ARC_STAT_NORESOURCE;
+			}
+		}
+
+		arc_verifypool_free(lib->arcl_verifypool);
+		lib->arcl_verifypool = pool;
+
+		return ARC_STAT_OK;
+	  }
+
+	  case ARC_OPTS_NAMESERVERS:
+	  {
+		u_char *nslist = NULL;
+
+		if (op == ARC_OP_GETOPT)
+		{
+			if (val == NULL)
+				return ARC_STAT_INVALID;
+
+			strlcpy((char *) val,
+			        lib->arcl_nslist == NULL ? ""
+			                                 : (char *) lib->arcl_nslist,
+			        valsz);
+
+			return ARC_STAT_OK;
+		}
+
+		if (lib->arcl_dns_nslist == NULL)
+			return ARC_STAT_NOTIMPLEMENT;
+
+		if (val != NULL)
+		{
+			nslist = (u_char *) strdup((char *) val);
+			if (nslist == NULL)
+				return ARC_STAT_NORESOURCE;
+		}
+
+		pthread_mutex_lock(&lib->arcl_dnslock);
+
+		/* apply it now if the resolver is already running */
+		if (nslist != NULL && lib->arcl_dns_service != NULL &&
+		    lib->arcl_dns_nslist(lib->arcl_dns_service,
+		                         (char *) nslist) != ARC_DNS_SUCCESS)
+		{
+			pthread_mutex_unlock(&lib->arcl_dnslock);
+			free(nslist);
+			return ARC_STAT_INVALID;
+		}
+
+		if (lib->arcl_nslist != NULL)
+			free(lib->arcl_nslist);
+		lib->arcl_nslist = nslist;
+
+		pthread_mutex_unlock(&lib->arcl_dnslock);
+
+		return ARC_STAT_OK;
+	  }
+
 	  default:
 		assert(0);
 	}
@@ -914,6 +1217,69 @@ arc_getsslbuf(ARC_LIB *lib)
 	return (const char *) arc_dstring_get(lib->arcl_sslerrbuf);
 }
 
+/*
+**  ARC_KEYCACHE_WRITE -- save the key cache to a snapshot file
+**
+**  Parameters:
+**  	lib -- library handle
+**  	path -- file to write; replaced atomically
+**
+**  Return value:
+**  	ARC_STAT_OK, or ARC_STAT_NORESOURCE with errno set on failure.
+*/
+
+ARC_STAT
+arc_keycache_write(ARC_LIB *lib, const char *path)
+{
+	assert(lib != NULL);
+	assert(path != NULL);
+
+	return arc_keycache_save(lib->arcl_keycache, path);
+}
+
+/*
+**  ARC_KEYCACHE_READ -- warm the key cache from a snapshot file
+**
+**  Parameters:
+**  	lib -- library handle
+**  	path -- file written earlier by arc_keycache_write()
+**  	nkeys -- number of records restored (returned; may be NULL)
+**
+**  Return value:
+**  	ARC_STAT_OK; ARC_STAT_NORESOURCE with errno set if the file can't
+**  	be read; ARC_STAT_SYNTAX if it isn't a valid snapshot.
+*/
+
+ARC_STAT
+arc_keycache_read(ARC_LIB *lib, const char *path, u_int *nkeys)
+{
+	assert(lib != NULL);
+	assert(path != NULL);
+
+	return arc_keycache_load(lib->arcl_keycache, path, nkeys);
+}
+
+/*
+**  ARC_KEYCACHE_COPY -- warm the key cache from another library's
+**
+**  Parameters:
+**  	dst -- library handle whose cache is filled
+**  	src -- library handle whose cache is copied
+**  	nkeys -- number of records copied (returned; may be NULL)
+**
+**  Return value:
+**  	None.
+*/
+
+void
+arc_keycache_copy(ARC_LIB *dst, ARC_LIB *src, u_int *nkeys)
+{
+	assert(dst != NULL);
+	assert(src != NULL);
+
+	arc_keycache_clone(dst->arcl_keycache, src->arcl_keycache, nkeys);
+}
+
 /*
 **  ARC_CHECK_UINT -- check a parameter for a valid unsigned integer
 **
@@ -1164,7 +1530,7 @@ arc_add_plist(ARC_MESSAGE *msg, ARC_KVSET *set, u_char *param, u_char *value,
 	{
 		int n;
 
-		plist = (ARC_PLIST *) malloc(sizeof(ARC_PLIST));
+		plist = (ARC_PLIST *) arc_malloc(msg, sizeof(ARC_PLIST));
 		if (plist == NULL)
 		{
 			arc_error(msg, "unable to allocate %d byte(s)",
@@ -1229,7 +1595,7 @@ arc_process_set(ARC_MESSAGE *msg, arc_kvsettype_t type, u_char *str,
 	state = 0;
 	spaced = FALSE;
 
-	hcopy = (u_char *) malloc(len + 1);
+	hcopy = (u_char *) arc_malloc(msg, len + 1);
 	if (hcopy == NULL)
 	{
 		arc_error(msg, "unable to allocate %d byte(s)", len + 1);
@@ -1237,10 +1603,10 @@ arc_process_set(ARC_MESSAGE *msg, arc_kvsettype_t type, u_char *str,
 	}
 	strlcpy((char *) hcopy, (char *) str, len + 1);
 
-	set = (ARC_KVSET *) malloc(sizeof(ARC_KVSET));
+	set = (ARC_KVSET *) arc_malloc(msg, sizeof(ARC_KVSET));
 	if (set == NULL)
 	{
-		free(hcopy);
+		arc_mfree(msg, hcopy);
 		arc_error(msg, "unable to allocate %d byte(s)",
 		          sizeof(ARC_KVSET));
 		return ARC_STAT_INTERNAL;
@@ -1450,7 +1816,7 @@ arc_process_set(ARC_MESSAGE *msg, arc_kvsettype_t type, u_char *str,
 
 		/* make sure nothing got signed that shouldn't be */
 		p = arc_param_get(set, (u_char *) "h");
-		hcopy = strdup(p);
+		hcopy = arc_mstrndup(msg, p, strlen(p));
 		if (hcopy == NULL)
 		{
 			len = strlen(p);
@@ -1467,10 +1833,12 @@ arc_process_set(ARC_MESSAGE *msg, arc_kvsettype_t type, u_char *str,
 			{
 				arc_error(msg, "ARC-Message-Signature signs %s",
 				          p);
+				arc_mfree(msg, hcopy);
 				set->set_bad = TRUE;
 				return ARC_STAT_INTERNAL;
 			}
 		}
+		arc_mfree(msg, hcopy);
 
 		/* test validity of "t", "x", and "i" */
 		
@@ -1567,25 +1935,65 @@ arc_get_key(ARC_MESSAGE *msg, _Bool test)
 	_Bool gotreply = FALSE;			/* reply received */
 	int status;
 	int c;
+	ARC_LIB *lib;
+	BIO *keybio;
+	EVP_PKEY *pkey = NULL;
 	struct arc_kvset *set = NULL;
 	struct arc_kvset *nextset;
 	unsigned char *p;
+	char qname[ARC_MAXHOSTNAMELEN + 1];
 	unsigned char buf[BUFRSZ + 1];
 
 	assert(msg != NULL);
 	assert(msg->arc_selector != NULL);
 	assert(msg->arc_domain != NULL);
 
+	lib = msg->arc_library;
+
+	if (msg->arc_pkey != NULL)
+	{
+		EVP_PKEY_free(msg->arc_pkey);
+		msg->arc_pkey = NULL;
+	}
+
 	memset(buf, '\0', sizeof buf);
 
 	/* use appropriate get method */
 	switch (msg->arc_query)
 	{
 	  case ARC_QUERY_DNS:
-		status = (int) arc_get_key_dns(msg, buf, sizeof buf);
+	  {
+		ARC_STAT cstat;
+
+		c = snprintf(qname, sizeof qname, "%s.%s.%s",
+		             msg->arc_selector, ARC_DNSKEYNAME,
+		             msg->arc_domain);
+		if (c < 0 || c >= sizeof qname)
+		{
+			arc_error(msg, "key query name too large");
+			return ARC_STAT_NORESOURCE;
+		}
+
+		/* try the cache first */
+		if (arc_keycache_get(lib->arcl_keycache, qname,
+		                     buf, sizeof buf, &cstat))
+		{
+			if (cstat != ARC_STAT_OK)
+			{
+				arc_error(msg, "'%s' record not found (cached)",
+				          qname);
+				return cstat;
+			}
+
+			break;
+		}
+
+		/* this also adds the result to the cache */
+		status = (int) arc_get_key_dns(msg, buf, sizeof buf, NULL);
 		if (status != (int) ARC_STAT_OK)
 			return (ARC_STAT) status;
 		break;
+	  }
 
 	  case ARC_QUERY_FILE:
 		status = (int) arc_get_key_file(msg, buf, sizeof buf);
@@ -1657,7 +2065,8 @@ arc_get_key(ARC_MESSAGE *msg, _Bool test)
 		arc_error(msg, "key type missing");
 		return ARC_STAT_SYNTAX;
 	}
-	else if (arc_name_to_code(keytypes, (char *) p) == -1)
+	msg->arc_keytype = arc_name_to_code(keytypes, (char *) p);
+	if (msg->arc_keytype == (u_int) -1)
 	{
 		arc_error(msg, "unknown key type '%s'", p);
 		return ARC_STAT_SYNTAX;
@@ -1719,49 +2128,225 @@ arc_get_key(ARC_MESSAGE *msg, _Bool test)
 		}
 	}
 
+	/*
+	**  Reuse the decoded key attached to the cached record if there
+	**  is one; otherwise decode it now and attach it for the next
+	**  message that needs it.
+	*/
+
+	if (msg->arc_query == ARC_QUERY_DNS)
+		pkey = arc_keycache_getpkey(lib->arcl_keycache, qname);
+
+#ifdef HAVE_ED25519
+	/* RFC 8463: "p=" is the bare 32-byte public key, not a SPKI */
+	if (pkey == NULL && msg->arc_keytype == ARC_KEYTYPE_ED25519)
+	{
+		pkey = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, NULL,
+		                                   msg->arc_key,
+		                                   msg->arc_keylen);
+		if (pkey == NULL)
+		{
+			arc_error(msg, "EVP_PKEY_new_raw_public_key() failed");
+			return ARC_STAT_SYNTAX;
+		}
+
+		if (msg->arc_query == ARC_QUERY_DNS)
+			arc_keycache_setpkey(lib->arcl_keycache, qname, pkey);
+	}
+#endif /* HAVE_ED25519 */
+
+	if (pkey == NULL)
+	{
+		keybio = BIO_new_mem_buf(msg->arc_key, msg->arc_keylen);
+		if (keybio == NULL)
+		{
+			arc_error(msg, "BIO_new_mem_buf() failed");
+			return ARC_STAT_NORESOURCE;
+		}
+
+		pkey = d2i_PUBKEY_bio(keybio, NULL);
+		BIO_free(keybio);
+		if (pkey == NULL)
+		{
+			arc_error(msg, "d2i_PUBKEY_bio() failed");
+			return ARC_STAT_INTERNAL;
+		}
+
+		if (msg->arc_query == ARC_QUERY_DNS)
+			arc_keycache_setpkey(lib->arcl_keycache, qname, pkey);
+	}
+
+	msg->arc_pkey = pkey;
+
 	return ARC_STAT_OK;
 }
 
 /*
-**  ARC_VALIDATE_MSG -- validate a specific ARC-Message-Signature
+**  ARC_VERIFY_SETKEY -- attach the current key to a signature check
 **
 **  Parameters:
 **  	msg -- ARC message handle
-**  	set -- ARC set number whose AMS should be validated (zero-based)
-**  	verify -- verify or sign
+**  	alg -- value of the signature's "a=" tag (may be NULL)
+**  	av -- signature check to fill in
 **
 **  Return value:
-**  	An ARC_STAT_* constant.
+**  	An ARC_STAT_* constant.  ARC_STAT_BADSIG means the key can't
+**  	have made a signature of this type.
+**
+**  Notes:
+**  	The key is handed over to "av"; msg->arc_pkey is cleared.
 */
 
 static ARC_STAT
-arc_validate_msg(ARC_MESSAGE *msg, u_int setnum)
+arc_verify_setkey(ARC_MESSAGE *msg, u_char *alg, struct arc_verify *av)
 {
-	int nid;
-	int rsastat;
-	size_t elen;
-	size_t hhlen;
-	size_t bhlen;
-	size_t b64siglen;
-	size_t b64bhlen;
-	size_t siglen;
-	ARC_STAT status;
-	u_char *alg;
-	u_char *b64sig;
-	u_char *b64bh;
-	u_char *b64bhtag;
-	void *hh;
-	void *bh;
-	void *sig;
-	BIO *key;
-	struct arc_set *set;
-	struct arc_hdrfield *h;
+	int signalg;
+
+	assert(msg != NULL);
+	assert(av != NULL);
+
+	signalg = ARC_SIGN_RSASHA1;
+	if (alg != NULL)
+		signalg = arc_name_to_code(algorithms, (char *) alg);
+
+	if (signalg == ARC_SIGN_ED25519SHA256)
+	{
+		if (msg->arc_keytype != ARC_KEYTYPE_ED25519)
+		{
+			arc_error(msg, "key type mismatch");
+			return ARC_STAT_BADSIG;
+		}
+
+		/* RFC 8463 signs the hash itself, so no digest is named */
+		av->av_md = NULL;
+	}
+	else
+	{
+		if (msg->arc_keytype != ARC_KEYTYPE_RSA ||
+		    EVP_PKEY_base_id(msg->arc_pkey) != EVP_PKEY_RSA)
+		{
+			arc_error(msg, "key type mismatch");
+			return ARC_STAT_BADSIG;
+		}
+
+		av->av_md = arc_md_sha1();
+		if (signalg == ARC_SIGN_RSASHA256)
+			av->av_md = arc_md_sha256();
+	}
+
+	av->av_pkey = msg->arc_pkey;
+	msg->arc_pkey = NULL;
+
+	return ARC_STAT_OK;
+}
+
+/*
+**  ARC_TIMING_START -- start timing a phase
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**
+**  Return value:
+**  	A start time for arc_timing_stop(), or 0 if timing is off.
+*/
+
+static uint64_t
+arc_timing_start(ARC_MESSAGE *msg)
+{
+	if ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_TIMING) == 0)
+		return 0;
+
+	return arc_clock_usec();
+}
+
+/*
+**  ARC_TIMING_ADD -- charge time to a phase
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**  	phase -- ARC_TIMING_* constant
+**  	hop -- ARC set the time was spent on, or 0
+**  	usec -- microseconds to add
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_timing_add(ARC_MESSAGE *msg, int phase, u_int hop, uint64_t usec)
+{
+	struct arc_hoptiming *ht;
+
+	msg->arc_timing[phase] += usec;
+
+	if (hop == 0 || hop > msg->arc_nsets || msg->arc_hoptiming == NULL)
+		return;
+
+	ht = &msg->arc_hoptiming[hop - 1];
+	if (phase == ARC_TIMING_KEYFETCH)
+		ht->ht_keyfetch += usec;
+	else if (phase == ARC_TIMING_VERIFY)
+		ht->ht_verify += usec;
+}
+
+/*
+**  ARC_TIMING_STOP -- finish timing a phase
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**  	phase -- ARC_TIMING_* constant
+**  	hop -- ARC set the time was spent on, or 0
+**  	start -- value returned by arc_timing_start()
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_timing_stop(ARC_MESSAGE *msg, int phase, u_int hop, uint64_t start)
+{
+	if ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_TIMING) == 0)
+		return;
+
+	arc_timing_add(msg, phase, hop, arc_clock_usec() - start);
+}
+
+/*
+**  ARC_VALIDATE_MSG -- prepare to validate a specific ARC-Message-Signature
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**  	set -- ARC set number whose AMS should be validated (one-based)
+**  	av -- signature check to fill in
+**
+**  Return value:
+**  	An ARC_STAT_* constant.  ARC_STAT_BADSIG means the body hash
+**  	didn't match, so the signature needn't be checked.
+*/
+
+static ARC_STAT
+arc_validate_msg(ARC_MESSAGE *msg, u_int setnum, struct arc_verify *av)
+{
+	uint64_t start;
+	size_t elen;
+	size_t hhlen;
+	size_t bhlen;
+	size_t b64siglen;
+	size_t b64bhlen;
+	int siglen;
+	ARC_STAT status;
+	u_char *alg;
+	u_char *b64sig;
+	u_char *b64bh;
+	u_char *b64bhtag;
+	void *hh;
+	void *bh;
+	void *sig;
+	struct arc_set *set;
 	ARC_KVSET *kvset;
-	BIO *keydata;
-	EVP_PKEY *pkey;
-	RSA *rsa;
 
 	assert(msg != NULL);
+	assert(av != NULL);
 
 	/* pull the (set-1)th ARC Set */
 	set = &msg->arc_sets[setnum - 1];
@@ -1789,7 +2374,9 @@ arc_validate_msg(ARC_MESSAGE *msg, u_int setnum)
 	msg->arc_domain = arc_param_get(kvset, "d");
 
 	/* get the key from DNS (or wherever) */
+	start = arc_timing_start(msg);
 	status = arc_get_key(msg, FALSE);
+	arc_timing_stop(msg, ARC_TIMING_KEYFETCH, setnum, start);
 	if (status != ARC_STAT_OK)
 	{
 		arc_error(msg, "arc_get_key() failed");
@@ -1804,10 +2391,29 @@ arc_validate_msg(ARC_MESSAGE *msg, u_int setnum)
 		return status;
 	}
 
-	/* extract the signature and body hash from the message */
+	/* verify the signature's "bh" against our computed one */
+	b64bhtag = arc_param_get(kvset, "bh");
+	b64bhlen = BASE64SIZE(bhlen);
+	b64bh = malloc(b64bhlen + 1);
+	if (b64bh == NULL)
+	{
+		arc_error(msg, "unable to allocate %d bytes", b64bhlen + 1);
+		return ARC_STAT_INTERNAL;
+	}
+	memset(b64bh, '\0', b64bhlen + 1);
+	elen = arc_base64_encode(bh, bhlen, b64bh, b64bhlen);
+	if (elen != strlen(b64bhtag) || strcmp(b64bh, b64bhtag) != 0)
+	{
+		arc_error(msg, "body hash mismatch");
+		free(b64bh);
+		return ARC_STAT_BADSIG;
+	}
+
+	free(b64bh);
+
+	/* extract the signature from the message */
 	b64sig = arc_param_get(kvset, "b");
 	b64siglen = strlen(b64sig);
-	b64bhtag = arc_param_get(kvset, "bh");
 
 	sig = malloc(b64siglen);
 	if (sig == NULL)
@@ -1819,98 +2425,56 @@ arc_validate_msg(ARC_MESSAGE *msg, u_int setnum)
 	if (siglen < 0)
 	{
 		arc_error(msg, "unable to decode signature");
+		free(sig);
 		return ARC_STAT_SYNTAX;
 	}
 
-	/* verify the signature against the header hash and the key */
-	key = BIO_new_mem_buf(msg->arc_key, msg->arc_keylen);
-	if (key == NULL)
-	{
-		arc_error(msg, "BIO_new_mem_buf() failed");
-		return ARC_STAT_INTERNAL;
-	}
-
-	pkey = d2i_PUBKEY_bio(key, NULL);
-	if (pkey == NULL)
-	{
-		arc_error(msg, "d2i_PUBKEY_bio() failed");
-		return ARC_STAT_INTERNAL;
-	}
-
-	rsa = EVP_PKEY_get1_RSA(pkey);
-	if (rsa == NULL)
-	{
-		arc_error(msg, "EVP_PKEY_get1_RSA() failed");
-		return ARC_STAT_INTERNAL;
-	}
-
+	/* the signature is checked against the header hash and the key */
 	alg = arc_param_get(kvset, "a");
-	nid = NID_sha1;
-	if (alg != NULL && strcmp(alg, "rsa-sha256") == 0)
-		nid = NID_sha256;
-
-	rsastat = RSA_verify(nid, hh, hhlen, sig, siglen, rsa);
-
-	RSA_free(rsa);
-	BIO_free(key);
-
-	if (rsastat != 1)
-		return ARC_STAT_BADSIG;
-
-	/* verify the signature's "bh" against our computed one */
-	b64bhlen = BASE64SIZE(bhlen);
-	b64bh = malloc(b64bhlen) + 1;
-	if (b64bh == NULL)
-	{
-		arc_error(msg, "unable to allocate %d bytes", b64bhlen + 1);
-		return ARC_STAT_INTERNAL;
-	}
-	memset(b64bh, '\0', b64bhlen + 1);
-	elen = arc_base64_encode(bh, bhlen, b64bh, b64bhlen);
-	if (elen != strlen(b64bhtag) || strcmp(b64bh, b64bhtag) != 0)
+	status = arc_verify_setkey(msg, alg, av);
+	if (status != ARC_STAT_OK)
 	{
-		arc_error(msg, "body hash mismatch");
-		return ARC_STAT_BADSIG;
+		free(sig);
+		return status;
 	}
 
-	/* if we got this far, the signature was good */
+	av->av_hash = hh;
+	av->av_hashlen = hhlen;
+	av->av_sig = sig;
+	av->av_siglen = siglen;
+
 	return ARC_STAT_OK;
 }
 
 /*
-**  ARC_VALIDATE_SEAL -- validate a specific ARC seal
+**  ARC_VALIDATE_SEAL -- prepare to validate a specific ARC seal
 **
 **  Parameters:
 **  	msg -- ARC message handle
-**  	set -- ARC set number to be validated (zero-based)
+**  	set -- ARC set number to be validated (one-based)
+**  	av -- signature check to fill in
 **
 **  Return value:
 **  	An ARC_STAT_* constant.
-**
-**  Side effects:
-**  	Updates msg->arc_cstate.
 */
 
 static ARC_STAT
-arc_validate_seal(ARC_MESSAGE *msg, u_int setnum)
+arc_validate_seal(ARC_MESSAGE *msg, u_int setnum, struct arc_verify *av)
 {
-	int nid;
-	int rsastat;
+	uint64_t start;
 	ARC_STAT status;
 	size_t shlen;
-	size_t siglen;
+	int siglen;
 	size_t b64siglen;
 	u_char *b64sig;
 	void *sh;
 	void *sig;
 	u_char *alg;
 	struct arc_set *set;
-	BIO *key;
-	EVP_PKEY *pkey;
-	RSA *rsa;
 	ARC_KVSET *kvset;
 
 	assert(msg != NULL);
+	assert(av != NULL);
 
 	/* pull the (set-1)th ARC Set */
 	set = &msg->arc_sets[setnum - 1];
@@ -1921,7 +2485,9 @@ arc_validate_seal(ARC_MESSAGE *msg, u_int setnum)
 	msg->arc_domain = arc_param_get(kvset, "d");
 
 	/* get the key from DNS (or wherever) */
+	start = arc_timing_start(msg);
 	status = arc_get_key(msg, FALSE);
+	arc_timing_stop(msg, ARC_TIMING_KEYFETCH, setnum, start);
 	if (status != ARC_STAT_OK)
 	{
 		arc_error(msg, "arc_get_key() failed");
@@ -1949,48 +2515,24 @@ arc_validate_seal(ARC_MESSAGE *msg, u_int setnum)
 	if (siglen < 0)
 	{
 		arc_error(msg, "unable to decode signature");
+		free(sig);
 		return ARC_STAT_SYNTAX;
 	}
 
-	/* verify the signature against the header hash and the key */
-	key = BIO_new_mem_buf(msg->arc_key, msg->arc_keylen);
-	if (key == NULL)
-	{
-		arc_error(msg, "BIO_new_mem_buf() failed");
-		return ARC_STAT_INTERNAL;
-	}
-
-	pkey = d2i_PUBKEY_bio(key, NULL);
-	if (pkey == NULL)
-	{
-		arc_error(msg, "d2i_PUBKEY_bio() failed");
-		return ARC_STAT_INTERNAL;
-	}
-
-	rsa = EVP_PKEY_get1_RSA(pkey);
-	if (rsa == NULL)
-	{
-		arc_error(msg, "EVP_PKEY_get1_RSA() failed");
-		return ARC_STAT_INTERNAL;
-	}
-
+	/* the signature is checked against the seal hash and the key */
 	alg = arc_param_get(kvset, "a");
-	nid = NID_sha1;
-	if (alg != NULL && strcmp(alg, "rsa-sha256") == 0)
-		nid = NID_sha256;
-
-	rsastat = RSA_verify(nid, sh, shlen, sig, siglen, rsa);
-
-	RSA_free(rsa);
-	BIO_free(key);
-
-	if (rsastat != 1)
+	status = arc_verify_setkey(msg, alg, av);
+	if (status != ARC_STAT_OK)
 	{
-		msg->arc_cstate = ARC_CHAIN_FAIL;
-		return ARC_STAT_BADSIG;
+		free(sig);
+		return status;
 	}
 
-	/* if we got this far, the signature was good */
+	av->av_hash = sh;
+	av->av_hashlen = shlen;
+	av->av_sig = sig;
+	av->av_siglen = siglen;
+
 	return ARC_STAT_OK;
 }
 
@@ -2018,52 +2560,234 @@ arc_message(ARC_LIB *lib, arc_canon_t canonhdr, arc_canon_t canonbody,
 	if (msg == NULL)
 	{
 		*err = strerror(errno);
+		return NULL;
 	}
-	else
-	{
-		memset(msg, '\0', sizeof *msg);
 
-		msg->arc_library = lib;
-		if (lib->arcl_fixedtime != 0)
-			msg->arc_timestamp = lib->arcl_fixedtime;
-		else
-			(void) time(&msg->arc_timestamp);
+	memset(msg, '\0', sizeof *msg);
+
+	if ((lib->arcl_flags & ARC_LIBFLAGS_ARENA) != 0)
+	{
+		msg->arc_arena = arc_arena_new();
+		if (msg->arc_arena == NULL)
+		{
+			*err = strerror(errno);
+			free(msg);
+			return NULL;
+		}
 	}
 
+	msg->arc_library = lib;
+	if (lib->arcl_fixedtime != 0)
+		msg->arc_timestamp = lib->arcl_fixedtime;
+	else
+		(void) time(&msg->arc_timestamp);
+
 	msg->arc_canonhdr = canonhdr;
 	msg->arc_canonbody = canonbody;
 	msg->arc_signalg = signalg;
 	msg->arc_margin = ARC_HDRMARGIN;
+	msg->arc_query = lib->arcl_querymethod;
 
 	return msg;
 }
 
 /*
-**  ARC_FREE -- deallocate a message object
+**  ARC_MESSAGE_CLEANUP -- release the per-message state of a message object
 **
 **  Parameters:
-**  	msg -- message object to be destroyed
+**  	msg -- message object
 **
 **  Return value:
 **  	None.
+**
+**  Notes:
+**  	The handle itself, its arena, its error buffer and the scratch
+**  	buffers that are reused from one message to the next (arc_canonbuf,
+**  	arc_hdrbuf) are left alone.  Arena memory is not
+**  	released here either; the caller resets or frees the arena.
 */
 
-void
-arc_free(ARC_MESSAGE *msg)
+static void
+arc_message_cleanup(ARC_MESSAGE *msg)
 {
+	int c;
 	struct arc_hdrfield *h;
 	struct arc_hdrfield *tmp;
+	struct arc_kvset *set;
+	struct arc_kvset *nextset;
+	struct arc_plist *plist;
+	struct arc_plist *nextplist;
+
+	arc_canon_cleanup(msg);
+
+	arc_key_prefetch_cleanup(msg);
+
+	if (msg->arc_key != NULL)
+		free(msg->arc_key);
+	if (msg->arc_pkey != NULL)
+		EVP_PKEY_free(msg->arc_pkey);
+	if (msg->arc_hoptiming != NULL)
+		free(msg->arc_hoptiming);
+
+	if (msg->arc_arena != NULL)
+		return;
 
 	h = msg->arc_hhead;
 	while (h != NULL)
 	{
 		tmp = h->hdr_next;
 		free(h->hdr_text);
+		if (h->hdr_canon != NULL)
+			free(h->hdr_canon);
 		free(h);
 		h = tmp;
 	}
 
-	arc_canon_cleanup(msg);
+	h = msg->arc_sealhead;
+	while (h != NULL)
+	{
+		tmp = h->hdr_next;
+		free(h->hdr_text);
+		if (h->hdr_canon != NULL)
+			free(h->hdr_canon);
+		free(h);
+		h = tmp;
+	}
+
+	for (set = msg->arc_kvsethead; set != NULL; set = nextset)
+	{
+		nextset = set->set_next;
+
+		for (c = 0; c < NPRINTABLE; c++)
+		{
+			for (plist = set->set_plist[c];
+			     plist != NULL;
+			     plist = nextplist)
+			{
+				nextplist = plist->plist_next;
+				free(plist);
+			}
+		}
+
+		free(set->set_data);
+		free(set);
+	}
+
+	if (msg->arc_sets != NULL)
+		free(msg->arc_sets);
+	if (msg->arc_sealcanons != NULL)
+		free(msg->arc_sealcanons);
+}
+
+/*
+**  ARC_MESSAGE_RESET -- prepare a message object for reuse
+**
+**  Parameters:
+**  	msg -- message object to be reset
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	The object is returned to the state arc_message() left it in,
+**  	with the same library, canonicalizations and signing algorithm,
+**  	but keeps its arena and scratch buffers so the next message can
+**  	be processed without allocating them again.
+*/
+
+void
+arc_message_reset(ARC_MESSAGE *msg)
+{
+	u_int timeout;
+	u_int margin;
+	arc_canon_t canonhdr;
+	arc_canon_t canonbody;
+	int signalg;
+	struct arc_dstring *canonbuf = NULL;
+	struct arc_dstring *hdrbuf = NULL;
+	ARC_ARENA *arena;
+	ARC_LIB *lib;
+	const void *ctx;
+
+	assert(msg != NULL);
+
+	arc_message_cleanup(msg);
+
+	if (msg->arc_error != NULL)
+		free(msg->arc_error);
+
+	arena = msg->arc_arena;
+	if (arena != NULL)
+	{
+		arc_arena_reset(arena);
+	}
+	else
+	{
+		canonbuf = msg->arc_canonbuf;
+		if (canonbuf != NULL)
+			arc_dstring_blank(canonbuf);
+		hdrbuf = msg->arc_hdrbuf;
+		if (hdrbuf != NULL)
+			arc_dstring_blank(hdrbuf);
+	}
+
+	lib = msg->arc_library;
+	ctx = msg->arc_user_context;
+	timeout = msg->arc_timeout;
+	margin = msg->arc_margin;
+	canonhdr = msg->arc_canonhdr;
+	canonbody = msg->arc_canonbody;
+	signalg = msg->arc_signalg;
+
+	memset(msg, '\0', sizeof *msg);
+
+	msg->arc_arena = arena;
+	msg->arc_library = lib;
+	msg->arc_user_context = ctx;
+	msg->arc_timeout = timeout;
+	msg->arc_margin = margin;
+	msg->arc_canonhdr = canonhdr;
+	msg->arc_canonbody = canonbody;
+	msg->arc_signalg = signalg;
+	msg->arc_canonbuf = canonbuf;
+	msg->arc_hdrbuf = hdrbuf;
+	msg->arc_query = lib->arcl_querymethod;
+
+	if (lib->arcl_fixedtime != 0)
+		msg->arc_timestamp = lib->arcl_fixedtime;
+	else
+		(void) time(&msg->arc_timestamp);
+}
+
+/*
+**  ARC_FREE -- deallocate a message object
+**
+**  Parameters:
+**  	msg -- message object to be destroyed
+**
+**  Return value:
+**  	None.
+*/
+
+void
+arc_free(ARC_MESSAGE *msg)
+{
+	arc_message_cleanup(msg);
+
+	if (msg->arc_error != NULL)
+		free(msg->arc_error);
+
+	if (msg->arc_arena != NULL)
+	{
+		arc_arena_free(msg->arc_arena);
+	}
+	else
+	{
+		if (msg->arc_canonbuf != NULL)
+			arc_dstring_free(msg->arc_canonbuf);
+		if (msg->arc_hdrbuf != NULL)
+			arc_dstring_free(msg->arc_hdrbuf);
+	}
 
 	free(msg);
 }
@@ -2137,7 +2861,7 @@ arc_parse_header_field(ARC_MESSAGE *msg, u_char *hdr, size_t hlen,
 	if (semicolon != NULL && colon != NULL && semicolon < colon)
 		return ARC_STAT_SYNTAX;
 
-	h = malloc(sizeof *h);
+	h = arc_malloc(msg, sizeof *h);
 	if (h == NULL)
 	{
 		arc_error(msg, "unable to allocate %d byte(s)", sizeof *h);
@@ -2154,7 +2878,7 @@ arc_parse_header_field(ARC_MESSAGE *msg, u_char *hdr, size_t hlen,
 		tmphdr = arc_dstring_new(msg, BUFRSZ, MAXBUFRSZ);
 		if (tmphdr == NULL)
 		{
-			free(h);
+			arc_mfree(msg, h);
 			return ARC_STAT_NORESOURCE;
 		}
 
@@ -2182,19 +2906,19 @@ arc_parse_header_field(ARC_MESSAGE *msg, u_char *hdr, size_t hlen,
 		if (prev == '\r')				/* end CR */
 			arc_dstring_cat1(tmphdr, '\n');
 
-		h->hdr_text = arc_strndup(arc_dstring_get(tmphdr),
-		                          arc_dstring_len(tmphdr));
+		h->hdr_text = arc_mstrndup(msg, arc_dstring_get(tmphdr),
+		                           arc_dstring_len(tmphdr));
 
 		arc_dstring_free(tmphdr);
 	}
 	else
 	{
-		h->hdr_text = arc_strndup(hdr, hlen);
+		h->hdr_text = arc_mstrndup(msg, hdr, hlen);
 	}
 
 	if (h->hdr_text == NULL)
 	{
-		free(h);
+		arc_mfree(msg, h);
 		return ARC_STAT_NORESOURCE;
 	}
 
@@ -2205,7 +2929,16 @@ arc_parse_header_field(ARC_MESSAGE *msg, u_char *hdr, size_t hlen,
 	else
 		h->hdr_colon = h->hdr_text + (colon - hdr);
 	h->hdr_flags = 0;
+	h->hdr_hash = arc_hdrhash(h->hdr_text, h->hdr_namelen);
+	h->hdr_nsame = 0;
+	h->hdr_canon = NULL;
+	h->hdr_canonlen = 0;
 	h->hdr_next = NULL;
+	h->hdr_nextname = NULL;
+	h->hdr_nextsame = NULL;
+	h->hdr_prevsame = NULL;
+	h->hdr_lastsame = NULL;
+	h->hdr_selnext = NULL;
 
 	*ret = h;
 
@@ -2227,6 +2960,7 @@ arc_parse_header_field(ARC_MESSAGE *msg, u_char *hdr, size_t hlen,
 ARC_STAT
 arc_header_field(ARC_MESSAGE *msg, u_char *hdr, size_t hlen)
 {
+	uint64_t start;
 	ARC_STAT status;
 	struct arc_hdrfield *h;
 
@@ -2238,7 +2972,9 @@ arc_header_field(ARC_MESSAGE *msg, u_char *hdr, size_t hlen)
 		return ARC_STAT_INVALID;
 	msg->arc_state = ARC_STATE_HEADER;
 
+	start = arc_timing_start(msg);
 	status = arc_parse_header_field(msg, hdr, hlen, &h);
+	arc_timing_stop(msg, ARC_TIMING_PARSE, 0, start);
 	if (status != ARC_STAT_OK)
 		return status;
 
@@ -2253,13 +2989,15 @@ arc_header_field(ARC_MESSAGE *msg, u_char *hdr, size_t hlen)
 		msg->arc_htail = h;
 	}
 
+	arc_hdrindex_add(msg, h);
+
 	msg->arc_hdrcnt++;
 
 	return ARC_STAT_OK;
 }
 
 /*
-**  ARC_EOH -- declare no more header fields are coming
+**  ARC_EOH_WORK -- arc_eoh() proper
 **
 **  Parameters:
 **  	msg -- message handle
@@ -2268,12 +3006,14 @@ arc_header_field(ARC_MESSAGE *msg, u_char *hdr, size_t hlen)
 **  	An ARC_STAT_* constant.
 */
 
-ARC_STAT
-arc_eoh(ARC_MESSAGE *msg)
+static ARC_STAT
+arc_eoh_work(ARC_MESSAGE *msg)
 {
 	_Bool keep;
+	int hashtype;
 	u_int c;
 	u_int n;
+	u_int last;
 	u_int nsets = 0;
 	arc_kvsettype_t type;
 	ARC_STAT status;
@@ -2281,6 +3021,7 @@ arc_eoh(ARC_MESSAGE *msg)
 	ARC_KVSET *set;
 	u_char *inst;
 	u_char *htag;
+	u_char *cv;
 
 	if (msg->arc_state >= ARC_STATE_EOH)
 		return ARC_STAT_INVALID;
@@ -2292,17 +3033,11 @@ arc_eoh(ARC_MESSAGE *msg)
 
 	for (h = msg->arc_hhead; h != NULL; h = h->hdr_next)
 	{
-		char hnbuf[ARC_MAXHEADER + 1];
+		arc_kvsettype_t kvtype;
 
-		memset(hnbuf, '\0', sizeof hnbuf);
-		strncpy(hnbuf, h->hdr_text, h->hdr_namelen);
-		if (strcasecmp(hnbuf, ARC_AR_HDRNAME) == 0 ||
-		    strcasecmp(hnbuf, ARC_MSGSIG_HDRNAME) == 0 ||
-		    strcasecmp(hnbuf, ARC_SEAL_HDRNAME) == 0)
+		kvtype = arc_hdr_arctype(h);
+		if (kvtype != -1)
 		{
-			arc_kvsettype_t kvtype;
-
-			kvtype = arc_name_to_code(archdrnames, hnbuf);
 			status = arc_process_set(msg, kvtype,
 			                         h->hdr_colon + 1,
 			                         h->hdr_textlen - h->hdr_namelen - 1,
@@ -2333,7 +3068,7 @@ arc_eoh(ARC_MESSAGE *msg)
 	/* build up the array of ARC sets, for use later */
 	if (nsets > 0)
 	{
-		msg->arc_sets = malloc(sizeof(struct arc_set) * nsets);
+		msg->arc_sets = arc_malloc(msg, sizeof(struct arc_set) * nsets);
 		if (msg->arc_sets == NULL)
 			return ARC_STAT_NORESOURCE;
 		memset(msg->arc_sets, '\0', sizeof(struct arc_set) * nsets);
@@ -2387,7 +3122,12 @@ arc_eoh(ARC_MESSAGE *msg)
 		}
 	}
 
-	/* look for invalid stuff */
+	/*
+	**  Look for structural problems.  Any of these means the chain
+	**  fails no matter what the signatures say, so arc_eom() won't
+	**  need any keys or signature checks.
+	*/
+
 	for (c = 0; c < nsets; c++)
 	{
 		if (msg->arc_sets[c].arcset_aar == NULL ||
@@ -2396,8 +3136,50 @@ arc_eoh(ARC_MESSAGE *msg)
 		{
 			arc_error(msg,
 			          "missing or incomplete ARC set at instance %u",
-			          c);
-			return ARC_STAT_SYNTAX;
+			          c + 1);
+			msg->arc_cstate = ARC_CHAIN_FAIL;
+			break;
+		}
+
+		cv = arc_param_get(msg->arc_sets[c].arcset_as->hdr_data, "cv");
+		if (cv == NULL ||
+		    (c == 0 && strcasecmp(cv, "none") != 0) ||
+		    (c != 0 && strcasecmp(cv, "pass") != 0))
+		{
+			arc_error(msg,
+			          "unexpected chain status at instance %u",
+			          c + 1);
+			msg->arc_cstate = ARC_CHAIN_FAIL;
+			break;
+		}
+	}
+
+	/* the oldest set whose seal arc_eom() will check */
+	if ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_NEWESTONLY) != 0)
+		last = nsets;
+	else
+		last = 1;
+
+	/*
+	**  Start the key queries arc_eom() is going to need: the newest
+	**  AMS and every AS.  The replies are collected there, so the
+	**  lookups overlap with the body being delivered and hashed.
+	**  A synchronous resolver would answer each one here, serially,
+	**  including keys arc_eom() may never get to, so don't bother.
+	*/
+
+	if (nsets > 0 && msg->arc_cstate != ARC_CHAIN_FAIL &&
+	    msg->arc_library->arcl_dns_async)
+	{
+		set = msg->arc_sets[nsets - 1].arcset_ams->hdr_data;
+		arc_key_prefetch(msg, arc_param_get(set, "s"),
+		                 arc_param_get(set, "d"));
+
+		for (c = nsets; c >= last; c--)
+		{
+			set = msg->arc_sets[c - 1].arcset_as->hdr_data;
+			arc_key_prefetch(msg, arc_param_get(set, "s"),
+			                 arc_param_get(set, "d"));
 		}
 	}
 
@@ -2405,16 +3187,21 @@ arc_eoh(ARC_MESSAGE *msg)
 	**  Request specific canonicalizations we want to run.
 	*/
 
+	/* only rsa-sha1 hashes with anything other than SHA-256 */
+	hashtype = ARC_HASHTYPE_SHA256;
+	if (msg->arc_signalg == ARC_SIGN_RSASHA1)
+		hashtype = ARC_HASHTYPE_SHA1;
+
 	/* header */
 	h = NULL;
 	htag = NULL;
-	if (nsets > 0)
+	if (nsets > 0 && msg->arc_cstate != ARC_CHAIN_FAIL)
 	{
-		h = msg->arc_sets[n - 1].arcset_ams;
+		h = msg->arc_sets[nsets - 1].arcset_ams;
 		htag = arc_param_get(h->hdr_data, "h");
 	}
 	status = arc_add_canon(msg, ARC_CANONTYPE_HEADER, msg->arc_canonhdr,
-	                       msg->arc_signalg, htag, h, (ssize_t) -1,
+	                       hashtype, htag, h, (ssize_t) -1,
 	                       &msg->arc_hdrcanon);
 	if (status != ARC_STAT_OK)
 	{
@@ -2423,9 +3210,28 @@ arc_eoh(ARC_MESSAGE *msg)
 		return status;
 	}
 
+	/* header, for a new ARC-Message-Signature */
+	if (h == NULL)
+	{
+		msg->arc_signhdrcanon = msg->arc_hdrcanon;
+	}
+	else
+	{
+		status = arc_add_canon(msg, ARC_CANONTYPE_HEADER,
+		                       msg->arc_canonhdr, hashtype,
+		                       NULL, NULL, (ssize_t) -1,
+		                       &msg->arc_signhdrcanon);
+		if (status != ARC_STAT_OK)
+		{
+			arc_error(msg,
+			          "failed to initialize header canonicalization object");
+			return status;
+		}
+	}
+
 	/* body */
 	status = arc_add_canon(msg, ARC_CANONTYPE_BODY, msg->arc_canonbody,
-	                       msg->arc_signalg, NULL, NULL, (ssize_t) -1,
+	                       hashtype, NULL, NULL, (ssize_t) -1,
 	                       &msg->arc_bodycanon);
 	if (status != ARC_STAT_OK)
 	{
@@ -2437,15 +3243,21 @@ arc_eoh(ARC_MESSAGE *msg)
 	/* sets already in the chain */
 	if (nsets > 0)
 	{
-		msg->arc_sealcanons = malloc(nsets * sizeof(ARC_CANON *));
+		msg->arc_sealcanons = arc_malloc(msg,
+		                                 nsets * sizeof(ARC_CANON *));
 		if (msg->arc_sealcanons == NULL)
 		{
 			arc_error(msg,
 		          	"failed to allocate memory for canonicalizations");
-			return status;
+			return ARC_STAT_NORESOURCE;
 		}
 
-		for (n = 0; n < nsets; n++)
+		memset(msg->arc_sealcanons, '\0', nsets * sizeof(ARC_CANON *));
+
+		/* only for the seals arc_eom() will check */
+		for (n = last - 1;
+		     n < nsets && msg->arc_cstate != ARC_CHAIN_FAIL;
+		     n++)
 		{
 			h = msg->arc_sets[n].arcset_as;
 
@@ -2466,152 +3278,463 @@ arc_eoh(ARC_MESSAGE *msg)
 		}
 	}
 
-	/* all sets, for the next chain */
-	status = arc_add_canon(msg,
-	                       ARC_CANONTYPE_SEAL,
-	                       ARC_CANON_RELAXED,
-	                       ARC_HASHTYPE_SHA256,
-	                       NULL,
-	                       NULL,
-	                       (ssize_t) -1,
-	                       &msg->arc_sealcanon);
-	if (status != ARC_STAT_OK)
+	/* all sets, for the next chain */
+	status = arc_add_canon(msg,
+	                       ARC_CANONTYPE_SEAL,
+	                       ARC_CANON_RELAXED,
+	                       ARC_HASHTYPE_SHA256,
+	                       NULL,
+	                       NULL,
+	                       (ssize_t) -1,
+	                       &msg->arc_sealcanon);
+	if (status != ARC_STAT_OK)
+	{
+		arc_error(msg,
+	          	"failed to initialize seal canonicalization object");
+		return status;
+	}
+
+	/* initialize them */
+	keep = ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_KEEPFILES) != 0);
+	status = arc_canon_init(msg, keep, keep);
+	if (status != ARC_STAT_OK)
+	{
+		arc_error(msg, "arc_canon_init() failed");
+		return ARC_STAT_SYNTAX;
+	}
+
+	/* process everything */
+	status = arc_canon_runheaders(msg);
+	if (status != ARC_STAT_OK)
+	{
+		arc_error(msg, "arc_canon_runheaders() failed");
+		return ARC_STAT_SYNTAX;
+	}
+
+	status = arc_canon_runheaders_seal(msg);
+	if (status != ARC_STAT_OK)
+	{
+		arc_error(msg, "arc_canon_runheaders_seal() failed");
+		return ARC_STAT_SYNTAX;
+	}
+
+	return ARC_STAT_OK;
+}
+
+/*
+**  ARC_EOH -- declare no more header fields are coming
+**
+**  Parameters:
+**  	msg -- message handle
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+*/
+
+ARC_STAT
+arc_eoh(ARC_MESSAGE *msg)
+{
+	uint64_t start;
+	ARC_STAT status;
+
+	assert(msg != NULL);
+
+	start = arc_timing_start(msg);
+	status = arc_eoh_work(msg);
+	arc_timing_stop(msg, ARC_TIMING_EOH, 0, start);
+
+	return status;
+}
+
+/*
+**  ARC_BODY -- process a body chunk
+**
+**  Parameters:
+**  	msg -- an ARC message handle
+**  	buf -- the body chunk to be processed, in canonical format
+**  	len -- number of bytes to process starting at "buf"
+**
+**  Return value:
+**  	A ARC_STAT_* constant.
+*/
+
+ARC_STAT
+arc_body(ARC_MESSAGE *msg, u_char *buf, size_t len)
+{
+	uint64_t start;
+	ARC_STAT status;
+
+	assert(msg != NULL);
+	assert(buf != NULL);
+
+	if (msg->arc_state > ARC_STATE_BODY ||
+	    msg->arc_state < ARC_STATE_EOH)
+		return ARC_STAT_INVALID;
+	msg->arc_state = ARC_STATE_BODY;
+
+	start = arc_timing_start(msg);
+	status = arc_canon_bodychunk(msg, buf, len);
+	arc_timing_stop(msg, ARC_TIMING_BODY, 0, start);
+
+	return status;
+}
+
+/*
+**  ARC_EOM -- declare end of message
+**
+**  Parameters:
+**  	msg -- message handle
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+**
+**  Notes:
+**  	If arc_eoh() already found the chain structurally broken, nothing
+**  	is verified.  Otherwise the newest ARC-Message-Signature and then
+**  	the seals, newest first, are checked; with ARC_LIBFLAGS_NEWESTONLY
+**  	only the newest seal is.  Without verification threads each one
+**  	is prepared and checked in turn, stopping at the first failure.
+**  	With them all are prepared and then checked together.  Either way
+**  	the first one that does not pass decides the result: a failed
+**  	check fails the chain, while an error preparing it (such as a
+**  	key that cannot be retrieved) is returned.
+*/
+
+ARC_STAT
+arc_eom(ARC_MESSAGE *msg)
+{
+	u_int c;
+	u_int n;
+	u_int set;
+	u_int last;
+	uint64_t start;
+	uint64_t keyfetch;
+	int cstate;
+	ARC_STAT status;
+	ARC_VERIFYPOOL *pool;
+	struct arc_verify *av;
+
+	/*
+	**  Verify the exisitng chain, if any.
+	*/
+
+	if (msg->arc_nsets == 0)
+	{
+		msg->arc_cstate = ARC_CHAIN_NONE;
+		return ARC_STAT_OK;
+	}
+
+	if (msg->arc_cstate == ARC_CHAIN_FAIL)
+		return ARC_STAT_OK;
+
+	/* the cv= values were checked by arc_eoh() */
+	if ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_NEWESTONLY) != 0)
+		last = msg->arc_nsets;
+	else
+		last = 1;
+
+	/* the final ARC-Message-Signature, then the seals */
+	n = msg->arc_nsets - last + 2;
+	av = (struct arc_verify *) malloc(n * sizeof *av);
+	if (av == NULL)
+	{
+		arc_error(msg, "unable to allocate %d bytes", n * sizeof *av);
+		return ARC_STAT_NORESOURCE;
+	}
+	memset(av, '\0', n * sizeof *av);
+
+	if ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_TIMING) != 0)
+	{
+		/* per-hop times are simply not kept if this fails */
+		if (msg->arc_hoptiming == NULL)
+		{
+			msg->arc_hoptiming = calloc(msg->arc_nsets,
+			                            sizeof *msg->arc_hoptiming);
+		}
+
+		for (c = 0; c < n; c++)
+			av[c].av_timed = TRUE;
+	}
+
+	pool = msg->arc_library->arcl_verifypool;
+
+	/*
+	**  Preparing a check counts as verification, less the key fetch
+	**  that arc_validate_*() times on its own.  av[0] is the newest
+	**  AMS, then come the seals newest first.
+	*/
+
+	for (c = 0; c < n; c++)
+	{
+		set = (c == 0 ? msg->arc_nsets : msg->arc_nsets - c + 1);
+
+		keyfetch = msg->arc_timing[ARC_TIMING_KEYFETCH];
+		start = arc_timing_start(msg);
+		if (c == 0)
+			av[c].av_status = arc_validate_msg(msg, set, &av[c]);
+		else
+			av[c].av_status = arc_validate_seal(msg, set, &av[c]);
+		keyfetch = msg->arc_timing[ARC_TIMING_KEYFETCH] - keyfetch;
+		arc_timing_stop(msg, ARC_TIMING_VERIFY, set, start + keyfetch);
+
+		if (pool == NULL)
+		{
+			if (av[c].av_status != ARC_STAT_OK)
+				break;
+
+			arc_verify_run(NULL, &av[c], 1);
+			if (av[c].av_result != 1)
+				break;
+		}
+	}
+
+	if (pool != NULL)
+		arc_verify_run(pool, av, n);
+
+	for (c = 0; c < n; c++)
+	{
+		if (av[c].av_timed)
+		{
+			arc_timing_add(msg, ARC_TIMING_VERIFY,
+			               c == 0 ? msg->arc_nsets
+			                      : msg->arc_nsets - c + 1,
+			               av[c].av_usec);
+		}
+	}
+
+	status = ARC_STAT_OK;
+	cstate = ARC_CHAIN_PASS;
+	for (c = 0; c < n; c++)
+	{
+		if (av[c].av_status == ARC_STAT_OK && av[c].av_result == 1)
+			continue;
+
+		if (av[c].av_status == ARC_STAT_OK ||
+		    av[c].av_status == ARC_STAT_BADSIG)
+			cstate = ARC_CHAIN_FAIL;
+		else
+			status = av[c].av_status;
+		break;
+	}
+
+	if (status == ARC_STAT_OK)
+		msg->arc_cstate = cstate;
+
+	arc_verify_free(av, n);
+
+	return status;
+}
+
+/*
+**  ARC_SIGNKEY_NEW -- load a private key for repeated use
+**
+**  Parameters:
+**  	key -- secret key, PEM or DER encoded
+**  	keylen -- key length
+**  	err -- error string (returned)
+**
+**  Return value:
+**  	A new signing key handle, or NULL on failure (and "err" is updated).
+*/
+
+ARC_SIGNKEY *
+arc_signkey_new(u_char *key, size_t keylen, const u_char **err)
+{
+	u_int keytype;
+	BIO *keydata;
+	EVP_PKEY *pkey;
+	ARC_SIGNKEY *sk;
+
+	assert(key != NULL);
+	assert(keylen > 0);
+
+	keydata = BIO_new_mem_buf(key, keylen);
+	if (keydata == NULL)
 	{
-		arc_error(msg,
-	          	"failed to initialize seal canonicalization object");
-		return status;
+		if (err != NULL)
+			*err = "BIO_new_mem_buf() failed";
+		return NULL;
 	}
 
-	/* initialize them */
-	keep = ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_KEEPFILES) != 0);
-	status = arc_canon_init(msg, keep, keep);
-	if (status != ARC_STAT_OK)
+	if (keylen >= 5 && strncmp(key, "-----", 5) == 0)
 	{
-		arc_error(msg, "arc_canon_init() failed");
-		return ARC_STAT_SYNTAX;
+		pkey = PEM_read_bio_PrivateKey(keydata, NULL, NULL, NULL);
+		if (pkey == NULL)
+		{
+			if (err != NULL)
+				*err = "PEM_read_bio_PrivateKey() failed";
+			BIO_free(keydata);
+			return NULL;
+		}
+	}
+	else
+	{
+		pkey = d2i_PrivateKey_bio(keydata, NULL);
+		if (pkey == NULL)
+		{
+			if (err != NULL)
+				*err = "d2i_PrivateKey_bio() failed";
+			BIO_free(keydata);
+			return NULL;
+		}
 	}
 
-	/* process everything */
-	status = arc_canon_runheaders(msg);
-	if (status != ARC_STAT_OK)
+	BIO_free(keydata);
+
+	switch (EVP_PKEY_base_id(pkey))
 	{
-		arc_error(msg, "arc_canon_runheaders() failed");
-		return ARC_STAT_SYNTAX;
+	  case EVP_PKEY_RSA:
+		keytype = ARC_KEYTYPE_RSA;
+		break;
+
+#ifdef HAVE_ED25519
+	  case EVP_PKEY_ED25519:
+		keytype = ARC_KEYTYPE_ED25519;
+		break;
+#endif /* HAVE_ED25519 */
+
+	  default:
+		if (err != NULL)
+			*err = "unsupported key type";
+		EVP_PKEY_free(pkey);
+		return NULL;
 	}
 
-	status = arc_canon_runheaders_seal(msg);
-	if (status != ARC_STAT_OK)
+	sk = (ARC_SIGNKEY *) malloc(sizeof *sk);
+	if (sk == NULL)
 	{
-		arc_error(msg, "arc_canon_runheaders_seal() failed");
-		return ARC_STAT_SYNTAX;
+		if (err != NULL)
+			*err = strerror(errno);
+		EVP_PKEY_free(pkey);
+		return NULL;
 	}
 
-	return ARC_STAT_OK;
+	sk->sk_keytype = keytype;
+	sk->sk_pkey = pkey;
+	sk->sk_keysize = EVP_PKEY_size(pkey);
+
+	return sk;
 }
 
 /*
-**  ARC_BODY -- process a body chunk
+**  ARC_SIGNKEY_FREE -- release a signing key handle
 **
 **  Parameters:
-**  	msg -- an ARC message handle
-**  	buf -- the body chunk to be processed, in canonical format
-**  	len -- number of bytes to process starting at "buf"
+**  	key -- handle previously returned by arc_signkey_new()
 **
 **  Return value:
-**  	A ARC_STAT_* constant.
+**  	None.
 */
 
-ARC_STAT
-arc_body(ARC_MESSAGE *msg, u_char *buf, size_t len)
+void
+arc_signkey_free(ARC_SIGNKEY *key)
 {
-	assert(msg != NULL);
-	assert(buf != NULL);
-
-	if (msg->arc_state > ARC_STATE_BODY ||
-	    msg->arc_state < ARC_STATE_EOH)
-		return ARC_STAT_INVALID;
-	msg->arc_state = ARC_STATE_BODY;
+	if (key == NULL)
+		return;
 
-	return arc_canon_bodychunk(msg, buf, len);
+	EVP_PKEY_free(key->sk_pkey);
+	free(key);
 }
 
 /*
-**  ARC_EOM -- declare end of message
+**  ARC_SIGN_DIGEST -- sign a finished digest
 **
 **  Parameters:
-**  	msg -- message handle
+**  	msg -- ARC_MESSAGE object
+**  	key -- signing key handle
+**  	digest -- digest to sign
+**  	diglen -- bytes at "digest"
+**  	sigout -- signature buffer, at least key->sk_keysize bytes
+**  	siglen -- signature length (returned)
 **
 **  Return value:
 **  	An ARC_STAT_* constant.
 */
 
-ARC_STAT
-arc_eom(ARC_MESSAGE *msg)
+static ARC_STAT
+arc_sign_digest(ARC_MESSAGE *msg, ARC_SIGNKEY *key, u_char *digest,
+                size_t diglen, u_char *sigout, int *siglen)
 {
-	/*
-	**  Verify the exisitng chain, if any.
-	*/
+	int rstatus;
+	size_t len;
+	EVP_PKEY_CTX *pctx;
 
-	if (msg->arc_nsets == 0)
-	{
-		msg->arc_cstate = ARC_CHAIN_NONE;
-	}
-	else
+	assert(msg != NULL);
+	assert(key != NULL);
+	assert(digest != NULL);
+	assert(sigout != NULL);
+	assert(siglen != NULL);
+
+	len = key->sk_keysize;
+
+#ifdef HAVE_ED25519
+	if (key->sk_keytype == ARC_KEYTYPE_ED25519)
 	{
-		u_int set;
+		EVP_MD_CTX *ctx;
 
-		/* validate the final ARC-Message-Signature */
-		if (arc_validate_msg(msg, msg->arc_nsets) == ARC_STAT_BADSIG)
+		ctx = arc_mdctx_get();
+		if (ctx == NULL)
 		{
-			msg->arc_cstate = ARC_CHAIN_FAIL;
+			arc_error(msg, "EVP_MD_CTX_new() failed");
+			return ARC_STAT_NORESOURCE;
 		}
-		else
+
+		/* RFC 8463 signs the hash itself, so no digest is named */
+		rstatus = EVP_DigestSignInit(ctx, NULL, NULL, NULL,
+		                             key->sk_pkey);
+		if (rstatus == 1)
 		{
-			u_char *inst;
-			u_char *cv;
-			ARC_KVSET *kvset;
+			rstatus = EVP_DigestSign(ctx, sigout, &len,
+			                         digest, diglen);
+		}
+		arc_mdctx_put(ctx);
 
-			for (set = msg->arc_nsets; set > 0; set--)
-			{
-				for (kvset = arc_set_first(msg,
-				                           ARC_KVSETTYPE_SEAL);
-				    kvset != NULL;
-				    kvset = arc_set_next(kvset,
-				                         ARC_KVSETTYPE_SEAL))
-				{
-					inst = arc_param_get(kvset, "i");
-					if (atoi(inst) == set)
-						break;
-				}
+		if (rstatus != 1 || len == 0)
+		{
+			arc_error(msg,
+			          "EVP_DigestSign() failed (status %d, length %d)",
+			          rstatus, (int) len);
+			return ARC_STAT_INTERNAL;
+		}
 
-				cv = arc_param_get(kvset, "cv");
-				if ((set == 1 && strcasecmp(cv, "none") == 0) ||
-				    (set != 1 && strcasecmp(cv, "pass") == 0))
-				{
-					ARC_STAT status;
+		*siglen = (int) len;
+		return ARC_STAT_OK;
+	}
+#endif /* HAVE_ED25519 */
 
-					status = arc_validate_seal(msg, set);
-					if (status == ARC_STAT_BADSIG)
-					{
-						msg->arc_cstate = ARC_CHAIN_FAIL;
-						break;
-					}
-					else if (status != ARC_STAT_OK)
-					{
-						return status;
-					}
-				}
-			}
-		}
+	pctx = EVP_PKEY_CTX_new(key->sk_pkey, NULL);
+	if (pctx == NULL)
+	{
+		arc_error(msg, "EVP_PKEY_CTX_new() failed");
+		return ARC_STAT_NORESOURCE;
+	}
+
+	/* encrypt the digest, labelled with whichever hash made it */
+	rstatus = EVP_PKEY_sign_init(pctx);
+	if (rstatus == 1 &&
+	    EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PADDING) > 0 &&
+	    EVP_PKEY_CTX_set_signature_md(pctx,
+	                                  diglen == SHA_DIGEST_LENGTH
+	                                  ? arc_md_sha1()
+	                                  : arc_md_sha256()) > 0)
+		rstatus = EVP_PKEY_sign(pctx, sigout, &len, digest, diglen);
+	else
+		rstatus = 0;
+	EVP_PKEY_CTX_free(pctx);
 
-		msg->arc_cstate = ARC_CHAIN_PASS;
+	if (rstatus != 1 || len == 0)
+	{
+		arc_error(msg, "EVP_PKEY_sign() failed (status %d, length %d)",
+		          rstatus, (int) len);
+		return ARC_STAT_INTERNAL;
 	}
 
+	*siglen = (int) len;
 	return ARC_STAT_OK;
 }
 
 /*
-**  ARC_GETSEAL -- get the "seal" to apply to this message
+**  ARC_GETSEAL_WORK -- arc_getseal_key() proper
 **
 **  Parameters:
 **  	msg -- ARC_MESSAGE object
@@ -2619,22 +3742,19 @@ arc_eom(ARC_MESSAGE *msg)
 **      authservid -- authservid to use when generating the seal
 **      selector -- selector name
 **      domain -- domain name
-**      key -- secret key, printable
-**      keylen -- key length
+**      key -- signing key handle
 **  	ar -- Authentication-Results to be enshrined
 **
 **  Return value:
 **  	An ARC_STAT_* constant.
 */
 
-ARC_STAT
-arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
-            char *selector, char *domain, u_char *key, size_t keylen,
-            u_char *ar)
+static ARC_STAT
+arc_getseal_work(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
+                 char *selector, char *domain, ARC_SIGNKEY *key, u_char *ar)
 {
 	int rstatus;
 	int siglen;
-	int nid;
 	u_int set;
 	ARC_STAT status;
 	size_t diglen;
@@ -2648,9 +3768,6 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 	ARC_HDRFIELD *h;
 	ARC_HDRFIELD hdr;
 	struct arc_dstring *dstr;
-	BIO *keydata;
-	EVP_PKEY *pkey;
-	RSA *rsa;
 
 	assert(msg != NULL);
 	assert(seal != NULL);
@@ -2658,60 +3775,27 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 	assert(selector != NULL);
 	assert(domain != NULL);
 	assert(key != NULL);
-	assert(keylen > 0);
 
 	/* copy required stuff */
 	msg->arc_domain = domain;
 	msg->arc_selector = selector;
 	msg->arc_authservid = authservid;
 
-	/* load the key */
-	keydata = BIO_new_mem_buf(key, keylen);
-	if (keydata == NULL)
-	{
-		arc_error(msg, "BIO_new_mem_buf() failed");
-		return ARC_STAT_NORESOURCE;
-	}
-
-	if (strncmp(key, "-----", 5) == 0)
-	{
-		pkey = PEM_read_bio_PrivateKey(keydata, NULL, NULL, NULL);
-		if (pkey == NULL)
-		{
-			arc_error(msg, "PEM_read_bio_PrivateKey() failed");
-			BIO_free(keydata);
-			return ARC_STAT_NORESOURCE;
-		}
-	}
-	else
-	{
-		pkey = d2i_PrivateKey_bio(keydata, NULL);
-		if (pkey == NULL)
-		{
-			arc_error(msg, "d2i_PrivateKey_bio() failed");
-			BIO_free(keydata);
-			return ARC_STAT_NORESOURCE;
-		}
-	}
-
-	rsa = EVP_PKEY_get1_RSA(pkey);
-	if (rsa == NULL)
+	/* the key has to be able to make the signature "a=" will claim */
+	if ((key->sk_keytype == ARC_KEYTYPE_ED25519) !=
+	    (msg->arc_signalg == ARC_SIGN_ED25519SHA256))
 	{
-		arc_error(msg, "EVP_PKEY_get1_RSA() failed");
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
-		return ARC_STAT_NORESOURCE;
+		arc_error(msg, "signing key does not match signing algorithm");
+		return ARC_STAT_INVALID;
 	}
+	msg->arc_keytype = key->sk_keytype;
 
-	keysize = RSA_size(rsa);
+	keysize = key->sk_keysize;
 	sigout = malloc(keysize);
 	if (sigout == NULL)
 	{
 		arc_error(msg, "can't allocate %d bytes for signature",
 		          keysize);
-		EVP_PKEY_free(pkey);
-		RSA_free(rsa);
-		BIO_free(keydata);
 		return ARC_STAT_NORESOURCE;
 	}
 
@@ -2731,8 +3815,11 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 		while (tmphdr != NULL)
 		{
 			next = tmphdr->hdr_next;
-			free(tmphdr->hdr_text);
-			free(tmphdr);
+			arc_mfree(msg, tmphdr->hdr_text);
+			if (tmphdr->hdr_canon != NULL)
+				arc_mfree(msg, tmphdr->hdr_canon);
+			arc_mfree(msg, tmphdr);
+			tmphdr = next;
 		}
 
 		msg->arc_sealhead = NULL;
@@ -2754,9 +3841,6 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 		arc_error(msg, "arc_parse_header_field() failed");
 		arc_dstring_free(dstr);
 		free(sigout);
-		EVP_PKEY_free(pkey);
-		RSA_free(rsa);
-		BIO_free(keydata);
 		return status;
 	}
 
@@ -2774,9 +3858,6 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 		arc_error(msg, "arc_canon_closebody() failed");
 		arc_dstring_free(dstr);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return status;
 	}
 
@@ -2792,9 +3873,6 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 		arc_error(msg, "arc_getamshdr_d() failed");
 		arc_dstring_free(dstr);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return status;
 	}
 
@@ -2806,6 +3884,8 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 	hdr.hdr_namelen = ARC_MSGSIG_HDRNAMELEN;
 	hdr.hdr_textlen = len;
 	hdr.hdr_flags = 0;
+	hdr.hdr_canon = NULL;
+	hdr.hdr_canonlen = 0;
 	hdr.hdr_next = NULL;
 
 	/* canonicalize */
@@ -2816,37 +3896,25 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 		arc_dstring_free(dstr);
 		free(sigout);
 		free(sighdr);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return ARC_STAT_INTERNAL;
 	}
 
-	status = arc_canon_getfinal(msg->arc_hdrcanon, &digest, &diglen);
+	status = arc_canon_getfinal(msg->arc_signhdrcanon, &digest, &diglen);
 	if (status != ARC_STAT_OK)
 	{
 		arc_error(msg, "arc_canon_getfinal() failed");
 		arc_dstring_free(dstr);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return ARC_STAT_INTERNAL;
 	}
 
-	/* encrypt the digest; that's our signature */
-	nid = NID_sha256;
-	rstatus = RSA_sign(nid, digest, diglen, sigout, &siglen, rsa);
-	if (rstatus != 1 || siglen == 0)
+	/* sign the digest */
+	status = arc_sign_digest(msg, key, digest, diglen, sigout, &siglen);
+	if (status != ARC_STAT_OK)
 	{
-		arc_error(msg, "RSA_sign() failed (status %d, length %d)",
-		          rstatus, siglen);
 		arc_dstring_free(dstr);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
-		return ARC_STAT_INTERNAL;
+		return status;
 	}
 
 	/* base64 encode it */
@@ -2859,9 +3927,6 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 		          b64siglen);
 		arc_dstring_free(dstr);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return ARC_STAT_NORESOURCE;
 	}
 
@@ -2873,9 +3938,6 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 		arc_dstring_free(dstr);
 		free(b64sig);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return ARC_STAT_INTERNAL;
 	}
 
@@ -2885,37 +3947,34 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 	/* XXX -- wrapping needs to happen here */
 
 	/* add it to the seal */
-	h = malloc(sizeof hdr);
+	h = arc_malloc(msg, sizeof hdr);
 	if (h == NULL)
 	{
 		arc_error(msg, "can't allocate %d bytes", sizeof hdr);
 		arc_dstring_free(dstr);
 		free(b64sig);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return ARC_STAT_INTERNAL;
 	}
 
-	h->hdr_text = strdup(arc_dstring_get(dstr));
+	h->hdr_text = arc_mstrndup(msg, arc_dstring_get(dstr),
+	                           arc_dstring_len(dstr));
 	if (h->hdr_text == NULL)
 	{
 		arc_error(msg, "can't allocate %d bytes",
 		          arc_dstring_len(dstr));
 		arc_dstring_free(dstr);
-		free(h);
+		arc_mfree(msg, h);
 		free(b64sig);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return ARC_STAT_INTERNAL;
 	}
 	h->hdr_colon = h->hdr_text + ARC_MSGSIG_HDRNAMELEN;
 	h->hdr_namelen = ARC_MSGSIG_HDRNAMELEN;
 	h->hdr_textlen = arc_dstring_len(dstr);
 	h->hdr_flags = 0;
+	h->hdr_canon = NULL;
+	h->hdr_canonlen = 0;
 	h->hdr_next = NULL;
 
 	msg->arc_sealtail->hdr_next = h;
@@ -2936,9 +3995,6 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 		arc_error(msg, "arc_canon_add_to_seal() failed");
 		arc_dstring_free(dstr);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return status;
 	}
 
@@ -2949,9 +4005,6 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 		arc_error(msg, "arc_getamshdr_d() failed");
 		arc_dstring_free(dstr);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return status;
 	}
 
@@ -2960,8 +4013,10 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 	hdr.hdr_text = arc_dstring_get(dstr);
 	hdr.hdr_colon = hdr.hdr_text + ARC_SEAL_HDRNAMELEN;
 	hdr.hdr_namelen = ARC_SEAL_HDRNAMELEN;
-	hdr.hdr_textlen = len;
+	hdr.hdr_textlen = arc_dstring_len(dstr);
 	hdr.hdr_flags = 0;
+	hdr.hdr_canon = NULL;
+	hdr.hdr_canonlen = 0;
 	hdr.hdr_next = NULL;
 
 	/* canonicalize */
@@ -2972,9 +4027,6 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 		arc_dstring_free(dstr);
 		free(sigout);
 		free(sighdr);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return ARC_STAT_INTERNAL;
 	}
 
@@ -2984,25 +4036,16 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 		arc_error(msg, "arc_canon_getseal() failed");
 		arc_dstring_free(dstr);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return status;
 	}
 
-	/* encrypt the digest; that's our signature */
-	nid = NID_sha256;
-	rstatus = RSA_sign(nid, digest, diglen, sigout, &siglen, rsa);
-	if (rstatus != 1 || siglen == 0)
+	/* sign the digest */
+	status = arc_sign_digest(msg, key, digest, diglen, sigout, &siglen);
+	if (status != ARC_STAT_OK)
 	{
-		arc_error(msg, "RSA_sign() failed (status %d, length %d)",
-		          rstatus, siglen);
 		arc_dstring_free(dstr);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
-		return ARC_STAT_INTERNAL;
+		return status;
 	}
 
 	/* base64 encode it */
@@ -3014,9 +4057,6 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 		arc_dstring_free(dstr);
 		free(b64sig);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return ARC_STAT_INTERNAL;
 	}
 
@@ -3026,34 +4066,31 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 	/* XXX -- wrapping needs to happen here */
 
 	/* add it to the seal */
-	h = malloc(sizeof hdr);
+	h = arc_malloc(msg, sizeof hdr);
 	if (h == NULL)
 	{
 		arc_error(msg, "can't allocate %d bytes", sizeof hdr);
 		arc_dstring_free(dstr);
 		free(b64sig);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return ARC_STAT_INTERNAL;
 	}
-	h->hdr_text = strdup(arc_dstring_get(dstr));
+	h->hdr_text = arc_mstrndup(msg, arc_dstring_get(dstr),
+	                           arc_dstring_len(dstr));
 	if (h->hdr_text == NULL)
 	{
 		arc_error(msg, "can't allocate %d bytes", sizeof hdr);
 		arc_dstring_free(dstr);
 		free(b64sig);
 		free(sigout);
-		RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-		BIO_free(keydata);
 		return ARC_STAT_INTERNAL;
 	}
 	h->hdr_colon = h->hdr_text + ARC_SEAL_HDRNAMELEN;
 	h->hdr_namelen = ARC_SEAL_HDRNAMELEN;
-	h->hdr_textlen = len;
+	h->hdr_textlen = arc_dstring_len(dstr);
 	h->hdr_flags = 0;
+	h->hdr_canon = NULL;
+	h->hdr_canonlen = 0;
 	h->hdr_next = NULL;
 
 	msg->arc_sealtail->hdr_next = h;
@@ -3063,15 +4100,101 @@ arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
 	arc_dstring_free(dstr);
 	free(b64sig);
 	free(sigout);
-	RSA_free(rsa);
-		EVP_PKEY_free(pkey);
-	BIO_free(keydata);
 
 	*seal = msg->arc_sealhead;
 
 	return ARC_STAT_OK;
 }
 
+/*
+**  ARC_GETSEAL_KEY -- get the "seal" to apply to this message, using
+**                     a previously loaded signing key
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE object
+**  	seal -- seal to apply (returned)
+**      authservid -- authservid to use when generating the seal
+**      selector -- selector name
+**      domain -- domain name
+**      key -- signing key handle
+**  	ar -- Authentication-Results to be enshrined
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+*/
+
+ARC_STAT
+arc_getseal_key(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
+                char *selector, char *domain, ARC_SIGNKEY *key, u_char *ar)
+{
+	uint64_t start;
+	ARC_STAT status;
+
+	assert(msg != NULL);
+
+	start = arc_timing_start(msg);
+	status = arc_getseal_work(msg, seal, authservid, selector, domain,
+	                          key, ar);
+	arc_timing_stop(msg, ARC_TIMING_SIGN, 0, start);
+
+	return status;
+}
+
+/*
+**  ARC_GETSEAL -- get the "seal" to apply to this message
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE object
+**  	seal -- seal to apply (returned)
+**      authservid -- authservid to use when generating the seal
+**      selector -- selector name
+**      domain -- domain name
+**      key -- secret key, printable
+**      keylen -- key length
+**  	ar -- Authentication-Results to be enshrined
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+**
+**  Notes:
+**  	This parses "key" on every call; callers signing more than one
+**  	message should use arc_signkey_new() and arc_getseal_key().
+*/
+
+ARC_STAT
+arc_getseal(ARC_MESSAGE *msg, ARC_HDRFIELD **seal, char *authservid,
+            char *selector, char *domain, u_char *key, size_t keylen,
+            u_char *ar)
+{
+	uint64_t start;
+	ARC_STAT status;
+	ARC_SIGNKEY *sk;
+	const u_char *err = NULL;
+
+	assert(msg != NULL);
+	assert(key != NULL);
+	assert(keylen > 0);
+
+	start = arc_timing_start(msg);
+
+	sk = arc_signkey_new(key, keylen, &err);
+	if (sk == NULL)
+	{
+		arc_error(msg, "%s", err);
+		arc_timing_stop(msg, ARC_TIMING_SIGN, 0, start);
+		return ARC_STAT_NORESOURCE;
+	}
+
+	status = arc_getseal_work(msg, seal, authservid, selector, domain,
+	                          sk, ar);
+
+	arc_signkey_free(sk);
+
+	arc_timing_stop(msg, ARC_TIMING_SIGN, 0, start);
+
+	return status;
+}
+
 /*
 **  ARC_HDR_NAME -- extract name from an ARC_HDRFIELD
 **
@@ -173,6 +173,7 @@ typedef int arc_alg_t;
 #define ARC_SIGN_DEFAULT	(-1)	/* use internal default */
 #define ARC_SIGN_RSASHA1	0	/* an RSA-signed SHA1 digest */
 #define ARC_SIGN_RSASHA256	1	/* an RSA-signed SHA256 digest */
+#define ARC_SIGN_ED25519SHA256	2	/* an Ed25519-signed SHA256 digest */
 
 /*
 **  ARC_QUERY -- key query method
@@ -219,15 +220,39 @@ typedef int arc_opts_t;
 #define	ARC_OPTS_FLAGS		0
 #define	ARC_OPTS_TMPDIR		1
 #define	ARC_OPTS_FIXEDTIME	2
+#define	ARC_OPTS_KEYCACHESIZE	3
+#define	ARC_OPTS_KEYCACHENEGTTL	4
+#define	ARC_OPTS_KEYCACHEHITS	5
+#define	ARC_OPTS_KEYCACHEMISSES	6
+#define	ARC_OPTS_NAMESERVERS	7
+#define	ARC_OPTS_VERIFYTHREADS	8
+#define	ARC_OPTS_QUERYMETHOD	9
+#define	ARC_OPTS_QUERYINFO	10
 
 /* flags */
 #define	ARC_LIBFLAGS_NONE		0x00000000
 #define	ARC_LIBFLAGS_FIXCRLF		0x00000001
 #define	ARC_LIBFLAGS_KEEPFILES		0x00000002
+#define	ARC_LIBFLAGS_ARENA		0x00000004
+#define	ARC_LIBFLAGS_NEWESTONLY		0x00000008
+#define	ARC_LIBFLAGS_TIMING		0x00000010
 
 /* default */
 #define	ARC_LIBFLAGS_DEFAULT		ARC_LIBFLAGS_NONE
 
+/*
+**  ARC_TIMING -- phases of message processing that can be timed
+*/
+
+#define	ARC_TIMING_PARSE	0	/* arc_header_field() */
+#define	ARC_TIMING_EOH		1	/* arc_eoh() */
+#define	ARC_TIMING_BODY		2	/* arc_body() */
+#define	ARC_TIMING_KEYFETCH	3	/* key retrieval; also per hop */
+#define	ARC_TIMING_VERIFY	4	/* signature checks; also per hop */
+#define	ARC_TIMING_SIGN		5	/* arc_getseal(), arc_getseal_key() */
+
+#define	ARC_TIMING_MAX		5
+
 /*
 **  ARC_DNSSEC -- results of DNSSEC queries
 */
@@ -253,8 +278,10 @@ typedef struct arc_lib ARC_LIB;
 
 /* LIBRARY FEATURES */
 #define	ARC_FEATURE_SHA256	1
+#define	ARC_FEATURE_ASYNCDNS	2
+#define	ARC_FEATURE_ED25519	3
 
-#define	ARC_FEATURE_MAX		1
+#define	ARC_FEATURE_MAX		3
 
 extern _Bool arc_libfeature __P((ARC_LIB *lib, u_int fc));
 
@@ -272,6 +299,13 @@ typedef struct arc_msghandle ARC_MESSAGE;
 struct arc_hdrfield;
 typedef struct arc_hdrfield ARC_HDRFIELD;
 
+/*
+**  ARC_SIGNKEY -- a private key, parsed and ready for signing
+*/
+
+struct arc_signkey;
+typedef struct arc_signkey ARC_SIGNKEY;
+
 /*
 **  PROTOTYPES
 */
@@ -288,7 +322,7 @@ typedef struct arc_hdrfield ARC_HDRFIELD;
 **  	None.
 */
 
-void arc_error __P((ARC_MESSAGE *, const char *, ...));
+extern void arc_error __P((ARC_MESSAGE *, const char *, ...));
 
 /*
 **  ARC_INIT -- create a library instance
@@ -300,7 +334,7 @@ void arc_error __P((ARC_MESSAGE *, const char *, ...));
 **  	A new library instance.
 */
 
-ARC_LIB *arc_init(void);
+extern ARC_LIB *arc_init __P((void));
 
 /*
 **  ARC_CLOSE -- terminate a library instance
@@ -312,7 +346,7 @@ ARC_LIB *arc_init(void);
 **  	None.
 */
 
-void arc_close(ARC_LIB *);
+extern void arc_close __P((ARC_LIB *));
 
 /*
 **  ARC_GETERROR -- return any stored error string from within the DKIM
@@ -327,6 +361,40 @@ void arc_close(ARC_LIB *);
 
 extern const char *arc_geterror __P((ARC_MESSAGE *));
 
+/*
+**  ARC_CHAIN_STATUS_STR -- report the chain state of a message
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**
+**  Return value:
+**  	"none", "fail" or "pass" once arc_eom() has run; "none" before.
+*/
+
+extern const char *arc_chain_status_str __P((ARC_MESSAGE *));
+
+/*
+**  ARC_GETTIMING -- report time spent in one phase of a message
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	phase -- ARC_TIMING_* constant
+**  	hop -- ARC set instance, or 0 for the whole message
+**  	usec -- microseconds spent (returned)
+**
+**  Return value:
+**  	ARC_STAT_OK, or ARC_STAT_INVALID if "phase" is unknown or "hop" is
+**  	out of range or not meaningful for "phase".
+**
+**  Notes:
+**  	Times are only recorded while the library has ARC_LIBFLAGS_TIMING
+**  	set, and read as zero otherwise.  Only ARC_TIMING_KEYFETCH and
+**  	ARC_TIMING_VERIFY are kept per hop.
+*/
+
+extern ARC_STAT arc_gettiming __P((ARC_MESSAGE *msg, int phase, u_int hop,
+                                   uint64_t *usec));
+
 /*
 ** 
 **  ARC_OPTIONS -- get/set library options
@@ -343,7 +411,7 @@ extern const char *arc_geterror __P((ARC_MESSAGE *));
 **  	argument.
 */
 
-ARC_STAT arc_options(ARC_LIB *, int, int, void *, size_t);
+extern ARC_STAT arc_options __P((ARC_LIB *, int, int, void *, size_t));
 
 /*
 **  ARC_GETSSLBUF -- retrieve SSL error buffer
@@ -355,7 +423,59 @@ ARC_STAT arc_options(ARC_LIB *, int, int, void *, size_t);
 **  	Pointer to the SSL buffer in the library handle.
 */
 
-const char *arc_getsslbuf(ARC_LIB *);
+extern const char *arc_getsslbuf __P((ARC_LIB *));
+
+/*
+**  ARC_KEYCACHE_WRITE -- save the key cache to a snapshot file
+**
+**  Parameters:
+**  	lib -- library handle
+**  	path -- file to write; replaced atomically
+**
+**  Return value:
+**  	ARC_STAT_OK, or ARC_STAT_NORESOURCE with errno set on failure.
+*/
+
+extern ARC_STAT arc_keycache_write __P((ARC_LIB *lib, const char *path));
+
+/*
+**  ARC_KEYCACHE_READ -- warm the key cache from a snapshot file
+**
+**  Parameters:
+**  	lib -- library handle
+**  	path -- file written earlier by arc_keycache_write()
+**  	nkeys -- number of records restored (returned; may be NULL)
+**
+**  Return value:
+**  	ARC_STAT_OK; ARC_STAT_NORESOURCE with errno set if the file can't
+**  	be read; ARC_STAT_SYNTAX if it isn't a valid snapshot.
+**
+**  Notes:
+**  	Records keep their original expiry time, so only the remainder
+**  	of each TTL is honoured and expired records are skipped.
+*/
+
+extern ARC_STAT arc_keycache_read __P((ARC_LIB *lib, const char *path,
+                                       u_int *nkeys));
+
+/*
+**  ARC_KEYCACHE_COPY -- warm the key cache from another library's
+**
+**  Parameters:
+**  	dst -- library handle whose cache is filled
+**  	src -- library handle whose cache is copied
+**  	nkeys -- number of records copied (returned; may be NULL)
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Like arc_keycache_read() from a fresh arc_keycache_write() of
+**  	"src", but without going through a file.
+*/
+
+extern void arc_keycache_copy __P((ARC_LIB *dst, ARC_LIB *src,
+                                   u_int *nkeys));
 
 /*
 **  ARC_MESSAGE -- create a new message handle
@@ -371,8 +491,8 @@ const char *arc_getsslbuf(ARC_LIB *);
 **  	A new message instance, or NULL on failure (and "err" is updated).
 */
 
-ARC_MESSAGE *arc_message(ARC_LIB *, arc_canon_t, arc_canon_t, arc_alg_t,
-                         const u_char **);
+extern ARC_MESSAGE *arc_message __P((ARC_LIB *, arc_canon_t, arc_canon_t,
+                                     arc_alg_t, const u_char **));
 
 /*
 **  ARC_FREE -- deallocate a message object
@@ -384,7 +504,24 @@ ARC_MESSAGE *arc_message(ARC_LIB *, arc_canon_t, arc_canon_t, arc_alg_t,
 **  	None.
 */
 
-void arc_free(ARC_MESSAGE *);
+extern void arc_free __P((ARC_MESSAGE *));
+
+/*
+**  ARC_MESSAGE_RESET -- prepare a message object for reuse
+**
+**  Parameters:
+**  	msg -- message object to be reset
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	The object can then be used for another message exactly as if
+**  	arc_message() had just returned it with the same parameters,
+**  	but the memory it accumulated is recycled rather than released.
+*/
+
+extern void arc_message_reset __P((ARC_MESSAGE *msg));
 
 /*
 **  ARC_HEADER_FIELD -- consume a header field
@@ -398,7 +535,7 @@ void arc_free(ARC_MESSAGE *);
 **  	An ARC_STAT_* constant.
 */
 
-ARC_STAT arc_header_field(ARC_MESSAGE *, u_char *, size_t);
+extern ARC_STAT arc_header_field __P((ARC_MESSAGE *, u_char *, size_t));
 
 /*
 **  ARC_EOH -- declare no more headers are coming
@@ -413,7 +550,7 @@ ARC_STAT arc_header_field(ARC_MESSAGE *, u_char *, size_t);
 **  	This can probably be merged with arc_eom().
 */
 
-ARC_STAT arc_eoh(ARC_MESSAGE *);
+extern ARC_STAT arc_eoh __P((ARC_MESSAGE *));
 
 /*
 **  ARC_BODY -- process a body chunk
@@ -439,7 +576,7 @@ extern ARC_STAT arc_body __P((ARC_MESSAGE *msg, u_char *buf, size_t len));
 **  	An ARC_STAT_* constant.
 */
 
-ARC_STAT arc_eom(ARC_MESSAGE *);
+extern ARC_STAT arc_eom __P((ARC_MESSAGE *));
 
 /*
 **  ARC_GETSEAL -- get the "seal" to apply to this message
@@ -462,8 +599,64 @@ ARC_STAT arc_eom(ARC_MESSAGE *);
 **  	prepended to the message in the presented order.
 */
 
-ARC_STAT arc_getseal(ARC_MESSAGE *, ARC_HDRFIELD **, char *, char *, char *,
-                     u_char *, size_t, u_char *);
+extern ARC_STAT arc_getseal __P((ARC_MESSAGE *, ARC_HDRFIELD **, char *, char *,
+                                 char *, u_char *, size_t, u_char *));
+
+/*
+**  ARC_SIGNKEY_NEW -- load a private key for repeated use
+**
+**  Parameters:
+**  	key -- secret key, PEM or DER encoded
+**  	keylen -- key length
+**  	err -- error string (returned)
+**
+**  Return value:
+**  	A new signing key handle, or NULL on failure (and "err" is updated).
+**
+**  Notes:
+**  	The handle is read-only once created and may be shared by any
+**  	number of threads calling arc_getseal_key() concurrently.
+*/
+
+extern ARC_SIGNKEY *arc_signkey_new __P((u_char *key, size_t keylen,
+                                         const u_char **err));
+
+/*
+**  ARC_SIGNKEY_FREE -- release a signing key handle
+**
+**  Parameters:
+**  	key -- handle previously returned by arc_signkey_new()
+**
+**  Return value:
+**  	None.
+*/
+
+extern void arc_signkey_free __P((ARC_SIGNKEY *key));
+
+/*
+**  ARC_GETSEAL_KEY -- get the "seal" to apply to this message, using
+**                     a previously loaded signing key
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE object
+**  	seal -- seal to apply (returned)
+**  	authservid -- authservid to use when generating A-R fields
+**  	selector -- selector name
+**  	domain -- domain name
+**  	key -- signing key handle
+**  	ar -- Authentication-Results to be enshrined
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+**
+**  Notes:
+**  	Identical to arc_getseal() except that no key parsing is done.
+*/
+
+extern ARC_STAT arc_getseal_key __P((ARC_MESSAGE *msg, ARC_HDRFIELD **seal,
+                                     char *authservid, char *selector,
+                                     char *domain, ARC_SIGNKEY *key,
+                                     u_char *ar));
 
 /*
 **  ARC_HDR_NAME -- extract name from an ARC_HDRFIELD
@@ -476,7 +669,7 @@ ARC_STAT arc_getseal(ARC_MESSAGE *, ARC_HDRFIELD **, char *, char *, char *,
 **  	Header field name stored in the object.
 */
 
-u_char *arc_hdr_name(ARC_HDRFIELD *, size_t *);
+extern u_char *arc_hdr_name __P((ARC_HDRFIELD *, size_t *));
 
 /*
 **  ARC_HDR_VALUE -- extract value from an ARC_HDRFIELD
@@ -488,7 +681,7 @@ u_char *arc_hdr_name(ARC_HDRFIELD *, size_t *);
 **  	Header field value stored in the object.
 */
 
-u_char *arc_hdr_value(ARC_HDRFIELD *);
+extern u_char *arc_hdr_value __P((ARC_HDRFIELD *));
 
 /*
 **  ARC_HDR_NEXT -- return pointer to next ARC_HDRFIELD
@@ -500,7 +693,7 @@ u_char *arc_hdr_value(ARC_HDRFIELD *);
 **  	Pointer to the next ARC_HDRFIELD in the sequence.
 */
 
-ARC_HDRFIELD *arc_hdr_next(ARC_HDRFIELD *hdr);
+extern ARC_HDRFIELD *arc_hdr_next __P((ARC_HDRFIELD *hdr));
 
 /*
 **  ARC_SSL_VERSION -- report the version of the crypto library against which
@@ -513,6 +706,6 @@ ARC_HDRFIELD *arc_hdr_next(ARC_HDRFIELD *hdr);
 **  	SSL library version, expressed as a uint64_t.
 */
 
-uint64_t arc_ssl_version(void);
+extern uint64_t arc_ssl_version __P((void));
 
 #endif /* _ARC_H_ */
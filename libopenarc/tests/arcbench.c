@@ -0,0 +1,1260 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/types.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#endif /* HAVE_STDBOOL_H */
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+/* OpenSSL includes */
+#include <openssl/bio.h>
+#include <openssl/opensslv.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+/* local includes */
+#include "sha256mb.h"
+
+/* macros */
+#define	CMDLINEOPTS	"b:s:"
+#define	AUTHSERVID	"mx.example.com"
+#define	BODYCHUNK	65536
+#define	DEFBODYSIZE	(4 * 1048576)
+#define	DOMAIN		"example.com"
+#define	FIXEDTIME	1500000000
+#define	MAXHEADERS	512
+#define	SEED		20170101
+
+#ifndef FALSE
+# define FALSE		0
+#endif /* ! FALSE */
+#ifndef TRUE
+# define TRUE		1
+#endif /* ! TRUE */
+
+/*
+**  BENCH_KEY -- a signing key and its public key record
+*/
+
+struct bench_key
+{
+	const char *		bk_name;	/* "rsa" or "ed25519" */
+	char *			bk_selector;
+	arc_alg_t		bk_alg;
+	size_t			bk_pemlen;
+	u_char *		bk_pem;		/* private key, PEM */
+	char *			bk_record;	/* "v=DKIM1; k=...; p=..." */
+	ARC_SIGNKEY *		bk_signkey;
+};
+
+/*
+**  BENCH_MSG -- a synthetic message
+*/
+
+struct bench_msg
+{
+	u_int			bm_nhdrs;
+	size_t			bm_bodylen;
+	char *			bm_hdrs[MAXHEADERS];
+	u_char *		bm_body;
+};
+
+/* globals */
+char *progname;
+
+static u_int scale = 1;
+static char queryfile[] = "/tmp/arcbench.XXXXXX";
+static const char *basehdrs[] =
+{
+	"From: Alice <alice@example.com>",
+	"To: Bob <bob@example.org>",
+	"Subject: benchmark message",
+	"Date: Fri, 14 Jul 2017 02:40:00 +0000",
+	"Message-ID: <bench@example.com>",
+	NULL
+};
+
+/*
+**  BENCH_RANDOM -- deterministic pseudo-random numbers
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	The next value from a fixed-seed xorshift generator, so every run
+**  	works on the same data.
+*/
+
+static uint32_t
+bench_random(void)
+{
+	static uint32_t state = SEED;
+
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+
+	return state;
+}
+
+/*
+**  BENCH_NOW -- read the monotonic clock
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	Seconds since some arbitrary point.
+*/
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/*
+**  BENCH_REPORT -- print one result
+**
+**  Parameters:
+**  	name -- benchmark name
+**  	params -- parameters, as comma-separated "key=value" pairs
+**  	iterations -- how many operations were timed
+**  	value -- the result
+**  	unit -- units of "value"
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Output is one tab-separated line per result so runs from different
+**  	releases can be compared with ordinary text tools.
+*/
+
+static void
+bench_report(const char *name, const char *params, u_int iterations,
+             double value, const char *unit)
+{
+	printf("%s\t%s\t%u\t%.3f\t%s\n", name, params, iterations, value,
+	       unit);
+	fflush(stdout);
+}
+
+/*
+**  BENCH_DIE -- report a library failure and exit
+**
+**  Parameters:
+**  	what -- what failed
+**  	msg -- message handle (may be NULL)
+**
+**  Return value:
+**  	None; doesn't return.
+*/
+
+static void
+bench_die(const char *what, ARC_MESSAGE *msg)
+{
+	const char *err = NULL;
+
+	if (msg != NULL)
+		err = arc_geterror(msg);
+
+	fprintf(stderr, "%s: %s failed%s%s\n", progname, what,
+	        err == NULL ? "" : ": ", err == NULL ? "" : err);
+
+	(void) unlink(queryfile);
+
+	exit(EX_SOFTWARE);
+}
+
+/*
+**  BENCH_MKBODY -- build a synthetic message body
+**
+**  Parameters:
+**  	len -- approximate size wanted
+**  	outlen -- actual size (returned)
+**
+**  Return value:
+**  	A CRLF-terminated body of text lines with irregular spacing and
+**  	trailing whitespace, so relaxed canonicalization has work to do,
+**  	followed by a few empty lines.
+*/
+
+static u_char *
+bench_mkbody(size_t len, size_t *outlen)
+{
+	size_t n = 0;
+	size_t linelen;
+	u_char *body;
+
+	body = malloc(len + 128);
+	if (body == NULL)
+		return NULL;
+
+	while (n < len)
+	{
+		linelen = 0;
+		while (linelen < 72 && n < len)
+		{
+			u_int w;
+
+			for (w = 2 + bench_random() % 8; w > 0; w--)
+			{
+				body[n++] = 'a' + bench_random() % 26;
+				linelen++;
+			}
+
+			for (w = 1 + (bench_random() % 8 == 0); w > 0; w--)
+			{
+				body[n++] = (bench_random() % 16 == 0 ? '\t'
+				                                      : ' ');
+				linelen++;
+			}
+		}
+
+		body[n++] = '\r';
+		body[n++] = '\n';
+	}
+
+	memcpy(body + n, "\r\n\r\n\r\n", 6);
+	*outlen = n + 6;
+
+	return body;
+}
+
+/*
+**  BENCH_B64 -- base64-encode a buffer
+**
+**  Parameters:
+**  	data -- data to encode
+**  	len -- bytes at "data"
+**
+**  Return value:
+**  	A newly allocated string, or NULL on failure.
+*/
+
+static char *
+bench_b64(const u_char *data, int len)
+{
+	char *out;
+
+	out = malloc(4 * ((len + 2) / 3) + 1);
+	if (out == NULL)
+		return NULL;
+
+	(void) EVP_EncodeBlock((u_char *) out, data, len);
+
+	return out;
+}
+
+/*
+**  BENCH_MKKEY -- generate a key pair
+**
+**  Parameters:
+**  	bk -- key to fill in; bk_name selects the type
+**
+**  Return value:
+**  	TRUE on success.
+*/
+
+static _Bool
+bench_mkkey(struct bench_key *bk)
+{
+	int type;
+	int derlen;
+	size_t len;
+	size_t klen;
+	size_t plen;
+	char *pub;
+	const char *ktag;
+	u_char *der = NULL;
+	u_char *p;
+	char *mem;
+	BIO *bio;
+	EVP_PKEY *pkey = NULL;
+	EVP_PKEY_CTX *pctx;
+
+	if (strcmp(bk->bk_name, "rsa") == 0)
+	{
+		type = EVP_PKEY_RSA;
+		ktag = "rsa";
+	}
+#ifdef EVP_PKEY_ED25519
+	else if (strcmp(bk->bk_name, "ed25519") == 0)
+	{
+		type = EVP_PKEY_ED25519;
+		ktag = "ed25519";
+	}
+#endif /* EVP_PKEY_ED25519 */
+	else
+	{
+		return FALSE;
+	}
+
+	pctx = EVP_PKEY_CTX_new_id(type, NULL);
+	if (pctx == NULL)
+		return FALSE;
+
+	if (EVP_PKEY_keygen_init(pctx) != 1 ||
+	    (type == EVP_PKEY_RSA &&
+	     EVP_PKEY_CTX_set_rsa_keygen_bits(pctx, 2048) <= 0) ||
+	    EVP_PKEY_keygen(pctx, &pkey) != 1)
+	{
+		EVP_PKEY_CTX_free(pctx);
+		return FALSE;
+	}
+	EVP_PKEY_CTX_free(pctx);
+
+	/* private half, as the filter would read it from a KeyFile */
+	bio = BIO_new(BIO_s_mem());
+	if (bio == NULL ||
+	    PEM_write_bio_PrivateKey(bio, pkey, NULL, NULL, 0, NULL,
+	                             NULL) != 1)
+	{
+		BIO_free(bio);
+		EVP_PKEY_free(pkey);
+		return FALSE;
+	}
+
+	len = BIO_get_mem_data(bio, &mem);
+	bk->bk_pem = malloc(len);
+	if (bk->bk_pem == NULL)
+	{
+		BIO_free(bio);
+		EVP_PKEY_free(pkey);
+		return FALSE;
+	}
+	memcpy(bk->bk_pem, mem, len);
+	bk->bk_pemlen = len;
+	BIO_free(bio);
+
+	/* public half: SPKI for RSA, the bare key for Ed25519 (RFC 8463) */
+	pub = NULL;
+#ifdef EVP_PKEY_ED25519
+	if (type == EVP_PKEY_ED25519)
+	{
+		u_char raw[32];
+		size_t rawlen = sizeof raw;
+
+		if (EVP_PKEY_get_raw_public_key(pkey, raw, &rawlen) == 1)
+			pub = bench_b64(raw, (int) rawlen);
+	}
+	else
+#endif /* EVP_PKEY_ED25519 */
+	{
+		derlen = i2d_PUBKEY(pkey, NULL);
+		if (derlen > 0 && (der = malloc(derlen)) != NULL)
+		{
+			p = der;
+			(void) i2d_PUBKEY(pkey, &p);
+			pub = bench_b64(der, derlen);
+			free(der);
+		}
+	}
+
+	EVP_PKEY_free(pkey);
+
+	if (pub == NULL)
+		return FALSE;
+
+	/*
+	**  Assembled by hand; snprintf() would draw -Wformat-truncation
+	**  since the compiler can't bound the length of "pub".
+	*/
+
+	klen = strlen(ktag);
+	plen = strlen(pub);
+	len = sizeof "v=DKIM1; k=; p=" + klen + plen;
+	bk->bk_record = malloc(len);
+	if (bk->bk_record == NULL)
+	{
+		free(pub);
+		return FALSE;
+	}
+	mem = bk->bk_record;
+	memcpy(mem, "v=DKIM1; k=", 11);
+	mem += 11;
+	memcpy(mem, ktag, klen);
+	mem += klen;
+	memcpy(mem, "; p=", 4);
+	mem += 4;
+	memcpy(mem, pub, plen + 1);
+	free(pub);
+
+	bk->bk_signkey = arc_signkey_new(bk->bk_pem, bk->bk_pemlen, NULL);
+
+	return bk->bk_signkey != NULL;
+}
+
+/*
+**  BENCH_FEED -- pass a message's header fields to the library
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	bm -- message
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+bench_feedhdrs(ARC_MESSAGE *msg, struct bench_msg *bm)
+{
+	u_int c;
+
+	for (c = 0; c < bm->bm_nhdrs; c++)
+	{
+		if (arc_header_field(msg, (u_char *) bm->bm_hdrs[c],
+		                     strlen(bm->bm_hdrs[c])) != ARC_STAT_OK)
+			bench_die("arc_header_field()", msg);
+	}
+}
+
+/*
+**  BENCH_FEEDBODY -- pass a message's body to the library
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	bm -- message
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+bench_feedbody(ARC_MESSAGE *msg, struct bench_msg *bm)
+{
+	size_t n;
+	size_t len;
+
+	for (n = 0; n < bm->bm_bodylen; n += len)
+	{
+		len = bm->bm_bodylen - n;
+		if (len > BODYCHUNK)
+			len = BODYCHUNK;
+
+		if (arc_body(msg, bm->bm_body + n, len) != ARC_STAT_OK)
+			bench_die("arc_body()", msg);
+	}
+}
+
+/*
+**  BENCH_MKMSG -- build a message with an ARC chain
+**
+**  Parameters:
+**  	lib -- library handle
+**  	bk -- key to seal with
+**  	bm -- message to fill in
+**  	nextra -- number of Received: fields to add
+**  	nhops -- length of the ARC chain to build
+**  	body -- body to use
+**  	bodylen -- bytes of "body" to use, less any partial last line
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Each hop is sealed by the library itself, so the result is a valid
+**  	chain as long as "bk" can be found in the query file.
+*/
+
+static void
+bench_mkmsg(ARC_LIB *lib, struct bench_key *bk, struct bench_msg *bm,
+            u_int nextra, u_int nhops, u_char *body, size_t bodylen)
+{
+	u_int c;
+	u_int hop;
+	u_int nseal;
+	char *seal[3];
+	const u_char *err;
+	ARC_MESSAGE *msg;
+	ARC_HDRFIELD *hdr;
+	ARC_HDRFIELD *sealhdr;
+
+	memset(bm, '\0', sizeof *bm);
+	bm->bm_body = body;
+
+	/* the library insists on a CRLF at the end */
+	while (bodylen > 2 && memcmp(body + bodylen - 2, "\r\n", 2) != 0)
+		bodylen--;
+	bm->bm_bodylen = bodylen;
+
+	for (c = 0; c < nextra && bm->bm_nhdrs < MAXHEADERS; c++)
+	{
+		char hbuf[BUFSIZ];
+
+		snprintf(hbuf, sizeof hbuf,
+		         "Received: from relay%u.example.net "
+		         "(relay%u.example.net [192.0.2.%u])\r\n"
+		         "\tby mx.example.com with ESMTPS id %08x;\r\n"
+		         "\tFri, 14 Jul 2017 02:40:00 +0000",
+		         c, c, c % 256, bench_random());
+		bm->bm_hdrs[bm->bm_nhdrs++] = strdup(hbuf);
+	}
+
+	for (c = 0; basehdrs[c] != NULL; c++)
+		bm->bm_hdrs[bm->bm_nhdrs++] = strdup(basehdrs[c]);
+
+	for (hop = 0; hop < nhops; hop++)
+	{
+		msg = arc_message(lib, ARC_CANON_RELAXED, ARC_CANON_RELAXED,
+		                  bk->bk_alg, &err);
+		if (msg == NULL)
+			bench_die("arc_message()", NULL);
+
+		bench_feedhdrs(msg, bm);
+		if (arc_eoh(msg) != ARC_STAT_OK)
+			bench_die("arc_eoh()", msg);
+		bench_feedbody(msg, bm);
+		if (arc_eom(msg) != ARC_STAT_OK)
+			bench_die("arc_eom()", msg);
+
+		if (arc_getseal_key(msg, &sealhdr, AUTHSERVID,
+		                    bk->bk_selector, DOMAIN, bk->bk_signkey,
+		                    (u_char *) "spf=pass") != ARC_STAT_OK ||
+		    sealhdr == NULL)
+			bench_die("arc_getseal_key()", msg);
+
+		/* the new set goes on top, in the order returned */
+		nseal = 0;
+		for (hdr = sealhdr;
+		     hdr != NULL && nseal < 3;
+		     hdr = arc_hdr_next(hdr))
+			seal[nseal++] = strdup((char *) arc_hdr_name(hdr, NULL));
+
+		if (bm->bm_nhdrs + nseal > MAXHEADERS)
+			bench_die("bench_mkmsg()", NULL);
+
+		memmove(&bm->bm_hdrs[nseal], &bm->bm_hdrs[0],
+		        bm->bm_nhdrs * sizeof bm->bm_hdrs[0]);
+		memcpy(&bm->bm_hdrs[0], seal, nseal * sizeof seal[0]);
+		bm->bm_nhdrs += nseal;
+
+		arc_free(msg);
+	}
+}
+
+/*
+**  BENCH_FREEMSG -- release a message built by bench_mkmsg()
+**
+**  Parameters:
+**  	bm -- message
+**
+**  Return value:
+**  	None.  The body isn't freed.
+*/
+
+static void
+bench_freemsg(struct bench_msg *bm)
+{
+	u_int c;
+
+	for (c = 0; c < bm->bm_nhdrs; c++)
+		free(bm->bm_hdrs[c]);
+}
+
+/*
+**  BENCH_CANON -- body canonicalization throughput
+**
+**  Parameters:
+**  	lib -- library handle
+**  	body -- synthetic body
+**  	bodylen -- bytes at "body"
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Only the arc_body() calls are timed; they go straight to
+**  	arc_canon_bodychunk() for the body hash.
+*/
+
+static void
+bench_canon(ARC_LIB *lib, u_char *body, size_t bodylen)
+{
+	u_int c;
+	u_int i;
+	u_int iterations;
+	double start;
+	double elapsed;
+	const u_char *err;
+	ARC_MESSAGE *msg;
+	struct bench_msg bm;
+	char params[BUFSIZ];
+	static struct
+	{
+		const char *	name;
+		arc_canon_t	canon;
+	} modes[] =
+	{
+		{ "simple",	ARC_CANON_SIMPLE },
+		{ "relaxed",	ARC_CANON_RELAXED },
+		{ NULL,		0 }
+	};
+
+	memset(&bm, '\0', sizeof bm);
+	for (c = 0; basehdrs[c] != NULL; c++)
+		bm.bm_hdrs[bm.bm_nhdrs++] = (char *) basehdrs[c];
+	bm.bm_body = body;
+	bm.bm_bodylen = bodylen;
+
+	iterations = 16 * scale;
+
+	for (c = 0; modes[c].name != NULL; c++)
+	{
+		msg = arc_message(lib, ARC_CANON_RELAXED, modes[c].canon,
+		                  ARC_SIGN_RSASHA256, &err);
+		if (msg == NULL)
+			bench_die("arc_message()", NULL);
+
+		elapsed = 0.0;
+		for (i = 0; i < iterations; i++)
+		{
+			bench_feedhdrs(msg, &bm);
+			if (arc_eoh(msg) != ARC_STAT_OK)
+				bench_die("arc_eoh()", msg);
+
+			start = bench_now();
+			bench_feedbody(msg, &bm);
+			elapsed += bench_now() - start;
+
+			arc_message_reset(msg);
+		}
+
+		arc_free(msg);
+
+		snprintf(params, sizeof params, "canon=%s,bodylen=%lu",
+		         modes[c].name, (u_long) bodylen);
+		bench_report("canon_body", params, iterations,
+		             (double) bodylen * iterations / elapsed / 1048576.0,
+		             "MB/s");
+	}
+}
+
+/*
+**  BENCH_EOH -- arc_eoh() cost against header count and chain length
+**
+**  Parameters:
+**  	lib -- library handle
+**  	bk -- key for building chains
+**  	body -- synthetic body, at least 16KB
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+bench_eoh(ARC_LIB *lib, struct bench_key *bk, u_char *body)
+{
+	u_int h;
+	u_int n;
+	u_int i;
+	u_int iterations;
+	double start;
+	double elapsed;
+	const u_char *err;
+	ARC_MESSAGE *msg;
+	struct bench_msg bm;
+	char params[BUFSIZ];
+	static u_int nextra[] = { 10, 50, 200, 0 };
+	static u_int nhops[] = { 0, 1, 5, 10, 25, (u_int) -1 };
+
+	iterations = 2000 * scale;
+
+	for (h = 0; nextra[h] != 0; h++)
+	{
+		for (n = 0; nhops[n] != (u_int) -1; n++)
+		{
+			bench_mkmsg(lib, bk, &bm, nextra[h], nhops[n],
+			            body, 1024);
+
+			msg = arc_message(lib, ARC_CANON_RELAXED,
+			                  ARC_CANON_RELAXED, bk->bk_alg, &err);
+			if (msg == NULL)
+				bench_die("arc_message()", NULL);
+
+			elapsed = 0.0;
+			for (i = 0; i < iterations; i++)
+			{
+				bench_feedhdrs(msg, &bm);
+
+				start = bench_now();
+				if (arc_eoh(msg) != ARC_STAT_OK)
+					bench_die("arc_eoh()", msg);
+				elapsed += bench_now() - start;
+
+				arc_message_reset(msg);
+			}
+
+			arc_free(msg);
+
+			snprintf(params, sizeof params,
+			         "headers=%u,hops=%u", bm.bm_nhdrs, nhops[n]);
+			bench_report("eoh", params, iterations,
+			             elapsed / iterations * 1000000.0, "usec/op");
+
+			bench_freemsg(&bm);
+		}
+	}
+}
+
+/*
+**  BENCH_SIGN -- seals per second
+**
+**  Parameters:
+**  	lib -- library handle
+**  	bk -- signing key
+**  	body -- synthetic body, at least 16KB
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	arc_getseal() parses the PEM key on every call; arc_getseal_key()
+**  	uses the key parsed once up front.  Only those calls are timed.
+*/
+
+static void
+bench_sign(ARC_LIB *lib, struct bench_key *bk, u_char *body)
+{
+	_Bool prepared;
+	u_int i;
+	u_int iterations;
+	double start;
+	double elapsed;
+	double elapsedkey;
+	const u_char *err;
+	ARC_STAT status;
+	ARC_MESSAGE *msg;
+	ARC_HDRFIELD *seal;
+	struct bench_msg bm;
+	char params[BUFSIZ];
+
+	bench_mkmsg(lib, bk, &bm, 10, 1, body, 1024);
+
+	msg = arc_message(lib, ARC_CANON_RELAXED, ARC_CANON_RELAXED,
+	                  bk->bk_alg, &err);
+	if (msg == NULL)
+		bench_die("arc_message()", NULL);
+
+	iterations = (bk->bk_alg == ARC_SIGN_RSASHA256 ? 200 : 2000) * scale;
+	elapsed = 0.0;
+	elapsedkey = 0.0;
+
+	for (i = 0; i < 2 * iterations; i++)
+	{
+		bench_feedhdrs(msg, &bm);
+		if (arc_eoh(msg) != ARC_STAT_OK)
+			bench_die("arc_eoh()", msg);
+		bench_feedbody(msg, &bm);
+		if (arc_eom(msg) != ARC_STAT_OK)
+			bench_die("arc_eom()", msg);
+
+		prepared = (i % 2 == 0);
+		start = bench_now();
+		if (prepared)
+		{
+			status = arc_getseal_key(msg, &seal, AUTHSERVID,
+			                         bk->bk_selector, DOMAIN,
+			                         bk->bk_signkey,
+			                         (u_char *) "spf=pass");
+		}
+		else
+		{
+			status = arc_getseal(msg, &seal, AUTHSERVID,
+			                     bk->bk_selector, DOMAIN,
+			                     bk->bk_pem, bk->bk_pemlen,
+			                     (u_char *) "spf=pass");
+		}
+
+		if (prepared)
+			elapsedkey += bench_now() - start;
+		else
+			elapsed += bench_now() - start;
+
+		if (status != ARC_STAT_OK)
+			bench_die("arc_getseal()", msg);
+
+		arc_message_reset(msg);
+	}
+
+	arc_free(msg);
+	bench_freemsg(&bm);
+
+	snprintf(params, sizeof params, "key=%s,api=getseal", bk->bk_name);
+	bench_report("sign", params, iterations, iterations / elapsed,
+	             "seals/s");
+	snprintf(params, sizeof params, "key=%s,api=getseal_key",
+	         bk->bk_name);
+	bench_report("sign", params, iterations, iterations / elapsedkey,
+	             "seals/s");
+}
+
+/*
+**  BENCH_VERIFY -- end-to-end verifications per second
+**
+**  Parameters:
+**  	lib -- library handle
+**  	bk -- key the chains are sealed with
+**  	body -- synthetic body, at least 16KB
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Each iteration is a whole message: header fields, arc_eoh(), the
+**  	body and arc_eom(), with keys read from the query file.
+*/
+
+static void
+bench_verify(ARC_LIB *lib, struct bench_key *bk, u_char *body)
+{
+	u_int n;
+	u_int i;
+	u_int iterations;
+	double start;
+	double elapsed;
+	const u_char *err;
+	ARC_MESSAGE *msg;
+	struct bench_msg bm;
+	char params[BUFSIZ];
+	static u_int nhops[] = { 1, 3, 10, 0 };
+
+	for (n = 0; nhops[n] != 0; n++)
+	{
+		bench_mkmsg(lib, bk, &bm, 10, nhops[n], body, 16384);
+
+		msg = arc_message(lib, ARC_CANON_RELAXED, ARC_CANON_RELAXED,
+		                  bk->bk_alg, &err);
+		if (msg == NULL)
+			bench_die("arc_message()", NULL);
+
+		iterations = 2000 * scale / nhops[n];
+
+		start = bench_now();
+		for (i = 0; i < iterations; i++)
+		{
+			bench_feedhdrs(msg, &bm);
+			if (arc_eoh(msg) != ARC_STAT_OK)
+				bench_die("arc_eoh()", msg);
+			bench_feedbody(msg, &bm);
+			if (arc_eom(msg) != ARC_STAT_OK)
+				bench_die("arc_eom()", msg);
+
+			if (strcmp(arc_chain_status_str(msg), "pass") != 0)
+				bench_die("chain validation", msg);
+
+			arc_message_reset(msg);
+		}
+		elapsed = bench_now() - start;
+
+		arc_free(msg);
+
+		snprintf(params, sizeof params, "key=%s,hops=%u,bodylen=%lu",
+		         bk->bk_name, nhops[n], (u_long) bm.bm_bodylen);
+		bench_report("verify", params, iterations,
+		             iterations / elapsed, "msgs/s");
+
+		bench_freemsg(&bm);
+	}
+}
+
+/*
+**  BENCH_SEALHASH -- verification seal hashing, plain and multi-buffer
+**
+**  Parameters:
+**  	lib -- library handle
+**  	bk -- key for building chains
+**  	body -- synthetic body, at least 1KB
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Each set's verification seal covers every earlier set, then its own
+**  	AAR and AMS, then its own AS without "b=".  Three ways of computing
+**  	them all are timed over the field text of a chain the library
+**  	sealed, with relaxed canonicalization itself left out:
+**
+**  	clone -- what arc_canon_runheaders_seal() does: one running hash,
+**  	copied for each seal, which then adds only its own AS
+**
+**  	rehash -- each seal hashed from the start, one at a time
+**
+**  	multibuffer -- each seal hashed from the start, up to eight side
+**  	by side through sha256mb_batch(); a copied EVP state can't be
+**  	loaded into its lanes, so this is the only way to batch them
+*/
+
+static void
+bench_sealhash(ARC_LIB *lib, struct bench_key *bk, u_char *body)
+{
+	u_int c;
+	u_int g;
+	u_int n;
+	u_int i;
+	u_int nsets;
+	u_int iterations;
+	size_t len;
+	size_t slen;
+	double start;
+	double elapsed;
+	char *p;
+	char *hdr;
+	char *stream;
+	char *aar;
+	char *ams;
+	char *as;
+	u_char *digests;
+	u_char *out;
+	size_t *prefix;
+	size_t *striplen;
+	const u_char **sdata;
+	const u_char **strip;
+	struct sha256mb *mb;
+	struct sha256mb **mbp;
+	EVP_MD_CTX *run;
+	EVP_MD_CTX *seal;
+	struct bench_msg bm;
+	char params[BUFSIZ];
+	static u_int nhops[] = { 1, 5, 10, 25, 0 };
+	static const char *impls[] = { "clone", "rehash", "multibuffer", NULL };
+
+	run = EVP_MD_CTX_new();
+	seal = EVP_MD_CTX_new();
+	if (run == NULL || seal == NULL)
+		bench_die("EVP_MD_CTX_new()", NULL);
+
+	for (n = 0; nhops[n] != 0; n++)
+	{
+		nsets = nhops[n];
+		bench_mkmsg(lib, bk, &bm, 0, nsets, body, 1024);
+
+		/* the chain as one stream, oldest set first */
+		len = 0;
+		for (c = 0; c < 3 * nsets; c++)
+			len += strlen(bm.bm_hdrs[c]) + 2;
+		stream = malloc(len);
+		prefix = malloc(nsets * sizeof *prefix);
+		striplen = malloc(nsets * sizeof *striplen);
+		sdata = malloc(nsets * sizeof *sdata);
+		strip = malloc(nsets * sizeof *strip);
+		mb = malloc(nsets * sizeof *mb);
+		mbp = malloc(nsets * sizeof *mbp);
+		digests = malloc(3 * nsets * SHA256MB_DIGEST);
+		if (stream == NULL || prefix == NULL || striplen == NULL ||
+		    sdata == NULL || strip == NULL || mb == NULL ||
+		    mbp == NULL || digests == NULL)
+			bench_die("malloc()", NULL);
+
+		slen = 0;
+		for (c = 0; c < nsets; c++)
+		{
+			/* set c is the group of three (nsets - 1 - c) from the top */
+			aar = ams = as = NULL;
+			for (g = 0; g < 3; g++)
+			{
+				hdr = bm.bm_hdrs[3 * (nsets - 1 - c) + g];
+				if (strncasecmp(hdr, "ARC-Seal:", 9) == 0)
+					as = hdr;
+				else if (strncasecmp(hdr, "ARC-Message-Signature:",
+				                     22) == 0)
+					ams = hdr;
+				else
+					aar = hdr;
+			}
+			if (aar == NULL || ams == NULL || as == NULL)
+				bench_die("bench_sealhash()", NULL);
+
+			memcpy(stream + slen, aar, strlen(aar));
+			slen += strlen(aar);
+			memcpy(stream + slen, "\r\n", 2);
+			slen += 2;
+			memcpy(stream + slen, ams, strlen(ams));
+			slen += strlen(ams);
+			memcpy(stream + slen, "\r\n", 2);
+			slen += 2;
+
+			prefix[c] = slen;
+			sdata[c] = (const u_char *) stream;
+			mbp[c] = &mb[c];
+
+			/* this seal ends at its own "b=", with no value or CRLF */
+			strip[c] = (const u_char *) as;
+			striplen[c] = 0;
+			for (p = as + 1; *p != '\0'; p++)
+			{
+				if (p[0] == 'b' && p[1] == '=' &&
+				    (p[-1] == ';' || p[-1] == ' ' ||
+				     p[-1] == '\t' || p[-1] == '\n'))
+					striplen[c] = p + 2 - as;
+			}
+			if (striplen[c] == 0)
+				bench_die("bench_sealhash()", NULL);
+
+			memcpy(stream + slen, as, strlen(as));
+			slen += strlen(as);
+			memcpy(stream + slen, "\r\n", 2);
+			slen += 2;
+		}
+
+		iterations = 2000 * scale;
+
+		for (c = 0; impls[c] != NULL; c++)
+		{
+			out = digests + c * nsets * SHA256MB_DIGEST;
+
+			start = bench_now();
+			for (i = 0; i < iterations; i++)
+			{
+				switch (c)
+				{
+				  case 0:
+					EVP_DigestInit_ex(run, EVP_sha256(), NULL);
+					len = 0;
+					for (g = 0; g < nsets; g++)
+					{
+						EVP_DigestUpdate(run, stream + len,
+						                 prefix[g] - len);
+						EVP_MD_CTX_copy_ex(seal, run);
+						EVP_DigestUpdate(seal, strip[g],
+						                 striplen[g]);
+						EVP_DigestFinal_ex(seal,
+						                   out + g * SHA256MB_DIGEST,
+						                   NULL);
+						len = prefix[g];
+					}
+					break;
+
+				  case 1:
+					for (g = 0; g < nsets; g++)
+					{
+						EVP_DigestInit_ex(seal, EVP_sha256(),
+						                  NULL);
+						EVP_DigestUpdate(seal, stream,
+						                 prefix[g]);
+						EVP_DigestUpdate(seal, strip[g],
+						                 striplen[g]);
+						EVP_DigestFinal_ex(seal,
+						                   out + g * SHA256MB_DIGEST,
+						                   NULL);
+					}
+					break;
+
+				  case 2:
+					for (g = 0; g < nsets; g++)
+						sha256mb_init(&mb[g]);
+					sha256mb_batch(mbp, sdata, prefix, nsets);
+					sha256mb_batch(mbp, strip, striplen, nsets);
+					for (g = 0; g < nsets; g++)
+					{
+						sha256mb_final(&mb[g],
+						               out + g * SHA256MB_DIGEST);
+					}
+					break;
+				}
+			}
+			elapsed = bench_now() - start;
+
+			if (memcmp(out, digests, nsets * SHA256MB_DIGEST) != 0)
+				bench_die("seal hash mismatch", NULL);
+
+			if (c == 2)
+			{
+				snprintf(params, sizeof params,
+				         "hops=%u,impl=%s,kernel=%s", nsets,
+				         impls[c], sha256mb_kernel());
+			}
+			else
+			{
+				snprintf(params, sizeof params, "hops=%u,impl=%s",
+				         nsets, impls[c]);
+			}
+			bench_report("seal_hash", params, iterations,
+			             elapsed / iterations * 1000000.0, "usec/op");
+		}
+
+		free(stream);
+		free(prefix);
+		free(striplen);
+		free(sdata);
+		free(strip);
+		free(mb);
+		free(mbp);
+		free(digests);
+		bench_freemsg(&bm);
+	}
+
+	EVP_MD_CTX_free(run);
+	EVP_MD_CTX_free(seal);
+}
+
+/*
+**  USAGE -- print usage message and exit
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	EX_USAGE
+*/
+
+static int
+usage(void)
+{
+	fprintf(stderr, "%s: usage: %s [options]\n"
+	                "\t-b bodylen\tbody size for canon_body (default %d)\n"
+	                "\t-s scale  \tmultiply iteration counts by scale\n",
+	        progname, progname, DEFBODYSIZE);
+
+	return EX_USAGE;
+}
+
+/*
+**  MAIN -- program mainline
+**
+**  Parameters:
+**  	argc, argv -- the usual
+**
+**  Return value:
+**  	Exit status.
+*/
+
+int
+main(int argc, char **argv)
+{
+	int c;
+	int fd;
+	u_int nkeys;
+	size_t bodylen = DEFBODYSIZE;
+	size_t len;
+	time_t fixed = FIXEDTIME;
+	arc_query_t qtype = ARC_QUERY_FILE;
+	char *p;
+	u_char *body;
+	ARC_LIB *lib;
+	FILE *f;
+	struct bench_key keys[2];
+
+	progname = (p = strrchr(argv[0], '/')) == NULL ? argv[0] : p + 1;
+
+	while ((c = getopt(argc, argv, CMDLINEOPTS)) != -1)
+	{
+		switch (c)
+		{
+		  case 'b':
+			bodylen = strtoul(optarg, &p, 10);
+			if (*p != '\0' || bodylen == 0)
+				return usage();
+			break;
+
+		  case 's':
+			scale = strtoul(optarg, &p, 10);
+			if (*p != '\0' || scale == 0)
+				return usage();
+			break;
+
+		  default:
+			return usage();
+		}
+	}
+
+	lib = arc_init();
+	if (lib == NULL)
+		bench_die("arc_init()", NULL);
+
+	/* keys come from a file so DNS doesn't figure in the numbers */
+	memset(keys, '\0', sizeof keys);
+	keys[0].bk_name = "rsa";
+	keys[0].bk_selector = "rsa";
+	keys[0].bk_alg = ARC_SIGN_RSASHA256;
+	nkeys = 1;
+	if (arc_libfeature(lib, ARC_FEATURE_ED25519))
+	{
+		keys[1].bk_name = "ed25519";
+		keys[1].bk_selector = "ed25519";
+		keys[1].bk_alg = ARC_SIGN_ED25519SHA256;
+		nkeys = 2;
+	}
+
+	fd = mkstemp(queryfile);
+	if (fd < 0 || (f = fdopen(fd, "w")) == NULL)
+	{
+		fprintf(stderr, "%s: %s: %s\n", progname, queryfile,
+		        strerror(errno));
+		return EX_CANTCREAT;
+	}
+
+	for (c = 0; c < nkeys; c++)
+	{
+		if (!bench_mkkey(&keys[c]))
+			bench_die("key generation", NULL);
+
+		fprintf(f, "%s._domainkey.%s %s\n", keys[c].bk_selector,
+		        DOMAIN, keys[c].bk_record);
+	}
+	fclose(f);
+
+	if (arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_QUERYMETHOD, &qtype,
+	                sizeof qtype) != ARC_STAT_OK ||
+	    arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_QUERYINFO, queryfile,
+	                strlen(queryfile)) != ARC_STAT_OK ||
+	    arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_FIXEDTIME, &fixed,
+	                sizeof fixed) != ARC_STAT_OK)
+		bench_die("arc_options()", NULL);
+
+	body = bench_mkbody(bodylen, &len);
+	if (body == NULL)
+		bench_die("bench_mkbody()", NULL);
+
+	printf("# %s %s, %s\n", progname, VERSION, OPENSSL_VERSION_TEXT);
+	printf("# benchmark\tparameters\titerations\tvalue\tunit\n");
+
+	bench_canon(lib, body, len);
+
+	bench_eoh(lib, &keys[0], body);
+
+	sha256mb_setup();
+	bench_sealhash(lib, &keys[0], body);
+
+	for (c = 0; c < nkeys; c++)
+		bench_sign(lib, &keys[c], body);
+
+	for (c = 0; c < nkeys; c++)
+		bench_verify(lib, &keys[c], body);
+
+	for (c = 0; c < nkeys; c++)
+	{
+		arc_signkey_free(keys[c].bk_signkey);
+		free(keys[c].bk_pem);
+		free(keys[c].bk_record);
+	}
+	free(body);
+	arc_close(lib);
+
+	(void) unlink(queryfile);
+
+	return EX_OK;
+}
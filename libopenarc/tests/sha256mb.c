@@ -0,0 +1,621 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/param.h>
+#include <sys/types.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#endif /* HAVE_STDBOOL_H */
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef HAVE_X86_SIMD
+# include <cpuid.h>
+# include <immintrin.h>
+#endif /* HAVE_X86_SIMD */
+
+/* local includes */
+#include "sha256mb.h"
+
+#ifndef FALSE
+# define FALSE		0
+#endif /* ! FALSE */
+#ifndef TRUE
+# define TRUE		1
+#endif /* ! TRUE */
+
+/* macros */
+#define	ROR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+#define	LOAD32BE(p)	(((uint32_t) (p)[0] << 24) | \
+			 ((uint32_t) (p)[1] << 16) | \
+			 ((uint32_t) (p)[2] << 8) | \
+			 ((uint32_t) (p)[3]))
+
+/* globals */
+static _Bool sha256mb_avx2 = FALSE;
+static _Bool sha256mb_shani = FALSE;
+
+static const uint32_t sha256mb_k[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/*
+**  SHA256MB_BLOCKS -- run whole blocks through one state
+**
+**  Parameters:
+**  	h -- hash state
+**  	data -- input
+**  	nblocks -- number of SHA256MB_BLOCK-byte blocks at "data"
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+sha256mb_blocks(uint32_t *h, const u_char *data, size_t nblocks)
+{
+	int t;
+	uint32_t a, b, c, d, e, f, g, hh;
+	uint32_t t1, t2;
+	uint32_t w[64];
+
+	for (; nblocks > 0; nblocks--, data += SHA256MB_BLOCK)
+	{
+		for (t = 0; t < 16; t++)
+			w[t] = LOAD32BE(data + 4 * t);
+		for (t = 16; t < 64; t++)
+		{
+			w[t] = (ROR32(w[t - 2], 17) ^ ROR32(w[t - 2], 19) ^
+			        (w[t - 2] >> 10)) + w[t - 7] +
+			       (ROR32(w[t - 15], 7) ^ ROR32(w[t - 15], 18) ^
+			        (w[t - 15] >> 3)) + w[t - 16];
+		}
+
+		a = h[0];
+		b = h[1];
+		c = h[2];
+		d = h[3];
+		e = h[4];
+		f = h[5];
+		g = h[6];
+		hh = h[7];
+
+		for (t = 0; t < 64; t++)
+		{
+			t1 = hh + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) +
+			     ((e & f) ^ (~e & g)) + sha256mb_k[t] + w[t];
+			t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) +
+			     ((a & b) ^ (a & c) ^ (b & c));
+			hh = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+		h[5] += f;
+		h[6] += g;
+		h[7] += hh;
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+/* eight-lane helpers; each 32-bit element is one stream */
+# define MB_ROR(x, n)	_mm256_or_si256(_mm256_srli_epi32((x), (n)), \
+			                _mm256_slli_epi32((x), 32 - (n)))
+# define MB_ADD(x, y)	_mm256_add_epi32((x), (y))
+# define MB_XOR(x, y)	_mm256_xor_si256((x), (y))
+
+/*
+**  SHA256MB_LOAD -- load one 32-byte slice of eight blocks, transposed
+**
+**  Parameters:
+**  	data -- block pointers, one per lane
+**  	off -- byte offset into each block (0 or 32)
+**  	w -- where to store message words off/4 through off/4 + 7
+**
+**  Return value:
+**  	None.
+*/
+
+__attribute__((target("avx2")))
+static void
+sha256mb_load(const u_char **data, size_t off, __m256i *w)
+{
+	int c;
+	__m256i r[8];
+	__m256i s[8];
+	__m256i bswap;
+
+	bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+	                         11, 10, 9, 8, 15, 14, 13, 12,
+	                         3, 2, 1, 0, 7, 6, 5, 4,
+	                         11, 10, 9, 8, 15, 14, 13, 12);
+
+	for (c = 0; c < 8; c++)
+	{
+		r[c] = _mm256_loadu_si256((const __m256i *) (data[c] + off));
+		r[c] = _mm256_shuffle_epi8(r[c], bswap);
+	}
+
+	/* 8x8 transpose of 32-bit elements */
+	s[0] = _mm256_unpacklo_epi32(r[0], r[1]);
+	s[1] = _mm256_unpackhi_epi32(r[0], r[1]);
+	s[2] = _mm256_unpacklo_epi32(r[2], r[3]);
+	s[3] = _mm256_unpackhi_epi32(r[2], r[3]);
+	s[4] = _mm256_unpacklo_epi32(r[4], r[5]);
+	s[5] = _mm256_unpackhi_epi32(r[4], r[5]);
+	s[6] = _mm256_unpacklo_epi32(r[6], r[7]);
+	s[7] = _mm256_unpackhi_epi32(r[6], r[7]);
+
+	r[0] = _mm256_unpacklo_epi64(s[0], s[2]);
+	r[1] = _mm256_unpackhi_epi64(s[0], s[2]);
+	r[2] = _mm256_unpacklo_epi64(s[1], s[3]);
+	r[3] = _mm256_unpackhi_epi64(s[1], s[3]);
+	r[4] = _mm256_unpacklo_epi64(s[4], s[6]);
+	r[5] = _mm256_unpackhi_epi64(s[4], s[6]);
+	r[6] = _mm256_unpacklo_epi64(s[5], s[7]);
+	r[7] = _mm256_unpackhi_epi64(s[5], s[7]);
+
+	for (c = 0; c < 4; c++)
+	{
+		w[c] = _mm256_permute2x128_si256(r[c], r[c + 4], 0x20);
+		w[c + 4] = _mm256_permute2x128_si256(r[c], r[c + 4], 0x31);
+	}
+}
+
+/*
+**  SHA256MB_X8 -- run whole blocks through eight states at once
+**
+**  Parameters:
+**  	h -- hash states; h[i] holds state word i of all eight lanes
+**  	data -- input pointers, one per lane
+**  	nblocks -- blocks to consume from every lane
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	The "data" pointers are advanced past what was consumed.
+*/
+
+__attribute__((target("avx2")))
+static void
+sha256mb_x8(uint32_t **h, const u_char **data, size_t nblocks)
+{
+	int c;
+	int t;
+	__m256i st[8];
+	__m256i v[8];
+	__m256i w[16];
+	__m256i s0, s1, t1, t2;
+
+	for (c = 0; c < 8; c++)
+		st[c] = _mm256_loadu_si256((const __m256i *) h[c]);
+
+	for (; nblocks > 0; nblocks--)
+	{
+		sha256mb_load(data, 0, &w[0]);
+		sha256mb_load(data, 32, &w[8]);
+
+		for (c = 0; c < 8; c++)
+		{
+			v[c] = st[c];
+			data[c] += SHA256MB_BLOCK;
+		}
+
+		for (t = 0; t < 64; t++)
+		{
+			if (t >= 16)
+			{
+				s0 = w[(t - 15) & 15];
+				s0 = MB_XOR(MB_XOR(MB_ROR(s0, 7), MB_ROR(s0, 18)),
+				            _mm256_srli_epi32(s0, 3));
+				s1 = w[(t - 2) & 15];
+				s1 = MB_XOR(MB_XOR(MB_ROR(s1, 17), MB_ROR(s1, 19)),
+				            _mm256_srli_epi32(s1, 10));
+				w[t & 15] = MB_ADD(MB_ADD(w[t & 15], s0),
+				                   MB_ADD(w[(t - 7) & 15], s1));
+			}
+
+			s1 = MB_XOR(MB_XOR(MB_ROR(v[4], 6), MB_ROR(v[4], 11)),
+			            MB_ROR(v[4], 25));
+			t1 = MB_XOR(_mm256_and_si256(v[4], v[5]),
+			            _mm256_andnot_si256(v[4], v[6]));
+			t1 = MB_ADD(MB_ADD(v[7], s1), t1);
+			t1 = MB_ADD(t1, MB_ADD(_mm256_set1_epi32((int) sha256mb_k[t]),
+			                       w[t & 15]));
+
+			s0 = MB_XOR(MB_XOR(MB_ROR(v[0], 2), MB_ROR(v[0], 13)),
+			            MB_ROR(v[0], 22));
+			t2 = MB_XOR(MB_XOR(_mm256_and_si256(v[0], v[1]),
+			                   _mm256_and_si256(v[0], v[2])),
+			            _mm256_and_si256(v[1], v[2]));
+			t2 = MB_ADD(s0, t2);
+
+			v[7] = v[6];
+			v[6] = v[5];
+			v[5] = v[4];
+			v[4] = MB_ADD(v[3], t1);
+			v[3] = v[2];
+			v[2] = v[1];
+			v[1] = v[0];
+			v[0] = MB_ADD(t1, t2);
+		}
+
+		for (c = 0; c < 8; c++)
+			st[c] = MB_ADD(st[c], v[c]);
+	}
+
+	for (c = 0; c < 8; c++)
+		_mm256_storeu_si256((__m256i *) h[c], st[c]);
+}
+#endif /* HAVE_X86_SIMD */
+
+/*
+**  SHA256MB_SETUP -- see what the CPU offers
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	None.
+*/
+
+void
+sha256mb_setup(void)
+{
+#ifdef HAVE_X86_SIMD
+	u_int eax, ebx, ecx, edx;
+
+	__builtin_cpu_init();
+
+	sha256mb_avx2 = __builtin_cpu_supports("avx2");
+
+	ebx = 0;
+	if (__get_cpuid_max(0, NULL) >= 7)
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	sha256mb_shani = ((ebx & (1 << 29)) != 0);
+#endif /* HAVE_X86_SIMD */
+}
+
+/*
+**  SHA256MB_KERNEL -- describe the kernel in use
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	"avx2" if sha256mb_batch() uses the eight-lane kernel, "portable"
+**  	if it hashes one stream at a time; either followed by ",sha-ni"
+**  	when the CPU has the SHA extensions, which OpenSSL uses for a
+**  	single stream.
+*/
+
+const char *
+sha256mb_kernel(void)
+{
+	if (sha256mb_avx2)
+		return sha256mb_shani ? "avx2,sha-ni" : "avx2";
+	else
+		return sha256mb_shani ? "portable,sha-ni" : "portable";
+}
+
+/*
+**  SHA256MB_INIT -- start a hash
+**
+**  Parameters:
+**  	ctx -- state to initialize
+**
+**  Return value:
+**  	None.
+*/
+
+void
+sha256mb_init(struct sha256mb *ctx)
+{
+	assert(ctx != NULL);
+
+	ctx->smb_h[0] = 0x6a09e667;
+	ctx->smb_h[1] = 0xbb67ae85;
+	ctx->smb_h[2] = 0x3c6ef372;
+	ctx->smb_h[3] = 0xa54ff53a;
+	ctx->smb_h[4] = 0x510e527f;
+	ctx->smb_h[5] = 0x9b05688c;
+	ctx->smb_h[6] = 0x1f83d9ab;
+	ctx->smb_h[7] = 0x5be0cd19;
+	ctx->smb_len = 0;
+	ctx->smb_buflen = 0;
+}
+
+/*
+**  SHA256MB_FILL -- top up a partial block
+**
+**  Parameters:
+**  	ctx -- state
+**  	data -- pointer to input pointer (updated)
+**  	len -- pointer to input length (updated)
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	On return either the partial block is empty or all input has
+**  	been consumed.
+*/
+
+static void
+sha256mb_fill(struct sha256mb *ctx, const u_char **data, size_t *len)
+{
+	size_t n;
+
+	ctx->smb_len += *len;
+
+	if (ctx->smb_buflen == 0)
+		return;
+
+	n = MIN(*len, SHA256MB_BLOCK - ctx->smb_buflen);
+	memcpy(ctx->smb_buf + ctx->smb_buflen, *data, n);
+	ctx->smb_buflen += n;
+	*data += n;
+	*len -= n;
+
+	if (ctx->smb_buflen == SHA256MB_BLOCK)
+	{
+		sha256mb_blocks(ctx->smb_h, ctx->smb_buf, 1);
+		ctx->smb_buflen = 0;
+	}
+}
+
+/*
+**  SHA256MB_UPDATE -- add data to one hash
+**
+**  Parameters:
+**  	ctx -- state
+**  	data -- input
+**  	len -- bytes at "data"
+**
+**  Return value:
+**  	None.
+*/
+
+void
+sha256mb_update(struct sha256mb *ctx, const u_char *data, size_t len)
+{
+	size_t nblocks;
+
+	assert(ctx != NULL);
+	assert(data != NULL || len == 0);
+
+	sha256mb_fill(ctx, &data, &len);
+
+	nblocks = len / SHA256MB_BLOCK;
+	if (nblocks > 0)
+	{
+		sha256mb_blocks(ctx->smb_h, data, nblocks);
+		data += nblocks * SHA256MB_BLOCK;
+		len -= nblocks * SHA256MB_BLOCK;
+	}
+
+	if (len > 0)
+	{
+		memcpy(ctx->smb_buf + ctx->smb_buflen, data, len);
+		ctx->smb_buflen += len;
+	}
+}
+
+/*
+**  SHA256MB_BATCH -- add data to several independent hashes
+**
+**  Parameters:
+**  	ctx -- states
+**  	data -- input for each state
+**  	len -- bytes of input for each state
+**  	n -- number of states
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Equivalent to calling sha256mb_update() on each state in turn,
+**  	but whole blocks are pushed through the eight-lane kernel while at
+**  	least two streams still have some left.  The states must be
+**  	distinct.
+*/
+
+void
+sha256mb_batch(struct sha256mb **ctx, const u_char **data,
+                   const size_t *len, u_int n)
+{
+#ifdef HAVE_X86_SIMD
+	u_int c;
+	u_int lane;
+	u_int nlanes;
+	u_int next;
+	size_t k;
+	struct sha256mb *lctx[SHA256MB_LANES];
+	const u_char *ldata[SHA256MB_LANES];
+	size_t lblocks[SHA256MB_LANES];
+	uint32_t *lh[8];
+	uint32_t hcols[8][SHA256MB_LANES];
+
+	assert(ctx != NULL);
+	assert(data != NULL);
+	assert(len != NULL);
+
+	if (!sha256mb_avx2 || n < 2)
+	{
+		for (c = 0; c < n; c++)
+			sha256mb_update(ctx[c], data[c], len[c]);
+		return;
+	}
+
+	for (c = 0; c < 8; c++)
+		lh[c] = hcols[c];
+
+	nlanes = 0;
+	next = 0;
+
+	for (;;)
+	{
+		/* fill empty lanes with streams that have whole blocks */
+		while (nlanes < SHA256MB_LANES && next < n)
+		{
+			const u_char *p;
+			size_t plen;
+
+			p = data[next];
+			plen = len[next];
+			sha256mb_fill(ctx[next], &p, &plen);
+
+			if (plen >= SHA256MB_BLOCK)
+			{
+				lctx[nlanes] = ctx[next];
+				ldata[nlanes] = p;
+				lblocks[nlanes] = plen / SHA256MB_BLOCK;
+				nlanes++;
+			}
+
+			/* the kernel doesn't touch smb_buf, so stash the tail now */
+			if (plen > 0)
+			{
+				size_t tail;
+
+				tail = plen % SHA256MB_BLOCK;
+				memcpy(ctx[next]->smb_buf, p + plen - tail, tail);
+				ctx[next]->smb_buflen = tail;
+			}
+
+			next++;
+		}
+
+		if (nlanes < 2)
+			break;
+
+		/* run as many blocks as the shortest lane has */
+		k = lblocks[0];
+		for (lane = 1; lane < nlanes; lane++)
+			k = MIN(k, lblocks[lane]);
+
+		for (c = 0; c < 8; c++)
+		{
+			for (lane = 0; lane < SHA256MB_LANES; lane++)
+			{
+				hcols[c][lane] = (lane < nlanes
+				                  ? lctx[lane]->smb_h[c]
+				                  : lctx[0]->smb_h[c]);
+			}
+		}
+
+		for (lane = nlanes; lane < SHA256MB_LANES; lane++)
+			ldata[lane] = ldata[0];
+
+		sha256mb_x8(lh, ldata, k);
+
+		for (lane = 0; lane < nlanes; lane++)
+		{
+			for (c = 0; c < 8; c++)
+				lctx[lane]->smb_h[c] = hcols[c][lane];
+			lblocks[lane] -= k;
+		}
+
+		/* retire finished lanes */
+		for (lane = 0; lane < nlanes; )
+		{
+			if (lblocks[lane] == 0)
+			{
+				nlanes--;
+				lctx[lane] = lctx[nlanes];
+				ldata[lane] = ldata[nlanes];
+				lblocks[lane] = lblocks[nlanes];
+			}
+			else
+			{
+				lane++;
+			}
+		}
+	}
+
+	/* at most one stream left with whole blocks */
+	if (nlanes == 1)
+		sha256mb_blocks(lctx[0]->smb_h, ldata[0], lblocks[0]);
+#else /* HAVE_X86_SIMD */
+	u_int c;
+
+	for (c = 0; c < n; c++)
+		sha256mb_update(ctx[c], data[c], len[c]);
+#endif /* HAVE_X86_SIMD */
+}
+
+/*
+**  SHA256MB_FINAL -- finish a hash
+**
+**  Parameters:
+**  	ctx -- state
+**  	out -- SHA256MB_DIGEST bytes for the digest
+**
+**  Return value:
+**  	None.
+*/
+
+void
+sha256mb_final(struct sha256mb *ctx, u_char *out)
+{
+	int c;
+	uint64_t bits;
+
+	assert(ctx != NULL);
+	assert(out != NULL);
+
+	bits = ctx->smb_len * 8;
+
+	ctx->smb_buf[ctx->smb_buflen++] = 0x80;
+	if (ctx->smb_buflen > SHA256MB_BLOCK - 8)
+	{
+		memset(ctx->smb_buf + ctx->smb_buflen, '\0',
+		       SHA256MB_BLOCK - ctx->smb_buflen);
+		sha256mb_blocks(ctx->smb_h, ctx->smb_buf, 1);
+		ctx->smb_buflen = 0;
+	}
+	memset(ctx->smb_buf + ctx->smb_buflen, '\0',
+	       SHA256MB_BLOCK - 8 - ctx->smb_buflen);
+	for (c = 0; c < 8; c++)
+		ctx->smb_buf[SHA256MB_BLOCK - 1 - c] = (u_char) (bits >> (8 * c));
+	sha256mb_blocks(ctx->smb_h, ctx->smb_buf, 1);
+
+	for (c = 0; c < 8; c++)
+	{
+		out[4 * c] = (u_char) (ctx->smb_h[c] >> 24);
+		out[4 * c + 1] = (u_char) (ctx->smb_h[c] >> 16);
+		out[4 * c + 2] = (u_char) (ctx->smb_h[c] >> 8);
+		out[4 * c + 3] = (u_char) ctx->smb_h[c];
+	}
+}
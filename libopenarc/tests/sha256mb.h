@@ -0,0 +1,43 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#ifndef _SHA256MB_H_
+#define _SHA256MB_H_
+
+/* system includes */
+#include <sys/types.h>
+#include <stdint.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+/* definitions */
+#define	SHA256MB_BLOCK	64	/* SHA-256 block size */
+#define	SHA256MB_DIGEST	32	/* SHA-256 digest size */
+#define	SHA256MB_LANES	8	/* streams hashed side by side */
+
+/*
+**  SHA256MB -- SHA-256 state that can be advanced in batches
+*/
+
+struct sha256mb
+{
+	uint32_t		smb_h[8];
+	uint64_t		smb_len;
+	size_t			smb_buflen;
+	u_char			smb_buf[SHA256MB_BLOCK];
+};
+
+/* prototypes */
+extern void sha256mb_setup __P((void));
+extern const char *sha256mb_kernel __P((void));
+
+extern void sha256mb_init __P((struct sha256mb *));
+extern void sha256mb_update __P((struct sha256mb *,
+                                     const u_char *, size_t));
+extern void sha256mb_batch __P((struct sha256mb **,
+                                    const u_char **, const size_t *, u_int));
+extern void sha256mb_final __P((struct sha256mb *, u_char *));
+
+#endif /* ! _SHA256MB_H_ */
@@ -0,0 +1,649 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/types.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#endif /* HAVE_STDBOOL_H */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* OpenSSL includes */
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+/* macros */
+#define	AUTHSERVID	"mx.example.com"
+#define	DOMAIN		"example.com"
+#define	MAXHEADERS	32
+#define	BODY		"Hello.\r\n\r\nThis is a test.\r\n"
+
+#ifndef FALSE
+# define FALSE		0
+#endif /* ! FALSE */
+#ifndef TRUE
+# define TRUE		1
+#endif /* ! TRUE */
+
+/*
+**  TKEY -- a signing key and its public key record
+*/
+
+struct tkey
+{
+	char *			tk_selector;
+	arc_alg_t		tk_alg;
+	size_t			tk_pemlen;
+	u_char *		tk_pem;		/* private key, PEM */
+	char *			tk_record;	/* "v=DKIM1; k=...; p=..." */
+};
+
+/*
+**  TMSG -- a message
+*/
+
+struct tmsg
+{
+	u_int			tm_nhdrs;
+	char *			tm_hdrs[MAXHEADERS];
+	char *			tm_body;
+};
+
+/* globals */
+static char queryfile[] = "/tmp/t-chain.XXXXXX";
+static const char *basehdrs[] =
+{
+	"From: Alice <alice@example.com>",
+	"To: Bob <bob@example.org>",
+	"Subject: test message",
+	"Date: Fri, 14 Jul 2017 02:40:00 +0000",
+	"Message-ID: <test@example.com>",
+	NULL
+};
+
+/*
+**  B64 -- base64-encode some bytes
+**
+**  Parameters:
+**  	data -- bytes to encode
+**  	len -- bytes at "data"
+**
+**  Return value:
+**  	A newly allocated string.
+*/
+
+static char *
+b64(const u_char *data, int len)
+{
+	char *out;
+
+	out = malloc(4 * ((len + 2) / 3) + 1);
+	assert(out != NULL);
+	(void) EVP_EncodeBlock((u_char *) out, data, len);
+
+	return out;
+}
+
+/*
+**  MKKEY -- generate a key pair
+**
+**  Parameters:
+**  	tk -- key to fill in
+**  	selector -- selector to publish it under
+**  	type -- EVP_PKEY_RSA or EVP_PKEY_ED25519
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+mkkey(struct tkey *tk, char *selector, int type)
+{
+	int derlen;
+	long len;
+	char *pub;
+	char *mem;
+	const char *ktag;
+	u_char *der;
+	u_char *p;
+	BIO *bio;
+	EVP_PKEY *pkey = NULL;
+	EVP_PKEY_CTX *pctx;
+
+	tk->tk_selector = selector;
+
+	pctx = EVP_PKEY_CTX_new_id(type, NULL);
+	assert(pctx != NULL);
+	assert(EVP_PKEY_keygen_init(pctx) == 1);
+	if (type == EVP_PKEY_RSA)
+		assert(EVP_PKEY_CTX_set_rsa_keygen_bits(pctx, 2048) == 1);
+	assert(EVP_PKEY_keygen(pctx, &pkey) == 1);
+	EVP_PKEY_CTX_free(pctx);
+
+	bio = BIO_new(BIO_s_mem());
+	assert(bio != NULL);
+	assert(PEM_write_bio_PrivateKey(bio, pkey, NULL, NULL, 0, NULL,
+	                                NULL) == 1);
+	len = BIO_get_mem_data(bio, &mem);
+	tk->tk_pem = malloc(len);
+	assert(tk->tk_pem != NULL);
+	memcpy(tk->tk_pem, mem, len);
+	tk->tk_pemlen = len;
+	BIO_free(bio);
+
+	/* public half: SPKI for RSA, the bare key for Ed25519 (RFC 8463) */
+#ifdef EVP_PKEY_ED25519
+	if (type == EVP_PKEY_ED25519)
+	{
+		u_char raw[32];
+		size_t rawlen = sizeof raw;
+
+		tk->tk_alg = ARC_SIGN_ED25519SHA256;
+		ktag = "ed25519";
+		assert(EVP_PKEY_get_raw_public_key(pkey, raw, &rawlen) == 1);
+		pub = b64(raw, (int) rawlen);
+	}
+	else
+#endif /* EVP_PKEY_ED25519 */
+	{
+		tk->tk_alg = ARC_SIGN_RSASHA256;
+		ktag = "rsa";
+		derlen = i2d_PUBKEY(pkey, NULL);
+		assert(derlen > 0);
+		der = malloc(derlen);
+		assert(der != NULL);
+		p = der;
+		(void) i2d_PUBKEY(pkey, &p);
+		pub = b64(der, derlen);
+		free(der);
+	}
+
+	EVP_PKEY_free(pkey);
+
+	tk->tk_record = malloc(sizeof "v=DKIM1; k=; p=" + strlen(ktag) +
+	                       strlen(pub));
+	assert(tk->tk_record != NULL);
+	strcpy(tk->tk_record, "v=DKIM1; k=");
+	strcat(tk->tk_record, ktag);
+	strcat(tk->tk_record, "; p=");
+	strcat(tk->tk_record, pub);
+	free(pub);
+}
+
+/*
+**  FREEKEY -- release a key pair made by mkkey()
+**
+**  Parameters:
+**  	tk -- key
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+freekey(struct tkey *tk)
+{
+	free(tk->tk_pem);
+	free(tk->tk_record);
+}
+
+/*
+**  WRITEKEYS -- publish a set of keys in the query file
+**
+**  Parameters:
+**  	keys -- keys to publish, ending with NULL
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+writekeys(struct tkey **keys)
+{
+	FILE *f;
+
+	f = fopen(queryfile, "w");
+	assert(f != NULL);
+	for (; *keys != NULL; keys++)
+	{
+		fprintf(f, "%s._domainkey.%s %s\n", (*keys)->tk_selector,
+		        DOMAIN, (*keys)->tk_record);
+	}
+	assert(fclose(f) == 0);
+}
+
+/*
+**  MKMSG -- start a message with no ARC sets
+**
+**  Parameters:
+**  	tm -- message to fill in
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+mkmsg(struct tmsg *tm)
+{
+	u_int c;
+
+	memset(tm, '\0', sizeof *tm);
+	for (c = 0; basehdrs[c] != NULL; c++)
+		tm->tm_hdrs[tm->tm_nhdrs++] = strdup(basehdrs[c]);
+	tm->tm_body = strdup(BODY);
+}
+
+/*
+**  FREEMSG -- release a message
+**
+**  Parameters:
+**  	tm -- message
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+freemsg(struct tmsg *tm)
+{
+	u_int c;
+
+	for (c = 0; c < tm->tm_nhdrs; c++)
+		free(tm->tm_hdrs[c]);
+	free(tm->tm_body);
+}
+
+/*
+**  RUN -- pass a message through the library
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	tm -- message
+**  	eohstatus -- chain status after arc_eoh() (returned; may be NULL)
+**
+**  Return value:
+**  	Whatever arc_eom() says.
+*/
+
+static ARC_STAT
+run(ARC_MESSAGE *msg, struct tmsg *tm, const char **eohstatus)
+{
+	u_int c;
+
+	for (c = 0; c < tm->tm_nhdrs; c++)
+	{
+		assert(arc_header_field(msg, (u_char *) tm->tm_hdrs[c],
+		                        strlen(tm->tm_hdrs[c])) == ARC_STAT_OK);
+	}
+	assert(arc_eoh(msg) == ARC_STAT_OK);
+	if (eohstatus != NULL)
+		*eohstatus = arc_chain_status_str(msg);
+	assert(arc_body(msg, (u_char *) tm->tm_body,
+	                strlen(tm->tm_body)) == ARC_STAT_OK);
+
+	return arc_eom(msg);
+}
+
+/*
+**  SEAL -- add an ARC set to a message
+**
+**  Parameters:
+**  	lib -- library handle
+**  	tm -- message
+**  	tk -- key to seal with
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+seal(ARC_LIB *lib, struct tmsg *tm, struct tkey *tk)
+{
+	u_int nseal;
+	const u_char *err;
+	char *hdrs[3];
+	ARC_MESSAGE *msg;
+	ARC_HDRFIELD *hdr;
+	ARC_HDRFIELD *sealhdr = NULL;
+
+	msg = arc_message(lib, ARC_CANON_RELAXED, ARC_CANON_RELAXED,
+	                  tk->tk_alg, &err);
+	assert(msg != NULL);
+
+	assert(run(msg, tm, NULL) == ARC_STAT_OK);
+	assert(arc_getseal(msg, &sealhdr, AUTHSERVID, tk->tk_selector,
+	                   DOMAIN, tk->tk_pem, tk->tk_pemlen,
+	                   (u_char *) "spf=pass") == ARC_STAT_OK);
+	assert(sealhdr != NULL);
+
+	/* the new set goes on top, in the order returned */
+	nseal = 0;
+	for (hdr = sealhdr; hdr != NULL; hdr = arc_hdr_next(hdr))
+	{
+		assert(nseal < 3);
+		hdrs[nseal++] = strdup((char *) arc_hdr_name(hdr, NULL));
+	}
+	assert(tm->tm_nhdrs + nseal <= MAXHEADERS);
+
+	memmove(&tm->tm_hdrs[nseal], &tm->tm_hdrs[0],
+	        tm->tm_nhdrs * sizeof tm->tm_hdrs[0]);
+	memcpy(&tm->tm_hdrs[0], hdrs, nseal * sizeof hdrs[0]);
+	tm->tm_nhdrs += nseal;
+
+	arc_free(msg);
+}
+
+/*
+**  VERIFY -- check a message's chain
+**
+**  Parameters:
+**  	lib -- library handle
+**  	tm -- message
+**  	eohstatus -- chain status after arc_eoh() (returned; may be NULL)
+**  	status -- what arc_eom() said (returned; if NULL, it must
+**  	          have succeeded)
+**
+**  Return value:
+**  	The chain status: "pass", "fail" or "none".
+*/
+
+static const char *
+verify(ARC_LIB *lib, struct tmsg *tm, const char **eohstatus,
+       ARC_STAT *status)
+{
+	ARC_STAT eom;
+	const char *ret;
+	const u_char *err;
+	ARC_MESSAGE *msg;
+
+	msg = arc_message(lib, ARC_CANON_RELAXED, ARC_CANON_RELAXED,
+	                  ARC_SIGN_RSASHA256, &err);
+	assert(msg != NULL);
+
+	eom = run(msg, tm, eohstatus);
+	if (status != NULL)
+		*status = eom;
+	else
+		assert(eom == ARC_STAT_OK);
+	ret = arc_chain_status_str(msg);
+
+	arc_free(msg);
+
+	return ret;
+}
+
+/*
+**  FINDHDR -- find the header field of a message starting with some text
+**
+**  Parameters:
+**  	tm -- message
+**  	prefix -- start of the field
+**
+**  Return value:
+**  	Index of the field.
+*/
+
+static u_int
+findhdr(struct tmsg *tm, const char *prefix)
+{
+	u_int c;
+
+	for (c = 0; c < tm->tm_nhdrs; c++)
+	{
+		if (strncmp(tm->tm_hdrs[c], prefix, strlen(prefix)) == 0)
+			return c;
+	}
+
+	assert(0);
+	return 0;
+}
+
+/*
+**  TAMPER -- replace some text in one of a message's header fields
+**
+**  Parameters:
+**  	tm -- message
+**  	prefix -- start of the field
+**  	from -- text to replace
+**  	to -- replacement, of the same length
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+tamper(struct tmsg *tm, const char *prefix, const char *from, const char *to)
+{
+	char *p;
+
+	assert(strlen(from) == strlen(to));
+
+	p = strstr(tm->tm_hdrs[findhdr(tm, prefix)], from);
+	assert(p != NULL);
+	memcpy(p, to, strlen(to));
+}
+
+/*
+**  DROPSET -- remove one ARC set from a message
+**
+**  Parameters:
+**  	tm -- message
+**  	inst -- instance to remove
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+dropset(struct tmsg *tm, u_int inst)
+{
+	u_int c;
+	u_int d;
+	u_int n;
+	char *p;
+	char match[16];
+
+	snprintf(match, sizeof match, " i=%u;", inst);
+
+	for (c = 0, d = 0; c < tm->tm_nhdrs; c++)
+	{
+		p = tm->tm_hdrs[c];
+		n = strcspn(p, ":");
+		if (strncasecmp(p, "ARC-", 4) == 0 &&
+		    strncmp(p + n + 1, match, strlen(match)) == 0)
+			free(p);
+		else
+			tm->tm_hdrs[d++] = p;
+	}
+
+	assert(d == tm->tm_nhdrs - 3);
+	tm->tm_nhdrs = d;
+}
+
+/*
+**  COPYMSG -- duplicate a message
+**
+**  Parameters:
+**  	dst -- copy (returned)
+**  	src -- message to copy
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+copymsg(struct tmsg *dst, struct tmsg *src)
+{
+	u_int c;
+
+	memset(dst, '\0', sizeof *dst);
+	for (c = 0; c < src->tm_nhdrs; c++)
+		dst->tm_hdrs[c] = strdup(src->tm_hdrs[c]);
+	dst->tm_nhdrs = src->tm_nhdrs;
+	dst->tm_body = strdup(src->tm_body);
+}
+
+/*
+**  MAIN -- program mainline
+**
+**  Parameters:
+**  	The usual.
+**
+**  Return value:
+**  	Exit status.
+*/
+
+int
+main(int argc, char **argv)
+{
+	int fd;
+	uint32_t flags;
+	arc_query_t qtype = ARC_QUERY_FILE;
+	const char *eohstatus;
+	ARC_STAT status;
+	ARC_LIB *lib;
+	struct tkey rsa;
+	struct tkey old;
+	struct tmsg good;
+	struct tmsg tm;
+	struct tkey *keys[3];
+
+	fd = mkstemp(queryfile);
+	assert(fd != -1);
+	close(fd);
+
+	lib = arc_init();
+	assert(lib != NULL);
+	assert(arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_QUERYMETHOD, &qtype,
+	                   sizeof qtype) == ARC_STAT_OK);
+	assert(arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_QUERYINFO, queryfile,
+	                   strlen(queryfile)) == ARC_STAT_OK);
+
+	mkkey(&rsa, "rsa", EVP_PKEY_RSA);
+	mkkey(&old, "old", EVP_PKEY_RSA);
+	keys[0] = &rsa;
+	keys[1] = &old;
+	keys[2] = NULL;
+	writekeys(keys);
+
+	/* a good chain passes */
+	mkmsg(&good);
+	assert(strcmp(verify(lib, &good, NULL, NULL), "none") == 0);
+	seal(lib, &good, &old);
+	assert(strcmp(verify(lib, &good, NULL, NULL), "pass") == 0);
+	seal(lib, &good, &rsa);
+	assert(strcmp(verify(lib, &good, NULL, NULL), "pass") == 0);
+
+	/* a tampered ARC-Authentication-Results fails */
+	copymsg(&tm, &good);
+	tamper(&tm, "ARC-Authentication-Results: i=2;", "spf=pass",
+	       "spf=fail");
+	assert(strcmp(verify(lib, &tm, NULL, NULL), "fail") == 0);
+	freemsg(&tm);
+
+	/* so does an older seal's cv= that was changed, at arc_eoh() */
+	copymsg(&tm, &good);
+	tamper(&tm, "ARC-Seal: i=1;", "cv=none", "cv=pass");
+	assert(strcmp(verify(lib, &tm, &eohstatus, NULL), "fail") == 0);
+	assert(strcmp(eohstatus, "fail") == 0);
+	freemsg(&tm);
+
+	/* ...and a tampered body */
+	copymsg(&tm, &good);
+	tm.tm_body[0] = 'J';
+	assert(strcmp(verify(lib, &tm, NULL, NULL), "fail") == 0);
+	freemsg(&tm);
+
+	/* a missing instance fails the chain in arc_eoh() */
+	copymsg(&tm, &good);
+	dropset(&tm, 1);
+	assert(strcmp(verify(lib, &tm, &eohstatus, NULL), "fail") == 0);
+	assert(strcmp(eohstatus, "fail") == 0);
+	freemsg(&tm);
+
+	/*
+	**  ARC_LIBFLAGS_NEWESTONLY only checks the newest set, so the key
+	**  for the older seal isn't needed.
+	*/
+
+	keys[1] = NULL;
+	writekeys(keys);
+	(void) verify(lib, &good, NULL, &status);
+	assert(status == ARC_STAT_NOKEY);
+
+	assert(arc_options(lib, ARC_OP_GETOPT, ARC_OPTS_FLAGS, &flags,
+	                   sizeof flags) == ARC_STAT_OK);
+	flags |= ARC_LIBFLAGS_NEWESTONLY;
+	assert(arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_FLAGS, &flags,
+	                   sizeof flags) == ARC_STAT_OK);
+	assert(strcmp(verify(lib, &good, NULL, NULL), "pass") == 0);
+
+	/* ...but still sees damage to the newest one */
+	copymsg(&tm, &good);
+	tm.tm_body[0] = 'J';
+	assert(strcmp(verify(lib, &tm, NULL, NULL), "fail") == 0);
+	freemsg(&tm);
+
+	flags &= ~ARC_LIBFLAGS_NEWESTONLY;
+	assert(arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_FLAGS, &flags,
+	                   sizeof flags) == ARC_STAT_OK);
+
+	freemsg(&good);
+
+#ifdef EVP_PKEY_ED25519
+	/* an Ed25519 seal round-trips, alone or next to an RSA one */
+	if (arc_libfeature(lib, ARC_FEATURE_ED25519))
+	{
+		struct tkey ed;
+
+		mkkey(&ed, "ed25519", EVP_PKEY_ED25519);
+		keys[1] = &ed;
+		keys[2] = NULL;
+		writekeys(keys);
+
+		mkmsg(&good);
+		seal(lib, &good, &ed);
+		assert(strstr(good.tm_hdrs[findhdr(&good, "ARC-Seal: i=1;")],
+		              "a=ed25519-sha256") != NULL);
+		assert(strcmp(verify(lib, &good, NULL, NULL), "pass") == 0);
+		seal(lib, &good, &rsa);
+		assert(strcmp(verify(lib, &good, NULL, NULL), "pass") == 0);
+		seal(lib, &good, &ed);
+		assert(strcmp(verify(lib, &good, NULL, NULL), "pass") == 0);
+
+		copymsg(&tm, &good);
+		tm.tm_body[0] = 'J';
+		assert(strcmp(verify(lib, &tm, NULL, NULL), "fail") == 0);
+		freemsg(&tm);
+
+		copymsg(&tm, &good);
+		tamper(&tm, "ARC-Authentication-Results: i=3;", "spf=pass",
+		       "spf=fail");
+		assert(strcmp(verify(lib, &tm, NULL, NULL), "fail") == 0);
+		freemsg(&tm);
+
+		freemsg(&good);
+		freekey(&ed);
+	}
+#endif /* EVP_PKEY_ED25519 */
+
+	freekey(&rsa);
+	freekey(&old);
+
+	arc_close(lib);
+	unlink(queryfile);
+
+	return 0;
+}
@@ -0,0 +1,564 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/nameser.h>
+#include <resolv.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#endif /* HAVE_STDBOOL_H */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* libopenarc includes */
+#include "arc.h"
+#include "arc-cache.h"
+#include "arc-dns.h"
+#include "arc-keys.h"
+#include "arc-types.h"
+
+/* macros */
+#define	SELECTOR	"sel"
+#define	DOMAIN		"example.com"
+#define	QUERYNAME	"sel._domainkey.example.com"
+#define	RECORD		"v=DKIM1; k=rsa; p=MIGfMA0GCSqGSIb3DQEBAQUAA4GN"
+#define	BIGTTL		0x7fffffff	/* largest TTL a server can send */
+#define	HOLDTIME	10		/* secs to hold a reply, at most */
+#define	SNAPFILE	"t-keycache.snap"
+#define	GONENAME	"gone._domainkey.example.com"
+#define	NOKEYNAME	"nokey._domainkey.example.com"
+
+#ifndef FALSE
+# define FALSE		0
+#endif /* ! FALSE */
+#ifndef TRUE
+# define TRUE		1
+#endif /* ! TRUE */
+
+/*
+**  FAKEQUERY -- a query handed to the fake resolver
+*/
+
+struct fakequery
+{
+	size_t			fq_buflen;
+	u_char *		fq_buf;
+	char			fq_name[MAXDNAME + 1];
+};
+
+/*
+**  SNAPHDR, SNAPREC -- key cache snapshot layout (see arc-cache.c)
+*/
+
+struct snaphdr
+{
+	char			sh_magic[8];
+	uint32_t		sh_order;
+	uint32_t		sh_count;
+	int64_t			sh_saved;
+};
+
+struct snaprec
+{
+	int64_t			sr_expire;
+	int32_t			sr_status;
+	uint32_t		sr_namelen;
+	uint32_t		sr_txtlen;
+	uint32_t		sr_pad;
+};
+
+/*
+**  FETCH -- one lookup run in its own thread
+*/
+
+struct fetch
+{
+	ARC_STAT		f_status;
+	ARC_LIB *		f_lib;
+	u_char			f_buf[BUFRSZ + 1];
+};
+
+/* globals */
+static int nqueries;			/* queries started */
+static _Bool hold;			/* hold replies until released */
+static _Bool released;			/* a waiter called back */
+static _Bool nxdomain;			/* answer NXDOMAIN */
+static uint32_t replyttl;		/* TTL of the answer */
+static pthread_mutex_t fakelock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fakecond = PTHREAD_COND_INITIALIZER;
+
+/*
+**  FAKE_INIT -- set up the fake resolver
+**
+**  Parameters:
+**  	srv -- service handle (returned)
+**
+**  Return value:
+**  	0.
+*/
+
+static int
+fake_init(void **srv)
+{
+	*srv = &nqueries;
+
+	return 0;
+}
+
+/*
+**  FAKE_CLOSE -- shut down the fake resolver
+**
+**  Parameters:
+**  	srv -- service handle
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+fake_close(void *srv)
+{
+	return;
+}
+
+/*
+**  FAKE_START -- start a query
+**
+**  Parameters:
+**  	srv -- service handle
+**  	type -- record type
+**  	query -- name to look up
+**  	buf -- buffer for the reply
+**  	buflen -- bytes available at "buf"
+**  	qh -- query handle (returned)
+**
+**  Return value:
+**  	ARC_DNS_SUCCESS.
+*/
+
+static int
+fake_start(void *srv, int type, unsigned char *query, unsigned char *buf,
+           size_t buflen, void **qh)
+{
+	struct fakequery *fq;
+
+	assert(type == T_TXT);
+
+	fq = (struct fakequery *) malloc(sizeof *fq);
+	assert(fq != NULL);
+	fq->fq_buf = buf;
+	fq->fq_buflen = buflen;
+	strncpy(fq->fq_name, (char *) query, sizeof fq->fq_name - 1);
+	fq->fq_name[sizeof fq->fq_name - 1] = '\0';
+
+	pthread_mutex_lock(&fakelock);
+	nqueries++;
+	pthread_cond_broadcast(&fakecond);
+	pthread_mutex_unlock(&fakelock);
+
+	*qh = fq;
+
+	return ARC_DNS_SUCCESS;
+}
+
+/*
+**  FAKE_CANCEL -- release a query
+**
+**  Parameters:
+**  	srv -- service handle
+**  	qh -- query handle
+**
+**  Return value:
+**  	0.
+*/
+
+static int
+fake_cancel(void *srv, void *qh)
+{
+	free(qh);
+
+	return 0;
+}
+
+/*
+**  FAKE_WAITREPLY -- answer a query
+**
+**  Parameters:
+**  	srv -- service handle
+**  	qh -- query handle
+**  	to -- timeout (ignored)
+**  	bytes -- reply length (returned)
+**  	error -- error code (returned)
+**  	dnssec -- DNSSEC status (returned)
+**
+**  Return value:
+**  	ARC_DNS_SUCCESS.
+**
+**  Notes:
+**  	The answer is a single TXT record carrying RECORD with a TTL
+**  	of "replyttl", or an NXDOMAIN if "nxdomain" is set.  If "hold"
+**  	is set, it isn't given until fake_callback() has been called or
+**  	HOLDTIME seconds have passed.
+*/
+
+static int
+fake_waitreply(void *srv, void *qh, struct timeval *to, size_t *bytes,
+               int *error, int *dnssec)
+{
+	int n;
+	size_t p;
+	size_t rdlen;
+	u_char *reply;
+	struct fakequery *fq;
+	struct timespec deadline;
+
+	fq = (struct fakequery *) qh;
+	reply = fq->fq_buf;
+
+	deadline.tv_sec = time(NULL) + HOLDTIME;
+	deadline.tv_nsec = 0;
+
+	pthread_mutex_lock(&fakelock);
+	while (hold && !released)
+	{
+		if (pthread_cond_timedwait(&fakecond, &fakelock,
+		                           &deadline) == ETIMEDOUT)
+			break;
+	}
+	pthread_mutex_unlock(&fakelock);
+
+	n = res_mkquery(QUERY, fq->fq_name, C_IN, T_TXT, NULL, 0, NULL,
+	                reply, fq->fq_buflen);
+	assert(n > 0);
+	p = n;
+
+	reply[2] |= 0x80;			/* QR */
+	reply[3] = 0x80;			/* RA, NOERROR */
+	if (nxdomain)
+	{
+		reply[3] |= NXDOMAIN;
+	}
+	else
+	{
+		rdlen = strlen(RECORD);
+		assert(p + 13 + rdlen <= fq->fq_buflen);
+
+		reply[7] = 1;			/* ANCOUNT */
+		reply[p++] = 0xc0;		/* name: pointer to question */
+		reply[p++] = HFIXEDSZ;
+		reply[p++] = 0;
+		reply[p++] = T_TXT;
+		reply[p++] = 0;
+		reply[p++] = C_IN;
+		reply[p++] = (replyttl >> 24) & 0xff;
+		reply[p++] = (replyttl >> 16) & 0xff;
+		reply[p++] = (replyttl >> 8) & 0xff;
+		reply[p++] = replyttl & 0xff;
+		reply[p++] = 0;
+		reply[p++] = rdlen + 1;
+		reply[p++] = rdlen;
+		memcpy(&reply[p], RECORD, rdlen);
+		p += rdlen;
+	}
+
+	*bytes = p;
+	if (error != NULL)
+		*error = 0;
+	if (dnssec != NULL)
+		*dnssec = ARC_DNSSEC_UNKNOWN;
+
+	return ARC_DNS_SUCCESS;
+}
+
+/*
+**  FAKE_CALLBACK -- DNS callback
+**
+**  Parameters:
+**  	context -- user context (ignored)
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	A caller blocked in fake_waitreply() can't call back, so being
+**  	called means another caller is waiting for the same query.  That
+**  	releases any held reply.
+*/
+
+static void
+fake_callback(const void *context)
+{
+	pthread_mutex_lock(&fakelock);
+	released = TRUE;
+	pthread_cond_broadcast(&fakecond);
+	pthread_mutex_unlock(&fakelock);
+}
+
+/*
+**  NEWLIB -- create a library handle that uses the fake resolver
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	The handle.
+*/
+
+static ARC_LIB *
+newlib(void)
+{
+	ARC_LIB *lib;
+
+	lib = arc_init();
+	assert(lib != NULL);
+
+	lib->arcl_dns_async = FALSE;
+	lib->arcl_dns_init = fake_init;
+	lib->arcl_dns_close = fake_close;
+	lib->arcl_dns_start = fake_start;
+	lib->arcl_dns_cancel = fake_cancel;
+	lib->arcl_dns_waitreply = fake_waitreply;
+	lib->arcl_dns_nslist = NULL;
+
+	return lib;
+}
+
+/*
+**  LOOKUP -- fetch the test key the way arc_get_key() does
+**
+**  Parameters:
+**  	lib -- library handle
+**  	buf -- buffer for the record
+**  	buflen -- bytes available at "buf"
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+*/
+
+static ARC_STAT
+lookup(ARC_LIB *lib, u_char *buf, size_t buflen)
+{
+	ARC_STAT status;
+	ARC_MESSAGE *msg;
+	const u_char *err = NULL;
+
+	if (arc_keycache_get(lib->arcl_keycache, QUERYNAME, buf, buflen,
+	                     &status))
+		return status;
+
+	msg = arc_message(lib, ARC_CANON_RELAXED, ARC_CANON_RELAXED,
+	                  ARC_SIGN_RSASHA256, &err);
+	assert(msg != NULL);
+	msg->arc_selector = (u_char *) SELECTOR;
+	msg->arc_domain = (u_char *) DOMAIN;
+
+	status = arc_get_key_dns(msg, buf, buflen, NULL);
+
+	arc_free(msg);
+
+	return status;
+}
+
+/*
+**  FETCHER -- thread body for a concurrent lookup
+**
+**  Parameters:
+**  	arg -- struct fetch
+**
+**  Return value:
+**  	NULL.
+*/
+
+static void *
+fetcher(void *arg)
+{
+	struct fetch *f;
+
+	f = (struct fetch *) arg;
+	f->f_status = lookup(f->f_lib, f->f_buf, sizeof f->f_buf);
+
+	return NULL;
+}
+
+/*
+**  SNAPEXPIRY -- find out when the only cached record expires
+**
+**  Parameters:
+**  	lib -- library handle
+**
+**  Return value:
+**  	The expiry time recorded in a snapshot of the cache.
+*/
+
+static time_t
+snapexpiry(ARC_LIB *lib)
+{
+	int fd;
+	struct snaphdr sh;
+	struct snaprec sr;
+
+	assert(arc_keycache_write(lib, SNAPFILE) == ARC_STAT_OK);
+	fd = open(SNAPFILE, O_RDONLY);
+	assert(fd != -1);
+	assert(read(fd, &sh, sizeof sh) == sizeof sh);
+	assert(sh.sh_count == 1);
+	assert(read(fd, &sr, sizeof sr) == sizeof sr);
+	close(fd);
+	unlink(SNAPFILE);
+
+	return (time_t) sr.sr_expire;
+}
+
+/*
+**  MAIN -- program mainline
+**
+**  Parameters:
+**  	The usual.
+**
+**  Return value:
+**  	Exit status.
+*/
+
+int
+main(int argc, char **argv)
+{
+	int fd;
+	u_int n;
+	u_int negttl;
+	int32_t badstatus;
+	time_t expire;
+	ARC_STAT status;
+	ARC_LIB *lib;
+	pthread_t t1;
+	pthread_t t2;
+	struct fetch f1;
+	struct fetch f2;
+	u_char buf[BUFRSZ + 1];
+
+	lib = newlib();
+
+	/* a record is cached, but for no longer than ARC_KEYCACHE_MAXTTL */
+	replyttl = BIGTTL;
+	assert(lookup(lib, buf, sizeof buf) == ARC_STAT_OK);
+	assert(strcmp((char *) buf, RECORD) == 0);
+	assert(nqueries == 1);
+	assert(lookup(lib, buf, sizeof buf) == ARC_STAT_OK);
+	assert(nqueries == 1);
+	expire = snapexpiry(lib);
+	assert(expire <= time(NULL) + ARC_KEYCACHE_MAXTTL);
+	assert(expire > time(NULL) + ARC_KEYCACHE_MAXTTL - 60);
+
+	arc_close(lib);
+
+	/* ...and goes away when its TTL runs out */
+	lib = newlib();
+	nqueries = 0;
+	replyttl = 1;
+	assert(lookup(lib, buf, sizeof buf) == ARC_STAT_OK);
+	assert(nqueries == 1);
+
+	/* a missing key is cached for KEYCACHENEGTTL, and goes away too */
+	negttl = 1;
+	assert(arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_KEYCACHENEGTTL,
+	                   &negttl, sizeof negttl) == ARC_STAT_OK);
+	nxdomain = TRUE;
+	assert(lookup(lib, buf, sizeof buf) == ARC_STAT_OK);
+	assert(nqueries == 1);
+
+	sleep(2);
+
+	assert(lookup(lib, buf, sizeof buf) == ARC_STAT_NOKEY);
+	assert(nqueries == 2);
+	assert(lookup(lib, buf, sizeof buf) == ARC_STAT_NOKEY);
+	assert(nqueries == 2);
+
+	sleep(2);
+
+	nxdomain = FALSE;
+	replyttl = 3600;
+	assert(lookup(lib, buf, sizeof buf) == ARC_STAT_OK);
+	assert(nqueries == 3);
+
+	/* a snapshot round-trips, less what expired since it was written */
+	arc_keycache_put(lib->arcl_keycache, GONENAME, ARC_STAT_OK,
+	                 (u_char *) RECORD, 1);
+	arc_keycache_put(lib->arcl_keycache, NOKEYNAME, ARC_STAT_NOKEY,
+	                 NULL, 3600);
+	assert(arc_keycache_write(lib, SNAPFILE) == ARC_STAT_OK);
+	arc_close(lib);
+
+	sleep(2);
+
+	lib = newlib();
+	nqueries = 0;
+	assert(arc_keycache_read(lib, SNAPFILE, &n) == ARC_STAT_OK);
+	assert(n == 2);
+	assert(lookup(lib, buf, sizeof buf) == ARC_STAT_OK);
+	assert(strcmp((char *) buf, RECORD) == 0);
+	assert(nqueries == 0);
+	assert(arc_keycache_get(lib->arcl_keycache, NOKEYNAME, buf,
+	                        sizeof buf, &status));
+	assert(status == ARC_STAT_NOKEY);
+	assert(!arc_keycache_peek(lib->arcl_keycache, GONENAME));
+	arc_close(lib);
+
+	/* a record with a status that's never cached is refused */
+	fd = open(SNAPFILE, O_RDWR);
+	assert(fd != -1);
+	badstatus = ARC_STAT_KEYFAIL;
+	assert(pwrite(fd, &badstatus, sizeof badstatus,
+	              sizeof(struct snaphdr) +
+	              offsetof(struct snaprec, sr_status)) == sizeof badstatus);
+	close(fd);
+
+	lib = newlib();
+	assert(arc_keycache_read(lib, SNAPFILE, &n) == ARC_STAT_SYNTAX);
+	assert(n == 0);
+	assert(!arc_keycache_peek(lib->arcl_keycache, QUERYNAME));
+	arc_close(lib);
+
+	unlink(SNAPFILE);
+
+	/* concurrent lookups of the same key make a single query */
+	lib = newlib();
+	lib->arcl_dns_callback = fake_callback;
+	lib->arcl_callback_int = 1;
+	nqueries = 0;
+	hold = TRUE;
+	f1.f_lib = lib;
+	f2.f_lib = lib;
+	assert(pthread_create(&t1, NULL, fetcher, &f1) == 0);
+	pthread_mutex_lock(&fakelock);
+	while (nqueries == 0)
+		pthread_cond_wait(&fakecond, &fakelock);
+	pthread_mutex_unlock(&fakelock);
+	assert(pthread_create(&t2, NULL, fetcher, &f2) == 0);
+	assert(pthread_join(t1, NULL) == 0);
+	assert(pthread_join(t2, NULL) == 0);
+	assert(released);
+	assert(nqueries == 1);
+	assert(f1.f_status == ARC_STAT_OK);
+	assert(strcmp((char *) f1.f_buf, RECORD) == 0);
+	assert(f2.f_status == ARC_STAT_OK);
+	assert(strcmp((char *) f2.f_buf, RECORD) == 0);
+	hold = FALSE;
+	arc_close(lib);
+
+	return 0;
+}
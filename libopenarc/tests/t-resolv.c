@@ -0,0 +1,427 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#endif /* HAVE_STDBOOL_H */
+#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* libopenarc includes */
+#include "arc.h"
+#include "arc-resolv.h"
+
+/* macros */
+#define	QUERYNAME	"sel._domainkey.example.com"
+#define	OTHERNAME	"sel._domainkey.example.net"
+#define	RECORD		"v=DKIM1; k=rsa; p=MIGfMA0GCSqGSIb3DQEBAQUAA4GN"
+#define	SHORTWAIT	200000		/* usecs to see a reply ignored */
+#define	LONGWAIT	2000		/* msecs to wait for real traffic */
+
+#ifndef FALSE
+# define FALSE		0
+#endif /* ! FALSE */
+#ifndef TRUE
+# define TRUE		1
+#endif /* ! TRUE */
+
+/* globals */
+static int ns;				/* nameserver UDP socket */
+static int nstcp;			/* nameserver TCP listener */
+static int rogue;			/* UDP socket on another port */
+static size_t qlen;			/* length of last query */
+static struct sockaddr_in client;	/* where the last query came from */
+static u_char query[PACKETSZ];		/* last query */
+
+/*
+**  SERVER_SETUP -- open UDP and TCP sockets sharing a loopback port
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	The port, in host byte order.
+*/
+
+static int
+server_setup(void)
+{
+	int c;
+	int on = 1;
+	socklen_t salen;
+	struct sockaddr_in sin;
+
+	for (c = 0; c < 16; c++)
+	{
+		memset(&sin, '\0', sizeof sin);
+		sin.sin_family = AF_INET;
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		ns = socket(AF_INET, SOCK_DGRAM, 0);
+		assert(ns != -1);
+		assert(bind(ns, (struct sockaddr *) &sin, sizeof sin) == 0);
+		salen = sizeof sin;
+		assert(getsockname(ns, (struct sockaddr *) &sin, &salen) == 0);
+
+		nstcp = socket(AF_INET, SOCK_STREAM, 0);
+		assert(nstcp != -1);
+		(void) setsockopt(nstcp, SOL_SOCKET, SO_REUSEADDR, &on,
+		                  sizeof on);
+		if (bind(nstcp, (struct sockaddr *) &sin, sizeof sin) == 0 &&
+		    listen(nstcp, 1) == 0)
+			break;
+
+		/* TCP port taken; try another one */
+		close(ns);
+		close(nstcp);
+	}
+
+	assert(c < 16);
+
+	memset(&sin, '\0', sizeof sin);
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	rogue = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(rogue != -1);
+	assert(bind(rogue, (struct sockaddr *) &sin, sizeof sin) == 0);
+
+	salen = sizeof sin;
+	assert(getsockname(ns, (struct sockaddr *) &sin, &salen) == 0);
+
+	return ntohs(sin.sin_port);
+}
+
+/*
+**  SERVER_RECV -- wait for a query on the UDP socket
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+server_recv(void)
+{
+	ssize_t n;
+	socklen_t salen;
+	struct pollfd pfd;
+
+	pfd.fd = ns;
+	pfd.events = POLLIN;
+	assert(poll(&pfd, 1, LONGWAIT) == 1);
+
+	salen = sizeof client;
+	n = recvfrom(ns, query, sizeof query, 0,
+	             (struct sockaddr *) &client, &salen);
+	assert(n >= HFIXEDSZ);
+	qlen = n;
+}
+
+/*
+**  SERVER_SEND -- send a datagram to the client
+**
+**  Parameters:
+**  	fd -- socket to send from
+**  	buf -- datagram
+**  	len -- bytes at "buf"
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+server_send(int fd, u_char *buf, size_t len)
+{
+	assert(sendto(fd, buf, len, 0, (struct sockaddr *) &client,
+	              sizeof client) == (ssize_t) len);
+}
+
+/*
+**  MKREPLY -- build a TXT answer to the last query
+**
+**  Parameters:
+**  	reply -- buffer to fill
+**  	tc -- set the truncation bit and leave the answer out
+**
+**  Return value:
+**  	Length of the reply.
+*/
+
+static size_t
+mkreply(u_char *reply, _Bool tc)
+{
+	size_t p;
+	size_t rdlen;
+
+	/* the header and question go back as they came */
+	for (p = HFIXEDSZ; query[p] != 0; p += query[p] + 1)
+		assert(p < qlen);
+	p += 1 + QFIXEDSZ;
+	assert(p <= qlen);
+	memcpy(reply, query, p);
+
+	reply[2] |= 0x80;			/* QR */
+	reply[3] = 0x80;			/* RA, NOERROR */
+	reply[6] = 0;				/* ANCOUNT */
+	reply[7] = (tc ? 0 : 1);
+	reply[8] = reply[9] = 0;		/* NSCOUNT */
+	reply[10] = reply[11] = 0;		/* ARCOUNT */
+	if (tc)
+	{
+		reply[2] |= 0x02;
+		return p;
+	}
+
+	rdlen = strlen(RECORD);
+	reply[p++] = 0xc0;			/* name: pointer to question */
+	reply[p++] = HFIXEDSZ;
+	reply[p++] = 0;
+	reply[p++] = T_TXT;
+	reply[p++] = 0;
+	reply[p++] = C_IN;
+	reply[p++] = 0;				/* TTL: 3600 */
+	reply[p++] = 0;
+	reply[p++] = 0x0e;
+	reply[p++] = 0x10;
+	reply[p++] = 0;
+	reply[p++] = rdlen + 1;
+	reply[p++] = rdlen;
+	memcpy(&reply[p], RECORD, rdlen);
+
+	return p + rdlen;
+}
+
+/*
+**  SERVER_TCP -- truncate the next UDP reply, then answer over TCP
+**
+**  Parameters:
+**  	reply -- the answer sent over TCP, without its length (returned)
+**  	badid -- send it with the wrong ID
+**
+**  Return value:
+**  	Length of the answer.
+*/
+
+static size_t
+server_tcp(u_char *reply, _Bool badid)
+{
+	int fd;
+	size_t len;
+	ssize_t n;
+	struct pollfd pfd;
+	u_char buf[PACKETSZ + 2];
+
+	server_recv();
+	len = mkreply(buf, TRUE);
+	server_send(ns, buf, len);
+
+	pfd.fd = nstcp;
+	pfd.events = POLLIN;
+	assert(poll(&pfd, 1, LONGWAIT) == 1);
+	fd = accept(nstcp, NULL, NULL);
+	assert(fd != -1);
+
+	for (len = 0; len < 2 || len < 2 + ((buf[0] << 8) | buf[1]); )
+	{
+		n = read(fd, buf + len, sizeof buf - len);
+		assert(n > 0);
+		len += n;
+	}
+	memcpy(query, buf + 2, len - 2);
+	qlen = len - 2;
+
+	len = mkreply(buf + 2, FALSE);
+	if (badid)
+		buf[3] ^= 0x01;
+	buf[0] = (len >> 8) & 0xff;
+	buf[1] = len & 0xff;
+	assert(write(fd, buf, len + 2) == (ssize_t) len + 2);
+	close(fd);
+
+	memcpy(reply, buf + 2, len);
+
+	return len;
+}
+
+/*
+**  WAITFOR -- wait a little for a query to complete
+**
+**  Parameters:
+**  	srv -- resolver handle
+**  	qh -- query handle
+**  	usecs -- how long to wait
+**  	bytes -- reply length (returned)
+**
+**  Return value:
+**  	Whatever arc_resolv_waitreply() says.
+*/
+
+static int
+waitfor(void *srv, void *qh, long usecs, size_t *bytes)
+{
+	struct timeval to;
+
+	to.tv_sec = usecs / 1000000;
+	to.tv_usec = usecs % 1000000;
+
+	return arc_resolv_waitreply(srv, qh, &to, bytes, NULL, NULL);
+}
+
+/*
+**  MAIN -- program mainline
+**
+**  Parameters:
+**  	The usual.
+**
+**  Return value:
+**  	Exit status.
+*/
+
+int
+main(int argc, char **argv)
+{
+	int port;
+	size_t len;
+	size_t len2;
+	size_t bytes;
+	void *srv;
+	void *qh;
+	void *qh2;
+	struct sockaddr_in first;
+	struct sockaddr_in second;
+	char nslist[INET_ADDRSTRLEN + 7];
+	u_char reply[PACKETSZ];
+	u_char other[PACKETSZ];
+	u_char answer[PACKETSZ];
+	u_char answer2[PACKETSZ];
+
+	printf("*** resolver reply parsing\n");
+
+	port = server_setup();
+
+	assert(arc_resolv_init(&srv) == 0);
+	snprintf(nslist, sizeof nslist, "127.0.0.1:%d", port);
+	assert(arc_resolv_nslist(srv, nslist) == ARC_DNS_SUCCESS);
+
+	/* runts and replies cut short inside the question are ignored */
+	assert(arc_resolv_start(srv, T_TXT, (u_char *) QUERYNAME, answer,
+	                        sizeof answer, &qh) == ARC_DNS_SUCCESS);
+	server_recv();
+	len = mkreply(reply, FALSE);
+	server_send(ns, reply, HFIXEDSZ - 1);
+	server_send(ns, reply, HFIXEDSZ + 4);
+	assert(waitfor(srv, qh, SHORTWAIT, NULL) == ARC_DNS_NOREPLY);
+	server_send(ns, reply, len);
+	assert(waitfor(srv, qh, SHORTWAIT * 10, &bytes) == ARC_DNS_SUCCESS);
+	assert(bytes == len);
+	assert(memcmp(answer, reply, len) == 0);
+	arc_resolv_cancel(srv, qh);
+
+	/* a reply with the wrong ID is ignored */
+	assert(arc_resolv_start(srv, T_TXT, (u_char *) QUERYNAME, answer,
+	                        sizeof answer, &qh) == ARC_DNS_SUCCESS);
+	server_recv();
+	len = mkreply(reply, FALSE);
+	memcpy(other, reply, len);
+	other[1] ^= 0x01;
+	server_send(ns, other, len);
+	assert(waitfor(srv, qh, SHORTWAIT, NULL) == ARC_DNS_NOREPLY);
+	server_send(ns, reply, len);
+	assert(waitfor(srv, qh, SHORTWAIT * 10, &bytes) == ARC_DNS_SUCCESS);
+	assert(bytes == len);
+	arc_resolv_cancel(srv, qh);
+
+	/* so is one that answers some other question */
+	assert(arc_resolv_start(srv, T_TXT, (u_char *) QUERYNAME, answer,
+	                        sizeof answer, &qh) == ARC_DNS_SUCCESS);
+	server_recv();
+	len = mkreply(reply, FALSE);
+	memcpy(other, reply, len);
+	other[HFIXEDSZ + strlen(QUERYNAME) - 1] = 'x';
+	server_send(ns, other, len);
+	assert(waitfor(srv, qh, SHORTWAIT, NULL) == ARC_DNS_NOREPLY);
+	server_send(ns, reply, len);
+	assert(waitfor(srv, qh, SHORTWAIT * 10, &bytes) == ARC_DNS_SUCCESS);
+	arc_resolv_cancel(srv, qh);
+
+	/* and one from an address that isn't a nameserver */
+	assert(arc_resolv_start(srv, T_TXT, (u_char *) QUERYNAME, answer,
+	                        sizeof answer, &qh) == ARC_DNS_SUCCESS);
+	server_recv();
+	len = mkreply(reply, FALSE);
+	server_send(rogue, reply, len);
+	assert(waitfor(srv, qh, SHORTWAIT, NULL) == ARC_DNS_NOREPLY);
+	server_send(ns, reply, len);
+	assert(waitfor(srv, qh, SHORTWAIT * 10, &bytes) == ARC_DNS_SUCCESS);
+	assert(bytes == len);
+	arc_resolv_cancel(srv, qh);
+
+	/* concurrent queries go out from different source ports */
+	assert(arc_resolv_start(srv, T_TXT, (u_char *) QUERYNAME, answer,
+	                        sizeof answer, &qh) == ARC_DNS_SUCCESS);
+	server_recv();
+	first = client;
+	len = mkreply(reply, FALSE);
+	assert(arc_resolv_start(srv, T_TXT, (u_char *) OTHERNAME, answer2,
+	                        sizeof answer2, &qh2) == ARC_DNS_SUCCESS);
+	server_recv();
+	second = client;
+	len2 = mkreply(other, FALSE);
+	assert(first.sin_port != second.sin_port);
+
+	/* and a reply is only taken on the port its query came from */
+	client = first;
+	server_send(ns, other, len2);
+	assert(waitfor(srv, qh2, SHORTWAIT, NULL) == ARC_DNS_NOREPLY);
+	server_send(ns, reply, len);
+	assert(waitfor(srv, qh, SHORTWAIT * 10, &bytes) == ARC_DNS_SUCCESS);
+	assert(bytes == len);
+	assert(memcmp(answer, reply, len) == 0);
+	client = second;
+	server_send(ns, other, len2);
+	assert(waitfor(srv, qh2, SHORTWAIT * 10, &bytes) == ARC_DNS_SUCCESS);
+	assert(bytes == len2);
+	assert(memcmp(answer2, other, len2) == 0);
+	arc_resolv_cancel(srv, qh);
+	arc_resolv_cancel(srv, qh2);
+
+	/* a truncated reply moves the query to TCP */
+	assert(arc_resolv_start(srv, T_TXT, (u_char *) OTHERNAME, answer,
+	                        sizeof answer, &qh) == ARC_DNS_SUCCESS);
+	len = server_tcp(reply, FALSE);
+	assert(waitfor(srv, qh, SHORTWAIT * 10, &bytes) == ARC_DNS_SUCCESS);
+	assert(bytes == len);
+	assert(memcmp(answer, reply, len) == 0);
+	arc_resolv_cancel(srv, qh);
+
+	/* where a reply with the wrong ID is an error */
+	assert(arc_resolv_start(srv, T_TXT, (u_char *) OTHERNAME, answer,
+	                        sizeof answer, &qh) == ARC_DNS_SUCCESS);
+	(void) server_tcp(reply, TRUE);
+	assert(waitfor(srv, qh, SHORTWAIT * 10, NULL) == ARC_DNS_ERROR);
+	arc_resolv_cancel(srv, qh);
+
+	arc_resolv_close(srv);
+	close(ns);
+	close(nstcp);
+	close(rogue);
+
+	printf("*** resolver reply parsing passed\n");
+
+	return 0;
+}
@@ -34,7 +34,10 @@ struct configdef arcf_config[] =
 	{ "FixedTimestamp",		CONFIG_TYPE_STRING,	FALSE },
 	{ "Include",			CONFIG_TYPE_INCLUDE,	FALSE },
 	{ "KeepTemporaryFiles",		CONFIG_TYPE_BOOLEAN,	FALSE },
+	{ "KeyCacheSnapshot",		CONFIG_TYPE_STRING,	FALSE },
+	{ "KeyCacheSnapshotInterval",	CONFIG_TYPE_INTEGER,	FALSE },
 	{ "KeyFile",			CONFIG_TYPE_STRING,	TRUE },
+	{ "LogTimings",			CONFIG_TYPE_STRING,	FALSE },
 	{ "MaximumHeaders",		CONFIG_TYPE_INTEGER,	FALSE },
 	{ "MilterDebug",		CONFIG_TYPE_INTEGER,	FALSE },
 	{ "PeerList",			CONFIG_TYPE_STRING,	FALSE },
@@ -47,6 +50,7 @@ struct configdef arcf_config[] =
 	{ "SyslogFacility",		CONFIG_TYPE_STRING,	FALSE },
 	{ "TemporaryDirectory",		CONFIG_TYPE_STRING,	FALSE },
 	{ "UserID",			CONFIG_TYPE_STRING,	FALSE },
+	{ "VerifyThreads",		CONFIG_TYPE_INTEGER,	FALSE },
 	{ NULL,				(u_int) -1,		FALSE }
 };
 
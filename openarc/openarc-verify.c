@@ -0,0 +1,1003 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#endif /* HAVE_STDBOOL_H */
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+/* macros */
+#define	CMDLINEOPTS	"a:d:k:n:qS:s:t:V"
+#define	CRLF		"\r\n"
+#define	DEFTHREADS	1
+#define	BODYCHUNK	65536
+#define	MAXTHREADS	1024
+
+#ifndef FALSE
+# define FALSE		0
+#endif /* ! FALSE */
+#ifndef TRUE
+# define TRUE		1
+#endif /* ! TRUE */
+
+/*
+**  ARCV_JOB -- one message to process
+*/
+
+struct arcv_job
+{
+	u_int			job_num;	/* message number in mbox */
+	ARC_STAT		job_status;
+	size_t			job_len;
+	const char *		job_path;
+	const char *		job_chain;
+	const u_char *		job_data;	/* NULL for a Maildir file */
+	char *			job_error;
+};
+
+/*
+**  ARCV_MAP -- an mbox file mapped for the duration of the run
+*/
+
+struct arcv_map
+{
+	size_t			map_len;
+	void *			map_addr;
+};
+
+/*
+**  ARCV_BUF -- growable buffer, one per worker
+*/
+
+struct arcv_buf
+{
+	size_t			buf_len;
+	size_t			buf_size;
+	u_char *		buf_data;
+};
+
+/*
+**  ARCV_ALG -- signing algorithm names
+*/
+
+struct arcv_alg
+{
+	const char *		alg_name;
+	arc_alg_t		alg_code;
+};
+
+/* globals */
+char *progname;
+
+static struct arcv_alg algs[] =
+{
+	{ "rsa-sha1",		ARC_SIGN_RSASHA1 },
+	{ "rsa-sha256",		ARC_SIGN_RSASHA256 },
+#ifdef ARC_SIGN_ED25519SHA256
+	{ "ed25519-sha256",	ARC_SIGN_ED25519SHA256 },
+#endif /* ARC_SIGN_ED25519SHA256 */
+	{ NULL,			0 }
+};
+
+static ARC_LIB *lib;
+static ARC_SIGNKEY *signkey = NULL;
+static arc_alg_t signalg = ARC_SIGN_RSASHA256;
+static char *authservid = NULL;
+static char *domain = NULL;
+static char *selector = NULL;
+
+static u_int njobs = 0;
+static u_int maxjobs = 0;
+static u_int nextjob = 0;
+static struct arcv_job *jobs = NULL;
+static pthread_mutex_t joblock = PTHREAD_MUTEX_INITIALIZER;
+
+static u_int nmaps = 0;
+static u_int maxmaps = 0;
+static struct arcv_map *maps = NULL;
+
+/*
+**  ARCV_BUF_CAT -- append to a worker buffer
+**
+**  Parameters:
+**  	buf -- buffer
+**  	data -- data to append
+**  	len -- bytes at "data"
+**
+**  Return value:
+**  	TRUE on success, FALSE if memory ran out.
+*/
+
+static _Bool
+arcv_buf_cat(struct arcv_buf *buf, const u_char *data, size_t len)
+{
+	assert(buf != NULL);
+
+	if (buf->buf_len + len > buf->buf_size)
+	{
+		size_t newsize;
+		u_char *new;
+
+		newsize = MAX(buf->buf_size * 2, buf->buf_len + len);
+		new = realloc(buf->buf_data, newsize);
+		if (new == NULL)
+			return FALSE;
+
+		buf->buf_data = new;
+		buf->buf_size = newsize;
+	}
+
+	memcpy(buf->buf_data + buf->buf_len, data, len);
+	buf->buf_len += len;
+
+	return TRUE;
+}
+
+/*
+**  ARCV_ADDJOB -- queue a message
+**
+**  Parameters:
+**  	path -- file it came from
+**  	num -- message number within that file (zero for a Maildir file)
+**  	data -- message text, or NULL to read "path" when it's processed
+**  	len -- bytes at "data"
+**
+**  Return value:
+**  	TRUE on success, FALSE if memory ran out.
+*/
+
+static _Bool
+arcv_addjob(const char *path, u_int num, const u_char *data, size_t len)
+{
+	struct arcv_job *job;
+
+	if (njobs == maxjobs)
+	{
+		u_int newmax;
+		struct arcv_job *new;
+
+		newmax = (maxjobs == 0 ? 1024 : maxjobs * 2);
+		new = realloc(jobs, newmax * sizeof *jobs);
+		if (new == NULL)
+			return FALSE;
+
+		jobs = new;
+		maxjobs = newmax;
+	}
+
+	job = &jobs[njobs++];
+	memset(job, '\0', sizeof *job);
+	job->job_path = path;
+	job->job_num = num;
+	job->job_data = data;
+	job->job_len = len;
+
+	return TRUE;
+}
+
+/*
+**  ARCV_LOADMBOX -- map an mbox file and queue each message in it
+**
+**  Parameters:
+**  	path -- mbox file
+**
+**  Return value:
+**  	An EX_* constant.
+**
+**  Notes:
+**  	A file that doesn't start with a "From " line is taken to be a
+**  	single message.  The empty line ahead of each "From " line is a
+**  	separator and not part of the message before it.
+*/
+
+static int
+arcv_loadmbox(const char *path)
+{
+	int fd;
+	u_int num;
+	size_t len;
+	const u_char *base;
+	const u_char *end;
+	const u_char *p;
+	const u_char *start;
+	const u_char *nl;
+	struct stat st;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		fprintf(stderr, "%s: %s: %s\n", progname, path,
+		        strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return EX_NOINPUT;
+	}
+
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return EX_OK;
+	}
+
+	len = (size_t) st.st_size;
+	base = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		fprintf(stderr, "%s: %s: mmap(): %s\n", progname, path,
+		        strerror(errno));
+		return EX_OSERR;
+	}
+
+	(void) madvise((void *) base, len, MADV_SEQUENTIAL);
+
+	if (nmaps == maxmaps)
+	{
+		u_int newmax;
+		struct arcv_map *new;
+
+		newmax = (maxmaps == 0 ? 16 : maxmaps * 2);
+		new = realloc(maps, newmax * sizeof *maps);
+		if (new == NULL)
+		{
+			munmap((void *) base, len);
+			return EX_OSERR;
+		}
+
+		maps = new;
+		maxmaps = newmax;
+	}
+
+	maps[nmaps].map_addr = (void *) base;
+	maps[nmaps].map_len = len;
+	nmaps++;
+
+	end = base + len;
+
+	if (len < 5 || memcmp(base, "From ", 5) != 0)
+		return arcv_addjob(path, 0, base, len) ? EX_OK : EX_OSERR;
+
+	num = 0;
+	p = base;
+	while (p < end)
+	{
+		/* skip the "From " line */
+		nl = memchr(p, '\n', end - p);
+		if (nl == NULL)
+			break;
+		start = nl + 1;
+
+		/* find the next one */
+		for (p = start; p < end; p = nl + 1)
+		{
+			if (end - p >= 5 && memcmp(p, "From ", 5) == 0)
+				break;
+
+			nl = memchr(p, '\n', end - p);
+			if (nl == NULL)
+			{
+				p = end;
+				break;
+			}
+		}
+
+		len = p - start;
+		if (p < end && len > 0 && start[len - 1] == '\n' &&
+		    (len == 1 || start[len - 2] == '\n'))
+			len--;
+
+		num++;
+		if (!arcv_addjob(path, num, start, len))
+			return EX_OSERR;
+	}
+
+	return EX_OK;
+}
+
+/*
+**  ARCV_LOADMAILDIR -- queue every message under a Maildir tree
+**
+**  Parameters:
+**  	path -- directory to walk
+**
+**  Return value:
+**  	An EX_* constant.
+**
+**  Notes:
+**  	Regular files directly inside a "cur" or "new" directory are
+**  	messages; anything under "tmp" is skipped.  Subdirectories are
+**  	walked too, so a tree of Maildir++ folders works.
+*/
+
+static int
+arcv_loadmaildir(const char *path)
+{
+	_Bool msgdir;
+	int status;
+	const char *base;
+	char *sub;
+	DIR *dir;
+	struct dirent *de;
+	struct stat st;
+
+	dir = opendir(path);
+	if (dir == NULL)
+	{
+		fprintf(stderr, "%s: %s: %s\n", progname, path,
+		        strerror(errno));
+		return EX_NOINPUT;
+	}
+
+	base = strrchr(path, '/');
+	base = (base == NULL ? path : base + 1);
+	msgdir = (strcmp(base, "cur") == 0 || strcmp(base, "new") == 0);
+
+	status = EX_OK;
+	while (status == EX_OK && (de = readdir(dir)) != NULL)
+	{
+		if (de->d_name[0] == '.' || strcmp(de->d_name, "tmp") == 0)
+			continue;
+
+		sub = malloc(strlen(path) + strlen(de->d_name) + 2);
+		if (sub == NULL)
+		{
+			status = EX_OSERR;
+			break;
+		}
+		sprintf(sub, "%s/%s", path, de->d_name);
+
+		if (stat(sub, &st) != 0)
+		{
+			free(sub);
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode))
+		{
+			status = arcv_loadmaildir(sub);
+			free(sub);
+		}
+		else if (msgdir && S_ISREG(st.st_mode))
+		{
+			/* "sub" stays around as the job's path */
+			if (!arcv_addjob(sub, 0, NULL, (size_t) st.st_size))
+				status = EX_OSERR;
+		}
+		else
+		{
+			free(sub);
+		}
+	}
+
+	closedir(dir);
+
+	return status;
+}
+
+/*
+**  ARCV_BODY -- feed a message body, converted to CRLF line endings
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	p -- start of the body
+**  	end -- end of the body
+**  	mbox -- the message came from an mbox file
+**  	chunk -- buffer for converted lines
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+**
+**  Notes:
+**  	For mbox messages a ">From " line, with any number of leading
+**  	'>', loses one of them (the "mboxrd" convention).  Lines too long
+**  	for "chunk" are passed through in place.
+*/
+
+static ARC_STAT
+arcv_body(ARC_MESSAGE *msg, const u_char *p, const u_char *end, _Bool mbox,
+          struct arcv_buf *chunk)
+{
+	size_t len;
+	ARC_STAT status;
+	const u_char *nl;
+	const u_char *q;
+
+	chunk->buf_len = 0;
+
+	while (p < end)
+	{
+		nl = memchr(p, '\n', end - p);
+		if (nl == NULL)
+			nl = end;
+
+		len = nl - p;
+		if (len > 0 && p[len - 1] == '\r')
+			len--;
+
+		if (mbox && len > 5 && p[0] == '>')
+		{
+			for (q = p; q < p + len && *q == '>'; q++)
+				continue;
+			if (p + len - q >= 5 && memcmp(q, "From ", 5) == 0)
+			{
+				p++;
+				len--;
+			}
+		}
+
+		if (chunk->buf_len + len + 2 > chunk->buf_size)
+		{
+			if (chunk->buf_len > 0)
+			{
+				status = arc_body(msg, chunk->buf_data,
+				                  chunk->buf_len);
+				if (status != ARC_STAT_OK)
+					return status;
+				chunk->buf_len = 0;
+			}
+
+			if (len + 2 > chunk->buf_size)
+			{
+				status = arc_body(msg, (u_char *) p, len);
+				if (status != ARC_STAT_OK)
+					return status;
+				len = 0;
+			}
+		}
+
+		memcpy(chunk->buf_data + chunk->buf_len, p, len);
+		memcpy(chunk->buf_data + chunk->buf_len + len, CRLF, 2);
+		chunk->buf_len += len + 2;
+
+		p = nl + 1;
+	}
+
+	if (chunk->buf_len > 0)
+		return arc_body(msg, chunk->buf_data, chunk->buf_len);
+
+	return ARC_STAT_OK;
+}
+
+/*
+**  ARCV_MESSAGE -- verify (and maybe seal) one message
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle, ready for a new message
+**  	job -- the message
+**  	data -- its text
+**  	hdr -- buffer for assembling header fields
+**  	chunk -- buffer for body lines
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+*/
+
+static ARC_STAT
+arcv_message(ARC_MESSAGE *msg, struct arcv_job *job, const u_char *data,
+             struct arcv_buf *hdr, struct arcv_buf *chunk)
+{
+	u_int nhdrs;
+	size_t len;
+	ARC_STAT status;
+	const u_char *p;
+	const u_char *nl;
+	const u_char *end;
+	const u_char *line;
+	ARC_HDRFIELD *seal;
+
+	p = data;
+	end = data + job->job_len;
+	hdr->buf_len = 0;
+	nhdrs = 0;
+
+	/* header fields, with any folding in CRLF form */
+	while (p < end)
+	{
+		line = p;
+		nl = memchr(p, '\n', end - p);
+		if (nl == NULL)
+			nl = end;
+		p = nl + 1;
+
+		len = nl - line;
+		if (len > 0 && line[len - 1] == '\r')
+			len--;
+
+		if (len == 0 || (line[0] != ' ' && line[0] != '\t'))
+		{
+			if (hdr->buf_len > 0)
+			{
+				status = arc_header_field(msg, hdr->buf_data,
+				                          hdr->buf_len);
+				if (status != ARC_STAT_OK)
+					return status;
+				hdr->buf_len = 0;
+				nhdrs++;
+			}
+
+			if (len == 0)
+				break;
+		}
+		else if (!arcv_buf_cat(hdr, (u_char *) CRLF, 2))
+		{
+			return ARC_STAT_NORESOURCE;
+		}
+
+		if (!arcv_buf_cat(hdr, line, len))
+			return ARC_STAT_NORESOURCE;
+	}
+
+	if (hdr->buf_len > 0)
+	{
+		status = arc_header_field(msg, hdr->buf_data, hdr->buf_len);
+		if (status != ARC_STAT_OK)
+			return status;
+		nhdrs++;
+	}
+
+	if (nhdrs == 0)
+	{
+		job->job_error = strdup("no header fields");
+		return ARC_STAT_SYNTAX;
+	}
+
+	status = arc_eoh(msg);
+	if (status != ARC_STAT_OK)
+		return status;
+
+	if (p < end)
+	{
+		status = arcv_body(msg, p, end, job->job_num != 0, chunk);
+		if (status != ARC_STAT_OK)
+			return status;
+	}
+
+	status = arc_eom(msg);
+	if (status != ARC_STAT_OK)
+		return status;
+
+	if (signkey != NULL)
+	{
+		status = arc_getseal_key(msg, &seal, authservid, selector,
+		                         domain, signkey, NULL);
+	}
+
+	return status;
+}
+
+/*
+**  ARCV_WORKER -- process queued messages until there are none left
+**
+**  Parameters:
+**  	arg -- unused
+**
+**  Return value:
+**  	Always NULL.
+*/
+
+static void *
+arcv_worker(void *arg)
+{
+	int fd;
+	u_int n;
+	const u_char *data;
+	const u_char *err;
+	const char *error;
+	ARC_MESSAGE *msg;
+	struct arcv_job *job;
+	struct arcv_buf hdr;
+	struct arcv_buf chunk;
+
+	memset(&hdr, '\0', sizeof hdr);
+	memset(&chunk, '\0', sizeof chunk);
+
+	chunk.buf_data = malloc(BODYCHUNK);
+	if (chunk.buf_data != NULL)
+		chunk.buf_size = BODYCHUNK;
+
+	msg = arc_message(lib, ARC_CANON_RELAXED, ARC_CANON_RELAXED, signalg,
+	                  &err);
+
+	for (;;)
+	{
+		pthread_mutex_lock(&joblock);
+		n = nextjob;
+		if (nextjob < njobs)
+			nextjob++;
+		pthread_mutex_unlock(&joblock);
+
+		if (n >= njobs)
+			break;
+
+		job = &jobs[n];
+
+		if (msg == NULL || chunk.buf_data == NULL)
+		{
+			job->job_status = ARC_STAT_NORESOURCE;
+			job->job_error = strdup("out of memory");
+			continue;
+		}
+
+		/* a Maildir message is mapped just while it's processed */
+		data = job->job_data;
+		if (data == NULL && job->job_len > 0)
+		{
+			fd = open(job->job_path, O_RDONLY);
+			data = (fd < 0 ? MAP_FAILED
+			               : mmap(NULL, job->job_len, PROT_READ,
+			                      MAP_PRIVATE, fd, 0));
+			if (fd >= 0)
+				close(fd);
+
+			if (data == MAP_FAILED)
+			{
+				job->job_status = ARC_STAT_INTERNAL;
+				job->job_error = strdup(strerror(errno));
+				continue;
+			}
+		}
+
+		job->job_status = arcv_message(msg, job,
+		                               data == NULL ? (u_char *) ""
+		                                            : data,
+		                               &hdr, &chunk);
+		job->job_chain = arc_chain_status_str(msg);
+		if (job->job_status != ARC_STAT_OK && job->job_error == NULL)
+		{
+			error = arc_geterror(msg);
+			job->job_error = strdup(error != NULL ? error
+			                                      : "processing failed");
+		}
+
+		if (job->job_data == NULL && data != NULL)
+			munmap((void *) data, job->job_len);
+
+		arc_message_reset(msg);
+	}
+
+	if (msg != NULL)
+		arc_free(msg);
+	free(hdr.buf_data);
+	free(chunk.buf_data);
+
+	return NULL;
+}
+
+/*
+**  USAGE -- print usage message and exit
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	EX_USAGE
+*/
+
+static int
+usage(void)
+{
+	fprintf(stderr, "%s: usage: %s [options] mbox|maildir [...]\n"
+	                "\t-a authservid\tauthservid to use when sealing\n"
+	                "\t-d domain    \tdomain to use when sealing\n"
+	                "\t-k keyfile   \tseal each message with this key\n"
+	                "\t-n servers   \tnameservers to use for key queries\n"
+	                "\t-q           \tprint only the summary\n"
+	                "\t-S algorithm \tsigning algorithm (default rsa-sha256)\n"
+	                "\t-s selector  \tselector to use when sealing\n"
+	                "\t-t threads   \tnumber of threads (default %d)\n"
+	                "\t-V           \tprint version number and exit\n",
+	        progname, progname, DEFTHREADS);
+
+	return EX_USAGE;
+}
+
+/*
+**  MAIN -- program mainline
+**
+**  Parameters:
+**  	argc, argv -- the usual
+**
+**  Return value:
+**  	Exit status.
+*/
+
+int
+main(int argc, char **argv)
+{
+	_Bool quiet = FALSE;
+	int c;
+	int status;
+	u_int nthreads = DEFTHREADS;
+	u_int npass = 0;
+	u_int nfail = 0;
+	u_int nnone = 0;
+	u_int nerror = 0;
+	u_long n;
+	double elapsed;
+	unsigned long long bytes = 0;
+	char *p;
+	char *keyfile = NULL;
+	char *nameservers = NULL;
+	pthread_t *threads;
+	struct arcv_alg *alg;
+	struct arcv_job *job;
+	struct stat st;
+	struct timeval start;
+	struct timeval finish;
+
+	progname = (p = strrchr(argv[0], '/')) == NULL ? argv[0] : p + 1;
+
+	while ((c = getopt(argc, argv, CMDLINEOPTS)) != -1)
+	{
+		switch (c)
+		{
+		  case 'a':
+			authservid = optarg;
+			break;
+
+		  case 'd':
+			domain = optarg;
+			break;
+
+		  case 'k':
+			keyfile = optarg;
+			break;
+
+		  case 'n':
+			nameservers = optarg;
+			break;
+
+		  case 'q':
+			quiet = TRUE;
+			break;
+
+		  case 'S':
+			for (alg = algs; alg->alg_name != NULL; alg++)
+			{
+				if (strcasecmp(alg->alg_name, optarg) == 0)
+					break;
+			}
+
+			if (alg->alg_name == NULL)
+			{
+				fprintf(stderr,
+				        "%s: unknown signing algorithm \"%s\"\n",
+				        progname, optarg);
+				return EX_USAGE;
+			}
+
+			signalg = alg->alg_code;
+			break;
+
+		  case 's':
+			selector = optarg;
+			break;
+
+		  case 't':
+			errno = 0;
+			n = strtoul(optarg, &p, 10);
+			if (errno != 0 || *p != '\0' || n == 0 ||
+			    n > MAXTHREADS)
+			{
+				fprintf(stderr,
+				        "%s: invalid thread count \"%s\"\n",
+				        progname, optarg);
+				return EX_USAGE;
+			}
+			nthreads = (u_int) n;
+			break;
+
+		  case 'V':
+			printf("%s: %s\n", progname, VERSION);
+			return EX_OK;
+
+		  default:
+			return usage();
+		}
+	}
+
+	if (optind >= argc)
+		return usage();
+
+	if (keyfile != NULL && (domain == NULL || selector == NULL))
+	{
+		fprintf(stderr, "%s: sealing requires -d and -s\n", progname);
+		return EX_USAGE;
+	}
+
+	if (authservid == NULL)
+		authservid = domain;
+
+	lib = arc_init();
+	if (lib == NULL)
+	{
+		fprintf(stderr, "%s: arc_init() failed\n", progname);
+		return EX_SOFTWARE;
+	}
+
+	if (nameservers != NULL &&
+	    arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_NAMESERVERS,
+	                nameservers, strlen(nameservers)) != ARC_STAT_OK)
+	{
+		fprintf(stderr, "%s: can't set nameservers \"%s\"\n",
+		        progname, nameservers);
+		arc_close(lib);
+		return EX_USAGE;
+	}
+
+	if (keyfile != NULL)
+	{
+		int fd;
+		const u_char *err = NULL;
+		u_char *key;
+
+		fd = open(keyfile, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) != 0)
+		{
+			fprintf(stderr, "%s: %s: %s\n", progname, keyfile,
+			        strerror(errno));
+			arc_close(lib);
+			return EX_NOINPUT;
+		}
+
+		key = malloc(st.st_size + 1);
+		if (key == NULL ||
+		    read(fd, key, st.st_size) != (ssize_t) st.st_size)
+		{
+			fprintf(stderr, "%s: %s: can't read key\n", progname,
+			        keyfile);
+			close(fd);
+			free(key);
+			arc_close(lib);
+			return EX_NOINPUT;
+		}
+		close(fd);
+
+		signkey = arc_signkey_new(key, st.st_size, &err);
+		free(key);
+		if (signkey == NULL)
+		{
+			fprintf(stderr, "%s: %s: %s\n", progname, keyfile,
+			        err == NULL ? "unusable key" : (char *) err);
+			arc_close(lib);
+			return EX_DATAERR;
+		}
+	}
+
+	/* queue everything up */
+	status = EX_OK;
+	for (c = optind; c < argc && status == EX_OK; c++)
+	{
+		if (stat(argv[c], &st) != 0)
+		{
+			fprintf(stderr, "%s: %s: %s\n", progname, argv[c],
+			        strerror(errno));
+			status = EX_NOINPUT;
+		}
+		else if (S_ISDIR(st.st_mode))
+		{
+			status = arcv_loadmaildir(argv[c]);
+		}
+		else
+		{
+			status = arcv_loadmbox(argv[c]);
+		}
+	}
+
+	if (status != EX_OK)
+	{
+		if (status == EX_OSERR)
+			fprintf(stderr, "%s: out of memory\n", progname);
+		arc_signkey_free(signkey);
+		arc_close(lib);
+		return status;
+	}
+
+	threads = malloc(nthreads * sizeof *threads);
+	if (threads == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", progname);
+		arc_signkey_free(signkey);
+		arc_close(lib);
+		return EX_OSERR;
+	}
+
+	/* ...and run it */
+	(void) gettimeofday(&start, NULL);
+
+	for (n = 0; n < nthreads; n++)
+	{
+		if (pthread_create(&threads[n], NULL, arcv_worker, NULL) != 0)
+			break;
+	}
+
+	if (n == 0)
+		(void) arcv_worker(NULL);
+
+	while (n > 0)
+		(void) pthread_join(threads[--n], NULL);
+
+	(void) gettimeofday(&finish, NULL);
+
+	free(threads);
+
+	for (n = 0; n < njobs; n++)
+	{
+		job = &jobs[n];
+		bytes += job->job_len;
+
+		if (job->job_status != ARC_STAT_OK)
+			nerror++;
+		else if (strcmp(job->job_chain, "pass") == 0)
+			npass++;
+		else if (strcmp(job->job_chain, "fail") == 0)
+			nfail++;
+		else
+			nnone++;
+
+		if (quiet)
+			continue;
+
+		if (job->job_num != 0)
+			printf("%s:%u: ", job->job_path, job->job_num);
+		else
+			printf("%s: ", job->job_path);
+
+		if (job->job_status != ARC_STAT_OK)
+			printf("error: %s\n", job->job_error);
+		else if (signkey != NULL)
+			printf("%s, sealed\n", job->job_chain);
+		else
+			printf("%s\n", job->job_chain);
+	}
+
+	elapsed = (finish.tv_sec - start.tv_sec) +
+	          (finish.tv_usec - start.tv_usec) / 1000000.0;
+	if (elapsed <= 0.0)
+		elapsed = 0.000001;
+
+	printf("%u message(s), %llu byte(s) in %.3fs with %u thread(s): "
+	       "%.1f msg/s, %.2f MB/s\n",
+	       njobs, bytes, elapsed, nthreads,
+	       njobs / elapsed, bytes / elapsed / 1048576.0);
+	printf("pass %u, fail %u, none %u, error %u\n",
+	       npass, nfail, nnone, nerror);
+
+	for (n = 0; n < njobs; n++)
+	{
+		free(jobs[n].job_error);
+		if (jobs[n].job_data == NULL)
+			free((void *) jobs[n].job_path);
+	}
+	free(jobs);
+
+	for (n = 0; n < nmaps; n++)
+		munmap(maps[n].map_addr, maps[n].map_len);
+	free(maps);
+
+	arc_signkey_free(signkey);
+	arc_close(lib);
+
+	return EX_OK;
+}
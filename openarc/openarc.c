@@ -23,7 +23,6 @@
 #ifdef __linux__
 # include <sys/prctl.h>
 #endif /* __linux__ */
-#include <sys/queue.h>
 #ifdef USE_LUA
 # include <netinet/in.h>
 # include <arpa/inet.h>
@@ -90,17 +89,8 @@
 /* macros */
 #define CMDLINEOPTS	"Ac:fhlnp:P:r:t:u:vV"
 #define AR_HEADER_NAME	"Authentication-Results"
-
-/*
-**  CONFIGVALUE -- a list of configuration values
-*/
-
-struct configvalue
-{
-	u_char *		value;
-	LIST_ENTRY(configvalue)	entries;
-};
-LIST_HEAD(conflist, configvalue);
+#define ARCF_TIMING_TOTAL	(ARC_TIMING_MAX + 1)	/* wall clock slot */
+#define ARCF_TIMING_BUCKETS	32		/* log2 histogram buckets */
 
 /*
 **  CONFIG -- configuration data
@@ -117,6 +107,10 @@ struct arcf_config
 	_Bool		conf_safekeys;		/* require safe keys */
 	_Bool		conf_keeptmpfiles;	/* keep temp files */
 	u_int		conf_refcnt;		/* reference count */
+	u_int		conf_npooled;		/* handles in conf_msgpool */
+	int		conf_verifythreads;	/* signature check threads */
+	int		conf_logtimings;	/* timing log priority */
+	int		conf_snapinterval;	/* key snapshot interval */
 	arc_canon_t	conf_canonhdr;		/* canonicalization for header */
 	arc_canon_t	conf_canonbody;		/* canonicalization for body */
 	arc_alg_t	conf_signalg;		/* signing algorithm */
@@ -126,13 +120,15 @@ struct arcf_config
 	char *		conf_tmpdir;		/* temp file directory */
 	char *		conf_authservid;	/* ID for A-R fields */
 	char *		conf_peerfile;		/* peer hosts table */
+	char *		conf_keysnapshot;	/* key cache snapshot file */
 	char *		conf_domain;		/* domain */
-	u_char *	conf_keydata;		/* binary key data */
-	size_t		conf_keylen;		/* key length */
+	ARC_SIGNKEY *	conf_signkey;		/* parsed signing key */
 	ssize_t		conf_maxhdrsz;		/* max. header size */
 	struct config *	conf_data;		/* configuration data */
 	ARC_LIB *	conf_libopenarc;	/* shared library instance */
-	struct conflist conf_peers;		/* peers hosts */
+	struct peerlist conf_peers;		/* peers hosts */
+	pthread_mutex_t	conf_poollock;		/* conf_msgpool lock */
+	ARC_MESSAGE *	conf_msgpool[MAXMSGPOOL]; /* idle message handles */
 };
 
 /*
@@ -144,9 +140,11 @@ struct msgctx
 {
 	_Bool		mctx_peer;		/* peer source? */
 	ssize_t		mctx_hdrbytes;		/* count of header bytes */
+	uint64_t	mctx_start;		/* message start (usec) */
 	u_char *	mctx_jobid;		/* job ID */
 	struct Header *	mctx_hqhead;		/* header queue head */
 	struct Header *	mctx_hqtail;		/* header queue tail */
+	struct Header *	mctx_hindex[HDRBUCKETS]; /* header name index */
 	ARC_MESSAGE *	mctx_arcmsg;		/* libopenarc message */
 	struct arcf_dstring * mctx_tmpstr;	/* temporary string */
 };
@@ -165,6 +163,7 @@ struct connctx
 	struct sockaddr_storage	cctx_ip;	/* IP info */
 	struct arcf_config * cctx_config;	/* configuration in use */
 	struct msgctx *	cctx_msg;		/* message context */
+	ARC_MESSAGE *	cctx_spare;		/* idle message handle */
 };
 
 /*
@@ -201,6 +200,31 @@ struct lookup log_facilities[] =
 	{ NULL,			-1 }
 };
 
+struct lookup log_priorities[] =
+{
+	{ "emerg",		LOG_EMERG },
+	{ "alert",		LOG_ALERT },
+	{ "crit",		LOG_CRIT },
+	{ "err",		LOG_ERR },
+	{ "warning",		LOG_WARNING },
+	{ "notice",		LOG_NOTICE },
+	{ "info",		LOG_INFO },
+	{ "debug",		LOG_DEBUG },
+	{ NULL,			-1 }
+};
+
+struct lookup arcf_timingphases[] =
+{
+	{ "parse",		ARC_TIMING_PARSE },
+	{ "eoh",		ARC_TIMING_EOH },
+	{ "body",		ARC_TIMING_BODY },
+	{ "keyfetch",		ARC_TIMING_KEYFETCH },
+	{ "verify",		ARC_TIMING_VERIFY },
+	{ "sign",		ARC_TIMING_SIGN },
+	{ "total",		ARCF_TIMING_TOTAL },
+	{ NULL,			-1 }
+};
+
 struct lookup arcf_canonicalizations[] = {
 	{ "simple",		ARC_CANON_SIMPLE },
 	{ "relaxed",		ARC_CANON_RELAXED },
@@ -210,6 +234,9 @@ struct lookup arcf_canonicalizations[] = {
 struct lookup arcf_signalgorithms[] = {
 	{ "rsa-sha1",		ARC_SIGN_RSASHA1 },
 	{ "rsa-sha256",		ARC_SIGN_RSASHA256 },
+#ifdef HAVE_ED25519
+	{ "ed25519-sha256",	ARC_SIGN_ED25519SHA256 },
+#endif /* HAVE_ED25519 */
 	{ NULL,			-1 }
 };
 
@@ -227,6 +254,7 @@ sfsistat mlfi_negotiate __P((SMFICTX *, unsigned long, unsigned long,
                                         unsigned long *, unsigned long *,
                                         unsigned long *, unsigned long *));
 
+static void arcf_config_free __P((struct arcf_config *));
 static Header arcf_findheader __P((msgctx, char *, int));
 
 /* GLOBALS */
@@ -234,6 +262,7 @@ _Bool dolog;					/* logging? (exported) */
 _Bool reload;					/* reload requested */
 _Bool no_i_whine;				/* noted ${i} is undefined */
 _Bool die;					/* global "die" flag */
+_Bool snaprunning;				/* snapshot thread started */
 _Bool testmode;					/* test mode */
 int diesig;					/* signal to distribute */
 char *progname;					/* program name */
@@ -242,6 +271,11 @@ char *conffile;					/* configuration file */
 struct arcf_config *curconf;			/* current configuration */
 pthread_mutex_t conf_lock;			/* config lock */
 pthread_mutex_t pwdb_lock;			/* passwd/group lock */
+pthread_mutex_t timing_lock;			/* timing histogram lock */
+pthread_cond_t snap_cond;			/* wakes snapshot thread */
+pthread_t snapthread;				/* snapshot thread */
+uint64_t timing_hist[ARCF_TIMING_TOTAL + 1][ARCF_TIMING_BUCKETS];
+						/* timing histograms */
 char myhostname[MAXHOSTNAMELEN + 1];		/* local host's name */
 
 /* Other useful definitions */
@@ -1131,141 +1165,279 @@ arcf_reloader(/* UNUSED */ void *vp)
 }
 
 /*
-**  ARCF_KILLCHILD -- kill child process
+**  ARCF_SNAPSHOT_SAVE -- write the key cache snapshot for a configuration
 **
 **  Parameters:
-**  	pid -- process ID to signal
-**  	sig -- signal to use
-**  	dolog -- log it?
+**  	conf -- configuration whose library's cache should be saved
 **
 **  Return value:
 **  	None.
 */
 
 static void
-arcf_killchild(pid_t pid, int sig, _Bool dolog)
+arcf_snapshot_save(struct arcf_config *conf)
 {
-	if (kill(pid, sig) == -1 && dolog)
+	ARC_STAT status;
+
+	assert(conf != NULL);
+
+	if (conf->conf_keysnapshot == NULL || conf->conf_libopenarc == NULL)
+		return;
+
+	status = arc_keycache_write(conf->conf_libopenarc,
+	                            conf->conf_keysnapshot);
+	if (status != ARC_STAT_OK && conf->conf_dolog)
 	{
-		syslog(LOG_ERR, "kill(%d, %d): %s", pid, sig,
-		       strerror(errno));
+		syslog(LOG_WARNING, "%s: can't write key cache snapshot: %s",
+		       conf->conf_keysnapshot, strerror(errno));
 	}
 }
 
 /*
-**  ARCF_CONFIG_NEW -- get a new configuration handle
+**  ARCF_SNAPSHOT_LOAD -- warm a configuration's key cache from its snapshot
 **
 **  Parameters:
-**  	None.
+**  	conf -- configuration whose library's cache should be loaded
 **
 **  Return value:
-**  	A new configuration handle, or NULL on error.
+**  	None.
+**
+**  Notes:
+**  	A missing snapshot isn't an error; it just means a cold start.
 */
 
-static struct arcf_config *
-arcf_config_new(void)
+static void
+arcf_snapshot_load(struct arcf_config *conf)
 {
-	struct arcf_config *new;
+	u_int nkeys = 0;
+	ARC_STAT status;
 
-	new = (struct arcf_config *) malloc(sizeof(struct arcf_config));
-	if (new == NULL)
-		return NULL;
+	assert(conf != NULL);
 
-	memset(new, '\0', sizeof(struct arcf_config));
-	new->conf_maxhdrsz = DEFMAXHDRSZ;
-	new->conf_safekeys = TRUE;
+	if (conf->conf_keysnapshot == NULL || conf->conf_libopenarc == NULL)
+		return;
 
-	LIST_INIT(&new->conf_peers);
+	status = arc_keycache_read(conf->conf_libopenarc,
+	                           conf->conf_keysnapshot, &nkeys);
+	if (!conf->conf_dolog)
+		return;
 
-	return new;
+	if (status == ARC_STAT_OK)
+	{
+		syslog(LOG_INFO, "%s: restored %u cached key(s)",
+		       conf->conf_keysnapshot, nkeys);
+	}
+	else if (status == ARC_STAT_SYNTAX)
+	{
+		syslog(LOG_WARNING,
+		       "%s: damaged key cache snapshot; restored %u key(s)",
+		       conf->conf_keysnapshot, nkeys);
+	}
+	else if (errno != ENOENT)
+	{
+		syslog(LOG_WARNING, "%s: can't read key cache snapshot: %s",
+		       conf->conf_keysnapshot, strerror(errno));
+	}
 }
 
 /*
-**  ARCF_LIST_LOAD -- load a list
+**  ARCF_SNAPSHOT_CARRY -- carry the key cache over to a new configuration
 **
 **  Parameters:
-**  	f -- input file
-**  	list -- list to update
-**  	err -- error string (returned)
+**  	old -- configuration being replaced
+**  	new -- configuration replacing it
 **
 **  Return value:
-**  	TRUE iff the operation succeeded.
+**  	None.
+**
+**  Notes:
+**  	Called with conf_lock held.  If the snapshot file is unchanged the
+**  	cache is copied in memory; otherwise the old configuration's cache
+**  	is saved and the new one is loaded from its own file.
 */
 
-_Bool
-arcf_list_load(struct conflist *list, char *path, char **err)
+static void
+arcf_snapshot_carry(struct arcf_config *old, struct arcf_config *new)
 {
-	FILE *f;
-	char *p;
-	struct configvalue *v;
-	char buf[BUFRSZ + 1];
+	u_int nkeys = 0;
+
+	assert(old != NULL);
+	assert(new != NULL);
 
-	f = fopen(path, "r");
-	if (f == NULL)
+	if (old->conf_libopenarc == NULL || new->conf_libopenarc == NULL)
+		return;
+
+	if ((old->conf_keysnapshot == NULL && new->conf_keysnapshot == NULL) ||
+	    (old->conf_keysnapshot != NULL && new->conf_keysnapshot != NULL &&
+	     strcmp(old->conf_keysnapshot, new->conf_keysnapshot) == 0))
 	{
-		*err = strerror(errno);
-		return FALSE;
+		arc_keycache_copy(new->conf_libopenarc, old->conf_libopenarc,
+		                  &nkeys);
+
+		if (new->conf_dolog && nkeys > 0)
+			syslog(LOG_INFO, "kept %u cached key(s)", nkeys);
+
+		return;
 	}
 
-	memset(buf, '\0', sizeof buf);
-	while (fgets(buf, sizeof buf - 1, f) != (char *) EOF)
+	arcf_snapshot_save(old);
+	arcf_snapshot_load(new);
+}
+
+/*
+**  ARCF_SNAPSHOTTER -- key cache snapshot thread
+**
+**  Parameters:
+**  	vp -- void pointer required by thread API but not used
+**
+**  Return value:
+**  	NULL.
+**
+**  Notes:
+**  	Writes the current configuration's snapshot every
+**  	KeyCacheSnapshotInterval seconds until "die" is set, sleeping on
+**  	snap_cond in between; a reload or shutdown signals it, which
+**  	starts the interval over.  The configuration is referenced rather
+**  	than locked while writing so new connections aren't held up.
+*/
+
+static void *
+arcf_snapshotter(/* UNUSED */ void *vp)
+{
+	int status;
+	struct arcf_config *conf;
+	struct timespec deadline;
+
+	pthread_mutex_lock(&conf_lock);
+
+	while (!die)
 	{
-		for (p = buf; *p != '\0'; p++)
+		conf = curconf;
+		if (conf->conf_keysnapshot == NULL ||
+		    conf->conf_snapinterval <= 0)
 		{
-			if (*p == '\n')
-			{
-				*p = '\0';
-				break;
-			}
+			(void) pthread_cond_wait(&snap_cond, &conf_lock);
+			continue;
 		}
 
-		v = (struct configvalue *) malloc(sizeof(struct configvalue));
-		if (v == NULL)
-		{
-			*err = strerror(errno);
-			fclose(f);
-			return FALSE;
-		}
-		v->value = strdup(buf);
-		if (v->value == NULL)
-		{
-			*err = strerror(errno);
-			fclose(f);
-			free(v);
-			return FALSE;
-		}
+		deadline.tv_sec = time(NULL) + conf->conf_snapinterval;
+		deadline.tv_nsec = 0;
+
+		status = pthread_cond_timedwait(&snap_cond, &conf_lock,
+		                                &deadline);
+		if (status != ETIMEDOUT || die || conf != curconf)
+			continue;
+
+		conf->conf_refcnt++;
+
+		pthread_mutex_unlock(&conf_lock);
 
-		LIST_INSERT_HEAD(list, v, entries);
+		arcf_snapshot_save(conf);
+
+		pthread_mutex_lock(&conf_lock);
+
+		conf->conf_refcnt--;
+		if (conf->conf_refcnt == 0 && conf != curconf)
+			arcf_config_free(conf);
 	}
 
-	fclose(f);
-	return TRUE;
+	pthread_mutex_unlock(&conf_lock);
+
+	return NULL;
 }
 
 /*
-**  ARCF_LIST_DESTROY -- destroy a list
+**  ARCF_SNAPSHOT_START -- start the key cache snapshot thread if needed
 **
 **  Parameters:
-**  	list -- LIST to be destroyed
+**  	conf -- configuration now in effect
 **
 **  Return value:
-**  	None.
+**  	0 on success or if there was nothing to do, else an error code
+**  	from pthread_create().
+**
+**  Notes:
+**  	The thread is only started once some configuration asks for
+**  	periodic snapshots.  If it's already running it is woken so it
+**  	picks up the new settings.  Called with conf_lock held once
+**  	other threads exist.
 */
 
-void
-arcf_list_destroy(struct conflist *list)
+static int
+arcf_snapshot_start(struct arcf_config *conf)
 {
-	while (!LIST_EMPTY(list))
+	int status;
+
+	assert(conf != NULL);
+
+	if (snaprunning)
 	{
-		struct configvalue *n;
+		pthread_cond_signal(&snap_cond);
+		return 0;
+	}
+
+	if (conf->conf_keysnapshot == NULL || conf->conf_snapinterval <= 0)
+		return 0;
+
+	status = pthread_create(&snapthread, NULL, arcf_snapshotter, NULL);
+	if (status == 0)
+		snaprunning = TRUE;
+
+	return status;
+}
+
+/*
+**  ARCF_KILLCHILD -- kill child process
+**
+**  Parameters:
+**  	pid -- process ID to signal
+**  	sig -- signal to use
+**  	dolog -- log it?
+**
+**  Return value:
+**  	None.
+*/
 
-		n = LIST_FIRST(list);
-		LIST_REMOVE(n, entries);
-		free(n->value);
-		free(n);
+static void
+arcf_killchild(pid_t pid, int sig, _Bool dolog)
+{
+	if (kill(pid, sig) == -1 && dolog)
+	{
+		syslog(LOG_ERR, "kill(%d, %d): %s", pid, sig,
+		       strerror(errno));
 	}
 }
 
+/*
+**  ARCF_CONFIG_NEW -- get a new configuration handle
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	A new configuration handle, or NULL on error.
+*/
+
+static struct arcf_config *
+arcf_config_new(void)
+{
+	struct arcf_config *new;
+
+	new = (struct arcf_config *) malloc(sizeof(struct arcf_config));
+	if (new == NULL)
+		return NULL;
+
+	memset(new, '\0', sizeof(struct arcf_config));
+	new->conf_maxhdrsz = DEFMAXHDRSZ;
+	new->conf_safekeys = TRUE;
+	new->conf_logtimings = -1;
+	new->conf_snapinterval = DEFSNAPINTERVAL;
+
+	pthread_mutex_init(&new->conf_poollock, NULL);
+
+	return new;
+}
+
 /*
 **  ARCF_CONFIG_FREE -- destroy a configuration handle
 **
@@ -1282,14 +1454,20 @@ arcf_config_free(struct arcf_config *conf)
 	assert(conf != NULL);
 	assert(conf->conf_refcnt == 0);
 
+	while (conf->conf_npooled > 0)
+		arc_free(conf->conf_msgpool[--conf->conf_npooled]);
+	pthread_mutex_destroy(&conf->conf_poollock);
+
 	if (conf->conf_libopenarc != NULL)
 		arc_close(conf->conf_libopenarc);
 
+	if (conf->conf_signkey != NULL)
+		arc_signkey_free(conf->conf_signkey);
+
 	if (conf->conf_authservid != NULL)
 		free(conf->conf_authservid);
 
-	if (!LIST_EMPTY(&conf->conf_peers))
-		arcf_list_destroy(&conf->conf_peers);
+	arcf_list_destroy(&conf->conf_peers);
 
 	if (conf->conf_data != NULL)
 		config_free(conf->conf_data);
@@ -1395,6 +1573,12 @@ arcf_config_load(struct config *data, struct arcf_config *conf,
 		{
 			conf->conf_signalg = arcf_lookup_strtoint(str,
 			                                          arcf_signalgorithms);
+			if (conf->conf_signalg == -1)
+			{
+				snprintf(err, errlen,
+				         "unknown signing algorithm \"%s\"", str);
+				return -1;
+			}
 		}
 
 		(void) config_get(data, "Domain",
@@ -1425,6 +1609,18 @@ arcf_config_load(struct config *data, struct arcf_config *conf,
 		                  &conf->conf_maxhdrsz,
 		                  sizeof conf->conf_maxhdrsz);
 
+		(void) config_get(data, "VerifyThreads",
+		                  &conf->conf_verifythreads,
+		                  sizeof conf->conf_verifythreads);
+
+		(void) config_get(data, "KeyCacheSnapshot",
+		                  &conf->conf_keysnapshot,
+		                  sizeof conf->conf_keysnapshot);
+
+		(void) config_get(data, "KeyCacheSnapshotInterval",
+		                  &conf->conf_snapinterval,
+		                  sizeof conf->conf_snapinterval);
+
 		str = NULL;
 		(void) config_get(data, "FixedTimestamp", &str, sizeof str);
 		if (str != NULL)
@@ -1440,6 +1636,24 @@ arcf_config_load(struct config *data, struct arcf_config *conf,
 			                  sizeof conf->conf_dolog);
 		}
 
+		str = NULL;
+		(void) config_get(data, "LogTimings", &str, sizeof str);
+		if (str != NULL)
+		{
+			conf->conf_logtimings = arcf_lookup_strtoint(str,
+			                                             log_priorities);
+			if (conf->conf_logtimings == -1)
+			{
+				snprintf(err, errlen,
+				         "unknown log priority \"%s\"", str);
+				return -1;
+			}
+
+			/* timings are only reported via syslog */
+			if (!conf->conf_dolog)
+				conf->conf_logtimings = -1;
+		}
+
 		(void) config_get(data, "DisableCryptoInit",
 		                  &conf->conf_disablecryptoinit,
 		                  sizeof conf->conf_disablecryptoinit);
@@ -1484,13 +1698,11 @@ arcf_config_load(struct config *data, struct arcf_config *conf,
 		(void) config_get(data, "PeerList", &str, sizeof str);
 	if (str != NULL)
 	{
-		int status;
 		char *dberr = NULL;
 
-		status = arcf_list_load(&conf->conf_peers, str, &dberr);
-		if (status != 0)
+		if (!arcf_list_load(&conf->conf_peers, str, &dberr))
 		{
-			snprintf(err, errlen, "%s: arcf_loadlist(): %s",
+			snprintf(err, errlen, "%s: arcf_list_load(): %s",
 			         str, dberr);
 			return -1;
 		}
@@ -1505,6 +1717,7 @@ arcf_config_load(struct config *data, struct arcf_config *conf,
 		ino_t ino;
 		uid_t asuser = (uid_t) -1;
 		u_char *s33krit;
+		const u_char *errstr = NULL;
 		struct stat s;
 
 		fd = open(conf->conf_keyfile, O_RDONLY, 0);
@@ -1618,8 +1831,6 @@ arcf_config_load(struct config *data, struct arcf_config *conf,
 			return -1;
 		}
 
-		conf->conf_keylen = s.st_size + 1;
-
 		rlen = read(fd, s33krit, s.st_size + 1);
 		if (rlen == (ssize_t) -1)
 		{
@@ -1659,7 +1870,24 @@ arcf_config_load(struct config *data, struct arcf_config *conf,
 
 		close(fd);
 		s33krit[s.st_size] = '\0';
-		conf->conf_keydata = s33krit;
+
+		/* parse it once here rather than once per message */
+		conf->conf_signkey = arc_signkey_new(s33krit, s.st_size + 1,
+		                                     &errstr);
+		memset(s33krit, '\0', s.st_size + 1);
+		free(s33krit);
+		if (conf->conf_signkey == NULL)
+		{
+			if (conf->conf_dolog)
+			{
+				syslog(LOG_ERR, "%s: can't load key: %s",
+				       conf->conf_keyfile, errstr);
+			}
+
+			snprintf(err, errlen, "%s: can't load key: %s",
+			         conf->conf_keyfile, errstr);
+			return -1;
+		}
 	}
 
 	/* activate logging if requested */
@@ -1725,17 +1953,31 @@ arcf_config_setlib(struct arcf_config *conf, char **err)
 
 	if (status == ARC_STAT_OK)
 	{
-		opts = ARC_LIBFLAGS_NONE;
+		opts = ARC_LIBFLAGS_ARENA;
 
 		if (conf->conf_keeptmpfiles)
 			opts |= ARC_LIBFLAGS_KEEPFILES;
 
+		if (conf->conf_logtimings != -1)
+			opts |= ARC_LIBFLAGS_TIMING;
+
 		status = arc_options(conf->conf_libopenarc,
 		                     ARC_OP_SETOPT,
 		                     ARC_OPTS_FLAGS,
 		                     &opts, sizeof opts);
 	}
 
+	if (status == ARC_STAT_OK && conf->conf_verifythreads > 0)
+	{
+		u_int nthreads;
+
+		nthreads = conf->conf_verifythreads;
+		status = arc_options(conf->conf_libopenarc,
+		                     ARC_OP_SETOPT,
+		                     ARC_OPTS_VERIFYTHREADS,
+		                     &nthreads, sizeof nthreads);
+	}
+
 	if (conf->conf_fixedtime != 0)
 	{
 		arc_options(conf->conf_libopenarc,
@@ -1755,6 +1997,169 @@ arcf_config_setlib(struct arcf_config *conf, char **err)
 	return TRUE;
 }
 
+/*
+**  ARCF_TIMING_BUCKET -- select the histogram bucket for a duration
+**
+**  Parameters:
+**  	usec -- duration, in microseconds
+**
+**  Return value:
+**  	Bucket index; bucket "n" counts durations below 2^n microseconds
+**  	that didn't fit in bucket "n - 1", and the last one takes the rest.
+*/
+
+static int
+arcf_timing_bucket(uint64_t usec)
+{
+	int b;
+
+	for (b = 0; b < ARCF_TIMING_BUCKETS - 1; b++)
+	{
+		if (usec < ((uint64_t) 1 << b))
+			break;
+	}
+
+	return b;
+}
+
+/*
+**  ARCF_TIMING_DUMP -- log and reset the timing histograms
+**
+**  Parameters:
+**  	priority -- syslog priority to use
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	One line is logged per phase that saw any messages, listing only
+**  	the non-empty buckets as "<limit>=count", with limits in
+**  	microseconds.
+*/
+
+static void
+arcf_timing_dump(int priority)
+{
+	int p;
+	int b;
+	size_t len;
+	uint64_t n;
+	char line[BUFRSZ + 1];
+
+	pthread_mutex_lock(&timing_lock);
+
+	for (p = 0; p <= ARCF_TIMING_TOTAL; p++)
+	{
+		len = 0;
+		n = 0;
+		line[0] = '\0';
+
+		for (b = 0; b < ARCF_TIMING_BUCKETS; b++)
+		{
+			if (timing_hist[p][b] == 0)
+				continue;
+
+			n += timing_hist[p][b];
+
+			if (len >= sizeof line)
+				continue;
+
+			if (b == ARCF_TIMING_BUCKETS - 1)
+			{
+				len += snprintf(line + len, sizeof line - len,
+				                " >=%llu=%llu",
+				                (unsigned long long) 1 << (b - 1),
+				                (unsigned long long) timing_hist[p][b]);
+			}
+			else
+			{
+				len += snprintf(line + len, sizeof line - len,
+				                " <%llu=%llu",
+				                (unsigned long long) 1 << b,
+				                (unsigned long long) timing_hist[p][b]);
+			}
+		}
+
+		if (n > 0)
+		{
+			syslog(priority, "timing histogram %s: n=%llu%s",
+			       arcf_lookup_inttostr(p, arcf_timingphases),
+			       (unsigned long long) n, line);
+		}
+	}
+
+	memset(timing_hist, '\0', sizeof timing_hist);
+
+	pthread_mutex_unlock(&timing_lock);
+}
+
+/*
+**  ARCF_TIMING_LOG -- log the timings for a completed message
+**
+**  Parameters:
+**  	conf -- configuration in use
+**  	afc -- message context
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	"total" is wall clock time since MAIL FROM, so the difference
+**  	between it and the sum of the library phases is time spent in the
+**  	filter, the MTA and the milter protocol.  Uses mctx_tmpstr.
+*/
+
+static void
+arcf_timing_log(struct arcf_config *conf, msgctx afc)
+{
+	int p;
+	u_int hop;
+	uint64_t usec[ARCF_TIMING_TOTAL + 1];
+	uint64_t keyfetch;
+	uint64_t verify;
+
+	assert(conf != NULL);
+	assert(afc != NULL);
+
+	for (p = 0; p < ARCF_TIMING_TOTAL; p++)
+	{
+		if (arc_gettiming(afc->mctx_arcmsg, p, 0,
+		                  &usec[p]) != ARC_STAT_OK)
+			usec[p] = 0;
+	}
+
+	usec[ARCF_TIMING_TOTAL] = arcf_clock_usec() - afc->mctx_start;
+
+	arcf_dstring_blank(afc->mctx_tmpstr);
+	for (p = 0; p <= ARCF_TIMING_TOTAL; p++)
+	{
+		arcf_dstring_printf(afc->mctx_tmpstr, " %s=%llu",
+		                    arcf_lookup_inttostr(p, arcf_timingphases),
+		                    (unsigned long long) usec[p]);
+	}
+
+	for (hop = 1;
+	     arc_gettiming(afc->mctx_arcmsg, ARC_TIMING_KEYFETCH, hop,
+	                   &keyfetch) == ARC_STAT_OK &&
+	     arc_gettiming(afc->mctx_arcmsg, ARC_TIMING_VERIFY, hop,
+	                   &verify) == ARC_STAT_OK;
+	     hop++)
+	{
+		arcf_dstring_printf(afc->mctx_tmpstr,
+		                    " i=%u:keyfetch=%llu,verify=%llu", hop,
+		                    (unsigned long long) keyfetch,
+		                    (unsigned long long) verify);
+	}
+
+	syslog(conf->conf_logtimings, "%s: timing (usec)%s", afc->mctx_jobid,
+	       arcf_dstring_get(afc->mctx_tmpstr));
+
+	pthread_mutex_lock(&timing_lock);
+	for (p = 0; p <= ARCF_TIMING_TOTAL; p++)
+		timing_hist[p][arcf_timing_bucket(usec[p])]++;
+	pthread_mutex_unlock(&timing_lock);
+}
+
 /*
 **  ARCF_CONFIG_RELOAD -- reload configuration if requested
 **
@@ -1772,6 +2177,7 @@ arcf_config_setlib(struct arcf_config *conf, char **err)
 static void
 arcf_config_reload(void)
 {
+	int status;
 	struct arcf_config *new;
 	char errbuf[BUFRSZ + 1];
 
@@ -1884,6 +2290,11 @@ arcf_config_reload(void)
 
 		if (!err)
 		{
+			if (curconf->conf_logtimings != -1)
+				arcf_timing_dump(curconf->conf_logtimings);
+
+			arcf_snapshot_carry(curconf, new);
+
 			if (curconf->conf_refcnt == 0)
 				arcf_config_free(curconf);
 
@@ -1891,6 +2302,13 @@ arcf_config_reload(void)
 			curconf = new;
 			new->conf_data = cfg;
 
+			status = arcf_snapshot_start(new);
+			if (status != 0 && new->conf_dolog)
+			{
+				syslog(LOG_ERR, "pthread_create(): %s",
+				       strerror(status));
+			}
+
 			if (new->conf_dolog)
 			{
 				syslog(LOG_INFO,
@@ -1963,6 +2381,9 @@ arcf_initcontext(struct arcf_config *conf)
 
 	(void) memset(ctx, '\0', sizeof(struct msgctx));
 
+	if (conf->conf_logtimings != -1)
+		ctx->mctx_start = arcf_clock_usec();
+
 	return ctx;
 }
 
@@ -1992,6 +2413,105 @@ arcf_log_ssl_errors(ARC_LIB *arc, char *jobid)
 		syslog(LOG_INFO, "%s: SSL %s", jobid, errbuf);
 }
 
+/*
+**  ARCF_MESSAGE_GET -- get a message handle, recycling an idle one if
+**                      possible
+**
+**  Parameters:
+**  	cc -- connection context
+**  	err -- error string (returned)
+**
+**  Return value:
+**  	A message handle, or NULL on failure (and "err" is updated).
+*/
+
+static ARC_MESSAGE *
+arcf_message_get(connctx cc, const u_char **err)
+{
+	ARC_MESSAGE *msg = NULL;
+	struct arcf_config *conf;
+
+	assert(cc != NULL);
+
+	conf = cc->cctx_config;
+
+	if (cc->cctx_spare != NULL)
+	{
+		msg = cc->cctx_spare;
+		cc->cctx_spare = NULL;
+		return msg;
+	}
+
+	pthread_mutex_lock(&conf->conf_poollock);
+	if (conf->conf_npooled > 0)
+		msg = conf->conf_msgpool[--conf->conf_npooled];
+	pthread_mutex_unlock(&conf->conf_poollock);
+
+	if (msg != NULL)
+		return msg;
+
+	return arc_message(conf->conf_libopenarc, conf->conf_canonhdr,
+	                   conf->conf_canonbody, conf->conf_signalg, err);
+}
+
+/*
+**  ARCF_MESSAGE_POOL -- return an idle message handle to the shared pool
+**
+**  Parameters:
+**  	conf -- configuration that created the handle
+**  	msg -- handle, already reset
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arcf_message_pool(struct arcf_config *conf, ARC_MESSAGE *msg)
+{
+	assert(conf != NULL);
+	assert(msg != NULL);
+
+	pthread_mutex_lock(&conf->conf_poollock);
+	if (conf->conf_npooled < MAXMSGPOOL)
+	{
+		conf->conf_msgpool[conf->conf_npooled++] = msg;
+		msg = NULL;
+	}
+	pthread_mutex_unlock(&conf->conf_poollock);
+
+	if (msg != NULL)
+		arc_free(msg);
+}
+
+/*
+**  ARCF_MESSAGE_PUT -- finish with a message handle
+**
+**  Parameters:
+**  	cc -- connection context
+**  	msg -- handle
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	The handle is reset and kept for the next message on this
+**  	connection, or for any connection using the same configuration.
+*/
+
+static void
+arcf_message_put(connctx cc, ARC_MESSAGE *msg)
+{
+	assert(cc != NULL);
+	assert(msg != NULL);
+
+	arc_message_reset(msg);
+
+	if (cc->cctx_spare == NULL)
+		cc->cctx_spare = msg;
+	else
+		arcf_message_pool(cc->cctx_config, msg);
+}
+
 /*
 **  ARCF_CLEANUP -- release local resources related to a message
 **
@@ -2037,7 +2557,7 @@ arcf_cleanup(SMFICTX *ctx)
 		}
 
 		if (afc->mctx_arcmsg != NULL)
-			arc_free(afc->mctx_arcmsg);
+			arcf_message_put(cc, afc->mctx_arcmsg);
 
 #ifdef _FFR_VBR
 		if (afc->mctx_vbr != NULL)
@@ -2119,332 +2639,119 @@ arcf_getarc(void *vp)
 }
 
 /*
-**  ARCF_FINDHEADER -- find a header
+**  ARCF_HDRFIRST -- find the first instance of a header field name
 **
 **  Parameters:
 **  	afc -- filter context
 **  	hname -- name of the header of interest
-**  	instance -- which instance is wanted (0 = first)
+**  	hash -- arcf_hdrhash() of "hname"
 **
 **  Return value:
-**  	Header handle, or NULL if not found.
-**
-**  Notes:
-**  	Negative values of "instance" search backwards from the end.
+**  	Header handle of the first instance, or NULL if there is none.
 */
 
 static Header
-arcf_findheader(msgctx afc, char *hname, int instance)
+arcf_hdrfirst(msgctx afc, char *hname, u_int hash)
 {
 	Header hdr;
 
-	assert(afc != NULL);
-	assert(hname != NULL);
-
-	if (instance < 0)
-		hdr = afc->mctx_hqtail;
-	else
-		hdr = afc->mctx_hqhead;
-
-	while (hdr != NULL)
+	for (hdr = afc->mctx_hindex[hash % HDRBUCKETS];
+	     hdr != NULL;
+	     hdr = hdr->hdr_nextname)
 	{
-		if (strcasecmp(hdr->hdr_hdr, hname) == 0)
-		{
-			if (instance == 0 || instance == -1)
-				return hdr;
-			else if (instance > 0)
-				instance--;
-			else
-				instance++;
-		}
-
-		if (instance < 0)
-			hdr = hdr->hdr_prev;
-		else
-			hdr = hdr->hdr_next;
+		if (hdr->hdr_hash == hash &&
+		    strcasecmp(hdr->hdr_hdr, hname) == 0)
+			return hdr;
 	}
 
 	return NULL;
 }
 
 /*
-**  ARCF_CHECKHOST -- check the peerlist for a host and its wildcards
+**  ARCF_INDEXHEADER -- add a newly queued header to the name index
 **
 **  Parameters:
-**  	list -- list to check
-**  	host -- hostname to find
+**  	afc -- filter context
+**  	hdr -- header just appended to the queue
 **
 **  Return value:
-**  	TRUE if there's a match, FALSE otherwise.
+**  	None.
 */
 
-_Bool
-arcf_checkhost(struct conflist *list, char *host)
+static void
+arcf_indexheader(msgctx afc, Header hdr)
 {
-	_Bool exists;
-	int status;
-	char *p;
-	struct configvalue *node;
-	char buf[BUFRSZ + 1];
+	Header first;
 
-	assert(host != NULL);
+	assert(afc != NULL);
+	assert(hdr != NULL);
 
-	/* short circuits */
-	if (list == NULL || host[0] == '\0')
-		return FALSE;
+	hdr->hdr_hash = arcf_hdrhash(hdr->hdr_hdr);
 
-	/* iterate over the possibilities */
-	for (p = host; p != NULL; p = strchr(p + 1, '.'))
+	first = arcf_hdrfirst(afc, hdr->hdr_hdr, hdr->hdr_hash);
+	if (first == NULL)
 	{
-		/* try the negative case */
-		snprintf(buf, sizeof buf, "!%s", p);
-		LIST_FOREACH(node, list, entries)
-			if (strcmp(node->value, buf) == 0)
-				return FALSE;
-
-		/* ...and now the positive case */
-		LIST_FOREACH(node, list, entries)
-			if (strcmp(node->value, &buf[1]) == 0)
-				return TRUE;
+		hdr->hdr_nextname = afc->mctx_hindex[hdr->hdr_hash % HDRBUCKETS];
+		afc->mctx_hindex[hdr->hdr_hash % HDRBUCKETS] = hdr;
+		hdr->hdr_lastsame = hdr;
+		hdr->hdr_nsame = 1;
+	}
+	else
+	{
+		hdr->hdr_prevsame = first->hdr_lastsame;
+		first->hdr_lastsame->hdr_nextsame = hdr;
+		first->hdr_lastsame = hdr;
+		first->hdr_nsame++;
 	}
-
-	return FALSE;
 }
 
 /*
-**  ARCF_CHECKIP -- check a peerlist table for an IP address or its matching
-**                 wildcards
+**  ARCF_FINDHEADER -- find a header
 **
 **  Parameters:
-**  	list -- list to check
-**  	ip -- IP address to find
+**  	afc -- filter context
+**  	hname -- name of the header of interest
+**  	instance -- which instance is wanted (0 = first)
 **
 **  Return value:
-**  	TRUE if there's a match, FALSE otherwise.
+**  	Header handle, or NULL if not found.
+**
+**  Notes:
+**  	Negative values of "instance" search backwards from the end.
+**  	The remaining instances of a name can be walked from the result
+**  	via hdr_nextsame (or hdr_prevsame).
 */
 
-_Bool
-arcf_checkip(struct conflist *list, struct sockaddr *ip)
+static Header
+arcf_findheader(msgctx afc, char *hname, int instance)
 {
-	_Bool exists;
-	char ipbuf[ARC_MAXHOSTNAMELEN + 1];
+	Header hdr;
 
-	assert(ip != NULL);
+	assert(afc != NULL);
+	assert(hname != NULL);
 
-	/* short circuit */
-	if (list == NULL)
-		return FALSE;
+	hdr = arcf_hdrfirst(afc, hname, arcf_hdrhash(hname));
+	if (hdr == NULL)
+		return NULL;
 
-#if AF_INET6
-	if (ip->sa_family == AF_INET6)
+	if (instance < 0)
 	{
-		int status;
-		int bits;
-		size_t dst_len;
-		size_t iplen;
-		char *dst;
-		struct configvalue *node;
-		struct sockaddr_in6 sin6;
-		struct in6_addr addr;
-
-		memcpy(&sin6, ip, sizeof sin6);
-
-		memcpy(&addr, &sin6.sin6_addr, sizeof addr);
-
-		memset(ipbuf, '\0', sizeof ipbuf);
-		ipbuf[0] = '!';
-
-		dst = &ipbuf[1];
-		dst_len = sizeof ipbuf - 1;
-
-		inet_ntop(AF_INET6, &addr, dst, dst_len);
-		arcf_lowercase((u_char *) dst);
-		iplen = strlen(dst);
-
-		exists = FALSE;
-
-		LIST_FOREACH(node, list, entries)
-			if (strcmp(ipbuf, node->value) == 0)
-				return FALSE;
-		LIST_FOREACH(node, list, entries)
-			if (strcmp(&ipbuf[1], node->value) == 0)
-				return TRUE;
-
-		/* try it with square brackets */
-		memmove(&ipbuf[2], &ipbuf[1], iplen + 1);
-		ipbuf[1] = '[';
-		ipbuf[iplen + 2] = ']';
-
-		LIST_FOREACH(node, list, entries)
-			if (strcmp(ipbuf, node->value) == 0)
-				return FALSE;
-		LIST_FOREACH(node, list, entries)
-			if (strcmp(&ipbuf[1], node->value) == 0)
-				return TRUE;
-
-		/* iterate over possible bitwise expressions */
-		for (bits = 0; bits <= 128; bits++)
-		{
-			size_t sz;
-
-			/* try this one */
-			memset(ipbuf, '\0', sizeof ipbuf);
-			ipbuf[0] = '!';
-
-			dst = &ipbuf[1];
-			dst_len = sizeof ipbuf - 1;
-
-			inet_ntop(AF_INET6, &addr, dst, dst_len);
-			arcf_lowercase((u_char *) dst);
-			iplen = strlen(dst);
-
-			sz = strlcat(ipbuf, "/", sizeof ipbuf);
-			if (sz >= sizeof ipbuf)
-				return FALSE;
-
-			dst = &ipbuf[sz];
-			dst_len = sizeof ipbuf - sz;
-
-			sz = snprintf(dst, dst_len, "%d", 128 - bits);
-			if (sz >= sizeof ipbuf)
-				return FALSE;
-
-			LIST_FOREACH(node, list, entries)
-				if (strcmp(ipbuf, node->value) == 0)
-					return FALSE;
-			LIST_FOREACH(node, list, entries)
-				if (strcmp(&ipbuf[1], node->value) == 0)
-					return TRUE;
-
-			/* try it with square brackets */
-			memmove(&ipbuf[2], &ipbuf[1], iplen + 1);
-			ipbuf[1] = '[';
-			ipbuf[iplen + 2] = ']';
-			ipbuf[iplen + 3] = '\0';
-
-			sz = strlcat(ipbuf, "/", sizeof ipbuf);
-			if (sz >= sizeof ipbuf)
-				return FALSE;
-
-			dst = &ipbuf[sz];
-			dst_len = sizeof ipbuf - sz;
-
-			sz = snprintf(dst, dst_len, "%d", 128 - bits);
-			if (sz >= sizeof ipbuf)
-				return FALSE;
-
-			LIST_FOREACH(node, list, entries)
-				if (strcmp(ipbuf, node->value) == 0)
-					return FALSE;
-			LIST_FOREACH(node, list, entries)
-				if (strcmp(&ipbuf[1], node->value) == 0)
-					return TRUE;
-
-			/* flip off a bit */
-			if (bits != 128)
-			{
-				int idx;
-				int bit;
+		if ((u_int) -instance > hdr->hdr_nsame)
+			return NULL;
 
-				idx = 15 - (bits / 8);
-				bit = bits % 8;
-				addr.s6_addr[idx] &= ~(1 << bit);
-			}
-		}
+		for (hdr = hdr->hdr_lastsame; instance < -1; instance++)
+			hdr = hdr->hdr_prevsame;
 	}
-#endif /* AF_INET6 */
-
-	if (ip->sa_family == AF_INET)
+	else
 	{
-		_Bool exists;
-		int c;
-		int status;
-		int bits;
-		size_t iplen;
-		struct configvalue *node;
-		struct in_addr addr;
-		struct in_addr mask;
-		struct sockaddr_in sin;
-
-		memcpy(&sin, ip, sizeof sin);
-		memcpy(&addr.s_addr, &sin.sin_addr, sizeof addr.s_addr);
-
-		/* try the IP address directly */
-		exists = FALSE;
-
-		ipbuf[0] = '!';
-		(void) arcf_inet_ntoa(addr, &ipbuf[1], sizeof ipbuf - 1);
-		LIST_FOREACH(node, list, entries)
-			if (strcmp(ipbuf, node->value) == 0)
-				return FALSE;
-		LIST_FOREACH(node, list, entries)
-			if (strcmp(&ipbuf[1], node->value) == 0)
-				return TRUE;
-
-		/* try it with square brackets */
-		memmove(&ipbuf[2], &ipbuf[1], strlen(&ipbuf[1]) + 1);
-		ipbuf[1] = '[';
-		ipbuf[strlen(ipbuf)] = ']';
-
-		LIST_FOREACH(node, list, entries)
-			if (strcmp(ipbuf, node->value) == 0)
-				return FALSE;
-		LIST_FOREACH(node, list, entries)
-			if (strcmp(&ipbuf[1], node->value) == 0)
-				return TRUE;
-
-		/* iterate over possible bitwise expressions */
-		for (bits = 32; bits >= 0; bits--)
-		{
-			if (bits == 32)
-			{
-				mask.s_addr = 0xffffffff;
-			}
-			else
-			{
-				mask.s_addr = 0;
-				for (c = 0; c < bits; c++)
-					mask.s_addr |= htonl(1 << (31 - c));
-			}
+		if ((u_int) instance >= hdr->hdr_nsame)
+			return NULL;
 
-			addr.s_addr = addr.s_addr & mask.s_addr;
-
-			memset(ipbuf, '\0', sizeof ipbuf);
-			ipbuf[0] = '!';
-			(void) arcf_inet_ntoa(addr, &ipbuf[1],
-			                      sizeof ipbuf - 1);
-			iplen = strlen(&ipbuf[1]);
-			c = strlen(ipbuf);
-			ipbuf[c] = '/';
-			c++;
-
-			snprintf(&ipbuf[c], sizeof ipbuf - c, "%d", bits);
-
-			LIST_FOREACH(node, list, entries)
-				if (strcmp(ipbuf, node->value) == 0)
-					return FALSE;
-			LIST_FOREACH(node, list, entries)
-				if (strcmp(&ipbuf[1], node->value) == 0)
-					return TRUE;
-
-			/* try it with square brackets */
-			memmove(&ipbuf[2], &ipbuf[1], strlen(&ipbuf[1]) + 1);
-			ipbuf[1] = '[';
-			ipbuf[iplen + 2] = ']';
-			ipbuf[iplen + 3] = '/';
-			snprintf(&ipbuf[iplen + 4], sizeof ipbuf - iplen - 4,
-			         "%d", bits);
-
-			LIST_FOREACH(node, list, entries)
-				if (strcmp(ipbuf, node->value) == 0)
-					return FALSE;
-			LIST_FOREACH(node, list, entries)
-				if (strcmp(&ipbuf[1], node->value) == 0)
-					return TRUE;
-		}
+		for (; instance > 0; instance--)
+			hdr = hdr->hdr_nextsame;
 	}
 
-	return FALSE;
+	return hdr;
 }
 
 #if SMFI_VERSION >= 0x01000000
@@ -2648,6 +2955,11 @@ mlfi_connect(SMFICTX *ctx, char *host, _SOCK_ADDR *ip)
 
 	cc->cctx_msg = NULL;
 
+	/* accept connections from peers without further processing */
+	if (arcf_checkhost(&conf->conf_peers, cc->cctx_host) ||
+	    arcf_checkip(&conf->conf_peers, (struct sockaddr *) &cc->cctx_ip))
+		return SMFIS_ACCEPT;
+
 	return SMFIS_CONTINUE;
 }
 
@@ -2898,6 +3210,8 @@ mlfi_header(SMFICTX *ctx, char *headerf, char *headerv)
 
 	afc->mctx_hqtail = newhdr;
 
+	arcf_indexheader(afc, newhdr);
+
 	return SMFIS_CONTINUE;
 }
 
@@ -3010,11 +3324,7 @@ mlfi_eoh(SMFICTX *ctx)
 	}
 
 	/* run the header fields */
-	afc->mctx_arcmsg = arc_message(conf->conf_libopenarc,
-	                               conf->conf_canonhdr,
-	                               conf->conf_canonbody,
-	                               conf->conf_signalg,
-	                               &err);
+	afc->mctx_arcmsg = arcf_message_get(cc, &err);
 	if (afc->mctx_arcmsg == NULL)
 	{
 		if (conf->conf_dolog)
@@ -3177,7 +3487,6 @@ mlfi_eom(SMFICTX *ctx)
 	_Bool testkey = FALSE;
 	_Bool authorsig;
 	int status = ARC_STAT_OK;
-	int c;
 	sfsistat ret;
 	connctx cc;
 	msgctx afc;
@@ -3242,11 +3551,10 @@ mlfi_eom(SMFICTX *ctx)
 
 	/* assemble authentication results */
 	arcf_dstring_blank(afc->mctx_tmpstr);
-	for (c = 0; ; c++)
+	for (hdr = arcf_findheader(afc, AR_HEADER_NAME, 0);
+	     hdr != NULL;
+	     hdr = hdr->hdr_nextsame)
 	{
-		hdr = arcf_findheader(afc, AR_HEADER_NAME, c);
-		if (hdr == NULL)
-			break;
 		status = ares_parse(hdr->hdr_val, &ar);
 		if (status != 0)
 		{
@@ -3300,15 +3608,14 @@ mlfi_eom(SMFICTX *ctx)
 	**  Get the seal fields to apply.
 	*/
 
-	status = arc_getseal(afc->mctx_arcmsg, &seal,
-                             conf->conf_authservid,
-	                     conf->conf_selector,
-	                     conf->conf_domain,
-	                     conf->conf_keydata,
-	                     conf->conf_keylen,
-	                     arcf_dstring_len(afc->mctx_tmpstr) > 0
-                                 ? arcf_dstring_get(afc->mctx_tmpstr)
-                                 : NULL);
+	status = arc_getseal_key(afc->mctx_arcmsg, &seal,
+	                         conf->conf_authservid,
+	                         conf->conf_selector,
+	                         conf->conf_domain,
+	                         conf->conf_signkey,
+	                         arcf_dstring_len(afc->mctx_tmpstr) > 0
+	                             ? arcf_dstring_get(afc->mctx_tmpstr)
+	                             : NULL);
 	if (status != ARC_STAT_OK)
 	{
 		if (conf->conf_dolog)
@@ -3374,6 +3681,9 @@ mlfi_eom(SMFICTX *ctx)
 		}
 	}
 
+	if (conf->conf_logtimings != -1)
+		arcf_timing_log(conf, afc);
+
 	/*
 	**  If we got this far, we're ready to complete.
 	*/
@@ -3419,6 +3729,12 @@ mlfi_close(SMFICTX *ctx)
 	cc = (connctx) arcf_getpriv(ctx);
 	if (cc != NULL)
 	{
+		if (cc->cctx_spare != NULL)
+		{
+			arcf_message_pool(cc->cctx_config, cc->cctx_spare);
+			cc->cctx_spare = NULL;
+		}
+
 		pthread_mutex_lock(&conf_lock);
 
 		cc->cctx_config->conf_refcnt--;
@@ -4453,6 +4769,8 @@ main(int argc, char **argv)
 		return EX_SOFTWARE;
 	}
 
+	arcf_snapshot_load(curconf);
+
 	if (filemask != -1)
 		(void) umask((mode_t) filemask);
 
@@ -4530,6 +4848,8 @@ main(int argc, char **argv)
 
 	pthread_mutex_init(&conf_lock, NULL);
 	pthread_mutex_init(&pwdb_lock, NULL);
+	pthread_mutex_init(&timing_lock, NULL);
+	pthread_cond_init(&snap_cond, NULL);
 
 	/* perform test mode */
 	if (testfile != NULL)
@@ -4584,6 +4904,22 @@ main(int argc, char **argv)
 		return EX_OSERR;
 	}
 
+	/* spawn the key cache snapshot writer, if one is wanted */
+	status = arcf_snapshot_start(curconf);
+	if (status != 0)
+	{
+		if (curconf->conf_dolog)
+		{
+			syslog(LOG_ERR, "pthread_create(): %s",
+			       strerror(status));
+		}
+
+		if (!autorestart && pidfile != NULL)
+			(void) unlink(pidfile);
+
+		return EX_OSERR;
+	}
+
 	/* call the milter mainline */
 	errno = 0;
 	status = smfi_main();
@@ -4595,9 +4931,21 @@ main(int argc, char **argv)
 		       ARCF_PRODUCT, VERSION, status, errno);
 	}
 
-	/* tell the reloader thread to die */
+	if (curconf->conf_logtimings != -1)
+		arcf_timing_dump(curconf->conf_logtimings);
+
+	/* tell the reloader and snapshot threads to die */
 	die = TRUE;
 	(void) raise(SIGUSR1);
+	if (snaprunning)
+	{
+		pthread_mutex_lock(&conf_lock);
+		pthread_cond_broadcast(&snap_cond);
+		pthread_mutex_unlock(&conf_lock);
+		(void) pthread_join(snapthread, NULL);
+	}
+
+	arcf_snapshot_save(curconf);
 
 	if (!autorestart && pidfile != NULL)
 		(void) unlink(pidfile);
@@ -42,6 +42,8 @@
 #define	DEFCONFFILE	CONFIG_BASE "/openarc.conf"
 #define	DEFINTERNAL	"csl:127.0.0.1,::1"
 #define	DEFMAXHDRSZ	65536
+#define	DEFSNAPINTERVAL	300
+#define	HDRBUCKETS	64
 #define	HOSTUNKNOWN	"unknown-host"
 #define	JOBIDUNKNOWN	"(unknown-jobid)"
 #define	LOCALHOST	"127.0.0.1"
@@ -50,9 +52,11 @@
 #define	MAXBUFRSZ	65536
 #define	MAXHDRCNT	64
 #define	MAXHDRLEN	78
+#define	MAXMSGPOOL	64
 #define	MAXSIGNATURE	1024
 #define	MTAMARGIN	78
 #define	NULLDOMAIN	"(invalid)"
+#define	PEERBUCKETS	64
 #define	UNKNOWN		"unknown"
 
 #define AUTHRESULTSHDR	"Authentication-Results"
@@ -65,10 +69,16 @@
 typedef struct Header * Header;
 struct Header
 {
+	u_int		hdr_hash;		/* case-folded name hash */
 	char *		hdr_hdr;
 	char *		hdr_val;
 	struct Header *	hdr_next;
 	struct Header *	hdr_prev;
+	struct Header *	hdr_nextname;		/* next name in bucket */
+	struct Header *	hdr_nextsame;		/* next of this name */
+	struct Header *	hdr_prevsame;		/* previous of this name */
+	struct Header *	hdr_lastsame;		/* last of this name */
+	u_int		hdr_nsame;		/* count of this name */
 };
 
 /* externs */
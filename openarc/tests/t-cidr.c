@@ -0,0 +1,187 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#endif /* HAVE_STDBOOL_H */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* openarc includes */
+#include "openarc.h"
+#include "util.h"
+
+/*
+**  CHECK -- see whether an address is a peer
+**
+**  Parameters:
+**  	list -- list to check
+**  	addr -- IPv4 or IPv6 address, as a string
+**
+**  Return value:
+**  	Whatever arcf_checkip() says.
+*/
+
+static _Bool
+check(struct peerlist *list, const char *addr)
+{
+	struct sockaddr_storage ss;
+
+	memset(&ss, '\0', sizeof ss);
+
+	if (strchr(addr, ':') == NULL)
+	{
+		struct sockaddr_in *sin;
+
+		sin = (struct sockaddr_in *) &ss;
+		sin->sin_family = AF_INET;
+		assert(inet_pton(AF_INET, addr, &sin->sin_addr) == 1);
+	}
+	else
+	{
+		struct sockaddr_in6 *sin6;
+
+		sin6 = (struct sockaddr_in6 *) &ss;
+		sin6->sin6_family = AF_INET6;
+		assert(inet_pton(AF_INET6, addr, &sin6->sin6_addr) == 1);
+	}
+
+	return arcf_checkip(list, (struct sockaddr *) &ss);
+}
+
+/*
+**  LOAD -- build a list from a NULL-terminated array of entries
+**
+**  Parameters:
+**  	list -- list to fill
+**  	entries -- entries to add
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+load(struct peerlist *list, char **entries)
+{
+	int c;
+
+	memset(list, '\0', sizeof *list);
+
+	for (c = 0; entries[c] != NULL; c++)
+		assert(arcf_list_add(list, entries[c]));
+}
+
+/*
+**  MAIN -- program mainline
+**
+**  Parameters:
+**  	The usual.
+**
+**  Return value:
+**  	Exit status.
+*/
+
+int
+main(int argc, char **argv)
+{
+	struct peerlist list;
+
+	printf("*** PeerList address prefixes\n");
+
+	/* /0 matches every address of its own family, and no other */
+	{
+		char *v4all[] = { "0.0.0.0/0", NULL };
+		char *v6all[] = { "::/0", NULL };
+
+		load(&list, v4all);
+		assert(check(&list, "0.0.0.0"));
+		assert(check(&list, "255.255.255.255"));
+		assert(check(&list, "192.0.2.1"));
+		assert(!check(&list, "::"));
+		assert(!check(&list, "2001:db8::1"));
+		arcf_list_destroy(&list);
+
+		load(&list, v6all);
+		assert(check(&list, "::"));
+		assert(check(&list, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff"));
+		assert(!check(&list, "0.0.0.0"));
+		arcf_list_destroy(&list);
+	}
+
+	/* /32 and /128 match one address, as does a bare address */
+	{
+		char *hosts[] = { "192.0.2.1/32", "192.0.2.3",
+		                  "2001:db8::1/128", "[2001:db8::3]", NULL };
+
+		load(&list, hosts);
+		assert(check(&list, "192.0.2.1"));
+		assert(!check(&list, "192.0.2.0"));
+		assert(!check(&list, "192.0.2.2"));
+		assert(check(&list, "192.0.2.3"));
+		assert(!check(&list, "192.0.3.1"));
+		assert(check(&list, "2001:db8::1"));
+		assert(!check(&list, "2001:db8::"));
+		assert(!check(&list, "2001:db8::2"));
+		assert(check(&list, "2001:db8::3"));
+		assert(!check(&list, "2001:db9::1"));
+		arcf_list_destroy(&list);
+	}
+
+	/* IPv4 and IPv6 entries don't interfere */
+	{
+		char *mixed[] = { "10.0.0.0/8", "[2001:db8::]/32",
+		                  "::ffff:192.0.2.0/120", NULL };
+
+		load(&list, mixed);
+		assert(check(&list, "10.255.0.1"));
+		assert(!check(&list, "11.0.0.1"));
+		assert(check(&list, "2001:db8:ffff::1"));
+		assert(!check(&list, "2001:db9::1"));
+		assert(!check(&list, "::a00:1"));
+		assert(!check(&list, "192.0.2.1"));
+		assert(check(&list, "::ffff:192.0.2.1"));
+		arcf_list_destroy(&list);
+	}
+
+	/* the most specific entry decides; a tie goes to the exclusion */
+	{
+		char *negated[] = { "10.0.0.0/8", "!10.1.0.0/16",
+		                    "10.1.2.0/24", "!10.1.2.3",
+		                    "2001:db8::/32", "!2001:db8::/32",
+		                    "!0.0.0.0/0", "192.0.2.0/24", NULL };
+
+		load(&list, negated);
+		assert(check(&list, "10.2.3.4"));
+		assert(!check(&list, "10.1.3.4"));
+		assert(check(&list, "10.1.2.4"));
+		assert(!check(&list, "10.1.2.3"));
+		assert(!check(&list, "2001:db8::1"));
+		assert(check(&list, "192.0.2.200"));
+		assert(!check(&list, "198.51.100.1"));
+		arcf_list_destroy(&list);
+	}
+
+	/* prefixes with host bits set can never match */
+	{
+		char *hostbits[] = { "192.0.2.1/24", "2001:db8::1/64", NULL };
+
+		load(&list, hostbits);
+		assert(list.pl_nhosts == 0);
+		assert(!check(&list, "192.0.2.1"));
+		assert(!check(&list, "2001:db8::1"));
+		arcf_list_destroy(&list);
+	}
+
+	printf("*** PeerList address prefixes passed\n");
+
+	return 0;
+}
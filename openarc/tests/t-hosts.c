@@ -0,0 +1,140 @@
+/*
+**  Copyright (c) 2017, The Trusted Domain Project.  All rights reserved.
+*/
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/types.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#endif /* HAVE_STDBOOL_H */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* openarc includes */
+#include "openarc.h"
+#include "util.h"
+
+/* macros */
+#define	NBULK		1000
+
+/*
+**  CHECK -- see whether a host name is a peer
+**
+**  Parameters:
+**  	list -- list to check
+**  	host -- host name
+**
+**  Return value:
+**  	Whatever arcf_checkhost() says.
+*/
+
+static _Bool
+check(struct peerlist *list, const char *host)
+{
+	char buf[BUFRSZ + 1];
+
+	/* arcf_checkhost() takes a writable name */
+	assert(strlen(host) < sizeof buf);
+	strcpy(buf, host);
+
+	return arcf_checkhost(list, buf);
+}
+
+/*
+**  MAIN -- program mainline
+**
+**  Parameters:
+**  	The usual.
+**
+**  Return value:
+**  	Exit status.
+*/
+
+int
+main(int argc, char **argv)
+{
+	int c;
+	struct peerlist list;
+	char *entries[] = { "mail.example.com", ".example.org",
+	                    ".example.net", "!.bad.example.net",
+	                    "!worse.example.net", "Relay.Example.EDU",
+	                    "twice.example.com", "!twice.example.com",
+	                    "192.0.2.1", NULL };
+	char name[BUFRSZ + 1];
+
+	printf("*** PeerList host names\n");
+
+	memset(&list, '\0', sizeof list);
+	for (c = 0; entries[c] != NULL; c++)
+		assert(arcf_list_add(&list, entries[c]));
+
+	/* addresses don't land in the name table */
+	assert(list.pl_nhosts == 7);
+	assert(!check(&list, "192.0.2.1"));
+
+	/* host names match exactly, without regard to case */
+	assert(check(&list, "mail.example.com"));
+	assert(check(&list, "MAIL.Example.Com"));
+	assert(check(&list, "relay.example.edu"));
+	assert(check(&list, "RELAY.EXAMPLE.EDU"));
+	assert(!check(&list, "example.com"));
+	assert(!check(&list, "x.mail.example.com"));
+	assert(!check(&list, "mail.example.co"));
+	assert(!check(&list, ""));
+
+	/* domain names match on whole labels only */
+	assert(check(&list, "a.example.org"));
+	assert(check(&list, "A.B.C.EXAMPLE.ORG"));
+	assert(!check(&list, "example.org"));
+	assert(!check(&list, "badexample.org"));
+	assert(!check(&list, "a.example.org.evil"));
+
+	/* the most specific entry decides */
+	assert(check(&list, "ok.example.net"));
+	assert(!check(&list, "x.bad.example.net"));
+	assert(!check(&list, "X.Y.BAD.example.NET"));
+	assert(check(&list, "bad.example.net"));
+	assert(!check(&list, "worse.example.net"));
+	assert(check(&list, "a.worse.example.net"));
+
+	/* a name listed with and without "!" is excluded */
+	assert(!check(&list, "twice.example.com"));
+
+	arcf_list_destroy(&list);
+	assert(list.pl_nhosts == 0);
+	assert(!check(&list, "mail.example.com"));
+
+	/* enough names to make the table grow several times */
+	memset(&list, '\0', sizeof list);
+	for (c = 0; c < NBULK; c++)
+	{
+		snprintf(name, sizeof name, "host%d.example.com", c);
+		assert(arcf_list_add(&list, name));
+		snprintf(name, sizeof name, ".Domain%d.Example", c);
+		assert(arcf_list_add(&list, name));
+	}
+
+	assert(list.pl_nhosts == 2 * NBULK);
+	assert(list.pl_nbuckets >= list.pl_nhosts);
+
+	for (c = 0; c < NBULK; c++)
+	{
+		snprintf(name, sizeof name, "HOST%d.example.com", c);
+		assert(check(&list, name));
+		snprintf(name, sizeof name, "mx.domain%d.example", c);
+		assert(check(&list, name));
+		snprintf(name, sizeof name, "host%d.example.com", c + NBULK);
+		assert(!check(&list, name));
+		snprintf(name, sizeof name, "domain%d.example", c);
+		assert(!check(&list, name));
+	}
+
+	arcf_list_destroy(&list);
+
+	printf("*** PeerList host names passed\n");
+
+	return 0;
+}
@@ -9,6 +9,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/resource.h>
 #include <sys/file.h>
 #include <netinet/in.h>
@@ -82,6 +83,17 @@ struct arcf_dstring
 	u_char *		ds_buf;
 };
 
+/* struct arcf_cidrnode -- a node in a path-compressed binary address trie */
+struct arcf_cidrnode
+{
+	u_int			cn_bits;
+	u_int			cn_flags;
+	u_char			cn_key[16];
+	struct arcf_cidrnode *	cn_child[2];
+};
+
+#define	ARCF_CIDR_BIT(k,n)	(((k)[(n) / 8] >> (7 - ((n) % 8))) & 1)
+
 /* base64 alphabet */
 static unsigned char alphabet[64] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
@@ -146,6 +158,34 @@ arcf_setmaxfd(void)
 	}
 }
 
+/*
+**  ARCF_CLOCK_USEC -- read the monotonic clock
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	Microseconds since some arbitrary point; only differences are
+**  	meaningful.
+*/
+
+uint64_t
+arcf_clock_usec(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif /* CLOCK_MONOTONIC */
+	{
+		struct timeval tv;
+
+		(void) gettimeofday(&tv, NULL);
+		return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+	}
+}
+
 /*
 **  ARCF_HOSTLIST -- see if a hostname is in a pattern of hosts/domains
 **
@@ -858,3 +898,671 @@ arcf_inet_ntoa(struct in_addr a, char *buf, size_t buflen)
 	                (addr >> 8) & 0xff, addr & 0xff);
 }
 
+
+/*
+**  ARCF_CIDR_COMMON -- count the leading bits two keys share
+**
+**  Parameters:
+**  	a, b -- keys to compare
+**  	start -- number of leading bits already known to match
+**  	bits -- maximum number of bits to compare
+**
+**  Return value:
+**  	Length of the common prefix, at most "bits".
+*/
+
+static u_int
+arcf_cidr_common(const u_char *a, const u_char *b, u_int start, u_int bits)
+{
+	u_int c;
+
+	c = start;
+
+	while (c % 8 != 0 && c < bits &&
+	       ARCF_CIDR_BIT(a, c) == ARCF_CIDR_BIT(b, c))
+		c++;
+
+	if (c % 8 == 0)
+	{
+		while (c + 8 <= bits && a[c / 8] == b[c / 8])
+			c += 8;
+
+		while (c < bits && ARCF_CIDR_BIT(a, c) == ARCF_CIDR_BIT(b, c))
+			c++;
+	}
+
+	return c;
+}
+
+/*
+**  ARCF_CIDR_NODE -- allocate a trie node
+**
+**  Parameters:
+**  	key -- key; only the first "bits" bits are copied
+**  	bits -- prefix length
+**  	flags -- ARCF_CIDR_* flags to set
+**
+**  Return value:
+**  	A new node, or NULL on allocation failure.
+*/
+
+static struct arcf_cidrnode *
+arcf_cidr_node(const u_char *key, u_int bits, u_int flags)
+{
+	struct arcf_cidrnode *new;
+
+	new = (struct arcf_cidrnode *) malloc(sizeof *new);
+	if (new == NULL)
+		return NULL;
+
+	memset(new, '\0', sizeof *new);
+	new->cn_bits = bits;
+	new->cn_flags = flags;
+	memcpy(new->cn_key, key, (bits + 7) / 8);
+	if (bits % 8 != 0)
+		new->cn_key[bits / 8] &= 0xff << (8 - (bits % 8));
+
+	return new;
+}
+
+/*
+**  ARCF_CIDR_ADD -- add a prefix to an address trie
+**
+**  Parameters:
+**  	root -- trie root (updated)
+**  	key -- address, in network byte order; host bits must be zero
+**  	bits -- prefix length (at most 128)
+**  	flags -- ARCF_CIDR_* flags to set on the prefix
+**
+**  Return value:
+**  	TRUE on success, FALSE on allocation failure.
+*/
+
+_Bool
+arcf_cidr_add(struct arcf_cidrnode **root, const u_char *key, u_int bits,
+              u_int flags)
+{
+	u_int common;
+	u_int start = 0;
+	struct arcf_cidrnode *n;
+	struct arcf_cidrnode *new;
+	struct arcf_cidrnode *glue;
+	struct arcf_cidrnode **pp;
+
+	assert(root != NULL);
+	assert(key != NULL);
+	assert(bits <= 128);
+
+	for (pp = root; ; pp = &n->cn_child[ARCF_CIDR_BIT(key, n->cn_bits)])
+	{
+		n = *pp;
+		if (n == NULL)
+		{
+			new = arcf_cidr_node(key, bits, flags);
+			if (new == NULL)
+				return FALSE;
+			*pp = new;
+			return TRUE;
+		}
+
+		common = arcf_cidr_common(n->cn_key, key, start,
+		                          MIN(n->cn_bits, bits));
+
+		if (common == n->cn_bits)
+		{
+			/* this node is a prefix of the new key */
+			if (bits == n->cn_bits)
+			{
+				n->cn_flags |= flags;
+				return TRUE;
+			}
+
+			start = common;
+			continue;
+		}
+
+		new = arcf_cidr_node(key, bits, flags);
+		if (new == NULL)
+			return FALSE;
+
+		if (common == bits)
+		{
+			/* the new key is a prefix of this node */
+			new->cn_child[ARCF_CIDR_BIT(n->cn_key, bits)] = n;
+			*pp = new;
+			return TRUE;
+		}
+
+		/* the keys diverge; join them under an unflagged node */
+		glue = arcf_cidr_node(key, common, 0);
+		if (glue == NULL)
+		{
+			free(new);
+			return FALSE;
+		}
+
+		glue->cn_child[ARCF_CIDR_BIT(key, common)] = new;
+		glue->cn_child[ARCF_CIDR_BIT(n->cn_key, common)] = n;
+		*pp = glue;
+		return TRUE;
+	}
+}
+
+/*
+**  ARCF_CIDR_MATCH -- find the most specific prefix covering an address
+**
+**  Parameters:
+**  	root -- trie root
+**  	key -- address, in network byte order
+**  	bits -- address length in bits (32 or 128)
+**
+**  Return value:
+**  	The ARCF_CIDR_* flags of the longest matching prefix, or 0 if
+**  	nothing in the trie covers the address.
+**
+**  Notes:
+**  	Visits at most one node per address bit and allocates nothing.
+*/
+
+u_int
+arcf_cidr_match(struct arcf_cidrnode *root, const u_char *key, u_int bits)
+{
+	u_int start = 0;
+	u_int flags = 0;
+	struct arcf_cidrnode *n;
+
+	assert(key != NULL);
+
+	for (n = root; n != NULL && n->cn_bits <= bits; )
+	{
+		if (arcf_cidr_common(n->cn_key, key, start,
+		                     n->cn_bits) != n->cn_bits)
+			break;
+
+		if (n->cn_flags != 0)
+			flags = n->cn_flags;
+
+		if (n->cn_bits == bits)
+			break;
+
+		start = n->cn_bits;
+		n = n->cn_child[ARCF_CIDR_BIT(key, n->cn_bits)];
+	}
+
+	return flags;
+}
+
+/*
+**  ARCF_CIDR_FREE -- release an address trie
+**
+**  Parameters:
+**  	root -- trie root
+**
+**  Return value:
+**  	None.
+*/
+
+void
+arcf_cidr_free(struct arcf_cidrnode *root)
+{
+	if (root == NULL)
+		return;
+
+	arcf_cidr_free(root->cn_child[0]);
+	arcf_cidr_free(root->cn_child[1]);
+	free(root);
+}
+
+/*
+**  ARCF_HDRHASH -- hash a header field name, case-insensitively
+**
+**  Parameters:
+**  	hname -- name to hash
+**
+**  Return value:
+**  	Hash of "hname".
+*/
+
+u_int
+arcf_hdrhash(const char *hname)
+{
+	u_int h = 5381;
+	const u_char *p;
+
+	for (p = (const u_char *) hname; *p != '\0'; p++)
+		h = ((h << 5) + h) + tolower(*p);
+
+	return h;
+}
+
+/*
+**  ARCF_LIST_ADDIP -- compile an IP address or CIDR expression from a list
+**
+**  Parameters:
+**  	list -- list to update
+**  	entry -- list entry
+**
+**  Return value:
+**  	1 if the entry was an address, 0 if it was not, -1 on error.
+**
+**  Notes:
+**  	The address may be enclosed in square brackets, and may be preceded
+**  	by "!" to mark an exclusion.  Prefixes with host bits set are
+**  	consumed but not added, as they could never match.
+*/
+
+static int
+arcf_list_addip(struct peerlist *list, char *entry)
+{
+	u_int c;
+	u_int bits;
+	u_int maxbits;
+	u_int flags;
+	size_t len;
+	char *p;
+	char *q;
+	char *slash;
+	struct arcf_cidrnode **root;
+	u_char key[16];
+	char buf[INET6_ADDRSTRLEN + 1];
+
+	flags = ARCF_CIDR_POSITIVE;
+	p = entry;
+	if (*p == '!')
+	{
+		flags = ARCF_CIDR_NEGATIVE;
+		p++;
+	}
+
+	slash = strchr(p, '/');
+	q = (slash == NULL ? p + strlen(p) : slash);
+	if (*p == '[')
+	{
+		if (q - p < 2 || *(q - 1) != ']')
+			return 0;
+		p++;
+		q--;
+	}
+
+	len = q - p;
+	if (len >= sizeof buf)
+		return 0;
+	memcpy(buf, p, len);
+	buf[len] = '\0';
+
+	memset(key, '\0', sizeof key);
+	if (inet_pton(AF_INET, buf, key) == 1)
+	{
+		root = &list->pl_ip4;
+		maxbits = 32;
+	}
+#ifdef AF_INET6
+	else if (inet_pton(AF_INET6, buf, key) == 1)
+	{
+		root = &list->pl_ip6;
+		maxbits = 128;
+	}
+#endif /* AF_INET6 */
+	else
+	{
+		return 0;
+	}
+
+	bits = maxbits;
+	if (slash != NULL)
+	{
+		char *end;
+		u_long n;
+
+		if (!isascii(slash[1]) || !isdigit(slash[1]))
+			return 0;
+
+		n = strtoul(slash + 1, &end, 10);
+		if (*end != '\0' || n > maxbits)
+			return 0;
+
+		bits = n;
+	}
+
+	for (c = bits; c < maxbits; c++)
+	{
+		if ((key[c / 8] & (0x80 >> (c % 8))) != 0)
+			return 1;
+	}
+
+	return (arcf_cidr_add(root, key, bits, flags) ? 1 : -1);
+}
+
+/*
+**  ARCF_LIST_FINDHOST -- look up a name in a list
+**
+**  Parameters:
+**  	list -- list to search
+**  	name -- name to find
+**
+**  Return value:
+**  	The matching entry, or NULL if the name is not listed.
+*/
+
+static struct peerhost *
+arcf_list_findhost(struct peerlist *list, const char *name)
+{
+	u_int hash;
+	struct peerhost *ph;
+
+	if (list->pl_nbuckets == 0)
+		return NULL;
+
+	hash = arcf_hdrhash(name);
+
+	for (ph = list->pl_hosts[hash % list->pl_nbuckets];
+	     ph != NULL;
+	     ph = ph->ph_next)
+	{
+		if (ph->ph_hash == hash && strcasecmp(ph->ph_name, name) == 0)
+			return ph;
+	}
+
+	return NULL;
+}
+
+/*
+**  ARCF_LIST_ADDHOST -- add a host or domain name to a list
+**
+**  Parameters:
+**  	list -- list to update
+**  	entry -- list entry, possibly preceded by "!"
+**
+**  Return value:
+**  	TRUE on success, FALSE on allocation failure.
+**
+**  Notes:
+**  	A name listed both with and without "!" shares one entry.  The
+**  	table doubles whenever it holds as many names as it has buckets.
+*/
+
+static _Bool
+arcf_list_addhost(struct peerlist *list, char *entry)
+{
+	_Bool exclude = FALSE;
+	u_int b;
+	struct peerhost *ph;
+
+	if (entry[0] == '!')
+	{
+		exclude = TRUE;
+		entry++;
+	}
+
+	ph = arcf_list_findhost(list, entry);
+	if (ph == NULL)
+	{
+		if (list->pl_nhosts >= list->pl_nbuckets)
+		{
+			u_int nb;
+			struct peerhost *next;
+			struct peerhost **new;
+
+			nb = (list->pl_nbuckets == 0 ? PEERBUCKETS
+			                             : list->pl_nbuckets * 2);
+			new = (struct peerhost **) calloc(nb, sizeof *new);
+			if (new == NULL)
+				return FALSE;
+
+			for (b = 0; b < list->pl_nbuckets; b++)
+			{
+				for (ph = list->pl_hosts[b]; ph != NULL; ph = next)
+				{
+					next = ph->ph_next;
+					ph->ph_next = new[ph->ph_hash % nb];
+					new[ph->ph_hash % nb] = ph;
+				}
+			}
+
+			free(list->pl_hosts);
+			list->pl_hosts = new;
+			list->pl_nbuckets = nb;
+		}
+
+		ph = (struct peerhost *) malloc(sizeof *ph);
+		if (ph == NULL)
+			return FALSE;
+
+		memset(ph, '\0', sizeof *ph);
+		ph->ph_name = strdup(entry);
+		if (ph->ph_name == NULL)
+		{
+			free(ph);
+			return FALSE;
+		}
+		ph->ph_hash = arcf_hdrhash(entry);
+
+		b = ph->ph_hash % list->pl_nbuckets;
+		ph->ph_next = list->pl_hosts[b];
+		list->pl_hosts[b] = ph;
+		list->pl_nhosts++;
+	}
+
+	if (exclude)
+		ph->ph_exclude = TRUE;
+	else
+		ph->ph_include = TRUE;
+
+	return TRUE;
+}
+
+/*
+**  ARCF_LIST_ADD -- add one entry to a list
+**
+**  Parameters:
+**  	list -- list to update
+**  	entry -- list entry
+**
+**  Return value:
+**  	TRUE on success, FALSE on allocation failure.
+*/
+
+_Bool
+arcf_list_add(struct peerlist *list, char *entry)
+{
+	int status;
+
+	/* addresses go into the tries, names into the hash table */
+	status = arcf_list_addip(list, entry);
+	if (status == 0 && !arcf_list_addhost(list, entry))
+		status = -1;
+
+	return (status != -1);
+}
+
+/*
+**  ARCF_LIST_LOAD -- load a list
+**
+**  Parameters:
+**  	list -- list to update
+**  	path -- path to the input file
+**  	err -- error string (returned)
+**
+**  Return value:
+**  	TRUE iff the operation succeeded.
+*/
+
+_Bool
+arcf_list_load(struct peerlist *list, char *path, char **err)
+{
+	FILE *f;
+	char *p;
+	char buf[BUFRSZ + 1];
+
+	f = fopen(path, "r");
+	if (f == NULL)
+	{
+		*err = strerror(errno);
+		return FALSE;
+	}
+
+	memset(buf, '\0', sizeof buf);
+	while (fgets(buf, sizeof buf - 1, f) != NULL)
+	{
+		for (p = buf; *p != '\0'; p++)
+		{
+			if (*p == '\n')
+			{
+				*p = '\0';
+				break;
+			}
+		}
+
+		if (buf[0] == '\0')
+			continue;
+
+		if (!arcf_list_add(list, buf))
+		{
+			*err = strerror(errno);
+			fclose(f);
+			return FALSE;
+		}
+	}
+
+	fclose(f);
+	return TRUE;
+}
+
+/*
+**  ARCF_LIST_DESTROY -- destroy a list
+**
+**  Parameters:
+**  	list -- list to be destroyed
+**
+**  Return value:
+**  	None.
+*/
+
+void
+arcf_list_destroy(struct peerlist *list)
+{
+	u_int b;
+	struct peerhost *ph;
+
+	for (b = 0; b < list->pl_nbuckets; b++)
+	{
+		while (list->pl_hosts[b] != NULL)
+		{
+			ph = list->pl_hosts[b];
+			list->pl_hosts[b] = ph->ph_next;
+			free(ph->ph_name);
+			free(ph);
+		}
+	}
+
+	free(list->pl_hosts);
+	list->pl_hosts = NULL;
+	list->pl_nhosts = 0;
+	list->pl_nbuckets = 0;
+
+	arcf_cidr_free(list->pl_ip4);
+	list->pl_ip4 = NULL;
+	arcf_cidr_free(list->pl_ip6);
+	list->pl_ip6 = NULL;
+}
+
+/*
+**  ARCF_CHECKHOST -- check the peerlist for a host and its wildcards
+**
+**  Parameters:
+**  	list -- list to check
+**  	host -- hostname to find
+**
+**  Return value:
+**  	TRUE if there's a match, FALSE otherwise.
+**
+**  Notes:
+**  	One table lookup per label, regardless of the size of the list.
+**  	Names are compared case-insensitively.
+*/
+
+_Bool
+arcf_checkhost(struct peerlist *list, char *host)
+{
+	char *p;
+	struct peerhost *ph;
+
+	assert(host != NULL);
+
+	/* short circuits */
+	if (list == NULL || list->pl_nhosts == 0 || host[0] == '\0')
+		return FALSE;
+
+	/* iterate over the possibilities, most specific first */
+	for (p = host; p != NULL; p = strchr(p + 1, '.'))
+	{
+		ph = arcf_list_findhost(list, p);
+		if (ph == NULL)
+			continue;
+
+		/* the negative case wins */
+		if (ph->ph_exclude)
+			return FALSE;
+
+		if (ph->ph_include)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+**  ARCF_CHECKIP -- check a peerlist table for an IP address or its matching
+**                 wildcards
+**
+**  Parameters:
+**  	list -- list to check
+**  	ip -- IP address to find
+**
+**  Return value:
+**  	TRUE if there's a match, FALSE otherwise.
+**
+**  Notes:
+**  	The most specific matching entry decides; if it is listed both
+**  	with and without "!", the exclusion wins.
+*/
+
+_Bool
+arcf_checkip(struct peerlist *list, struct sockaddr *ip)
+{
+	u_int flags;
+
+	assert(ip != NULL);
+
+	/* short circuit */
+	if (list == NULL)
+		return FALSE;
+
+#ifdef AF_INET6
+	if (ip->sa_family == AF_INET6)
+	{
+		struct sockaddr_in6 sin6;
+
+		memcpy(&sin6, ip, sizeof sin6);
+
+		flags = arcf_cidr_match(list->pl_ip6, sin6.sin6_addr.s6_addr,
+		                        128);
+	}
+	else
+#endif /* AF_INET6 */
+	if (ip->sa_family == AF_INET)
+	{
+		struct sockaddr_in sin;
+
+		memcpy(&sin, ip, sizeof sin);
+
+		flags = arcf_cidr_match(list->pl_ip4,
+		                        (u_char *) &sin.sin_addr.s_addr, 32);
+	}
+	else
+	{
+		return FALSE;
+	}
+
+	return (flags == ARCF_CIDR_POSITIVE);
+}
@@ -13,15 +13,59 @@
 #include <netinet/in.h>
 #include <regex.h>
 #include <stdio.h>
+#include <inttypes.h>
 
 /* openarc includes */
 #include "build-config.h"
 
+/* arcf_cidr_match() flags */
+#define	ARCF_CIDR_POSITIVE	0x01
+#define	ARCF_CIDR_NEGATIVE	0x02
+
 /* TYPES */
+struct arcf_cidrnode;
 struct arcf_dstring;
 
+/*
+**  PEERHOST -- a host or domain name from a PeerList
+*/
+
+struct peerhost
+{
+	_Bool			ph_include;	/* listed as is */
+	_Bool			ph_exclude;	/* listed with "!" */
+	u_int			ph_hash;	/* arcf_hdrhash() of name */
+	char *			ph_name;	/* name */
+	struct peerhost *	ph_next;	/* next in bucket */
+};
+
+/*
+**  PEERLIST -- a compiled PeerList
+*/
+
+struct peerlist
+{
+	u_int			pl_nhosts;	/* names in pl_hosts */
+	u_int			pl_nbuckets;	/* size of pl_hosts */
+	struct peerhost **	pl_hosts;	/* host and domain names */
+	struct arcf_cidrnode *	pl_ip4;		/* IPv4 prefixes */
+	struct arcf_cidrnode *	pl_ip6;		/* IPv6 prefixes */
+};
+
 /* PROTOTYPES */
+extern _Bool arcf_cidr_add __P((struct arcf_cidrnode **, const u_char *,
+                                u_int, u_int));
+extern void arcf_cidr_free __P((struct arcf_cidrnode *));
+extern u_int arcf_cidr_match __P((struct arcf_cidrnode *, const u_char *,
+                                  u_int));
+extern _Bool arcf_checkhost __P((struct peerlist *, char *));
+extern _Bool arcf_checkip __P((struct peerlist *, struct sockaddr *));
+extern uint64_t arcf_clock_usec __P((void));
+extern u_int arcf_hdrhash __P((const char *));
 extern size_t arcf_inet_ntoa __P((struct in_addr, char *, size_t));
+extern _Bool arcf_list_add __P((struct peerlist *, char *));
+extern void arcf_list_destroy __P((struct peerlist *));
+extern _Bool arcf_list_load __P((struct peerlist *, char *, char **));
 extern void arcf_lowercase __P((u_char *));
 extern void arcf_optlist __P((FILE *));
 extern void arcf_setmaxfd __P((void));